@@ -0,0 +1,263 @@
+#if !defined(LC_BENCH_H)
+#define LC_BENCH_H
+
+// Shared helpers for the benchmark programs: key generation, timing with
+// sampled per-operation latencies, resident set size and, when the kernel
+// allows it, hardware counters read through perf_event_open.
+//
+// Every benchmark prints rows in the same format so the output of the C and
+// C++ programs can be compared or concatenated:
+//
+// impl key n op Mops/s p50 p99 p99.9 rss-MB cache-miss/op branch-miss/op
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // clock_gettime, syscall
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// At most 2^BENCH_SAMPLE_BITS operations of a phase, and never more than one
+// out of BENCH_SAMPLE_MIN_STRIDE, are timed one by one.
+#define BENCH_SAMPLE_BITS 16
+#define BENCH_SAMPLE_MIN_STRIDE 64
+
+typedef struct {
+  const char *impl, *key;
+  size_t n;
+  uint64_t t0;
+  long rss0;
+  int perf_fd[2];
+  uint64_t sample_mask;
+  uint64_t *samples;
+  size_t nsamples;
+} bench_phase;
+
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Resident set size in bytes, read from /proc/self/statm.
+static inline long bench_rss(void) {
+  long pages = 0, rss = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+    rss = 0;
+  fclose(f);
+  return rss * sysconf(_SC_PAGESIZE);
+}
+
+static inline int bench_perf_open(uint64_t config) {
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  (void)config;
+  return -1;
+#endif
+}
+
+static inline void bench_perf_start(int fd) {
+#if defined(__linux__)
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#else
+  (void)fd;
+#endif
+}
+
+static inline int64_t bench_perf_stop(int fd) {
+  uint64_t v = 0;
+  if (fd < 0)
+    return -1;
+#if defined(__linux__)
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+  if (read(fd, &v, sizeof(v)) != (ssize_t)sizeof(v))
+    return -1;
+  return (int64_t)v;
+}
+
+static inline void bench_header(void) {
+  printf("%-18s %-4s %10s %-8s %9s %7s %7s %7s %8s %10s %10s\n", "impl",
+         "key", "n", "op", "Mops/s", "p50", "p99", "p99.9", "rss-MB",
+         "llc-miss", "br-miss");
+}
+
+static inline void bench_begin(bench_phase *ph, const char *impl,
+                               const char *key, size_t n) {
+  memset(ph, 0, sizeof(*ph));
+  ph->impl = impl;
+  ph->key = key;
+  ph->n = n;
+  ph->sample_mask = BENCH_SAMPLE_MIN_STRIDE - 1;
+  while ((n >> BENCH_SAMPLE_BITS) > ph->sample_mask)
+    ph->sample_mask = (ph->sample_mask << 1) | 1;
+  ph->samples =
+      (uint64_t *)malloc(sizeof(uint64_t) * (n / (ph->sample_mask + 1) + 1));
+  ph->perf_fd[0] = bench_perf_open(PERF_COUNT_HW_CACHE_MISSES);
+  ph->perf_fd[1] = bench_perf_open(PERF_COUNT_HW_BRANCH_MISSES);
+  ph->rss0 = bench_rss();
+  bench_perf_start(ph->perf_fd[0]);
+  bench_perf_start(ph->perf_fd[1]);
+  ph->t0 = bench_now_ns();
+}
+
+static inline int bench_cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Runs 'stmt' as the i-th operation of the phase, timing it on its own for
+// one operation out of every sample_mask + 1.
+#define BENCH_OP(ph, i, stmt)                                                  \
+  do {                                                                         \
+    if (((i) & (ph)->sample_mask) == 0) {                                      \
+      uint64_t _bench_t = bench_now_ns();                                      \
+      stmt;                                                                    \
+      (ph)->samples[(ph)->nsamples++] = bench_now_ns() - _bench_t;             \
+    } else {                                                                   \
+      stmt;                                                                    \
+    }                                                                          \
+  } while (0)
+
+// Ends a phase of 'ph->n' operations and prints its row. 'keep_rss' reports
+// the memory growth since bench_begin (useful for insertion phases).
+static inline void bench_end(bench_phase *ph, const char *op, int keep_rss) {
+  uint64_t t1 = bench_now_ns();
+  int64_t llc = bench_perf_stop(ph->perf_fd[0]);
+  int64_t br = bench_perf_stop(ph->perf_fd[1]);
+  double secs = (double)(t1 - ph->t0) * 1e-9;
+  qsort(ph->samples, ph->nsamples, sizeof(uint64_t), bench_cmp_u64);
+  uint64_t p50 = 0, p99 = 0, p999 = 0;
+  if (ph->nsamples) {
+    p50 = ph->samples[ph->nsamples / 2];
+    p99 = ph->samples[(size_t)(ph->nsamples * 0.99)];
+    p999 = ph->samples[(size_t)(ph->nsamples * 0.999)];
+  }
+  printf("%-18s %-4s %10zu %-8s %9.2f %7llu %7llu %7llu", ph->impl, ph->key,
+         ph->n, op, secs > 0 ? (double)ph->n / secs * 1e-6 : 0.0,
+         (unsigned long long)p50, (unsigned long long)p99,
+         (unsigned long long)p999);
+  if (keep_rss)
+    printf(" %8.1f", (double)(bench_rss() - ph->rss0) / (1 << 20));
+  else
+    printf(" %8s", "-");
+  if (llc >= 0 && br >= 0)
+    printf(" %10.3f %10.3f\n", (double)llc / ph->n, (double)br / ph->n);
+  else
+    printf(" %10s %10s\n", "-", "-");
+  fflush(stdout);
+  for (int i = 0; i < 2; i++)
+    if (ph->perf_fd[i] >= 0)
+      close(ph->perf_fd[i]);
+  free(ph->samples);
+}
+
+// ================== KEYS ====================== //
+// Hit keys are a bijection of [0, n), miss keys of [n, 2n), so both sets
+// are free of duplicates and disjoint while still looking random.
+
+static inline uint64_t bench_key(uint64_t i) {
+  return i * 0x9e3779b97f4a7c15ULL;
+}
+
+static inline int *bench_keys_int(size_t n, size_t first) {
+  int *keys = (int *)malloc(sizeof(int) * n);
+  for (size_t i = 0; i < n; i++)
+    keys[i] = (int)(uint32_t)((first + i) * 2654435761u);
+  return keys;
+}
+
+static inline uint64_t *bench_keys_u64(size_t n, size_t first) {
+  uint64_t *keys = (uint64_t *)malloc(sizeof(uint64_t) * n);
+  for (size_t i = 0; i < n; i++)
+    keys[i] = bench_key(first + i);
+  return keys;
+}
+
+static inline char **bench_keys_str(size_t n, size_t first) {
+  char **keys = (char **)malloc(sizeof(char *) * n);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = (char *)malloc(20);
+    snprintf(keys[i], 20, "k%016llx", (unsigned long long)bench_key(first + i));
+  }
+  return keys;
+}
+
+static inline void bench_free_str(char **keys, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    free(keys[i]);
+  free(keys);
+}
+
+// Random permutation of [0, n). The "hit" phases look the keys up in the
+// order they were inserted, which lets node based containers walk their
+// nodes in allocation order; "hit_rand" phases go through this one instead.
+static inline size_t *bench_order(size_t n) {
+  size_t *order = (size_t *)malloc(sizeof(size_t) * (n ? n : 1));
+  uint64_t x = 0x2545f4914f6cdd1dULL;
+  for (size_t i = 0; i < n; i++)
+    order[i] = i;
+  for (size_t i = n; i > 1; i--) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    size_t j = (size_t)(x % i), t = order[i - 1];
+    order[i - 1] = order[j];
+    order[j] = t;
+  }
+  return order;
+}
+
+// Parses the command line shared by all the programs:
+//
+// prog [-f filter] [size...]
+//
+// Sizes default to 1K..1M; pass e.g. 100000000 explicitly for 100M.
+static inline size_t bench_args(int argc, char **argv, size_t *sizes,
+                                size_t max_sizes, const char **filter) {
+  static const size_t defaults[] = {1000, 10000, 100000, 1000000};
+  size_t count = 0;
+  *filter = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+      *filter = argv[++i];
+    else if (count < max_sizes)
+      sizes[count++] = (size_t)strtoull(argv[i], NULL, 10);
+  }
+  if (count == 0) {
+    for (; count < sizeof(defaults) / sizeof(*defaults); count++)
+      sizes[count] = defaults[count];
+  }
+  return count;
+}
+
+static inline int bench_selected(const char *filter, const char *impl) {
+  return !filter || strstr(impl, filter) != NULL;
+}
+
+#endif // LC_BENCH_H
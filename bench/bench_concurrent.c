@@ -0,0 +1,506 @@
+// Multi-threaded benchmark of the thread-safe containers against their
+// single-threaded counterparts behind a global lock: the sharded
+// concurrent_umap against an open-addressing umap behind a mutex and the
+// lock-free skiplist against a red black tree behind a rwlock.
+//
+// Mixes: read-heavy (95% lookups), write-heavy (50% lookups, the rest split
+// between insertions and removals) and 1w, where every thread only looks up
+// keys while one extra thread keeps inserting and removing (only the lookups
+// are counted).
+//
+// bench_concurrent [-f filter] [-t max_threads] [size...]
+//
+// Each map is prefilled with 'size' keys and lookups draw from twice as many,
+// so half of them miss and the map size stays stable under the write mix.
+// Thread counts double from 1 up to max_threads (default: twice the number of
+// online CPUs).
+//
+// The queues then hand BENCH_OPS elements from producers to as many
+// consumers, one at a time (mix b1) or in batches of QUEUE_BATCH (b32): the
+// lock-free spsc_queue with one producer and one consumer, the mpmc_queue and
+// a deque behind a mutex with up to max_threads of each. 'n' is the capacity
+// of the queue.
+
+#include "bench.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define K uint64_t
+#define V uint64_t
+#define lcore_open_addressing
+#define lcore_pfx bumap
+#include "containers/unordered_map.h"
+
+#define K uint64_t
+#define V uint64_t
+#define lcore_pfx cumap
+#include "containers/concurrent_umap.h"
+
+#define T uint64_t
+#define lcore_cmp_fn(a, b) (((a) > (b)) - ((a) < (b)))
+#define lcore_pfx brbtree
+#include "containers/red_black_tree.h"
+
+#define T uint64_t
+#define lcore_pfx slist
+#include "containers/skiplist.h"
+
+#define T uint64_t
+#define lcore_pfx squeue
+#include "containers/spsc_queue.h"
+
+#define T uint64_t
+#define lcore_pfx mqueue
+#include "containers/mpmc_queue.h"
+
+#define T uint64_t
+#define lcore_pfx bdeque
+#include "containers/deque.h"
+
+#define BENCH_OPS (1u << 22)
+#define QUEUE_CAPACITY 1024
+#define QUEUE_BATCH 32
+
+typedef struct {
+  pthread_mutex_t lock;
+  bumap map;
+} locked_umap;
+
+typedef struct {
+  const char *name;
+  void *(*create)(size_t n);
+  void (*destroy)(void *m);
+  bool (*get)(void *m, uint64_t key);
+  bool (*insert)(void *m, uint64_t key);
+  bool (*remove)(void *m, uint64_t key);
+} impl;
+
+static void *locked_create(size_t n) {
+  locked_umap *m = (locked_umap *)malloc(sizeof(locked_umap));
+  pthread_mutex_init(&m->lock, NULL);
+  bumap_init(&m->map, 64);
+  (void)n;
+  return m;
+}
+
+static void locked_destroy(void *m) {
+  locked_umap *l = (locked_umap *)m;
+  bumap_destroy(&l->map);
+  pthread_mutex_destroy(&l->lock);
+  free(l);
+}
+
+static bool locked_get(void *m, uint64_t key) {
+  locked_umap *l = (locked_umap *)m;
+  pthread_mutex_lock(&l->lock);
+  uint64_t *v = bumap_find(&l->map, key);
+  uint64_t value = v ? *v : 0;
+  pthread_mutex_unlock(&l->lock);
+  return value != 0;
+}
+
+static bool locked_insert(void *m, uint64_t key) {
+  locked_umap *l = (locked_umap *)m;
+  pthread_mutex_lock(&l->lock);
+  bool inserted = bumap_insert(&l->map, key, key | 1);
+  pthread_mutex_unlock(&l->lock);
+  return inserted;
+}
+
+static bool locked_remove(void *m, uint64_t key) {
+  locked_umap *l = (locked_umap *)m;
+  pthread_mutex_lock(&l->lock);
+  bool removed = bumap_remove(&l->map, key);
+  pthread_mutex_unlock(&l->lock);
+  return removed;
+}
+
+static void *sharded_create(size_t n) {
+  cumap *m = (cumap *)malloc(sizeof(cumap));
+  cumap_init(m, 64);
+  (void)n;
+  return m;
+}
+
+static void sharded_destroy(void *m) {
+  cumap_destroy((cumap *)m);
+  free(m);
+}
+
+static bool sharded_get(void *m, uint64_t key) {
+  uint64_t value = 0;
+  cumap_get((cumap *)m, key, &value);
+  return value != 0;
+}
+
+static bool sharded_insert(void *m, uint64_t key) {
+  return cumap_insert((cumap *)m, key, key | 1);
+}
+
+static bool sharded_remove(void *m, uint64_t key) {
+  return cumap_remove((cumap *)m, key);
+}
+
+typedef struct {
+  pthread_rwlock_t lock;
+  brbtree tree;
+} locked_rbtree;
+
+static void *rbtree_create(size_t n) {
+  locked_rbtree *m = (locked_rbtree *)malloc(sizeof(locked_rbtree));
+  pthread_rwlock_init(&m->lock, NULL);
+  brbtree_init(&m->tree);
+  (void)n;
+  return m;
+}
+
+static void rbtree_destroy(void *m) {
+  locked_rbtree *l = (locked_rbtree *)m;
+  brbtree_destroy(&l->tree);
+  pthread_rwlock_destroy(&l->lock);
+  free(l);
+}
+
+static bool rbtree_get(void *m, uint64_t key) {
+  locked_rbtree *l = (locked_rbtree *)m;
+  pthread_rwlock_rdlock(&l->lock);
+  bool found = brbtree_contains(&l->tree, key);
+  pthread_rwlock_unlock(&l->lock);
+  return found;
+}
+
+static bool rbtree_insert(void *m, uint64_t key) {
+  locked_rbtree *l = (locked_rbtree *)m;
+  pthread_rwlock_wrlock(&l->lock);
+  bool inserted = brbtree_insert(&l->tree, key);
+  pthread_rwlock_unlock(&l->lock);
+  return inserted;
+}
+
+static bool rbtree_remove(void *m, uint64_t key) {
+  locked_rbtree *l = (locked_rbtree *)m;
+  pthread_rwlock_wrlock(&l->lock);
+  bool removed = brbtree_remove(&l->tree, key);
+  pthread_rwlock_unlock(&l->lock);
+  return removed;
+}
+
+static void *skiplist_create(size_t n) {
+  slist *m = (slist *)malloc(sizeof(slist));
+  slist_init(m);
+  (void)n;
+  return m;
+}
+
+static void skiplist_destroy(void *m) {
+  slist_destroy((slist *)m);
+  free(m);
+}
+
+static bool skiplist_get(void *m, uint64_t key) {
+  return slist_contains((slist *)m, key);
+}
+
+static bool skiplist_insert(void *m, uint64_t key) {
+  return slist_insert((slist *)m, key);
+}
+
+static bool skiplist_remove(void *m, uint64_t key) {
+  return slist_remove((slist *)m, key);
+}
+
+static const impl impls[] = {
+    {"lc_umap_mutex", locked_create, locked_destroy, locked_get,
+     locked_insert, locked_remove},
+    {"lc_cumap", sharded_create, sharded_destroy, sharded_get, sharded_insert,
+     sharded_remove},
+    {"lc_rbtree_rwlock", rbtree_create, rbtree_destroy, rbtree_get,
+     rbtree_insert, rbtree_remove},
+    {"lc_skiplist", skiplist_create, skiplist_destroy, skiplist_get,
+     skiplist_insert, skiplist_remove},
+};
+
+typedef struct {
+  const impl *impl;
+  void *map;
+  const uint64_t *keys; // 2n keys, the first n are in the map
+  size_t nkeys;
+  unsigned read_pct;
+  size_t ops;
+  uint64_t seed;
+  pthread_barrier_t *start;
+  atomic_int *stop; // ends the run early
+  size_t hits;
+} worker;
+
+static void *worker_main(void *arg) {
+  worker *w = (worker *)arg;
+  uint64_t x = w->seed;
+  size_t hits = 0;
+  pthread_barrier_wait(w->start);
+  for (size_t i = 0; i < w->ops; i++) {
+    if (atomic_load_explicit(w->stop, memory_order_relaxed))
+      break;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uint64_t key = w->keys[(x >> 16) % w->nkeys];
+    unsigned roll = (unsigned)(x % 100);
+    if (roll < w->read_pct)
+      hits += w->impl->get(w->map, key);
+    else if (roll & 1)
+      hits += w->impl->insert(w->map, key);
+    else
+      hits += w->impl->remove(w->map, key);
+  }
+  w->hits = hits;
+  return NULL;
+}
+
+// With 'writer' set, one more thread only writes until the others are done.
+static void run_mix(const impl *im, const char *mix, unsigned read_pct,
+                    bool writer, const uint64_t *keys, size_t n, int threads) {
+  void *map = im->create(n);
+  for (size_t i = 0; i < n; i++)
+    im->insert(map, keys[i]);
+  int spawned = threads + writer;
+  pthread_t tid[spawned];
+  worker w[spawned];
+  pthread_barrier_t start;
+  atomic_int stop;
+  atomic_init(&stop, 0);
+  pthread_barrier_init(&start, NULL, (unsigned)spawned + 1);
+  for (int t = 0; t < spawned; t++) {
+    w[t] = (worker){im, map, keys, 2 * n, read_pct, BENCH_OPS / threads,
+                    bench_key((uint64_t)t + 1), &start, &stop, 0};
+    if (t == threads) {
+      w[t].read_pct = 0;
+      w[t].ops = SIZE_MAX;
+    }
+    pthread_create(&tid[t], NULL, worker_main, &w[t]);
+  }
+  pthread_barrier_wait(&start);
+  uint64_t t0 = bench_now_ns();
+  for (int t = 0; t < threads; t++)
+    pthread_join(tid[t], NULL);
+  double secs = (double)(bench_now_ns() - t0) * 1e-9;
+  atomic_store(&stop, 1);
+  if (writer)
+    pthread_join(tid[threads], NULL);
+  size_t ops = (size_t)(BENCH_OPS / threads) * threads;
+  printf("%-18s %-6s %7d %10zu %9.2f\n", im->name, mix, threads, n,
+         (double)ops / secs * 1e-6);
+  fflush(stdout);
+  pthread_barrier_destroy(&start);
+  im->destroy(map);
+}
+
+// ============== QUEUE HAND-OFF ================ //
+
+typedef struct {
+  pthread_mutex_t lock;
+  bdeque deque;
+} locked_deque;
+
+typedef struct {
+  const char *name;
+  bool spsc; // one producer and one consumer only
+  void *(*create)(void);
+  void (*destroy)(void *q);
+  // Move up to 'n' elements, return how many moved.
+  size_t (*push)(void *q, const uint64_t *values, size_t n);
+  size_t (*pop)(void *q, uint64_t *out, size_t n);
+} queue_impl;
+
+static void *spsc_create(void) {
+  squeue *q = (squeue *)aligned_alloc(LC_CACHE_LINE, sizeof(squeue));
+  squeue_init(q, QUEUE_CAPACITY);
+  return q;
+}
+
+static void spsc_destroy(void *q) {
+  squeue_destroy((squeue *)q);
+  free(q);
+}
+
+static size_t spsc_push(void *q, const uint64_t *values, size_t n) {
+  if (n == 1)
+    return squeue_try_push((squeue *)q, *values);
+  return squeue_push_many((squeue *)q, values, n);
+}
+
+static size_t spsc_pop(void *q, uint64_t *out, size_t n) {
+  if (n == 1)
+    return squeue_try_pop((squeue *)q, out);
+  return squeue_pop_many((squeue *)q, out, n);
+}
+
+static void *mpmc_create(void) {
+  mqueue *q = (mqueue *)aligned_alloc(LC_CACHE_LINE, sizeof(mqueue));
+  mqueue_init(q, QUEUE_CAPACITY);
+  return q;
+}
+
+static void mpmc_destroy(void *q) {
+  mqueue_destroy((mqueue *)q);
+  free(q);
+}
+
+static size_t mpmc_push(void *q, const uint64_t *values, size_t n) {
+  if (n == 1)
+    return mqueue_try_push((mqueue *)q, *values);
+  return mqueue_push_many((mqueue *)q, values, n);
+}
+
+static size_t mpmc_pop(void *q, uint64_t *out, size_t n) {
+  if (n == 1)
+    return mqueue_try_pop((mqueue *)q, out);
+  return mqueue_pop_many((mqueue *)q, out, n);
+}
+
+static void *locked_deque_create(void) {
+  locked_deque *q = (locked_deque *)malloc(sizeof(locked_deque));
+  pthread_mutex_init(&q->lock, NULL);
+  bdeque_init(&q->deque, QUEUE_CAPACITY);
+  return q;
+}
+
+static void locked_deque_destroy(void *q) {
+  locked_deque *l = (locked_deque *)q;
+  bdeque_destroy(&l->deque);
+  pthread_mutex_destroy(&l->lock);
+  free(l);
+}
+
+static size_t locked_deque_push(void *q, const uint64_t *values, size_t n) {
+  locked_deque *l = (locked_deque *)q;
+  pthread_mutex_lock(&l->lock);
+  size_t room = QUEUE_CAPACITY - l->deque.size;
+  if (n > room)
+    n = room;
+  bdeque_push_back_many(&l->deque, values, n);
+  pthread_mutex_unlock(&l->lock);
+  return n;
+}
+
+static size_t locked_deque_pop(void *q, uint64_t *out, size_t n) {
+  locked_deque *l = (locked_deque *)q;
+  pthread_mutex_lock(&l->lock);
+  n = bdeque_pop_front_many(&l->deque, out, n);
+  pthread_mutex_unlock(&l->lock);
+  return n;
+}
+
+static const queue_impl queue_impls[] = {
+    {"lc_spsc_queue", true, spsc_create, spsc_destroy, spsc_push, spsc_pop},
+    {"lc_mpmc_queue", false, mpmc_create, mpmc_destroy, mpmc_push, mpmc_pop},
+    {"lc_deque_mutex", false, locked_deque_create, locked_deque_destroy,
+     locked_deque_push, locked_deque_pop},
+};
+
+typedef struct {
+  const queue_impl *impl;
+  void *queue;
+  bool producer;
+  size_t ops;   // elements to push or to pop
+  size_t batch; // elements per call
+  pthread_barrier_t *start;
+  uint64_t sum;
+} queue_worker;
+
+// A full (or empty) queue yields the CPU, the other side may be waiting for
+// it when there are more threads than CPUs.
+static void *queue_worker_main(void *arg) {
+  queue_worker *w = (queue_worker *)arg;
+  uint64_t buf[QUEUE_BATCH], sum = 0;
+  pthread_barrier_wait(w->start);
+  for (size_t done = 0; done < w->ops;) {
+    size_t n = w->ops - done < w->batch ? w->ops - done : w->batch;
+    size_t moved;
+    if (w->producer) {
+      for (size_t i = 0; i < n; i++)
+        buf[i] = done + i;
+      moved = w->impl->push(w->queue, buf, n);
+    } else {
+      moved = w->impl->pop(w->queue, buf, n);
+      for (size_t i = 0; i < moved; i++)
+        sum += buf[i];
+    }
+    if (moved == 0)
+      sched_yield();
+    done += moved;
+  }
+  w->sum = sum;
+  return NULL;
+}
+
+// 'pairs' producers and as many consumers, each moving BENCH_OPS / pairs
+// elements.
+static void run_queue(const queue_impl *im, size_t batch, int pairs) {
+  void *queue = im->create();
+  int spawned = 2 * pairs;
+  pthread_t tid[spawned];
+  queue_worker w[spawned];
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, (unsigned)spawned + 1);
+  for (int t = 0; t < spawned; t++) {
+    w[t] = (queue_worker){im, queue, t < pairs, BENCH_OPS / pairs, batch,
+                          &start, 0};
+    pthread_create(&tid[t], NULL, queue_worker_main, &w[t]);
+  }
+  pthread_barrier_wait(&start);
+  uint64_t t0 = bench_now_ns();
+  for (int t = 0; t < spawned; t++)
+    pthread_join(tid[t], NULL);
+  double secs = (double)(bench_now_ns() - t0) * 1e-9;
+  size_t ops = (size_t)(BENCH_OPS / pairs) * pairs;
+  char mix[8];
+  snprintf(mix, sizeof(mix), "b%zu", batch);
+  printf("%-18s %-6s %7d %10d %9.2f\n", im->name, mix, spawned,
+         QUEUE_CAPACITY, (double)ops / secs * 1e-6);
+  fflush(stdout);
+  pthread_barrier_destroy(&start);
+  im->destroy(queue);
+}
+
+int main(int argc, char **argv) {
+  size_t sizes[16];
+  const char *filter;
+  int max_threads = 2 * (int)sysconf(_SC_NPROCESSORS_ONLN);
+  // Strip '-t' before handing the rest to the shared parser.
+  int nargs = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      max_threads = atoi(argv[++i]);
+    else
+      argv[nargs++] = argv[i];
+  }
+  size_t count = bench_args(nargs, argv, sizes, 16, &filter);
+  printf("%-18s %-6s %7s %10s %9s\n", "impl", "mix", "threads", "n",
+         "Mops/s");
+  for (size_t c = 0; c < count; c++) {
+    size_t n = sizes[c];
+    uint64_t *keys = bench_keys_u64(2 * n, 0);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(*impls); i++) {
+      if (!bench_selected(filter, impls[i].name))
+        continue;
+      for (int t = 1; t <= max_threads; t <<= 1) {
+        run_mix(&impls[i], "95/5", 95, false, keys, n, t);
+        run_mix(&impls[i], "50/50", 50, false, keys, n, t);
+        run_mix(&impls[i], "1w", 100, true, keys, n, t);
+      }
+    }
+    free(keys);
+  }
+  for (size_t i = 0; i < sizeof(queue_impls) / sizeof(*queue_impls); i++) {
+    const queue_impl *im = &queue_impls[i];
+    if (!bench_selected(filter, im->name))
+      continue;
+    for (int pairs = 1; pairs <= (im->spsc ? 1 : max_threads); pairs <<= 1) {
+      run_queue(im, 1, pairs);
+      run_queue(im, QUEUE_BATCH, pairs);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,978 @@
+// Throughput and latency of the libcontainers templates (and of khash when
+// built with KHASH_DIR=...) for int, 64 bit and string keys, see bench.h for
+// the output format and Makefile for how to run it.
+
+#include "bench.h"
+
+#define bench_cmp(a, b) (((a) > (b)) - ((a) < (b)))
+#define bench_touch(x) ((size_t)(uintptr_t)(x))
+
+// ============== INSTANTIATIONS ================ //
+
+#define T int
+#define lcore_pfx vec_int
+#include "containers/vector.h"
+#define T uint64_t
+#define lcore_pfx vec_u64
+#include "containers/vector.h"
+#define T char *
+#define lcore_pfx vec_str
+#include "containers/vector.h"
+
+#define lcore_inline_cap 8
+#define T int
+#define lcore_pfx vecsbo_int
+#include "containers/vector.h"
+#define lcore_inline_cap 8
+#define T uint64_t
+#define lcore_pfx vecsbo_u64
+#include "containers/vector.h"
+#define lcore_inline_cap 8
+#define T char *
+#define lcore_pfx vecsbo_str
+#include "containers/vector.h"
+
+#define lcore_mmap_threshold (1 << 20)
+#define T int
+#define lcore_pfx vecmm_int
+#include "containers/vector.h"
+#define lcore_mmap_threshold (1 << 20)
+#define T uint64_t
+#define lcore_pfx vecmm_u64
+#include "containers/vector.h"
+#define lcore_mmap_threshold (1 << 20)
+#define T char *
+#define lcore_pfx vecmm_str
+#include "containers/vector.h"
+
+#define T uint64_t
+#define lcore_less_fn(a, b) ((a) < (b))
+#define lcore_radix_sort
+#define lcore_pfx vecsort_u64
+#include "containers/vector.h"
+#define T uint64_t
+#define lcore_less_fn(a, b) ((a) < (b))
+#define lcore_radix_sort
+#define lcore_sort_threads 8
+#define lcore_pfx vecsortmt_u64
+#include "containers/vector.h"
+
+#define T int
+#define lcore_pfx uset_int
+#include "containers/unordered_set.h"
+#define T uint64_t
+#define lcore_pfx uset_u64
+#include "containers/unordered_set.h"
+#define T char *
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx uset_str
+#include "containers/unordered_set.h"
+
+#define lcore_cache_hash
+#define T int
+#define lcore_pfx usetch_int
+#include "containers/unordered_set.h"
+#define lcore_cache_hash
+#define T uint64_t
+#define lcore_pfx usetch_u64
+#include "containers/unordered_set.h"
+#define lcore_cache_hash
+#define T char *
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx usetch_str
+#include "containers/unordered_set.h"
+
+#define lcore_open_addressing
+#define T int
+#define lcore_pfx usetoa_int
+#include "containers/unordered_set.h"
+#define lcore_open_addressing
+#define T uint64_t
+#define lcore_pfx usetoa_u64
+#include "containers/unordered_set.h"
+#define lcore_open_addressing
+#define T char *
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx usetoa_str
+#include "containers/unordered_set.h"
+
+#define K int
+#define V uint64_t
+#define lcore_pfx umap_int
+#include "containers/unordered_map.h"
+#define K uint64_t
+#define V uint64_t
+#define lcore_pfx umap_u64
+#include "containers/unordered_map.h"
+#define K char *
+#define V uint64_t
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx umap_str
+#include "containers/unordered_map.h"
+
+#define lcore_cache_hash
+#define K int
+#define V uint64_t
+#define lcore_pfx umapch_int
+#include "containers/unordered_map.h"
+#define lcore_cache_hash
+#define K uint64_t
+#define V uint64_t
+#define lcore_pfx umapch_u64
+#include "containers/unordered_map.h"
+#define lcore_cache_hash
+#define K char *
+#define V uint64_t
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx umapch_str
+#include "containers/unordered_map.h"
+
+#define lcore_open_addressing
+#define K int
+#define V uint64_t
+#define lcore_pfx umapoa_int
+#include "containers/unordered_map.h"
+#define lcore_open_addressing
+#define K uint64_t
+#define V uint64_t
+#define lcore_pfx umapoa_u64
+#include "containers/unordered_map.h"
+#define lcore_open_addressing
+#define K char *
+#define V uint64_t
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx umapoa_str
+#include "containers/unordered_map.h"
+
+// String keys copied into the entries, see lcore_str_keys. The benchmark's
+// keys are 17 bytes long, inline storage is widened so they fit.
+#define LC_STRKEY_INLINE 24
+#define K char *
+#define V uint64_t
+#define lcore_str_keys
+#define lcore_pfx umapsk_str
+#include "containers/unordered_map.h"
+#define lcore_open_addressing
+#define K char *
+#define V uint64_t
+#define lcore_str_keys
+#define lcore_pfx umapoask_str
+#include "containers/unordered_map.h"
+
+// Sets with a Bloom filter answering most misses, see lcore_filter.
+#define lcore_filter
+#define T int
+#define lcore_pfx usetf_int
+#include "containers/unordered_set.h"
+#define lcore_filter
+#define T uint64_t
+#define lcore_pfx usetf_u64
+#include "containers/unordered_set.h"
+#define lcore_filter
+#define T char *
+#define lcore_hash_fn(x) lc_hash_str(x)
+#define lcore_eq_fn(a, b) (strcmp(a, b) == 0)
+#define lcore_pfx usetf_str
+#include "containers/unordered_set.h"
+
+#define T uint64_t
+#define lcore_pfx deque_u64
+#include "containers/deque.h"
+
+#define K uint64_t
+#define V uint64_t
+#define lcore_pfx flat_u64
+#include "containers/flat_map.h"
+#define K uint64_t
+#define V uint64_t
+#define lcore_flat_simd
+#define lcore_pfx flatsimd_u64
+#include "containers/flat_map.h"
+
+#define T uint64_t
+#define lcore_arity 2
+#define lcore_pfx heap2_u64
+#include "containers/heap.h"
+#define T uint64_t
+#define lcore_pfx heap4_u64
+#include "containers/heap.h"
+#define T uint64_t
+#define lcore_arity 8
+#define lcore_pfx heap8_u64
+#include "containers/heap.h"
+#define T uint64_t
+#define lcore_radix_heap
+#define lcore_pfx rheap_u64
+#include "containers/heap.h"
+
+#define T uint64_t
+#define lcore_pfx bloom_u64
+#include "containers/filter.h"
+#define lcore_cuckoo_filter
+#define T uint64_t
+#define lcore_pfx cuckoo_u64
+#include "containers/filter.h"
+
+#define lcore_open_addressing
+#define lcore_persist
+#define K uint64_t
+#define V uint64_t
+#define lcore_pfx umapimg_u64
+#include "containers/unordered_map.h"
+
+#define T int
+#define lcore_cmp_fn(a, b) bench_cmp(a, b)
+#define lcore_pfx rbtree_int
+#include "containers/red_black_tree.h"
+#define T uint64_t
+#define lcore_cmp_fn(a, b) bench_cmp(a, b)
+#define lcore_pfx rbtree_u64
+#include "containers/red_black_tree.h"
+#define T char *
+#define lcore_cmp_fn(a, b) strcmp(a, b)
+#define lcore_pfx rbtree_str
+#include "containers/red_black_tree.h"
+
+#define T int
+#define lcore_cmp_fn(a, b) bench_cmp(a, b)
+#define lcore_rbtree_compact
+#define lcore_pfx rbtreec_int
+#include "containers/red_black_tree.h"
+#define T uint64_t
+#define lcore_cmp_fn(a, b) bench_cmp(a, b)
+#define lcore_rbtree_compact
+#define lcore_pfx rbtreec_u64
+#include "containers/red_black_tree.h"
+#define T char *
+#define lcore_cmp_fn(a, b) strcmp(a, b)
+#define lcore_rbtree_compact
+#define lcore_pfx rbtreec_str
+#include "containers/red_black_tree.h"
+
+#define T uint64_t
+#define lcore_cmp_fn(a, b) bench_cmp(a, b)
+#define lcore_rbtree_threads 8
+#define lcore_pfx rbtreemt_u64
+#include "containers/red_black_tree.h"
+
+#define T int
+#define lcore_pfx btree_int
+#include "containers/btree.h"
+#define T uint64_t
+#define lcore_pfx btree_u64
+#include "containers/btree.h"
+#define T char *
+#define lcore_cmp_fn(a, b) strcmp(a, b)
+#define lcore_pfx btree_str
+#include "containers/btree.h"
+
+#if defined(HAVE_KHASH)
+#include "khash.h"
+KHASH_MAP_INIT_INT(kh_int, uint64_t)
+KHASH_MAP_INIT_INT64(kh_u64, uint64_t)
+KHASH_MAP_INIT_STR(kh_str, uint64_t)
+#endif // HAVE_KHASH
+
+static volatile size_t bench_sink;
+
+// ================ ITERATION =================== //
+// The containers have no iteration API, the benchmarks walk their storage.
+
+#define ITER_CHAINED(s, node_t, field, acc)                                    \
+  for (size_t b = 0; b < (s).capacity; b++)                                    \
+    for (node_t *c = (s).buckets[b]; c; c = c->next)                           \
+      acc += bench_touch(c->field);
+
+#define ITER_OPEN(s, field, acc)                                               \
+  for (size_t b = 0; b < (s).capacity; b++)                                    \
+    if (!((s).ctrl[b] & LC_CTRL_EMPTY))                                        \
+      acc += bench_touch((s).slots[b] field);
+
+#define ITER_USET(s, S, acc) ITER_CHAINED(s, _lc_join(S, node), data, acc)
+#define ITER_USETOA(s, S, acc) ITER_OPEN(s, , acc)
+#define ITER_UMAP(s, S, acc) ITER_CHAINED(s, _lc_join(S, node), value, acc)
+#define ITER_UMAPOA(s, S, acc) ITER_OPEN(s, .value, acc)
+
+// ================= RUNNERS ==================== //
+
+// Batched lookups of BENCH_BATCH keys per call, reported as "hit_many" and
+// "miss_many" rows.
+#define BENCH_BATCH 1024
+#define BENCH_BATCHES(ph, i, b, hit_stmt, miss_stmt)                           \
+  bench_begin(&ph, impl, kn, n);                                               \
+  for (size_t i = 0; i < n; i += BENCH_BATCH) {                                \
+    size_t b = n - i < BENCH_BATCH ? n - i : BENCH_BATCH;                      \
+    hit_stmt;                                                                  \
+  }                                                                            \
+  bench_end(&ph, "hit_many", 0);                                               \
+  bench_begin(&ph, impl, kn, n);                                               \
+  for (size_t i = 0; i < n; i += BENCH_BATCH) {                                \
+    size_t b = n - i < BENCH_BATCH ? n - i : BENCH_BATCH;                      \
+    miss_stmt;                                                                 \
+  }                                                                            \
+  bench_end(&ph, "miss_many", 0);
+
+#define BENCH_SCRATCH 8
+#define BENCH_VEC(S, KT)                                                       \
+  static void _lc_join(run, S)(const char *impl, const char *kn,               \
+                               KT *hit, KT *miss, size_t n) {                  \
+    (void)miss;                                                                \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    S v;                                                                       \
+    _lc_join(S, init)(&v, 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, push_back)(&v, hit[i]));                    \
+    bench_end(&ph, "insert", 1);                                               \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i,                                                         \
+               acc += bench_touch(_lc_join(S, at)(&v, bench_key(i) % n)));     \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < v.size; i++)                                        \
+      acc += bench_touch(_lc_join(S, data)(&v)[i]);                            \
+    bench_end(&ph, "iterate", 0);                                              \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += bench_touch(_lc_join(S, pop_back)(&v)));         \
+    bench_end(&ph, "remove", 0);                                               \
+    _lc_join(S, shrink_to_fit)(&v);                                            \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i += BENCH_BATCH)                                \
+      _lc_join(S, extend)(&v, hit + i,                                         \
+                          n - i < BENCH_BATCH ? n - i : BENCH_BATCH);          \
+    bench_end(&ph, "extend", 1);                                               \
+    _lc_join(S, destroy)(&v);                                                  \
+    /* Short lived scratch vectors of BENCH_SCRATCH elements. */               \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i + BENCH_SCRATCH <= n; i += BENCH_SCRATCH) {           \
+      S tmp;                                                                   \
+      _lc_join(S, init)(&tmp, 0);                                              \
+      for (size_t j = 0; j < BENCH_SCRATCH; j++)                               \
+        _lc_join(S, push_back)(&tmp, hit[i + j]);                              \
+      acc += bench_touch(_lc_join(S, at)(&tmp, i % BENCH_SCRATCH));            \
+      _lc_join(S, destroy)(&tmp);                                              \
+    }                                                                          \
+    bench_end(&ph, "scratch", 0);                                              \
+    bench_sink = acc;                                                          \
+  }
+
+#define BENCH_SET(S, KT, ITER)                                                 \
+  static void _lc_join(run, S)(const char *impl, const char *kn,               \
+                               KT *hit, KT *miss, size_t n) {                  \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    S s;                                                                       \
+    _lc_join(S, init)(&s, 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, insert)(&s, hit[i]));                       \
+    bench_end(&ph, "insert", 1);                                               \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&s, hit[i]));              \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&s, miss[i]));             \
+    bench_end(&ph, "miss", 0);                                                 \
+    BENCH_BATCHES(ph, i, b,                                                    \
+                  acc += _lc_join(S, contains_many)(&s, hit + i, b, NULL),     \
+                  acc += _lc_join(S, contains_many)(&s, miss + i, b, NULL));   \
+    bench_begin(&ph, impl, kn, n);                                             \
+    ITER(s, S, acc)                                                            \
+    bench_end(&ph, "iterate", 0);                                              \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, remove)(&s, hit[i]));                \
+    bench_end(&ph, "remove", 0);                                               \
+    _lc_join(S, destroy)(&s);                                                  \
+    _lc_join(S, init)(&s, 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i += BENCH_BATCH)                                \
+      _lc_join(S, insert_many)(&s, hit + i,                                    \
+                               n - i < BENCH_BATCH ? n - i : BENCH_BATCH);     \
+    bench_end(&ph, "ins_many", 1);                                             \
+    _lc_join(S, destroy)(&s);                                                  \
+    bench_sink = acc;                                                          \
+  }
+
+#define BENCH_MAP(S, KT, ITER)                                                 \
+  static void _lc_join(run, S)(const char *impl, const char *kn,               \
+                               KT *hit, KT *miss, size_t n) {                  \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    S m;                                                                       \
+    uint64_t *vals = (uint64_t *)malloc(sizeof(uint64_t) * n);                 \
+    for (size_t i = 0; i < n; i++)                                             \
+      vals[i] = i;                                                             \
+    _lc_join(S, init)(&m, 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, insert)(&m, hit[i], i));                    \
+    bench_end(&ph, "insert", 1);                                               \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += *_lc_join(S, find)(&m, hit[i]));                 \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, find)(&m, miss[i]) != NULL);         \
+    bench_end(&ph, "miss", 0);                                                 \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, ++*_lc_join(S, get_or_insert)(&m, hit[i], NULL));       \
+    bench_end(&ph, "upsert", 0);                                               \
+    {                                                                          \
+      uint64_t *out[BENCH_BATCH];                                              \
+      BENCH_BATCHES(ph, i, b,                                                  \
+                    acc += _lc_join(S, find_many)(&m, hit + i, b, out),        \
+                    acc += _lc_join(S, find_many)(&m, miss + i, b, out));      \
+    }                                                                          \
+    bench_begin(&ph, impl, kn, n);                                             \
+    ITER(m, S, acc)                                                            \
+    bench_end(&ph, "iterate", 0);                                              \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, remove)(&m, hit[i]));                \
+    bench_end(&ph, "remove", 0);                                               \
+    _lc_join(S, destroy)(&m);                                                  \
+    _lc_join(S, init)(&m, 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i += BENCH_BATCH)                                \
+      _lc_join(S, insert_many)(&m, hit + i, vals + i,                          \
+                               n - i < BENCH_BATCH ? n - i : BENCH_BATCH);     \
+    bench_end(&ph, "ins_many", 1);                                             \
+    _lc_join(S, destroy)(&m);                                                  \
+    free(vals);                                                                \
+    bench_sink = acc;                                                          \
+  }
+
+// In-order walk through the parent pointers.
+#define ITER_RBTREE(t, S, acc)                                                 \
+  for (_lc_join(S, iter) it = _lc_join(S, first)(&t);                          \
+       !_lc_join(S, iter_done)(it); _lc_join(S, iter_next)(&it))               \
+    acc += bench_touch(_lc_join(S, iter_get)(it));
+
+// In-order walk with an explicit stack, the height of a btree never gets
+// close to 32 levels.
+#define ITER_BTREE(t, S, acc)                                                  \
+  {                                                                            \
+    _lc_join(S, node) *stack[32];                                              \
+    size_t next[32];                                                           \
+    int d = t.root ? 0 : -1;                                                   \
+    stack[0] = t.root;                                                         \
+    next[0] = 0;                                                               \
+    while (d >= 0) {                                                           \
+      _lc_join(S, node) *x = stack[d];                                         \
+      size_t k = next[d]++;                                                    \
+      if (x->leaf) {                                                           \
+        for (size_t j = 0; j < x->count; j++)                                  \
+          acc += bench_touch(x->keys[j]);                                      \
+        d--;                                                                   \
+      } else if (k > x->count) {                                               \
+        d--;                                                                   \
+      } else {                                                                 \
+        if (k > 0)                                                             \
+          acc += bench_touch(x->keys[k - 1]);                                  \
+        stack[++d] = x->children[k];                                           \
+        next[d] = 0;                                                           \
+      }                                                                        \
+    }                                                                          \
+  }
+
+#define BENCH_TREE(S, KT, ITER)                                                \
+  static void _lc_join(run, S)(const char *impl, const char *kn,               \
+                               KT *hit, KT *miss, size_t n) {                  \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    size_t *order = bench_order(n);                                            \
+    S t;                                                                       \
+    _lc_join(S, init)(&t);                                                     \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, insert)(&t, hit[i]));                       \
+    bench_end(&ph, "insert", 1);                                               \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&t, hit[i]));              \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&t, hit[order[i]]));       \
+    bench_end(&ph, "hit_rand", 0);                                             \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&t, miss[i]));             \
+    bench_end(&ph, "miss", 0);                                                 \
+    bench_begin(&ph, impl, kn, n);                                             \
+    ITER(t, S, acc)                                                            \
+    bench_end(&ph, "iterate", 0);                                              \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, remove)(&t, hit[i]));                \
+    bench_end(&ph, "remove", 0);                                               \
+    _lc_join(S, destroy)(&t);                                                  \
+    free(order);                                                               \
+    bench_sink = acc;                                                          \
+  }
+
+#if defined(HAVE_KHASH)
+#define BENCH_KHASH(S, KT)                                                     \
+  static void _lc_join(run, S)(const char *impl, const char *kn,               \
+                               KT *hit, KT *miss, size_t n) {                  \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    int ret;                                                                   \
+    khash_t(S) *h = kh_init(S);                                                \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, kh_value(h, kh_put(S, h, hit[i], &ret)) = i);           \
+    bench_end(&ph, "insert", 1);                                               \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += kh_value(h, kh_get(S, h, hit[i])));              \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += kh_get(S, h, miss[i]) != kh_end(h));             \
+    bench_end(&ph, "miss", 0);                                                 \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (khiter_t k = kh_begin(h); k != kh_end(h); k++)                        \
+      if (kh_exist(h, k))                                                      \
+        acc += kh_value(h, k);                                                 \
+    bench_end(&ph, "iterate", 0);                                              \
+    bench_begin(&ph, impl, kn, n);                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, kh_del(S, h, kh_get(S, h, hit[i])));                    \
+    bench_end(&ph, "remove", 0);                                               \
+    kh_destroy(S, h);                                                          \
+    bench_sink = acc;                                                          \
+  }
+#endif // HAVE_KHASH
+
+// FIFO of n 64 bit keys: n pushes, then n pops of a queue that stays full
+// (each popped key is pushed back, as a work queue in a steady state), then
+// n pops draining it.
+#define BENCH_DEQUE(S)                                                         \
+  static void _lc_join(run, S)(const char *impl, const uint64_t *keys,         \
+                               size_t n) {                                     \
+    bench_phase ph;                                                            \
+    uint64_t acc = 0, front;                                                   \
+    S d;                                                                       \
+    _lc_join(S, init)(&d, 0);                                                  \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, push_back)(&d, keys[i]));                   \
+    bench_end(&ph, "push", 1);                                                 \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, (front = _lc_join(S, pop_front)(&d), acc += front,     \
+                        _lc_join(S, push_back)(&d, front)));                   \
+    bench_end(&ph, "fifo", 0);                                                 \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, pop_front)(&d));                     \
+    bench_end(&ph, "pop", 0);                                                  \
+    bench_sink = acc;                                                          \
+    _lc_join(S, destroy)(&d);                                                  \
+  }
+
+// Immutable map built from the sorted keys (sorted beforehand with a vector,
+// outside of the timed phases), then the lookups of BENCH_TREE and
+// lower_bound() on the missing keys.
+#define BENCH_FLAT(S)                                                          \
+  static void _lc_join(run, S)(const char *impl, const uint64_t *hit,          \
+                               const uint64_t *miss, size_t n) {               \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    size_t *order = bench_order(n);                                            \
+    vecsort_u64 sorted;                                                        \
+    vecsort_u64_init(&sorted, n);                                              \
+    vecsort_u64_extend(&sorted, hit, n);                                       \
+    vecsort_u64_sort(&sorted);                                                 \
+    S m;                                                                       \
+    _lc_join(S, init)(&m);                                                     \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, build)(&m, vecsort_u64_data(&sorted),                          \
+                       vecsort_u64_data(&sorted), n);                          \
+    bench_end(&ph, "build", 1);                                                \
+    vecsort_u64_destroy(&sorted);                                              \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&m, hit[i]));              \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&m, hit[order[i]]));       \
+    bench_end(&ph, "hit_rand", 0);                                             \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&m, miss[i]));             \
+    bench_end(&ph, "miss", 0);                                                 \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i,                                                         \
+               acc += _lc_join(S, lower_bound)(&m, miss[i]).pos);              \
+    bench_end(&ph, "lower", 0);                                                \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (_lc_join(S, iter) it = _lc_join(S, first)(&m);                        \
+         !_lc_join(S, iter_done)(it); _lc_join(S, iter_next)(&it))             \
+      acc += _lc_join(S, iter_key)(it);                                        \
+    bench_end(&ph, "iterate", 0);                                              \
+    _lc_join(S, destroy)(&m);                                                  \
+    free(order);                                                               \
+    bench_sink = acc;                                                          \
+  }
+
+BENCH_VEC(vec_int, int)
+BENCH_VEC(vec_u64, uint64_t)
+BENCH_VEC(vec_str, char *)
+BENCH_VEC(vecsbo_int, int)
+BENCH_VEC(vecsbo_u64, uint64_t)
+BENCH_VEC(vecsbo_str, char *)
+BENCH_VEC(vecmm_int, int)
+BENCH_VEC(vecmm_u64, uint64_t)
+BENCH_VEC(vecmm_str, char *)
+BENCH_SET(uset_int, int, ITER_USET)
+BENCH_SET(uset_u64, uint64_t, ITER_USET)
+BENCH_SET(uset_str, char *, ITER_USET)
+BENCH_SET(usetch_int, int, ITER_USET)
+BENCH_SET(usetch_u64, uint64_t, ITER_USET)
+BENCH_SET(usetch_str, char *, ITER_USET)
+BENCH_SET(usetoa_int, int, ITER_USETOA)
+BENCH_SET(usetoa_u64, uint64_t, ITER_USETOA)
+BENCH_SET(usetoa_str, char *, ITER_USETOA)
+BENCH_SET(usetf_int, int, ITER_USET)
+BENCH_SET(usetf_u64, uint64_t, ITER_USET)
+BENCH_SET(usetf_str, char *, ITER_USET)
+BENCH_MAP(umap_int, int, ITER_UMAP)
+BENCH_MAP(umap_u64, uint64_t, ITER_UMAP)
+BENCH_MAP(umap_str, char *, ITER_UMAP)
+BENCH_MAP(umapch_int, int, ITER_UMAP)
+BENCH_MAP(umapch_u64, uint64_t, ITER_UMAP)
+BENCH_MAP(umapch_str, char *, ITER_UMAP)
+BENCH_MAP(umapoa_int, int, ITER_UMAPOA)
+BENCH_MAP(umapoa_u64, uint64_t, ITER_UMAPOA)
+BENCH_MAP(umapoa_str, char *, ITER_UMAPOA)
+BENCH_MAP(umapsk_str, char *, ITER_UMAP)
+BENCH_MAP(umapoask_str, char *, ITER_UMAPOA)
+BENCH_TREE(rbtree_int, int, ITER_RBTREE)
+BENCH_TREE(rbtree_u64, uint64_t, ITER_RBTREE)
+BENCH_TREE(rbtree_str, char *, ITER_RBTREE)
+BENCH_TREE(rbtreec_int, int, ITER_RBTREE)
+BENCH_TREE(rbtreec_u64, uint64_t, ITER_RBTREE)
+BENCH_TREE(rbtreec_str, char *, ITER_RBTREE)
+BENCH_TREE(btree_int, int, ITER_BTREE)
+BENCH_TREE(btree_u64, uint64_t, ITER_BTREE)
+BENCH_TREE(btree_str, char *, ITER_BTREE)
+BENCH_DEQUE(deque_u64)
+BENCH_FLAT(flat_u64)
+BENCH_FLAT(flatsimd_u64)
+#if defined(HAVE_KHASH)
+BENCH_KHASH(kh_int, int)
+BENCH_KHASH(kh_u64, uint64_t)
+BENCH_KHASH(kh_str, char *)
+#endif // HAVE_KHASH
+
+#define RUN(name, S)                                                           \
+  do {                                                                         \
+    if (bench_selected(filter, name)) {                                        \
+      _lc_join(run, _lc_join(S, int))(name, "int", ki, kim, n);                \
+      _lc_join(run, _lc_join(S, u64))(name, "u64", ku, kum, n);                \
+      _lc_join(run, _lc_join(S, str))(name, "str", ks, ksm, n);                \
+    }                                                                          \
+  } while (0)
+
+// Bulk loading and set operations on sorted 64 bit keys: n one by one
+// insertions against build(), then the union of two interleaved trees of n / 2
+// keys each, sequential and split across threads.
+#define BENCH_RBTREE_BULK(S, impl, n)                                          \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    uint64_t *sorted = (uint64_t *)malloc(sizeof(uint64_t) * n);               \
+    for (size_t i = 0; i < n; i++)                                             \
+      sorted[i] = i;                                                           \
+    S t, u;                                                                    \
+    _lc_join(S, init)(&t);                                                     \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, insert)(&t, sorted[i]));                    \
+    bench_end(&ph, "ins_sort", 1);                                             \
+    _lc_join(S, destroy)(&t);                                                  \
+    _lc_join(S, init)(&t);                                                     \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, build)(&t, sorted, n);                                         \
+    bench_end(&ph, "build", 1);                                                \
+    _lc_join(S, destroy)(&t);                                                  \
+    for (size_t i = 0; i < n / 2; i++)                                         \
+      sorted[i] = 2 * i;                                                       \
+    _lc_join(S, init)(&t);                                                     \
+    _lc_join(S, init)(&u);                                                     \
+    _lc_join(S, build)(&t, sorted, n / 2);                                     \
+    for (size_t i = 0; i < n / 2; i++)                                         \
+      sorted[i] = 2 * i + 1;                                                   \
+    _lc_join(S, build)(&u, sorted, n / 2);                                     \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, set_union)(&t, &u);                                            \
+    bench_end(&ph, "union", 0);                                                \
+    bench_sink = t.size;                                                       \
+    _lc_join(S, destroy)(&t);                                                  \
+    _lc_join(S, destroy)(&u);                                                  \
+    free(sorted);                                                              \
+  } while (0)
+
+// Approximate membership of n 64 bit keys at a 1% false positive rate, the
+// misses counting the keys that got through the filter.
+#define BENCH_FILTER(S, impl, hit, miss, n)                                    \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    S f;                                                                       \
+    _lc_join(S, init)(&f, n, 0.01);                                            \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, insert)(&f, hit[i]));                       \
+    bench_end(&ph, "insert", 1);                                               \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&f, hit[i]));              \
+    bench_end(&ph, "hit", 0);                                                  \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, contains)(&f, miss[i]));             \
+    bench_end(&ph, "miss", 0);                                                 \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i += BENCH_BATCH)                                \
+      acc += _lc_join(S, contains_many)(                                       \
+          &f, miss + i, n - i < BENCH_BATCH ? n - i : BENCH_BATCH, NULL);      \
+    bench_end(&ph, "miss_many", 0);                                            \
+    bench_sink = acc;                                                          \
+    _lc_join(S, destroy)(&f);                                                  \
+  } while (0)
+
+// Priority queue of n random 64 bit keys: n pushes, then n pops of a queue
+// that stays full (each popped key is pushed back later, as timers are),
+// then n pops draining it.
+#define BENCH_HEAP(S, impl, keys, n)                                           \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    uint64_t acc = 0, top;                                                     \
+    S h;                                                                       \
+    _lc_join(S, init)(&h, 0);                                                  \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, _lc_join(S, push)(&h, keys[i]));                        \
+    bench_end(&ph, "push", 1);                                                 \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, (top = _lc_join(S, pop)(&h), acc += top,               \
+                        _lc_join(S, push)(&h, top + (keys[i] >> 24))));        \
+    bench_end(&ph, "hold", 0);                                                 \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      BENCH_OP(&ph, i, acc += _lc_join(S, pop)(&h));                           \
+    bench_end(&ph, "pop", 0);                                                  \
+    bench_sink = acc;                                                          \
+    _lc_join(S, destroy)(&h);                                                  \
+  } while (0)
+
+// Building a heap of n random 64 bit keys in one go.
+#define BENCH_HEAPIFY(S, impl, keys, n)                                        \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    S h;                                                                       \
+    _lc_join(S, init)(&h, 0);                                                  \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, heapify)(&h, keys, n);                                         \
+    bench_end(&ph, "heapify", 1);                                              \
+    bench_sink = _lc_join(S, top)(&h);                                         \
+    _lc_join(S, destroy)(&h);                                                  \
+  } while (0)
+
+static int bench_qsort_u64(const uint64_t *a, const uint64_t *b) {
+  return bench_cmp(*a, *b);
+}
+
+// Startup of a read-only lookup table of n 64 bit keys: building it with
+// insertions against mapping an image of it, then the first lookups into the
+// mapping, which pay for its page faults.
+#define BENCH_UMAP_IMAGE(S, impl, keys, n)                                     \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    const char *path = "/tmp/lc_bench_umap.img";                               \
+    size_t acc = 0;                                                            \
+    S m;                                                                       \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, init)(&m, 0);                                                  \
+    for (size_t i = 0; i < n; i++)                                             \
+      _lc_join(S, insert)(&m, keys[i], i);                                     \
+    bench_end(&ph, "build", 1);                                                \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    bool saved = _lc_join(S, save)(&m, path);                                  \
+    bench_end(&ph, "save", 0);                                                 \
+    _lc_join(S, destroy)(&m);                                                  \
+    if (saved) {                                                               \
+      bench_begin(&ph, impl, "u64", n);                                        \
+      bool opened = _lc_join(S, open_mmap)(&m, path, LC_PERSIST_READONLY);     \
+      bench_end(&ph, "open", 0);                                               \
+      if (opened) {                                                            \
+        bench_begin(&ph, impl, "u64", n);                                      \
+        for (size_t i = 0; i < n; i++)                                         \
+          BENCH_OP(&ph, i, acc += *_lc_join(S, find)(&m, keys[i]));            \
+        bench_end(&ph, "hit_cold", 1);                                         \
+        _lc_join(S, destroy)(&m);                                              \
+      }                                                                        \
+      unlink(path);                                                            \
+    }                                                                          \
+    bench_sink = acc;                                                          \
+  } while (0)
+
+// Sorting n random 64 bit keys: the qsort() based method as the baseline,
+// then sort() and radix_sort().
+#define BENCH_VEC_SORT(S, impl, keys, n)                                       \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    S v;                                                                       \
+    _lc_join(S, init)(&v, n);                                                  \
+    _lc_join(S, extend)(&v, keys, n);                                          \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, qsort)(&v, bench_qsort_u64);                                   \
+    bench_end(&ph, "qsort", 0);                                                \
+    v.size = 0;                                                                \
+    _lc_join(S, extend)(&v, keys, n);                                          \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, sort)(&v);                                                     \
+    bench_end(&ph, "sort", 0);                                                 \
+    v.size = 0;                                                                \
+    _lc_join(S, extend)(&v, keys, n);                                          \
+    bench_begin(&ph, impl, "u64", n);                                          \
+    _lc_join(S, radix_sort)(&v);                                               \
+    bench_end(&ph, "radix", 0);                                                \
+    bench_sink = _lc_join(S, data)(&v)[n / 2];                                 \
+    _lc_join(S, destroy)(&v);                                                  \
+  } while (0)
+
+// Full scans of n keys: a plain loop looking for a missing key as the
+// baseline, then find() of the same key, count(), min() and sum().
+#define BENCH_VEC_SCAN(S, KT, impl, kn, keys, n)                               \
+  do {                                                                         \
+    bench_phase ph;                                                            \
+    size_t acc = 0;                                                            \
+    S v;                                                                       \
+    _lc_join(S, init)(&v, n);                                                  \
+    _lc_join(S, extend)(&v, keys, n);                                          \
+    KT *e = _lc_join(S, data)(&v);                                             \
+    KT missing = (KT)bench_key(n + 1);                                         \
+    bench_begin(&ph, impl, kn, n);                                             \
+    size_t at = n;                                                             \
+    for (size_t i = 0; i < n; i++)                                             \
+      if (e[i] == missing) {                                                   \
+        at = i;                                                                \
+        break;                                                                 \
+      }                                                                        \
+    bench_end(&ph, "loop", 0);                                                 \
+    acc += at;                                                                 \
+    bench_begin(&ph, impl, kn, n);                                             \
+    acc += _lc_join(S, find)(&v, missing);                                     \
+    bench_end(&ph, "find", 0);                                                 \
+    bench_begin(&ph, impl, kn, n);                                             \
+    acc += _lc_join(S, count)(&v, e[n / 2]);                                   \
+    bench_end(&ph, "count", 0);                                                \
+    KT m = 0;                                                                  \
+    bench_begin(&ph, impl, kn, n);                                             \
+    _lc_join(S, min)(&v, &m);                                                  \
+    bench_end(&ph, "min", 0);                                                  \
+    acc += (size_t)m;                                                          \
+    bench_begin(&ph, impl, kn, n);                                             \
+    acc += (size_t)_lc_join(S, sum)(&v);                                       \
+    bench_end(&ph, "sum", 0);                                                  \
+    bench_sink = acc;                                                          \
+    _lc_join(S, destroy)(&v);                                                  \
+  } while (0)
+
+int main(int argc, char **argv) {
+  size_t sizes[16];
+  const char *filter;
+  size_t count = bench_args(argc, argv, sizes, 16, &filter);
+  bench_header();
+  for (size_t c = 0; c < count; c++) {
+    size_t n = sizes[c];
+    int *ki = bench_keys_int(n, 0), *kim = bench_keys_int(n, n);
+    uint64_t *ku = bench_keys_u64(n, 0), *kum = bench_keys_u64(n, n);
+    char **ks = bench_keys_str(n, 0), **ksm = bench_keys_str(n, n);
+    RUN("lc_vector", vec);
+    RUN("lc_vector_sbo", vecsbo);
+    RUN("lc_vector_mmap", vecmm);
+    if (bench_selected(filter, "lc_vector_scan")) {
+      BENCH_VEC_SCAN(vec_int, int, "lc_vector_scan", "int", ki, n);
+      BENCH_VEC_SCAN(vec_u64, uint64_t, "lc_vector_scan", "u64", ku, n);
+    }
+    if (bench_selected(filter, "lc_umap_image"))
+      BENCH_UMAP_IMAGE(umapimg_u64, "lc_umap_image", ku, n);
+    if (bench_selected(filter, "lc_vector_sort"))
+      BENCH_VEC_SORT(vecsort_u64, "lc_vector_sort", ku, n);
+    if (bench_selected(filter, "lc_vector_sort_mt"))
+      BENCH_VEC_SORT(vecsortmt_u64, "lc_vector_sort_mt", ku, n);
+    RUN("lc_uset", uset);
+    RUN("lc_uset_cached", usetch);
+    RUN("lc_uset_open", usetoa);
+    RUN("lc_uset_filter", usetf);
+    if (bench_selected(filter, "lc_deque"))
+      run_deque_u64("lc_deque", ku, n);
+    if (bench_selected(filter, "lc_heap2")) {
+      BENCH_HEAP(heap2_u64, "lc_heap2", ku, n);
+      BENCH_HEAPIFY(heap2_u64, "lc_heap2", ku, n);
+    }
+    if (bench_selected(filter, "lc_heap4")) {
+      BENCH_HEAP(heap4_u64, "lc_heap4", ku, n);
+      BENCH_HEAPIFY(heap4_u64, "lc_heap4", ku, n);
+    }
+    if (bench_selected(filter, "lc_heap8")) {
+      BENCH_HEAP(heap8_u64, "lc_heap8", ku, n);
+      BENCH_HEAPIFY(heap8_u64, "lc_heap8", ku, n);
+    }
+    if (bench_selected(filter, "lc_radix_heap"))
+      BENCH_HEAP(rheap_u64, "lc_radix_heap", ku, n);
+    if (bench_selected(filter, "lc_bloom"))
+      BENCH_FILTER(bloom_u64, "lc_bloom", ku, kum, n);
+    if (bench_selected(filter, "lc_cuckoo"))
+      BENCH_FILTER(cuckoo_u64, "lc_cuckoo", ku, kum, n);
+    RUN("lc_umap", umap);
+    RUN("lc_umap_cached", umapch);
+    RUN("lc_umap_open", umapoa);
+    if (bench_selected(filter, "lc_umap_skey"))
+      run_umapsk_str("lc_umap_skey", "str", ks, ksm, n);
+    if (bench_selected(filter, "lc_umap_open_skey"))
+      run_umapoask_str("lc_umap_open_skey", "str", ks, ksm, n);
+    RUN("lc_rbtree", rbtree);
+    RUN("lc_rbtree_compact", rbtreec);
+    if (bench_selected(filter, "lc_flat_map"))
+      run_flat_u64("lc_flat_map", ku, kum, n);
+    if (bench_selected(filter, "lc_flat_map_simd"))
+      run_flatsimd_u64("lc_flat_map_simd", ku, kum, n);
+    if (bench_selected(filter, "lc_rbtree_bulk"))
+      BENCH_RBTREE_BULK(rbtree_u64, "lc_rbtree_bulk", n);
+    if (bench_selected(filter, "lc_rbtree_bulk_mt"))
+      BENCH_RBTREE_BULK(rbtreemt_u64, "lc_rbtree_bulk_mt", n);
+    RUN("lc_btree", btree);
+#if defined(HAVE_KHASH)
+    RUN("khash", kh);
+#endif // HAVE_KHASH
+    free(ki);
+    free(kim);
+    free(ku);
+    free(kum);
+    bench_free_str(ks, n);
+    bench_free_str(ksm, n);
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+// C++ standard library baselines running the same workloads as bench_lc.c.
+// String keys are std::string_view over the shared key buffers so that, like
+// the C containers instantiated with char *, no copy of the key is stored.
+
+#include "bench.h"
+
+#include <deque>
+#include <functional>
+#include <queue>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+static volatile size_t bench_sink;
+
+template <typename K> static size_t touch(const K &k) {
+  return (size_t)k;
+}
+
+static size_t touch(const std::string_view &k) {
+  return (size_t)(uintptr_t)k.data();
+}
+
+template <typename K>
+static void run_vector(const char *kn, const K *hit, size_t n) {
+  bench_phase ph;
+  size_t acc = 0;
+  std::vector<K> v;
+  bench_begin(&ph, "std_vector", kn, n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, v.push_back(hit[i]));
+  bench_end(&ph, "insert", 1);
+  bench_begin(&ph, "std_vector", kn, n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, acc += touch(v.at(bench_key(i) % n)));
+  bench_end(&ph, "hit", 0);
+  bench_begin(&ph, "std_vector", kn, n);
+  for (const K &k : v)
+    acc += touch(k);
+  bench_end(&ph, "iterate", 0);
+  bench_begin(&ph, "std_vector", kn, n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, (acc += touch(v.back()), v.pop_back()));
+  bench_end(&ph, "remove", 0);
+  bench_sink = acc;
+}
+
+// std::unordered_set and std::set share the same set-like interface.
+template <typename S, typename K>
+static void run_set(const char *impl, const char *kn, const K *hit,
+                    const K *miss, size_t n) {
+  bench_phase ph;
+  size_t acc = 0;
+  size_t *order = bench_order(n);
+  {
+    S s;
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, s.insert(hit[i]));
+    bench_end(&ph, "insert", 1);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += s.count(hit[i]));
+    bench_end(&ph, "hit", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += s.count(hit[order[i]]));
+    bench_end(&ph, "hit_rand", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += s.count(miss[i]));
+    bench_end(&ph, "miss", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (const K &k : s)
+      acc += touch(k);
+    bench_end(&ph, "iterate", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += s.erase(hit[i]));
+    bench_end(&ph, "remove", 0);
+  }
+  free(order);
+  bench_sink = acc;
+}
+
+template <typename K>
+static void run_map(const char *kn, const K *hit, const K *miss, size_t n) {
+  const char *impl = "std_unordered_map";
+  bench_phase ph;
+  size_t acc = 0;
+  {
+    std::unordered_map<K, uint64_t> m;
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, m.emplace(hit[i], i));
+    bench_end(&ph, "insert", 1);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += m.find(hit[i])->second);
+    bench_end(&ph, "hit", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += m.find(miss[i]) != m.end());
+    bench_end(&ph, "miss", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, ++m[hit[i]]);
+    bench_end(&ph, "upsert", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (const auto &kv : m)
+      acc += kv.second;
+    bench_end(&ph, "iterate", 0);
+    bench_begin(&ph, impl, kn, n);
+    for (size_t i = 0; i < n; i++)
+      BENCH_OP(&ph, i, acc += m.erase(hit[i]));
+    bench_end(&ph, "remove", 0);
+  }
+  bench_sink = acc;
+}
+
+// Same workload as BENCH_DEQUE in bench_lc.c.
+static void run_deque(const uint64_t *keys, size_t n) {
+  bench_phase ph;
+  uint64_t acc = 0, front;
+  std::deque<uint64_t> d;
+  bench_begin(&ph, "std_deque", "u64", n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, d.push_back(keys[i]));
+  bench_end(&ph, "push", 1);
+  bench_begin(&ph, "std_deque", "u64", n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, (front = d.front(), d.pop_front(), acc += front,
+                      d.push_back(front)));
+  bench_end(&ph, "fifo", 0);
+  bench_begin(&ph, "std_deque", "u64", n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, (acc += d.front(), d.pop_front()));
+  bench_end(&ph, "pop", 0);
+  bench_sink = acc;
+}
+
+// Same workload as BENCH_HEAP and BENCH_HEAPIFY in bench_lc.c.
+static void run_priority_queue(const uint64_t *keys, size_t n) {
+  bench_phase ph;
+  uint64_t acc = 0, top;
+  std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>>
+      q;
+  bench_begin(&ph, "std_priority_queue", "u64", n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, q.push(keys[i]));
+  bench_end(&ph, "push", 1);
+  bench_begin(&ph, "std_priority_queue", "u64", n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, (top = q.top(), q.pop(), acc += top,
+                      q.push(top + (keys[i] >> 24))));
+  bench_end(&ph, "hold", 0);
+  bench_begin(&ph, "std_priority_queue", "u64", n);
+  for (size_t i = 0; i < n; i++)
+    BENCH_OP(&ph, i, (acc += q.top(), q.pop()));
+  bench_end(&ph, "pop", 0);
+  bench_begin(&ph, "std_priority_queue", "u64", n);
+  std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>>
+      built(keys, keys + n);
+  bench_end(&ph, "heapify", 1);
+  bench_sink = acc + built.top();
+}
+
+template <typename K>
+static void run_all(const char *filter, const char *kn, const K *hit,
+                    const K *miss, size_t n) {
+  if (bench_selected(filter, "std_vector"))
+    run_vector(kn, hit, n);
+  if (bench_selected(filter, "std_unordered_set"))
+    run_set<std::unordered_set<K>>("std_unordered_set", kn, hit, miss, n);
+  if (bench_selected(filter, "std_unordered_map"))
+    run_map(kn, hit, miss, n);
+  if (bench_selected(filter, "std_set"))
+    run_set<std::set<K>>("std_set", kn, hit, miss, n);
+}
+
+int main(int argc, char **argv) {
+  size_t sizes[16];
+  const char *filter;
+  size_t count = bench_args(argc, argv, sizes, 16, &filter);
+  bench_header();
+  for (size_t c = 0; c < count; c++) {
+    size_t n = sizes[c];
+    int *ki = bench_keys_int(n, 0), *kim = bench_keys_int(n, n);
+    uint64_t *ku = bench_keys_u64(n, 0), *kum = bench_keys_u64(n, n);
+    char **ks = bench_keys_str(n, 0), **ksm = bench_keys_str(n, n);
+    std::vector<std::string_view> vs(ks, ks + n), vsm(ksm, ksm + n);
+    run_all(filter, "int", ki, kim, n);
+    run_all(filter, "u64", ku, kum, n);
+    run_all(filter, "str", vs.data(), vsm.data(), n);
+    if (bench_selected(filter, "std_deque"))
+      run_deque(ku, n);
+    if (bench_selected(filter, "std_priority_queue"))
+      run_priority_queue(ku, n);
+    free(ki);
+    free(kim);
+    free(ku);
+    free(kum);
+    bench_free_str(ks, n);
+    bench_free_str(ksm, n);
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Hash quality benchmark: chain length distribution and lookup throughput of
+// a separate-chaining uset for adversarial integer key patterns, hashed with
+// the old identity function and with the default lc_hash_int mixer.
+//
+// cc -O2 -I.. hash_bench.c -o hash_bench && ./hash_bench [keys]
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <time.h>
+
+#define T uint64_t
+#define lcore_hash_fn(x) (x)
+#define lcore_pfx id_set
+#include "containers/unordered_set.h"
+
+#define T uint64_t
+#define lcore_pfx mix_set
+#include "containers/unordered_set.h"
+
+#define HIST_MAX 8
+
+typedef struct {
+  const char *name;
+  uint64_t (*key)(uint64_t i);
+} pattern;
+
+static uint64_t key_seq(uint64_t i) {
+  return i;
+}
+
+static uint64_t key_stride64(uint64_t i) {
+  return i << 6;
+}
+
+static uint64_t key_ptr(uint64_t i) {
+  return 0x7f3a5c000000ULL + i * 48;
+}
+
+static uint64_t key_usec(uint64_t i) {
+  return 1700000000000000ULL + i * 1000;
+}
+
+static uint64_t key_rand(uint64_t i) {
+  return lc_hash_int(i * 0x2545f4914f6cdd1dULL);
+}
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define REPORT(set_t, label)                                                   \
+  do {                                                                         \
+    set_t s;                                                                   \
+    _lc_join(set_t, init)(&s, 0);                                              \
+    for (uint64_t i = 0; i < n; i++)                                           \
+      _lc_join(set_t, insert)(&s, p->key(i));                                  \
+    size_t hist[HIST_MAX + 1] = {0}, max_chain = 0, used = 0;                  \
+    for (size_t b = 0; b < s.capacity; b++) {                                  \
+      size_t len = 0;                                                          \
+      for (_lc_join(set_t, node) *c = s.buckets[b]; c; c = c->next)            \
+        len++;                                                                 \
+      hist[len < HIST_MAX ? len : HIST_MAX]++;                                 \
+      used += len != 0;                                                        \
+      max_chain = len > max_chain ? len : max_chain;                           \
+    }                                                                          \
+    double t0 = now_sec();                                                     \
+    size_t hits = 0;                                                           \
+    for (uint64_t i = 0; i < n; i++)                                           \
+      hits += _lc_join(set_t, contains)(&s, p->key(i));                        \
+    double t1 = now_sec();                                                     \
+    printf("%-10s %-9s %8.2f %9.2f %9zu ", p->name, label,                     \
+           (double)n / (t1 - t0) * 1e-6, (double)s.size / used, max_chain);   \
+    for (size_t k = 0; k <= HIST_MAX; k++)                                     \
+      printf(" %5.1f", 100.0 * hist[k] / s.capacity);                          \
+    printf("%s\n", hits == n ? "" : "  (lookup mismatch)");                    \
+    _lc_join(set_t, destroy)(&s);                                              \
+  } while (0)
+
+int main(int argc, char **argv) {
+  uint64_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  const pattern patterns[] = {
+      {"sequential", key_seq}, {"stride64", key_stride64},
+      {"pointers", key_ptr},   {"usec", key_usec},
+      {"random", key_rand},
+  };
+  printf("%llu keys, bucket occupancy in %% of buckets by chain length\n",
+         (unsigned long long)n);
+  printf("%-10s %-9s %8s %9s %9s ", "pattern", "hash", "Mlookup/s",
+         "avg chain", "max chain");
+  for (size_t k = 0; k < HIST_MAX; k++)
+    printf(" %5zu", k);
+  printf(" %4d+\n", HIST_MAX);
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(*patterns); i++) {
+    const pattern *p = &patterns[i];
+    REPORT(id_set, "identity");
+    REPORT(mix_set, "lc_hash");
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+#if !defined(LC_ARENA_H)
+#define LC_ARENA_H
+
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Bump allocator for variable-size byte strings that live as long as the
+// container owning the arena, used by the string keyed hash tables.
+//
+// Allocations are carved out of blocks whose size doubles up to
+// LC_ARENA_MAX_BLOCK, with no header and no alignment, and are never freed
+// one by one: lc_arena_release() gives every block back at once. Requests
+// larger than a quarter of a block get a block of their own, so a long
+// string does not waste the tail of the current one.
+
+#ifndef LC_ARENA_MIN_BLOCK
+#define LC_ARENA_MIN_BLOCK (4096)
+#endif // LC_ARENA_MIN_BLOCK
+
+#ifndef LC_ARENA_MAX_BLOCK
+#define LC_ARENA_MAX_BLOCK (1 << 20)
+#endif // LC_ARENA_MAX_BLOCK
+
+typedef struct lc_arena_block {
+  struct lc_arena_block *next;
+} lc_arena_block;
+
+typedef struct lc_arena {
+  lc_arena_block *blocks; // every block owned by the arena
+  char *bump, *bump_end;  // unused tail of the current block
+  size_t block_size;      // size of the next block to allocate
+  size_t bytes;           // bytes allocated for all the blocks
+} lc_arena;
+
+static inline void lc_arena_init(lc_arena *arena) {
+  memset(arena, 0, sizeof(*arena));
+  arena->block_size = LC_ARENA_MIN_BLOCK;
+}
+
+static inline void *lc_arena_alloc(lc_arena *arena, size_t n) {
+  if ((size_t)(arena->bump_end - arena->bump) >= n) {
+    void *p = arena->bump;
+    arena->bump += n;
+    return p;
+  }
+  bool own = n > arena->block_size / 4;
+  size_t size = sizeof(lc_arena_block) + (own ? n : arena->block_size);
+  lc_arena_block *block = lc_malloc(lc_arena_block, size);
+  if (!block)
+    return NULL;
+  arena->bytes += size;
+  char *p = (char *)(block + 1);
+  if (own && arena->blocks) {
+    // Keep bumping into the current block.
+    block->next = arena->blocks->next;
+    arena->blocks->next = block;
+    return p;
+  }
+  block->next = arena->blocks;
+  arena->blocks = block;
+  arena->bump = p + n;
+  arena->bump_end = (char *)block + size;
+  if (!own && arena->block_size < LC_ARENA_MAX_BLOCK)
+    arena->block_size <<= 1;
+  return p;
+}
+
+// Frees every block at once, all the memory handed out becomes invalid.
+static inline void lc_arena_release(lc_arena *arena) {
+  lc_arena_block *block = arena->blocks;
+  while (block) {
+    lc_arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+  lc_arena_init(arena);
+}
+
+#endif // LC_ARENA_H
@@ -0,0 +1,99 @@
+#if !defined(LC_BLOOM_H)
+#define LC_BLOOM_H
+
+#include "_lc_hash.h"
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Cache-line blocked Bloom filter working on 64 bit hashes, shared by
+// filter.h and the hash tables built with 'lcore_filter'.
+//
+// The upper half of a hash picks one 64 byte block, its lower half (remixed)
+// the 'k' bits to set in that block by double hashing. A lookup or an
+// insertion therefore touches a single cache line, for a higher false
+// positive rate than a classic Bloom filter of the same size. Filters are
+// made LC_BLOOM_OVERSIZE times larger than the classic formula asks, which
+// keeps the measured rate at or below the requested one down to about 0.1%.
+// Lower rates need many more bits per key with blocking (a 0.01% target
+// ends up around 0.035%), a cuckoo filter is the better fit there.
+
+#define LC_BLOOM_WORDS 8 // 64 bit words per block
+#define LC_BLOOM_MAX_K 16
+
+#ifndef LC_BLOOM_OVERSIZE
+#define LC_BLOOM_OVERSIZE 1.15
+#endif // LC_BLOOM_OVERSIZE
+
+typedef struct {
+  uint64_t *blocks; // nblocks * LC_BLOOM_WORDS words, cache line aligned
+  size_t nblocks;   // at most 2^32
+  unsigned k;       // bits set per key
+} lc_bloom;
+
+// Sizes 'b' for 'n' keys and a false positive rate of 'fpr' (0 < fpr < 1):
+// k = ceil(log2(1 / fpr)) bits set and k / ln 2 * LC_BLOOM_OVERSIZE bits of
+// filter per key. False when the blocks can not be allocated.
+static inline bool lc_bloom_init(lc_bloom *b, size_t n, double fpr) {
+  unsigned k = 1;
+  for (double p = 0.5; p > fpr && k < LC_BLOOM_MAX_K; p *= 0.5)
+    k++;
+  double bits = (double)(n ? n : 1) * k * 1.4426950408889634;
+  bits *= LC_BLOOM_OVERSIZE;
+  double nblocks = bits / (LC_BLOOM_WORDS * 64) + 1;
+  b->nblocks = nblocks < (double)UINT32_MAX ? (size_t)nblocks : UINT32_MAX;
+  b->k = k;
+  size_t bytes = sizeof(uint64_t) * LC_BLOOM_WORDS * b->nblocks;
+  b->blocks = (uint64_t *)aligned_alloc(64, bytes);
+  if (!b->blocks) {
+    b->nblocks = 0;
+    return false;
+  }
+  memset(b->blocks, 0, bytes);
+  return true;
+}
+
+static inline void lc_bloom_release(lc_bloom *b) {
+  free(b->blocks);
+  memset(b, 0, sizeof(*b));
+}
+
+static inline void lc_bloom_clear(lc_bloom *b) {
+  memset(b->blocks, 0, sizeof(uint64_t) * LC_BLOOM_WORDS * b->nblocks);
+}
+
+static inline size_t lc_bloom_bytes(const lc_bloom *b) {
+  return sizeof(uint64_t) * LC_BLOOM_WORDS * b->nblocks;
+}
+
+static inline uint64_t *_lc_bloom_block(const lc_bloom *b, uint64_t h) {
+  size_t i = (size_t)(((h >> 32) * (uint64_t)b->nblocks) >> 32);
+  return b->blocks + i * LC_BLOOM_WORDS;
+}
+
+// The k bits of 'h' are 9 bit positions (word, then bit within it) read
+// from the top of 'x' as it advances by 'step'.
+static inline void lc_bloom_add(lc_bloom *b, uint64_t h) {
+  uint64_t *block = _lc_bloom_block(b, h);
+  uint64_t g = (h ^ (h >> 29)) * LC_HASH_GOLDEN;
+  uint32_t x = (uint32_t)g, step = (uint32_t)(g >> 32) | 1;
+  for (unsigned i = 0; i < b->k; i++, x += step)
+    block[x >> 29] |= 1ull << ((x >> 23) & 63);
+}
+
+// False means the key hashing to 'h' was never added. Most such keys stop at
+// the first or second bit.
+static inline bool lc_bloom_test(const lc_bloom *b, uint64_t h) {
+  const uint64_t *block = _lc_bloom_block(b, h);
+  uint64_t g = (h ^ (h >> 29)) * LC_HASH_GOLDEN;
+  uint32_t x = (uint32_t)g, step = (uint32_t)(g >> 32) | 1;
+  for (unsigned i = 0; i < b->k; i++, x += step)
+    if (!(block[x >> 29] >> ((x >> 23) & 63) & 1))
+      return false;
+  return true;
+}
+
+static inline void lc_bloom_prefetch(const lc_bloom *b, uint64_t h) {
+  lc_prefetch(_lc_bloom_block(b, h));
+}
+
+#endif // LC_BLOOM_H
@@ -0,0 +1,173 @@
+#if !defined(LC_CUCKOO_H)
+#define LC_CUCKOO_H
+
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Cuckoo filter working on 64 bit hashes, used by filter.h when
+// 'lcore_cuckoo_filter' is defined.
+//
+// A key is a 16 bit fingerprint (the top bits of its hash, never 0) stored
+// in one of two buckets: i1 from the low bits of the hash, i2 = i1 ^ f(fp).
+// Since i2 only depends on i1 and the fingerprint, a fingerprint can be
+// moved between its two buckets without knowing its key, which is how an
+// insertion into two full buckets makes room, and how keys are removed.
+//
+// A bucket is a single 64 bit word of LC_CUCKOO_SLOTS fingerprints, matched
+// all at once with SWAR arithmetic. A lookup reads two words and its false
+// positive rate is at most 2 * LC_CUCKOO_SLOTS / 65535, about 0.012%.
+//
+// An insertion that gives up after LC_CUCKOO_MAX_KICKS moves undoes them, so
+// a failed insertion leaves the filter as it was. A key inserted more than
+// 2 * LC_CUCKOO_SLOTS times fails without moving anything once its two
+// buckets are full of its own fingerprint, as no eviction could help.
+
+#define LC_CUCKOO_SLOTS 4
+#define LC_CUCKOO_MAX_KICKS 500
+#define LC_CUCKOO_LOADF 0.95 // load the sizing plans for
+
+#define _LC_CUCKOO_ONES 0x0001000100010001ull
+#define _LC_CUCKOO_HIGHS 0x8000800080008000ull
+
+typedef struct {
+  uint64_t *buckets; // mask + 1 words of LC_CUCKOO_SLOTS fingerprints
+  size_t mask;       // number of buckets - 1, a power of two minus one
+  uint64_t rng;      // xorshift state picking the entries to evict
+} lc_cuckoo;
+
+// Sizes 'c' for 'n' fingerprints. False when it can not be allocated.
+static inline bool lc_cuckoo_init(lc_cuckoo *c, size_t n) {
+  size_t want = (size_t)((double)n / (LC_CUCKOO_SLOTS * LC_CUCKOO_LOADF)) + 1;
+  size_t nbuckets = 1;
+  while (nbuckets < want)
+    nbuckets <<= 1;
+  memset(c, 0, sizeof(*c));
+  c->buckets = lc_calloc(uint64_t, sizeof(uint64_t), nbuckets);
+  if (!c->buckets)
+    return false;
+  c->mask = nbuckets - 1;
+  c->rng = 0x2545f4914f6cdd1dull;
+  return true;
+}
+
+static inline void lc_cuckoo_release(lc_cuckoo *c) {
+  free(c->buckets);
+  memset(c, 0, sizeof(*c));
+}
+
+static inline void lc_cuckoo_clear(lc_cuckoo *c) {
+  memset(c->buckets, 0, sizeof(uint64_t) * (c->mask + 1));
+}
+
+static inline size_t lc_cuckoo_bytes(const lc_cuckoo *c) {
+  return sizeof(uint64_t) * (c->mask + 1);
+}
+
+static inline uint16_t _lc_cuckoo_fp(uint64_t h) {
+  uint16_t fp = (uint16_t)(h >> 48);
+  return fp ? fp : 1;
+}
+
+static inline size_t _lc_cuckoo_alt(const lc_cuckoo *c, size_t i,
+                                    uint16_t fp) {
+  return (i ^ (size_t)(fp * 0x5bd1e995ull)) & c->mask;
+}
+
+// One bit (the top one of its lane) per lane of 'b' equal to 'fp'. Only the
+// lowest bit is exact, which is all the callers look at.
+static inline uint64_t _lc_cuckoo_match(uint64_t b, uint16_t fp) {
+  uint64_t x = b ^ (fp * _LC_CUCKOO_ONES);
+  return (x - _LC_CUCKOO_ONES) & ~x & _LC_CUCKOO_HIGHS;
+}
+
+static inline unsigned _lc_cuckoo_lane(uint64_t m) {
+  return (unsigned)__builtin_ctzll(m) & ~15u;
+}
+
+// Stores 'fp' in a free slot of bucket 'i', false when there is none.
+static inline bool _lc_cuckoo_put(lc_cuckoo *c, size_t i, uint16_t fp) {
+  uint64_t m = _lc_cuckoo_match(c->buckets[i], 0);
+  if (!m)
+    return false;
+  c->buckets[i] |= (uint64_t)fp << _lc_cuckoo_lane(m);
+  return true;
+}
+
+// Clears one slot of bucket 'i' holding 'fp', false when there is none.
+static inline bool _lc_cuckoo_take(lc_cuckoo *c, size_t i, uint16_t fp) {
+  uint64_t m = _lc_cuckoo_match(c->buckets[i], fp);
+  if (!m)
+    return false;
+  c->buckets[i] &= ~(0xffffull << _lc_cuckoo_lane(m));
+  return true;
+}
+
+// Writes 'fp' in the slot of bucket 'i' at bit 'shift', returns what it
+// held.
+static inline uint16_t _lc_cuckoo_swap(lc_cuckoo *c, size_t i, unsigned shift,
+                                       uint16_t fp) {
+  uint16_t old = (uint16_t)(c->buckets[i] >> shift);
+  c->buckets[i] &= ~(0xffffull << shift);
+  c->buckets[i] |= (uint64_t)fp << shift;
+  return old;
+}
+
+// False when the filter is full, the key is then not added and the filter
+// is left unchanged.
+static inline bool lc_cuckoo_add(lc_cuckoo *c, uint64_t h) {
+  uint16_t fp = _lc_cuckoo_fp(h);
+  size_t i1 = (size_t)h & c->mask;
+  size_t i = _lc_cuckoo_alt(c, i1, fp);
+  if (_lc_cuckoo_put(c, i1, fp) || _lc_cuckoo_put(c, i, fp))
+    return true;
+  // Both buckets are full of copies of this key or of keys it can not be
+  // told apart from, evicting them would only move copies around.
+  if (_lc_cuckoo_match(c->buckets[i1], fp) &&
+      _lc_cuckoo_match(c->buckets[i], fp))
+    return false;
+  // Slots written by the kicks, as bucket * LC_CUCKOO_SLOTS + slot.
+  size_t path[LC_CUCKOO_MAX_KICKS];
+  for (int kick = 0; kick < LC_CUCKOO_MAX_KICKS; kick++) {
+    c->rng ^= c->rng << 13;
+    c->rng ^= c->rng >> 7;
+    c->rng ^= c->rng << 17;
+    unsigned slot = (unsigned)(c->rng % LC_CUCKOO_SLOTS);
+    path[kick] = i * LC_CUCKOO_SLOTS + slot;
+    fp = _lc_cuckoo_swap(c, i, slot * 16, fp);
+    i = _lc_cuckoo_alt(c, i, fp);
+    if (_lc_cuckoo_put(c, i, fp))
+      return true;
+  }
+  // Puts every evicted fingerprint back, last kick first.
+  for (int kick = LC_CUCKOO_MAX_KICKS - 1; kick >= 0; kick--)
+    fp = _lc_cuckoo_swap(c, path[kick] / LC_CUCKOO_SLOTS,
+                         (unsigned)(path[kick] % LC_CUCKOO_SLOTS) * 16, fp);
+  return false;
+}
+
+// False means the key hashing to 'h' was never added (or was removed).
+static inline bool lc_cuckoo_test(const lc_cuckoo *c, uint64_t h) {
+  uint16_t fp = _lc_cuckoo_fp(h);
+  size_t i1 = (size_t)h & c->mask;
+  size_t i2 = _lc_cuckoo_alt(c, i1, fp);
+  return (_lc_cuckoo_match(c->buckets[i1], fp) |
+          _lc_cuckoo_match(c->buckets[i2], fp)) != 0;
+}
+
+// Removes one copy of the fingerprint of 'h'. Only keys that were added may
+// be removed: another key sharing their fingerprint and buckets would lose
+// its entry instead.
+static inline bool lc_cuckoo_remove(lc_cuckoo *c, uint64_t h) {
+  uint16_t fp = _lc_cuckoo_fp(h);
+  size_t i1 = (size_t)h & c->mask;
+  size_t i2 = _lc_cuckoo_alt(c, i1, fp);
+  return _lc_cuckoo_take(c, i1, fp) || _lc_cuckoo_take(c, i2, fp);
+}
+
+static inline void lc_cuckoo_prefetch(const lc_cuckoo *c, uint64_t h) {
+  size_t i1 = (size_t)h & c->mask;
+  lc_prefetch(c->buckets + i1);
+  lc_prefetch(c->buckets + _lc_cuckoo_alt(c, i1, _lc_cuckoo_fp(h)));
+}
+
+#endif // LC_CUCKOO_H
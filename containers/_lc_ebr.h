@@ -0,0 +1,223 @@
+#if !defined(LC_EBR_H)
+#define LC_EBR_H
+
+#include "_lc_templating.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Epoch-based reclamation for the lock-free containers.
+//
+// Readers of a lock-free structure may still hold a pointer to a node after
+// a writer unlinked it, so the node can not be freed right away. Every
+// access runs between lc_ebr_enter() and lc_ebr_exit(), which announce the
+// global epoch the thread observed. Unlinked objects are handed to
+// lc_ebr_retire() and parked in a per-thread limbo list tagged with the
+// current epoch. The epoch only advances once every thread inside a critical
+// section has observed it, so when it is two steps ahead of a list's tag no
+// thread can still reach the objects in it and they are released.
+//
+// Objects embed an lc_ebr_link whose 'free_fn' releases the whole object,
+// retiring never allocates. Each domain keeps one record per thread. A single
+// process-wide pthread key maps a thread to the list of records it owns, one
+// per domain it used, so any number of domains can coexist. Records of
+// exited threads are reused by new ones along with their pending limbo
+// lists; a record still owned when its domain is destroyed is freed by its
+// thread instead.
+
+#if !defined(PTHREAD_RWLOCK_INITIALIZER)
+#error "_lc_ebr.h needs POSIX threads, define _POSIX_C_SOURCE 200809L"
+#endif
+
+// Retired objects per thread between two attempts at advancing the epoch.
+#ifndef LC_EBR_COLLECT_EVERY
+#define LC_EBR_COLLECT_EVERY 64
+#endif // LC_EBR_COLLECT_EVERY
+
+typedef struct lc_ebr_link {
+  struct lc_ebr_link *next;
+  void (*free_fn)(struct lc_ebr_link *link);
+} lc_ebr_link;
+
+// States of a record: free for any thread, owned by a live thread, or owned
+// by a live thread while its domain is gone.
+enum { _LC_EBR_IDLE, _LC_EBR_OWNED, _LC_EBR_ORPHAN };
+
+typedef struct lc_ebr_thread {
+  _Atomic uint64_t epoch;      // observed epoch << 1 | 1 while active, or 0
+  atomic_int state;            // _LC_EBR_IDLE, _OWNED or _ORPHAN
+  unsigned nest;               // nested critical sections
+  unsigned retired;            // retired since the last collection
+  lc_ebr_link *limbo[3];       // retired objects, by epoch % 3
+  uint64_t limbo_epoch[3];     // epoch of the objects in each limbo list
+  const struct lc_ebr *domain; // domain the record belongs to
+  struct lc_ebr_thread *next;  // registry, records are never unlinked
+  struct lc_ebr_thread *owned; // next record of the owning thread
+} lc_ebr_thread;
+
+typedef struct lc_ebr {
+  _Atomic uint64_t epoch;
+  _Atomic(lc_ebr_thread *) threads;
+} lc_ebr;
+
+static pthread_once_t _lc_ebr_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _lc_ebr_key; // thread -> list of its records
+static bool _lc_ebr_key_ok;
+
+static inline void _lc_ebr_free_list(lc_ebr_link *link) {
+  while (link) {
+    lc_ebr_link *next = link->next;
+    link->free_fn(link);
+    link = next;
+  }
+}
+
+// pthread key destructor, gives the records back when their thread exits.
+static inline void _lc_ebr_release(void *list) {
+  lc_ebr_thread *t = (lc_ebr_thread *)list;
+  while (t) {
+    lc_ebr_thread *owned = t->owned;
+    atomic_store_explicit(&t->epoch, 0, memory_order_release);
+    if (atomic_exchange(&t->state, _LC_EBR_IDLE) == _LC_EBR_ORPHAN)
+      free(t);
+    t = owned;
+  }
+}
+
+static inline void _lc_ebr_key_create(void) {
+  _lc_ebr_key_ok = pthread_key_create(&_lc_ebr_key, _lc_ebr_release) == 0;
+}
+
+// Record of the calling thread in 'd', NULL when it can not be allocated.
+// The list of the thread is kept most recently used first and drops the
+// records of destroyed domains on the way.
+static inline lc_ebr_thread *_lc_ebr_self(lc_ebr *d) {
+  lc_ebr_thread *list = (lc_ebr_thread *)pthread_getspecific(_lc_ebr_key);
+  lc_ebr_thread **link = &list, *t;
+  while ((t = *link)) {
+    if (atomic_load(&t->state) == _LC_EBR_ORPHAN) {
+      *link = t->owned;
+      free(t);
+    } else if (t->domain == d) {
+      *link = t->owned;
+      break;
+    } else {
+      link = &t->owned;
+    }
+  }
+  if (!t) {
+    for (t = atomic_load(&d->threads); t; t = t->next) {
+      int idle = _LC_EBR_IDLE;
+      if (atomic_compare_exchange_strong(&t->state, &idle, _LC_EBR_OWNED))
+        break;
+    }
+  }
+  if (!t) {
+    t = lc_calloc(lc_ebr_thread, sizeof(lc_ebr_thread), 1);
+    if (!t) {
+      pthread_setspecific(_lc_ebr_key, list);
+      return NULL;
+    }
+    atomic_init(&t->state, _LC_EBR_OWNED);
+    t->domain = d;
+    t->next = atomic_load(&d->threads);
+    while (!atomic_compare_exchange_weak(&d->threads, &t->next, t))
+      ;
+  }
+  t->owned = list;
+  pthread_setspecific(_lc_ebr_key, t);
+  return t;
+}
+
+// False when the process-wide pthread key can not be created.
+static inline bool lc_ebr_init(lc_ebr *d) {
+  atomic_init(&d->epoch, 0);
+  atomic_init(&d->threads, NULL);
+  pthread_once(&_lc_ebr_once, _lc_ebr_key_create);
+  return _lc_ebr_key_ok;
+}
+
+// Frees every pending object. No thread may use the domain anymore.
+static inline void lc_ebr_destroy(lc_ebr *d) {
+  lc_ebr_thread *t = atomic_load(&d->threads);
+  while (t) {
+    lc_ebr_thread *next = t->next;
+    for (int i = 0; i < 3; i++) {
+      _lc_ebr_free_list(t->limbo[i]);
+      t->limbo[i] = NULL;
+    }
+    // Records still in a thread's list are freed by that thread.
+    if (atomic_exchange(&t->state, _LC_EBR_ORPHAN) == _LC_EBR_IDLE)
+      free(t);
+    t = next;
+  }
+  atomic_store(&d->threads, NULL);
+}
+
+// Starts a critical section, the returned record is passed to lc_ebr_exit()
+// and lc_ebr_retire(). Sections nest. NULL when the thread has no record in
+// 'd' yet and none can be allocated.
+static inline lc_ebr_thread *lc_ebr_enter(lc_ebr *d) {
+  lc_ebr_thread *t = _lc_ebr_self(d);
+  if (!t)
+    return NULL;
+  if (t->nest++)
+    return t;
+  // Publishing a stale epoch would let the global one run two steps ahead
+  // of this thread, so retry until the announcement is current.
+  uint64_t e = atomic_load(&d->epoch);
+  for (;;) {
+    atomic_store_explicit(&t->epoch, e << 1 | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t now = atomic_load(&d->epoch);
+    if (now == e)
+      return t;
+    e = now;
+  }
+}
+
+static inline void lc_ebr_exit(lc_ebr_thread *t) {
+  if (--t->nest == 0)
+    atomic_store_explicit(&t->epoch, 0, memory_order_release);
+}
+
+// Advances the global epoch when every active thread has observed it, then
+// frees the limbo lists of 't' that became unreachable.
+static inline void lc_ebr_collect(lc_ebr *d, lc_ebr_thread *t) {
+  uint64_t e = atomic_load(&d->epoch);
+  bool quiet = true;
+  for (lc_ebr_thread *r = atomic_load(&d->threads); r && quiet; r = r->next) {
+    uint64_t v = atomic_load(&r->epoch);
+    quiet = !(v & 1) || (v >> 1) == e;
+  }
+  if (quiet && atomic_compare_exchange_strong(&d->epoch, &e, e + 1))
+    e++;
+  for (int i = 0; i < 3; i++) {
+    if (t->limbo[i] && t->limbo_epoch[i] + 2 <= e) {
+      _lc_ebr_free_list(t->limbo[i]);
+      t->limbo[i] = NULL;
+    }
+  }
+}
+
+// Schedules 'link->free_fn' for when no thread can reach the object anymore.
+// The object must already be unreachable for threads entering from now on.
+static inline void lc_ebr_retire(lc_ebr *d, lc_ebr_thread *t,
+                                 lc_ebr_link *link) {
+  uint64_t e = atomic_load(&d->epoch);
+  int i = (int)(e % 3);
+  if (t->limbo_epoch[i] != e) {
+    // Tagged at most e - 3, two epochs behind already.
+    _lc_ebr_free_list(t->limbo[i]);
+    t->limbo[i] = NULL;
+    t->limbo_epoch[i] = e;
+  }
+  link->next = t->limbo[i];
+  t->limbo[i] = link;
+  if (++t->retired >= LC_EBR_COLLECT_EVERY) {
+    t->retired = 0;
+    lc_ebr_collect(d, t);
+  }
+}
+
+#endif // LC_EBR_H
@@ -0,0 +1,103 @@
+#if !defined(LC_GROUP_H)
+#define LC_GROUP_H
+
+#include "_lc_templating.h"
+
+// Control byte helpers shared by the open-addressing hash containers.
+//
+// Every slot of an open-addressing table has a matching control byte:
+// LC_CTRL_EMPTY (high bit set) for free slots, or the 7 low bits of the key
+// hash (H2) for occupied ones. Lookups load LC_GROUP_WIDTH control bytes at a
+// time and compare them all at once, using AVX2 (32 slots), SSE2 (16 slots)
+// or a portable SWAR fallback (8 slots) depending on the target.
+//
+// A group mask has one bit set per matching slot; lc_mask_lowest() returns the
+// offset of the first match inside the group and `m &= m - 1` moves to the
+// next one on every backend.
+
+#define LC_CTRL_EMPTY ((uint8_t)0x80)
+
+#define lc_hash_h1(h) ((size_t)(h))
+#define lc_hash_h2(h) ((uint8_t)((h) >> 57))
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define LC_GROUP_WIDTH 32
+#define LC_GROUP_SHIFT 0
+typedef uint32_t lc_group_mask;
+
+static inline lc_group_mask lc_group_match(const uint8_t *ctrl, uint8_t h2) {
+  __m256i g = _mm256_loadu_si256((const __m256i *)ctrl);
+  __m256i m = _mm256_cmpeq_epi8(g, _mm256_set1_epi8((char)h2));
+  return (lc_group_mask)_mm256_movemask_epi8(m);
+}
+
+static inline lc_group_mask lc_group_match_empty(const uint8_t *ctrl) {
+  __m256i g = _mm256_loadu_si256((const __m256i *)ctrl);
+  return (lc_group_mask)_mm256_movemask_epi8(g);
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define LC_GROUP_WIDTH 16
+#define LC_GROUP_SHIFT 0
+typedef uint32_t lc_group_mask;
+
+static inline lc_group_mask lc_group_match(const uint8_t *ctrl, uint8_t h2) {
+  __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+  __m128i m = _mm_cmpeq_epi8(g, _mm_set1_epi8((char)h2));
+  return (lc_group_mask)_mm_movemask_epi8(m);
+}
+
+static inline lc_group_mask lc_group_match_empty(const uint8_t *ctrl) {
+  __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+  return (lc_group_mask)_mm_movemask_epi8(g);
+}
+
+#else
+
+// Portable fallback: 8 control bytes packed in a 64 bit word, one flag per
+// byte kept in its high bit. The zero-byte trick used by lc_group_match can
+// report false positives on bytes that follow a real match, which is fine
+// since every candidate is confirmed with a full key comparison.
+#define LC_GROUP_WIDTH 8
+#define LC_GROUP_SHIFT 3
+typedef uint64_t lc_group_mask;
+
+static inline uint64_t _lc_group_load(const uint8_t *ctrl) {
+  uint64_t w;
+  memcpy(&w, ctrl, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  return w;
+}
+
+static inline lc_group_mask lc_group_match(const uint8_t *ctrl, uint8_t h2) {
+  const uint64_t lsbs = 0x0101010101010101ULL;
+  uint64_t x = _lc_group_load(ctrl) ^ (lsbs * h2);
+  return (x - lsbs) & ~x & (lsbs << 7);
+}
+
+static inline lc_group_mask lc_group_match_empty(const uint8_t *ctrl) {
+  return _lc_group_load(ctrl) & 0x8080808080808080ULL;
+}
+
+#endif
+
+static inline size_t lc_mask_lowest(lc_group_mask m) {
+  return (size_t)__builtin_ctzll((unsigned long long)m) >> LC_GROUP_SHIFT;
+}
+
+// Tables keep LC_GROUP_WIDTH extra control bytes mirroring the first ones so
+// that a group load starting near the end of the array wraps around for free.
+static inline void lc_ctrl_set(uint8_t *ctrl, size_t capacity, size_t i,
+                               uint8_t v) {
+  ctrl[i] = v;
+  if (i < LC_GROUP_WIDTH)
+    ctrl[capacity + i] = v;
+}
+
+#endif // LC_GROUP_H
@@ -0,0 +1,106 @@
+#if !defined(LC_HASH_H)
+#define LC_HASH_H
+
+#include "_lc_templating.h"
+
+// Built-in hash functions for the hash containers.
+//
+// lc_hash_int is the default 'lcore_hash_fn': a single 64x64->128 bit
+// multiply by the golden ratio folded back onto itself, so every input bit
+// reaches both the low bits used to pick a bucket and the high bits used as
+// a fingerprint. Keys sharing a low-bit pattern (pointers, multiples of 64,
+// timestamps) therefore spread over the whole table.
+//
+// lc_hash_bytes is a wyhash-style hasher for strings and arbitrary byte
+// ranges. Pick one of the following right before including a container:
+//
+// #define lcore_hash_fn(x) lc_hash_ptr(x)  // pointer keys
+// #define lcore_hash_fn(x) lc_hash_str(x)  // NUL terminated strings
+// #define lcore_hash_fn(x) lc_hash_pod(x)  // fixed size structs (no padding)
+
+#define LC_HASH_GOLDEN 0x9e3779b97f4a7c15ULL
+
+// Multiplies 'a' and 'b' into 128 bits and folds the halves together.
+static inline uint64_t lc_hash_mix(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  return lo ^ hi;
+#endif
+}
+
+static inline uint64_t lc_hash_int(uint64_t x) {
+  return lc_hash_mix(x ^ LC_HASH_GOLDEN, LC_HASH_GOLDEN);
+}
+
+#define lc_hash_ptr(p) lc_hash_int((uint64_t)(uintptr_t)(p))
+
+static inline uint64_t _lc_hash_r8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t _lc_hash_r4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t lc_hash_bytes(const void *key, size_t len) {
+  static const uint64_t s[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+                                0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+  const uint8_t *p = (const uint8_t *)key;
+  uint64_t seed = lc_hash_mix(s[0], s[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      size_t k = (len >> 3) << 2;
+      a = (_lc_hash_r4(p) << 32) | _lc_hash_r4(p + k);
+      b = (_lc_hash_r4(p + len - 4) << 32) | _lc_hash_r4(p + len - 4 - k);
+    } else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = lc_hash_mix(_lc_hash_r8(p) ^ s[1], _lc_hash_r8(p + 8) ^ seed);
+        see1 = lc_hash_mix(_lc_hash_r8(p + 16) ^ s[2],
+                           _lc_hash_r8(p + 24) ^ see1);
+        see2 = lc_hash_mix(_lc_hash_r8(p + 32) ^ s[3],
+                           _lc_hash_r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = lc_hash_mix(_lc_hash_r8(p) ^ s[1], _lc_hash_r8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = _lc_hash_r8(p + i - 16);
+    b = _lc_hash_r8(p + i - 8);
+  }
+  return lc_hash_mix(s[1] ^ len, lc_hash_mix(a ^ s[1], b ^ seed));
+}
+
+static inline uint64_t lc_hash_str(const char *str) {
+  return lc_hash_bytes(str, strlen(str));
+}
+
+#define lc_hash_pod(x) lc_hash_bytes(&(x), sizeof(x))
+
+#endif // LC_HASH_H
@@ -0,0 +1,178 @@
+#if !defined(LC_PERSIST_H)
+#define LC_PERSIST_H
+
+#include "_lc_templating.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// On-disk images of the flat containers, shared by vector.h and the
+// open-addressing hash tables when 'lcore_persist' is defined.
+//
+// An image is a header followed by the raw arrays of the container (the
+// elements of a vector, the control bytes and the slots of a table), each
+// starting on a LC_PERSIST_ALIGN boundary and located by its offset from the
+// start of the file. There are no pointers in it, so it can be mapped at any
+// address and the container points straight into the mapping: opening costs
+// one mmap and the pages are faulted in on first use.
+//
+// The header records everything the layout depends on (format version,
+// container kind, element size, byte order and control group width), images
+// written by an incompatible build are rejected. The hash function and the
+// element type itself can not be checked: the same instantiation has to
+// write and read an image, and T must not hold pointers.
+//
+// Images are trusted: a corrupted one is only checked for consistent sizes.
+
+#if !defined(MAP_FAILED) || !defined(O_CLOEXEC)
+#error "lcore_persist needs POSIX mmap, define _POSIX_C_SOURCE 200809L"
+#endif
+
+#define LC_PERSIST_MAGIC "LCIMAGE"
+#define LC_PERSIST_VERSION 1
+#define LC_PERSIST_ALIGN 64
+#define LC_PERSIST_SECTIONS 2
+
+// Container kinds.
+#define LC_PERSIST_VECTOR 1
+#define LC_PERSIST_USET 2
+#define LC_PERSIST_UMAP 3
+
+// How open_mmap() maps an image.
+typedef enum {
+  LC_PERSIST_READONLY, // shared read-only pages, the container must not change
+  LC_PERSIST_PRIVATE,  // copy-on-write, changes never reach the file
+} lc_persist_mode;
+
+typedef struct {
+  char magic[8];           // LC_PERSIST_MAGIC
+  uint32_t version;        // LC_PERSIST_VERSION
+  uint32_t kind;           // LC_PERSIST_*
+  uint32_t byte_order;     // 0x01020304 as stored by the writer
+  uint32_t group_width;    // LC_GROUP_WIDTH of the writer, 0 for vectors
+  uint64_t elem_size;      // bytes per element or slot
+  uint64_t size;           // number of elements
+  uint64_t capacity;       // number of slots, 'size' for vectors
+  uint64_t offset[LC_PERSIST_SECTIONS]; // from the start of the file
+  uint64_t length[LC_PERSIST_SECTIONS]; // in bytes
+} lc_persist_header;
+
+// A file mapping owned by a container, addr is NULL when there is none.
+typedef struct {
+  void *addr;
+  size_t len;
+} lc_mapping;
+
+static inline bool _lc_persist_write_all(int fd, const void *buf, size_t n) {
+  const char *p = (const char *)buf;
+  while (n) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0)
+      return false;
+    p += w;
+    n -= (size_t)w;
+  }
+  return true;
+}
+
+// Writes 'hdr' and its sections to 'path'. The image is written to a
+// temporary file that replaces 'path' once complete, so readers never see a
+// partial one and mappings of the previous image stay valid.
+static inline bool lc_persist_save(const char *path, lc_persist_header *hdr,
+                                   const void *const *sections) {
+  static const char zeros[LC_PERSIST_ALIGN] = {0};
+  memcpy(hdr->magic, LC_PERSIST_MAGIC, sizeof(hdr->magic));
+  hdr->version = LC_PERSIST_VERSION;
+  hdr->byte_order = 0x01020304;
+  uint64_t end = sizeof(*hdr);
+  for (int s = 0; s < LC_PERSIST_SECTIONS; s++) {
+    end = (end + LC_PERSIST_ALIGN - 1) & ~(uint64_t)(LC_PERSIST_ALIGN - 1);
+    hdr->offset[s] = hdr->length[s] ? end : 0;
+    end += hdr->length[s];
+  }
+  size_t len = strlen(path);
+  char *tmp = lc_malloc(char, len + sizeof(".tmp"));
+  if (!tmp)
+    return false;
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0 && _lc_persist_write_all(fd, hdr, sizeof(*hdr));
+  uint64_t at = sizeof(*hdr);
+  for (int s = 0; ok && s < LC_PERSIST_SECTIONS; s++) {
+    if (!hdr->length[s])
+      continue;
+    ok = _lc_persist_write_all(fd, zeros, (size_t)(hdr->offset[s] - at)) &&
+         _lc_persist_write_all(fd, sections[s], (size_t)hdr->length[s]);
+    at = hdr->offset[s] + hdr->length[s];
+  }
+  ok = ok && fsync(fd) == 0;
+  if (fd >= 0)
+    ok = close(fd) == 0 && ok;
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok && fd >= 0)
+    unlink(tmp);
+  free(tmp);
+  return ok;
+}
+
+// Maps the image at 'path' and checks that it was written for a container
+// of this 'kind', 'elem_size' and 'group_width'. Returns its header, which
+// is also the start of 'map', or NULL.
+static inline const lc_persist_header *
+lc_persist_open(const char *path, lc_persist_mode mode, uint32_t kind,
+                uint64_t elem_size, uint32_t group_width, lc_mapping *map) {
+  map->addr = NULL;
+  map->len = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (uint64_t)st.st_size < sizeof(lc_persist_header)) {
+    close(fd);
+    return NULL;
+  }
+  size_t len = (size_t)st.st_size;
+  void *addr = mode == LC_PERSIST_READONLY
+                   ? mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0)
+                   : mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                          0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return NULL;
+  const lc_persist_header *hdr = (const lc_persist_header *)addr;
+  bool ok = memcmp(hdr->magic, LC_PERSIST_MAGIC, sizeof(hdr->magic)) == 0 &&
+            hdr->version == LC_PERSIST_VERSION && hdr->kind == kind &&
+            hdr->byte_order == 0x01020304 &&
+            hdr->group_width == group_width && hdr->elem_size == elem_size &&
+            hdr->size <= hdr->capacity;
+  for (int s = 0; ok && s < LC_PERSIST_SECTIONS; s++)
+    ok = hdr->offset[s] % LC_PERSIST_ALIGN == 0 && hdr->offset[s] <= len &&
+         hdr->length[s] <= len - hdr->offset[s];
+  if (!ok) {
+    munmap(addr, len);
+    return NULL;
+  }
+  map->addr = addr;
+  map->len = len;
+  return hdr;
+}
+
+// Start of section 's' of a mapped image.
+static inline void *lc_persist_section(lc_mapping *map, int s) {
+  const lc_persist_header *hdr = (const lc_persist_header *)map->addr;
+  return (char *)map->addr + hdr->offset[s];
+}
+
+static inline void lc_persist_unmap(lc_mapping *map) {
+  if (map->addr)
+    munmap(map->addr, map->len);
+  map->addr = NULL;
+  map->len = 0;
+}
+
+#endif // LC_PERSIST_H
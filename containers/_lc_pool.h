@@ -0,0 +1,107 @@
+#if !defined(LC_POOL_H)
+#define LC_POOL_H
+
+#include "_lc_templating.h"
+
+// Fixed-size object pool used by the node based containers when
+// 'lcore_node_pool' is defined before including them.
+//
+// Objects are carved out of large slab chunks (no per-object malloc header)
+// and released objects go to an intrusive free list that is reused before
+// touching the slabs again. Chunk sizes double up to LC_POOL_MAX_CHUNK, so a
+// pool holding millions of nodes owns only a few dozen chunks and
+// lc_pool_release() gives all of them back with a handful of free() calls.
+
+#ifndef LC_POOL_MIN_CHUNK
+#define LC_POOL_MIN_CHUNK (4096)
+#endif // LC_POOL_MIN_CHUNK
+
+#ifndef LC_POOL_MAX_CHUNK
+#define LC_POOL_MAX_CHUNK (64 << 20)
+#endif // LC_POOL_MAX_CHUNK
+
+// Chunk header, padded so the objects that follow are suitably aligned.
+typedef union lc_pool_chunk {
+  union lc_pool_chunk *next;
+  max_align_t _align;
+} lc_pool_chunk;
+
+typedef struct lc_pool {
+  void *free_list;       // released objects, linked through their first word
+  lc_pool_chunk *chunks; // every chunk owned by the pool
+  char *bump, *bump_end; // unused tail of the newest chunk
+  size_t obj_size;       // size of a single object
+  size_t chunk_size;     // size of the next chunk to allocate
+} lc_pool;
+
+static inline void lc_pool_init(lc_pool *pool, size_t obj_size) {
+  memset(pool, 0, sizeof(*pool));
+  pool->obj_size = obj_size < sizeof(void *) ? sizeof(void *) : obj_size;
+  pool->chunk_size = LC_POOL_MIN_CHUNK;
+}
+
+static inline void *lc_pool_alloc(lc_pool *pool) {
+  if (pool->free_list) {
+    void *obj = pool->free_list;
+    pool->free_list = *(void **)obj;
+    return obj;
+  }
+  if ((size_t)(pool->bump_end - pool->bump) < pool->obj_size) {
+    size_t size = pool->chunk_size;
+    if (size < sizeof(lc_pool_chunk) + pool->obj_size)
+      size = sizeof(lc_pool_chunk) + pool->obj_size;
+    lc_pool_chunk *chunk = lc_malloc(lc_pool_chunk, size);
+    if (!chunk)
+      return NULL;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->bump = (char *)(chunk + 1);
+    pool->bump_end = (char *)chunk + size;
+    if (pool->chunk_size < LC_POOL_MAX_CHUNK)
+      pool->chunk_size <<= 1;
+  }
+  void *obj = pool->bump;
+  pool->bump += pool->obj_size;
+  return obj;
+}
+
+static inline void lc_pool_free(lc_pool *pool, void *obj) {
+  *(void **)obj = pool->free_list;
+  pool->free_list = obj;
+}
+
+// Moves every chunk and released object of 'src' (same object size) into
+// 'dst', used when nodes migrate from one container to another. 'src' is left
+// empty and the unused tail of its newest chunk is lost until 'dst' is
+// released.
+static inline void lc_pool_adopt(lc_pool *dst, lc_pool *src) {
+  assert(dst->obj_size == src->obj_size);
+  if (src->chunks) {
+    lc_pool_chunk *last = src->chunks;
+    while (last->next)
+      last = last->next;
+    last->next = dst->chunks;
+    dst->chunks = src->chunks;
+  }
+  if (src->free_list) {
+    void *last = src->free_list;
+    while (*(void **)last)
+      last = *(void **)last;
+    *(void **)last = dst->free_list;
+    dst->free_list = src->free_list;
+  }
+  lc_pool_init(src, src->obj_size);
+}
+
+// Frees every chunk at once, all the objects handed out become invalid.
+static inline void lc_pool_release(lc_pool *pool) {
+  lc_pool_chunk *chunk = pool->chunks;
+  while (chunk) {
+    lc_pool_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  lc_pool_init(pool, pool->obj_size);
+}
+
+#endif // LC_POOL_H
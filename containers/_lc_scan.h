@@ -0,0 +1,907 @@
+#if !defined(LC_SCAN_H)
+#define LC_SCAN_H
+
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Vectorized linear scans over arrays of primitive numbers, used by vector.h
+// for find(), count(), min(), max() and sum().
+//
+// Every kernel comes in an SSE2 and an AVX2 flavor. On x86-64 SSE2 is always
+// there, AVX2 is used when the target has it (-mavx2, -march=native) or,
+// with GCC and Clang, when the CPU running the program reports it: the AVX2
+// kernels are then compiled with a target attribute and picked at run time.
+// Other architectures use the scalar loops only.
+//
+// The SIMD kernels process a prefix of the array and return its length, the
+// lc_scan_* wrappers finish the remaining elements one by one. Integers are
+// handled as raw 32 and 64 bit words: equality and wrapping sums ignore the
+// sign, and min/max xor every word with a mask first so a signed compare
+// yields the wanted order (the sign bit for unsigned words, all bits to turn
+// a minimum into a maximum). Floats flip their sign bit for max instead.
+//
+// Float sums are accumulated in several lanes, so they are rounded
+// differently from a left to right loop. min() and max() of floats are
+// unspecified when the array holds NaNs.
+
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(_M_X64))
+#define LC_SCAN_X86
+#include <immintrin.h>
+#if defined(__AVX2__)
+#define _lc_avx2_fn static inline
+#define _lc_have_avx2() 1
+#elif defined(__GNUC__)
+#define _lc_avx2_fn __attribute__((target("avx2"))) static inline
+#define _lc_have_avx2() __builtin_cpu_supports("avx2")
+#else
+#define _lc_avx2_fn static inline
+#define _lc_have_avx2() 0
+#endif
+#endif // __SSE2__ && x86-64
+
+// Counts are kept in 32 bit lanes and folded every _LC_SCAN_CHUNK elements.
+#define _LC_SCAN_CHUNK ((size_t)1 << 24)
+
+#if defined(LC_SCAN_X86)
+#define _lc_scan_simd(fn, ...)                                                 \
+  (_lc_have_avx2() ? _lc_join(fn, avx2)(__VA_ARGS__)                           \
+                   : _lc_join(fn, sse2)(__VA_ARGS__))
+#else
+#define _lc_scan_simd(fn, ...) ((size_t)0)
+#endif // LC_SCAN_X86
+
+#if defined(LC_SCAN_X86)
+
+// ================ SSE2 KERNELS ================ //
+
+static inline size_t _lc_scan_find32_sse2(const uint32_t *a, size_t n,
+                                          uint32_t key) {
+  __m128i k = _mm_set1_epi32((int32_t)key);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(a + i + 4));
+    __m128i e = _mm_or_si128(_mm_cmpeq_epi32(x, k), _mm_cmpeq_epi32(y, k));
+    if (_mm_movemask_epi8(e))
+      break;
+  }
+  return i;
+}
+
+static inline size_t _lc_scan_count32_sse2(const uint32_t *a, size_t n,
+                                           uint32_t key, size_t *count) {
+  __m128i k = _mm_set1_epi32((int32_t)key);
+  size_t i = 0;
+  while (i + 8 <= n) {
+    size_t end = n - i > _LC_SCAN_CHUNK ? i + _LC_SCAN_CHUNK : n;
+    __m128i c = _mm_setzero_si128();
+    for (; i + 8 <= end; i += 8) {
+      __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+      __m128i y = _mm_loadu_si128((const __m128i *)(a + i + 4));
+      c = _mm_sub_epi32(c, _mm_cmpeq_epi32(x, k));
+      c = _mm_sub_epi32(c, _mm_cmpeq_epi32(y, k));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, c);
+    *count += (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  return i;
+}
+
+static inline size_t _lc_scan_min32_sse2(const uint32_t *a, size_t n,
+                                         uint32_t mask, uint32_t *best) {
+  __m128i m = _mm_set1_epi32((int32_t)mask);
+  __m128i b = _mm_set1_epi32((int32_t)*best);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)), m);
+    __m128i lt = _mm_cmpgt_epi32(b, x);
+    b = _mm_or_si128(_mm_and_si128(lt, x), _mm_andnot_si128(lt, b));
+  }
+  int32_t lanes[4];
+  _mm_storeu_si128((__m128i *)lanes, b);
+  for (int l = 0; l < 4; l++)
+    if (lanes[l] < (int32_t)*best)
+      *best = (uint32_t)lanes[l];
+  return i;
+}
+
+static inline size_t _lc_scan_sum32_sse2(const uint32_t *a, size_t n,
+                                         uint32_t *sum) {
+  __m128i s0 = _mm_setzero_si128();
+  __m128i s1 = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm_add_epi32(s0, _mm_loadu_si128((const __m128i *)(a + i)));
+    s1 = _mm_add_epi32(s1, _mm_loadu_si128((const __m128i *)(a + i + 4)));
+  }
+  uint32_t lanes[4];
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi32(s0, s1));
+  *sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return i;
+}
+
+// 64 bit words compare equal when both of their halves do.
+static inline __m128i _lc_scan_cmpeq64_sse2(__m128i x, __m128i k) {
+  __m128i e = _mm_cmpeq_epi32(x, k);
+  return _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static inline size_t _lc_scan_find64_sse2(const uint64_t *a, size_t n,
+                                          uint64_t key) {
+  __m128i k = _mm_set1_epi64x((int64_t)key);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(a + i + 2));
+    __m128i e = _mm_or_si128(_lc_scan_cmpeq64_sse2(x, k),
+                             _lc_scan_cmpeq64_sse2(y, k));
+    if (_mm_movemask_epi8(e))
+      break;
+  }
+  return i;
+}
+
+static inline size_t _lc_scan_count64_sse2(const uint64_t *a, size_t n,
+                                           uint64_t key, size_t *count) {
+  __m128i k = _mm_set1_epi64x((int64_t)key);
+  __m128i c = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(a + i + 2));
+    c = _mm_sub_epi64(c, _lc_scan_cmpeq64_sse2(x, k));
+    c = _mm_sub_epi64(c, _lc_scan_cmpeq64_sse2(y, k));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, c);
+  *count += (size_t)(lanes[0] + lanes[1]);
+  return i;
+}
+
+// SSE2 has no 64 bit compare, the scalar loop does the whole array.
+static inline size_t _lc_scan_min64_sse2(const uint64_t *a, size_t n,
+                                         uint64_t mask, uint64_t *best) {
+  (void)a;
+  (void)n;
+  (void)mask;
+  (void)best;
+  return 0;
+}
+
+static inline size_t _lc_scan_sum64_sse2(const uint64_t *a, size_t n,
+                                         uint64_t *sum) {
+  __m128i s0 = _mm_setzero_si128();
+  __m128i s1 = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_epi64(s0, _mm_loadu_si128((const __m128i *)(a + i)));
+    s1 = _mm_add_epi64(s1, _mm_loadu_si128((const __m128i *)(a + i + 2)));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(s0, s1));
+  *sum += lanes[0] + lanes[1];
+  return i;
+}
+
+static inline size_t _lc_scan_findf_sse2(const float *a, size_t n,
+                                         float key) {
+  __m128 k = _mm_set1_ps(key);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 e = _mm_or_ps(_mm_cmpeq_ps(_mm_loadu_ps(a + i), k),
+                         _mm_cmpeq_ps(_mm_loadu_ps(a + i + 4), k));
+    if (_mm_movemask_ps(e))
+      break;
+  }
+  return i;
+}
+
+static inline size_t _lc_scan_countf_sse2(const float *a, size_t n, float key,
+                                          size_t *count) {
+  __m128 k = _mm_set1_ps(key);
+  size_t i = 0;
+  while (i + 8 <= n) {
+    size_t end = n - i > _LC_SCAN_CHUNK ? i + _LC_SCAN_CHUNK : n;
+    __m128i c = _mm_setzero_si128();
+    for (; i + 8 <= end; i += 8) {
+      __m128 x = _mm_cmpeq_ps(_mm_loadu_ps(a + i), k);
+      __m128 y = _mm_cmpeq_ps(_mm_loadu_ps(a + i + 4), k);
+      c = _mm_sub_epi32(c, _mm_castps_si128(x));
+      c = _mm_sub_epi32(c, _mm_castps_si128(y));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, c);
+    *count += (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  return i;
+}
+
+static inline size_t _lc_scan_minf_sse2(const float *a, size_t n, float sign,
+                                        float *best) {
+  __m128 m = _mm_set1_ps(sign);
+  __m128 b0 = _mm_set1_ps(*best);
+  __m128 b1 = b0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    b0 = _mm_min_ps(b0, _mm_xor_ps(_mm_loadu_ps(a + i), m));
+    b1 = _mm_min_ps(b1, _mm_xor_ps(_mm_loadu_ps(a + i + 4), m));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_min_ps(b0, b1));
+  for (int l = 0; l < 4; l++)
+    if (lanes[l] < *best)
+      *best = lanes[l];
+  return i;
+}
+
+static inline size_t _lc_scan_sumf_sse2(const float *a, size_t n,
+                                        float *sum) {
+  __m128 s0 = _mm_setzero_ps();
+  __m128 s1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_loadu_ps(a + i));
+    s1 = _mm_add_ps(s1, _mm_loadu_ps(a + i + 4));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+  *sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  return i;
+}
+
+static inline size_t _lc_scan_findd_sse2(const double *a, size_t n,
+                                         double key) {
+  __m128d k = _mm_set1_pd(key);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d e = _mm_or_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i), k),
+                          _mm_cmpeq_pd(_mm_loadu_pd(a + i + 2), k));
+    if (_mm_movemask_pd(e))
+      break;
+  }
+  return i;
+}
+
+static inline size_t _lc_scan_countd_sse2(const double *a, size_t n,
+                                          double key, size_t *count) {
+  __m128d k = _mm_set1_pd(key);
+  __m128i c = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d x = _mm_cmpeq_pd(_mm_loadu_pd(a + i), k);
+    __m128d y = _mm_cmpeq_pd(_mm_loadu_pd(a + i + 2), k);
+    c = _mm_sub_epi64(c, _mm_castpd_si128(x));
+    c = _mm_sub_epi64(c, _mm_castpd_si128(y));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, c);
+  *count += (size_t)(lanes[0] + lanes[1]);
+  return i;
+}
+
+static inline size_t _lc_scan_mind_sse2(const double *a, size_t n,
+                                        double sign, double *best) {
+  __m128d m = _mm_set1_pd(sign);
+  __m128d b0 = _mm_set1_pd(*best);
+  __m128d b1 = b0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    b0 = _mm_min_pd(b0, _mm_xor_pd(_mm_loadu_pd(a + i), m));
+    b1 = _mm_min_pd(b1, _mm_xor_pd(_mm_loadu_pd(a + i + 2), m));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_min_pd(b0, b1));
+  for (int l = 0; l < 2; l++)
+    if (lanes[l] < *best)
+      *best = lanes[l];
+  return i;
+}
+
+static inline size_t _lc_scan_sumd_sse2(const double *a, size_t n,
+                                        double *sum) {
+  __m128d s0 = _mm_setzero_pd();
+  __m128d s1 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+    s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+  *sum += lanes[0] + lanes[1];
+  return i;
+}
+
+// ================ AVX2 KERNELS ================ //
+// Two vectors per iteration, so two loads are in flight per step.
+
+_lc_avx2_fn size_t _lc_scan_find32_avx2(const uint32_t *a, size_t n,
+                                        uint32_t key) {
+  __m256i k = _mm256_set1_epi32((int32_t)key);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(a + i + 8));
+    __m256i e =
+        _mm256_or_si256(_mm256_cmpeq_epi32(x, k), _mm256_cmpeq_epi32(y, k));
+    if (!_mm256_testz_si256(e, e))
+      break;
+  }
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_count32_avx2(const uint32_t *a, size_t n,
+                                         uint32_t key, size_t *count) {
+  __m256i k = _mm256_set1_epi32((int32_t)key);
+  size_t i = 0;
+  while (i + 16 <= n) {
+    size_t end = n - i > _LC_SCAN_CHUNK ? i + _LC_SCAN_CHUNK : n;
+    __m256i c = _mm256_setzero_si256();
+    for (; i + 16 <= end; i += 16) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+      __m256i y = _mm256_loadu_si256((const __m256i *)(a + i + 8));
+      c = _mm256_sub_epi32(c, _mm256_cmpeq_epi32(x, k));
+      c = _mm256_sub_epi32(c, _mm256_cmpeq_epi32(y, k));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, c);
+    for (int l = 0; l < 8; l++)
+      *count += lanes[l];
+  }
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_min32_avx2(const uint32_t *a, size_t n,
+                                       uint32_t mask, uint32_t *best) {
+  __m256i m = _mm256_set1_epi32((int32_t)mask);
+  __m256i b0 = _mm256_set1_epi32((int32_t)*best);
+  __m256i b1 = b0;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(a + i + 8));
+    b0 = _mm256_min_epi32(b0, _mm256_xor_si256(x, m));
+    b1 = _mm256_min_epi32(b1, _mm256_xor_si256(y, m));
+  }
+  int32_t lanes[8];
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_min_epi32(b0, b1));
+  for (int l = 0; l < 8; l++)
+    if (lanes[l] < (int32_t)*best)
+      *best = (uint32_t)lanes[l];
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_sum32_avx2(const uint32_t *a, size_t n,
+                                       uint32_t *sum) {
+  __m256i s0 = _mm256_setzero_si256();
+  __m256i s1 = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm256_add_epi32(s0, _mm256_loadu_si256((const __m256i *)(a + i)));
+    s1 = _mm256_add_epi32(s1,
+                          _mm256_loadu_si256((const __m256i *)(a + i + 8)));
+  }
+  uint32_t lanes[8];
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(s0, s1));
+  for (int l = 0; l < 8; l++)
+    *sum += lanes[l];
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_find64_avx2(const uint64_t *a, size_t n,
+                                        uint64_t key) {
+  __m256i k = _mm256_set1_epi64x((int64_t)key);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(a + i + 4));
+    __m256i e =
+        _mm256_or_si256(_mm256_cmpeq_epi64(x, k), _mm256_cmpeq_epi64(y, k));
+    if (!_mm256_testz_si256(e, e))
+      break;
+  }
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_count64_avx2(const uint64_t *a, size_t n,
+                                         uint64_t key, size_t *count) {
+  __m256i k = _mm256_set1_epi64x((int64_t)key);
+  __m256i c = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(a + i + 4));
+    c = _mm256_sub_epi64(c, _mm256_cmpeq_epi64(x, k));
+    c = _mm256_sub_epi64(c, _mm256_cmpeq_epi64(y, k));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, c);
+  *count += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_min64_avx2(const uint64_t *a, size_t n,
+                                       uint64_t mask, uint64_t *best) {
+  __m256i m = _mm256_set1_epi64x((int64_t)mask);
+  __m256i b0 = _mm256_set1_epi64x((int64_t)*best);
+  __m256i b1 = b0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)(a + i)), m);
+    __m256i y = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i *)(a + i + 4)), m);
+    b0 = _mm256_blendv_epi8(b0, x, _mm256_cmpgt_epi64(b0, x));
+    b1 = _mm256_blendv_epi8(b1, y, _mm256_cmpgt_epi64(b1, y));
+  }
+  int64_t lanes[8];
+  _mm256_storeu_si256((__m256i *)lanes, b0);
+  _mm256_storeu_si256((__m256i *)(lanes + 4), b1);
+  for (int l = 0; l < 8; l++)
+    if (lanes[l] < (int64_t)*best)
+      *best = (uint64_t)lanes[l];
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_sum64_avx2(const uint64_t *a, size_t n,
+                                       uint64_t *sum) {
+  __m256i s0 = _mm256_setzero_si256();
+  __m256i s1 = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_epi64(s0, _mm256_loadu_si256((const __m256i *)(a + i)));
+    s1 = _mm256_add_epi64(s1,
+                          _mm256_loadu_si256((const __m256i *)(a + i + 4)));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(s0, s1));
+  *sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_findf_avx2(const float *a, size_t n,
+                                       float key) {
+  __m256 k = _mm256_set1_ps(key);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 x = _mm256_cmp_ps(_mm256_loadu_ps(a + i), k, _CMP_EQ_OQ);
+    __m256 y = _mm256_cmp_ps(_mm256_loadu_ps(a + i + 8), k, _CMP_EQ_OQ);
+    if (_mm256_movemask_ps(_mm256_or_ps(x, y)))
+      break;
+  }
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_countf_avx2(const float *a, size_t n, float key,
+                                        size_t *count) {
+  __m256 k = _mm256_set1_ps(key);
+  size_t i = 0;
+  while (i + 16 <= n) {
+    size_t end = n - i > _LC_SCAN_CHUNK ? i + _LC_SCAN_CHUNK : n;
+    __m256i c = _mm256_setzero_si256();
+    for (; i + 16 <= end; i += 16) {
+      __m256 x = _mm256_cmp_ps(_mm256_loadu_ps(a + i), k, _CMP_EQ_OQ);
+      __m256 y = _mm256_cmp_ps(_mm256_loadu_ps(a + i + 8), k, _CMP_EQ_OQ);
+      c = _mm256_sub_epi32(c, _mm256_castps_si256(x));
+      c = _mm256_sub_epi32(c, _mm256_castps_si256(y));
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, c);
+    for (int l = 0; l < 8; l++)
+      *count += lanes[l];
+  }
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_minf_avx2(const float *a, size_t n, float sign,
+                                      float *best) {
+  __m256 m = _mm256_set1_ps(sign);
+  __m256 b0 = _mm256_set1_ps(*best);
+  __m256 b1 = b0;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    b0 = _mm256_min_ps(b0, _mm256_xor_ps(_mm256_loadu_ps(a + i), m));
+    b1 = _mm256_min_ps(b1, _mm256_xor_ps(_mm256_loadu_ps(a + i + 8), m));
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_min_ps(b0, b1));
+  for (int l = 0; l < 8; l++)
+    if (lanes[l] < *best)
+      *best = lanes[l];
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_sumf_avx2(const float *a, size_t n,
+                                      float *sum) {
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm256_add_ps(s0, _mm256_loadu_ps(a + i));
+    s1 = _mm256_add_ps(s1, _mm256_loadu_ps(a + i + 8));
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_add_ps(s0, s1));
+  *sum += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+          ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_findd_avx2(const double *a, size_t n,
+                                       double key) {
+  __m256d k = _mm256_set1_pd(key);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256d x = _mm256_cmp_pd(_mm256_loadu_pd(a + i), k, _CMP_EQ_OQ);
+    __m256d y = _mm256_cmp_pd(_mm256_loadu_pd(a + i + 4), k, _CMP_EQ_OQ);
+    if (_mm256_movemask_pd(_mm256_or_pd(x, y)))
+      break;
+  }
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_countd_avx2(const double *a, size_t n,
+                                        double key, size_t *count) {
+  __m256d k = _mm256_set1_pd(key);
+  __m256i c = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256d x = _mm256_cmp_pd(_mm256_loadu_pd(a + i), k, _CMP_EQ_OQ);
+    __m256d y = _mm256_cmp_pd(_mm256_loadu_pd(a + i + 4), k, _CMP_EQ_OQ);
+    c = _mm256_sub_epi64(c, _mm256_castpd_si256(x));
+    c = _mm256_sub_epi64(c, _mm256_castpd_si256(y));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, c);
+  *count += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_mind_avx2(const double *a, size_t n,
+                                      double sign, double *best) {
+  __m256d m = _mm256_set1_pd(sign);
+  __m256d b0 = _mm256_set1_pd(*best);
+  __m256d b1 = b0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    b0 = _mm256_min_pd(b0, _mm256_xor_pd(_mm256_loadu_pd(a + i), m));
+    b1 = _mm256_min_pd(b1, _mm256_xor_pd(_mm256_loadu_pd(a + i + 4), m));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_min_pd(b0, b1));
+  for (int l = 0; l < 4; l++)
+    if (lanes[l] < *best)
+      *best = lanes[l];
+  return i;
+}
+
+_lc_avx2_fn size_t _lc_scan_sumd_avx2(const double *a, size_t n,
+                                      double *sum) {
+  __m256d s0 = _mm256_setzero_pd();
+  __m256d s1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+    s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+  *sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  return i;
+}
+
+#endif // LC_SCAN_X86
+
+// ================ WORD SCANS ================== //
+
+static inline size_t _lc_scan_find_32(const uint32_t *a, size_t n,
+                                     uint32_t key) {
+  for (size_t i = _lc_scan_simd(_lc_scan_find32, a, n, key); i < n; i++)
+    if (a[i] == key)
+      return i;
+  return n;
+}
+
+static inline size_t _lc_scan_count_32(const uint32_t *a, size_t n,
+                                      uint32_t key) {
+  size_t count = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_count32, a, n, key, &count); i < n;
+       i++)
+    count += a[i] == key;
+  return count;
+}
+
+// Minimum of a[i] ^ mask as signed words, returned ^ mask. n > 0.
+static inline uint32_t _lc_scan_min_32(const uint32_t *a, size_t n,
+                                      uint32_t mask) {
+  uint32_t best = a[0] ^ mask;
+  for (size_t i = _lc_scan_simd(_lc_scan_min32, a, n, mask, &best); i < n;
+       i++)
+    if ((int32_t)(a[i] ^ mask) < (int32_t)best)
+      best = a[i] ^ mask;
+  return best ^ mask;
+}
+
+static inline uint32_t _lc_scan_sum_32(const uint32_t *a, size_t n) {
+  uint32_t sum = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_sum32, a, n, &sum); i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+static inline size_t _lc_scan_find_64(const uint64_t *a, size_t n,
+                                     uint64_t key) {
+  for (size_t i = _lc_scan_simd(_lc_scan_find64, a, n, key); i < n; i++)
+    if (a[i] == key)
+      return i;
+  return n;
+}
+
+static inline size_t _lc_scan_count_64(const uint64_t *a, size_t n,
+                                      uint64_t key) {
+  size_t count = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_count64, a, n, key, &count); i < n;
+       i++)
+    count += a[i] == key;
+  return count;
+}
+
+static inline uint64_t _lc_scan_min_64(const uint64_t *a, size_t n,
+                                      uint64_t mask) {
+  uint64_t best = a[0] ^ mask;
+  for (size_t i = _lc_scan_simd(_lc_scan_min64, a, n, mask, &best); i < n;
+       i++)
+    if ((int64_t)(a[i] ^ mask) < (int64_t)best)
+      best = a[i] ^ mask;
+  return best ^ mask;
+}
+
+static inline uint64_t _lc_scan_sum_64(const uint64_t *a, size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_sum64, a, n, &sum); i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+// max() negates every element by flipping its sign bit.
+static inline float _lc_scan_minf(const float *a, size_t n, bool max) {
+  float best = max ? -a[0] : a[0];
+  size_t i = _lc_scan_simd(_lc_scan_minf, a, n, max ? -0.0f : 0.0f, &best);
+  for (; i < n; i++) {
+    float x = max ? -a[i] : a[i];
+    if (x < best)
+      best = x;
+  }
+  return max ? -best : best;
+}
+
+static inline double _lc_scan_mind(const double *a, size_t n, bool max) {
+  double best = max ? -a[0] : a[0];
+  size_t i = _lc_scan_simd(_lc_scan_mind, a, n, max ? -0.0 : 0.0, &best);
+  for (; i < n; i++) {
+    double x = max ? -a[i] : a[i];
+    if (x < best)
+      best = x;
+  }
+  return max ? -best : best;
+}
+
+// ================ TYPED SCANS ================= //
+// lc_scan_<op>_<type>(a, n[, key]) for find, count, min, max and sum. find
+// returns the index of the first element equal to 'key' or 'n', min and max
+// need n > 0, integer sums wrap around.
+
+#define _LC_SCAN_INT(sfx, type, word, bits, bias)                              \
+  static inline size_t _lc_join(lc_scan_find, sfx)(const type *a, size_t n,    \
+                                                   type key) {                 \
+    return _lc_join(_lc_scan_find, bits)((const word *)a, n, (word)key);       \
+  }                                                                            \
+  static inline size_t _lc_join(lc_scan_count, sfx)(const type *a, size_t n,   \
+                                                    type key) {                \
+    return _lc_join(_lc_scan_count, bits)((const word *)a, n, (word)key);      \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_min, sfx)(const type *a, size_t n) {     \
+    return (type)_lc_join(_lc_scan_min, bits)((const word *)a, n, bias);       \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_max, sfx)(const type *a, size_t n) {     \
+    return (type)_lc_join(_lc_scan_min, bits)((const word *)a, n,              \
+                                              (word)~(word)(bias));            \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_sum, sfx)(const type *a, size_t n) {     \
+    return (type)_lc_join(_lc_scan_sum, bits)((const word *)a, n);             \
+  }
+
+_LC_SCAN_INT(i32, int32_t, uint32_t, 32, 0)
+_LC_SCAN_INT(u32, uint32_t, uint32_t, 32, 0x80000000u)
+_LC_SCAN_INT(i64, int64_t, uint64_t, 64, 0)
+_LC_SCAN_INT(u64, uint64_t, uint64_t, 64, 0x8000000000000000ull)
+
+#undef _LC_SCAN_INT
+
+static inline size_t lc_scan_find_f32(const float *a, size_t n, float key) {
+  for (size_t i = _lc_scan_simd(_lc_scan_findf, a, n, key); i < n; i++)
+    if (a[i] == key)
+      return i;
+  return n;
+}
+
+static inline size_t lc_scan_count_f32(const float *a, size_t n, float key) {
+  size_t count = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_countf, a, n, key, &count); i < n;
+       i++)
+    count += a[i] == key;
+  return count;
+}
+
+static inline float lc_scan_min_f32(const float *a, size_t n) {
+  return _lc_scan_minf(a, n, false);
+}
+
+static inline float lc_scan_max_f32(const float *a, size_t n) {
+  return _lc_scan_minf(a, n, true);
+}
+
+static inline float lc_scan_sum_f32(const float *a, size_t n) {
+  float sum = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_sumf, a, n, &sum); i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+static inline size_t lc_scan_find_f64(const double *a, size_t n,
+                                      double key) {
+  for (size_t i = _lc_scan_simd(_lc_scan_findd, a, n, key); i < n; i++)
+    if (a[i] == key)
+      return i;
+  return n;
+}
+
+static inline size_t lc_scan_count_f64(const double *a, size_t n,
+                                       double key) {
+  size_t count = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_countd, a, n, key, &count); i < n;
+       i++)
+    count += a[i] == key;
+  return count;
+}
+
+static inline double lc_scan_min_f64(const double *a, size_t n) {
+  return _lc_scan_mind(a, n, false);
+}
+
+static inline double lc_scan_max_f64(const double *a, size_t n) {
+  return _lc_scan_mind(a, n, true);
+}
+
+static inline double lc_scan_sum_f64(const double *a, size_t n) {
+  double sum = 0;
+  for (size_t i = _lc_scan_simd(_lc_scan_sumd, a, n, &sum); i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+// ============ OTHER ARITHMETIC TYPES ========== //
+// The remaining integer types of 32 or 64 bits use the kernels of the fixed
+// width type with the same size and signedness. Narrower integers and long
+// double take plain loops.
+
+#define _LC_SCAN_WORD(sfx, type)                                               \
+  static inline size_t _lc_join(lc_scan_find, sfx)(const type *a, size_t n,    \
+                                                   type key) {                 \
+    if (sizeof(type) == 4)                                                     \
+      return lc_scan_find_u32((const uint32_t *)a, n, (uint32_t)key);          \
+    return lc_scan_find_u64((const uint64_t *)a, n, (uint64_t)key);            \
+  }                                                                            \
+  static inline size_t _lc_join(lc_scan_count, sfx)(const type *a, size_t n,   \
+                                                    type key) {                \
+    if (sizeof(type) == 4)                                                     \
+      return lc_scan_count_u32((const uint32_t *)a, n, (uint32_t)key);         \
+    return lc_scan_count_u64((const uint64_t *)a, n, (uint64_t)key);           \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_min, sfx)(const type *a, size_t n) {     \
+    if (sizeof(type) == 4)                                                     \
+      return (type)-1 > 0 ? (type)lc_scan_min_u32((const uint32_t *)a, n)      \
+                          : (type)lc_scan_min_i32((const int32_t *)a, n);      \
+    return (type)-1 > 0 ? (type)lc_scan_min_u64((const uint64_t *)a, n)        \
+                        : (type)lc_scan_min_i64((const int64_t *)a, n);        \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_max, sfx)(const type *a, size_t n) {     \
+    if (sizeof(type) == 4)                                                     \
+      return (type)-1 > 0 ? (type)lc_scan_max_u32((const uint32_t *)a, n)      \
+                          : (type)lc_scan_max_i32((const int32_t *)a, n);      \
+    return (type)-1 > 0 ? (type)lc_scan_max_u64((const uint64_t *)a, n)        \
+                        : (type)lc_scan_max_i64((const int64_t *)a, n);        \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_sum, sfx)(const type *a, size_t n) {     \
+    if (sizeof(type) == 4)                                                     \
+      return (type)lc_scan_sum_u32((const uint32_t *)a, n);                    \
+    return (type)lc_scan_sum_u64((const uint64_t *)a, n);                      \
+  }                                                                            \
+  _Static_assert(sizeof(type) == 4 || sizeof(type) == 8,                       \
+                 #type " has no word kernel");
+
+#define _LC_SCAN_PLAIN(sfx, type)                                              \
+  static inline size_t _lc_join(lc_scan_find, sfx)(const type *a, size_t n,    \
+                                                   type key) {                 \
+    for (size_t i = 0; i < n; i++)                                             \
+      if (a[i] == key)                                                         \
+        return i;                                                              \
+    return n;                                                                  \
+  }                                                                            \
+  static inline size_t _lc_join(lc_scan_count, sfx)(const type *a, size_t n,   \
+                                                    type key) {                \
+    size_t count = 0;                                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      count += a[i] == key;                                                    \
+    return count;                                                              \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_min, sfx)(const type *a, size_t n) {     \
+    type best = a[0];                                                          \
+    for (size_t i = 1; i < n; i++)                                             \
+      if (a[i] < best)                                                         \
+        best = a[i];                                                           \
+    return best;                                                               \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_max, sfx)(const type *a, size_t n) {     \
+    type best = a[0];                                                          \
+    for (size_t i = 1; i < n; i++)                                             \
+      if (best < a[i])                                                         \
+        best = a[i];                                                           \
+    return best;                                                               \
+  }                                                                            \
+  static inline type _lc_join(lc_scan_sum, sfx)(const type *a, size_t n) {     \
+    type sum = 0;                                                              \
+    for (size_t i = 0; i < n; i++)                                             \
+      sum = (type)(sum + a[i]);                                                \
+    return sum;                                                                \
+  }
+
+_LC_SCAN_WORD(int, int)
+_LC_SCAN_WORD(uint, unsigned int)
+_LC_SCAN_WORD(long, long)
+_LC_SCAN_WORD(ulong, unsigned long)
+_LC_SCAN_WORD(llong, long long)
+_LC_SCAN_WORD(ullong, unsigned long long)
+_LC_SCAN_PLAIN(char, char)
+_LC_SCAN_PLAIN(schar, signed char)
+_LC_SCAN_PLAIN(uchar, unsigned char)
+_LC_SCAN_PLAIN(short, short)
+_LC_SCAN_PLAIN(ushort, unsigned short)
+_LC_SCAN_PLAIN(ldouble, long double)
+
+#undef _LC_SCAN_WORD
+#undef _LC_SCAN_PLAIN
+
+// Picks lc_scan_<op>_* for the type of 'x', or 'fallback' for every other
+// type. Only the selected function is called, so 'fallback' may take any
+// element type. The fixed width types are typedefs of the standard ones, so
+// int32_t and friends land on the word kernels of their size.
+#define lc_scan_dispatch(op, x, fallback)                                      \
+  _Generic((x),                                                                \
+      char: lc_scan_##op##_char,                                               \
+      signed char: lc_scan_##op##_schar,                                       \
+      unsigned char: lc_scan_##op##_uchar,                                     \
+      short: lc_scan_##op##_short,                                             \
+      unsigned short: lc_scan_##op##_ushort,                                   \
+      int: lc_scan_##op##_int,                                                 \
+      unsigned int: lc_scan_##op##_uint,                                       \
+      long: lc_scan_##op##_long,                                               \
+      unsigned long: lc_scan_##op##_ulong,                                     \
+      long long: lc_scan_##op##_llong,                                         \
+      unsigned long long: lc_scan_##op##_ullong,                               \
+      float: lc_scan_##op##_f32,                                               \
+      double: lc_scan_##op##_f64,                                              \
+      long double: lc_scan_##op##_ldouble,                                     \
+      default: fallback)
+
+// Marks a 'fallback' that is declared but never defined: GCC and Clang
+// reject a call that survives to code generation, other compilers fail to
+// link.
+#if defined(__GNUC__)
+#define _LC_SCAN_MISUSE(msg) __attribute__((error(msg))) extern
+#else
+#define _LC_SCAN_MISUSE(msg) extern
+#endif // __GNUC__
+
+#endif // LC_SCAN_H
@@ -0,0 +1,182 @@
+#if !defined(LC_SIMD_H)
+#define LC_SIMD_H
+
+#include "_lc_templating.h"
+
+// Vectorized searches over small sorted arrays of primitive keys, used by the
+// ordered containers to search inside a node.
+//
+// lc_rank_*(keys, n, key) returns how many of the 'n' sorted 'keys' are
+// smaller than 'key', i.e. the index of the first key >= 'key'. Keys are
+// compared a vector at a time (AVX2 or SSE2 depending on the target) and the
+// scan stops at the first vector that is not entirely smaller than 'key'.
+// Unsigned keys are biased by their sign bit so the signed compare
+// instructions order them correctly.
+//
+// lc_count_*(keys, n, key) returns the same number without stopping early:
+// every vector is compared and the bits of the masks are added up. For a
+// handful of vectors (a cache line) that is cheaper than the mispredicted
+// exit of lc_rank_* when the searched keys are random.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static inline size_t _lc_rank_i32(const int32_t *keys, size_t n, int32_t key,
+                                  uint32_t bias) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  __m256i b = _mm256_set1_epi32((int32_t)bias);
+  __m256i k = _mm256_xor_si256(_mm256_set1_epi32(key), b);
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+    __m256i lt = _mm256_cmpgt_epi32(k, _mm256_xor_si256(v, b));
+    uint32_t m = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(lt));
+    if (m != 0xff)
+      return i + (size_t)__builtin_ctz(~m);
+  }
+#elif defined(__SSE2__)
+  __m128i b = _mm_set1_epi32((int32_t)bias);
+  __m128i k = _mm_xor_si128(_mm_set1_epi32(key), b);
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+    __m128i lt = _mm_cmpgt_epi32(k, _mm_xor_si128(v, b));
+    uint32_t m = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(lt));
+    if (m != 0xf)
+      return i + (size_t)__builtin_ctz(~m);
+  }
+#endif
+  while (i < n && (int32_t)((uint32_t)keys[i] ^ bias) <
+                      (int32_t)((uint32_t)key ^ bias))
+    i++;
+  return i;
+}
+
+static inline size_t _lc_rank_i64(const int64_t *keys, size_t n, int64_t key,
+                                  uint64_t bias) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  __m256i b = _mm256_set1_epi64x((int64_t)bias);
+  __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), b);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+    __m256i lt = _mm256_cmpgt_epi64(k, _mm256_xor_si256(v, b));
+    uint32_t m = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(lt));
+    if (m != 0xf)
+      return i + (size_t)__builtin_ctz(~m);
+  }
+#endif
+  while (i < n && (int64_t)((uint64_t)keys[i] ^ bias) <
+                      (int64_t)((uint64_t)key ^ bias))
+    i++;
+  return i;
+}
+
+static inline size_t _lc_count_i32(const int32_t *keys, size_t n,
+                                   int32_t key, uint32_t bias) {
+  size_t i = 0, r = 0;
+#if defined(__AVX2__)
+  __m256i b = _mm256_set1_epi32((int32_t)bias);
+  __m256i k = _mm256_xor_si256(_mm256_set1_epi32(key), b);
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+    __m256i lt = _mm256_cmpgt_epi32(k, _mm256_xor_si256(v, b));
+    r += (size_t)__builtin_popcount(
+        (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+  }
+#elif defined(__SSE2__)
+  __m128i b = _mm_set1_epi32((int32_t)bias);
+  __m128i k = _mm_xor_si128(_mm_set1_epi32(key), b);
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+    __m128i lt = _mm_cmpgt_epi32(k, _mm_xor_si128(v, b));
+    r += (size_t)__builtin_popcount(
+        (unsigned)_mm_movemask_ps(_mm_castsi128_ps(lt)));
+  }
+#endif
+  for (; i < n; i++)
+    r += (int32_t)((uint32_t)keys[i] ^ bias) < (int32_t)((uint32_t)key ^ bias);
+  return r;
+}
+
+static inline size_t _lc_count_i64(const int64_t *keys, size_t n,
+                                   int64_t key, uint64_t bias) {
+  size_t i = 0, r = 0;
+#if defined(__AVX2__)
+  __m256i b = _mm256_set1_epi64x((int64_t)bias);
+  __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), b);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(keys + i));
+    __m256i lt = _mm256_cmpgt_epi64(k, _mm256_xor_si256(v, b));
+    r += (size_t)__builtin_popcount(
+        (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+  }
+#endif
+  for (; i < n; i++)
+    r += (int64_t)((uint64_t)keys[i] ^ bias) < (int64_t)((uint64_t)key ^ bias);
+  return r;
+}
+
+static inline size_t lc_rank_i32(const int32_t *keys, size_t n, int32_t key) {
+  return _lc_rank_i32(keys, n, key, 0);
+}
+
+static inline size_t lc_rank_u32(const uint32_t *keys, size_t n,
+                                 uint32_t key) {
+  return _lc_rank_i32((const int32_t *)keys, n, (int32_t)key, 0x80000000u);
+}
+
+static inline size_t lc_rank_i64(const int64_t *keys, size_t n, int64_t key) {
+  return _lc_rank_i64(keys, n, key, 0);
+}
+
+static inline size_t lc_rank_u64(const uint64_t *keys, size_t n,
+                                 uint64_t key) {
+  return _lc_rank_i64((const int64_t *)keys, n, (int64_t)key,
+                      0x8000000000000000ull);
+}
+
+// Picks the lc_rank_* function matching the type of 'key', or 'fallback' for
+// every other type. Only the selected function is called, so 'fallback' may
+// take any key type.
+#define lc_rank_dispatch(key, fallback)                                        \
+  _Generic((key),                                                              \
+      int32_t: lc_rank_i32,                                                    \
+      uint32_t: lc_rank_u32,                                                   \
+      int64_t: lc_rank_i64,                                                    \
+      uint64_t: lc_rank_u64,                                                   \
+      default: fallback)
+
+static inline size_t lc_count_i32(const int32_t *keys, size_t n,
+                                  int32_t key) {
+  return _lc_count_i32(keys, n, key, 0);
+}
+
+static inline size_t lc_count_u32(const uint32_t *keys, size_t n,
+                                  uint32_t key) {
+  return _lc_count_i32((const int32_t *)keys, n, (int32_t)key, 0x80000000u);
+}
+
+static inline size_t lc_count_i64(const int64_t *keys, size_t n,
+                                  int64_t key) {
+  return _lc_count_i64(keys, n, key, 0);
+}
+
+static inline size_t lc_count_u64(const uint64_t *keys, size_t n,
+                                  uint64_t key) {
+  return _lc_count_i64((const int64_t *)keys, n, (int64_t)key,
+                       0x8000000000000000ull);
+}
+
+// Same as lc_rank_dispatch() for the lc_count_* functions.
+#define lc_count_dispatch(key, fallback)                                       \
+  _Generic((key),                                                              \
+      int32_t: lc_count_i32,                                                   \
+      uint32_t: lc_count_u32,                                                  \
+      int64_t: lc_count_i64,                                                   \
+      uint64_t: lc_count_u64,                                                  \
+      default: fallback)
+
+#endif // LC_SIMD_H
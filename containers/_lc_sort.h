@@ -0,0 +1,133 @@
+#if !defined(LC_SORT_H)
+#define LC_SORT_H
+
+#include "_lc_templating.h"
+#include <limits.h>
+#include <stdbool.h>
+
+// Helpers for the sorting routines generated by vector.h.
+//
+// lc_radix_key(x) maps a value of any standard integer or floating point type
+// to an unsigned integer of the same width that sorts in the same order, so
+// an LSD radix sort can bucket it byte by byte. Signed integers get their
+// sign bit flipped; negative floats get all their bits flipped, positive ones
+// only the sign bit. Other types fail to compile.
+
+static inline uint64_t _lc_rk_char(char x) {
+  return CHAR_MIN < 0 ? (uint8_t)x ^ 0x80u : (uint8_t)x;
+}
+
+static inline uint64_t _lc_rk_schar(signed char x) {
+  return (uint8_t)x ^ 0x80u;
+}
+
+static inline uint64_t _lc_rk_uchar(unsigned char x) {
+  return x;
+}
+
+static inline uint64_t _lc_rk_short(short x) {
+  return (uint16_t)x ^ 0x8000u;
+}
+
+static inline uint64_t _lc_rk_ushort(unsigned short x) {
+  return x;
+}
+
+static inline uint64_t _lc_rk_int(int x) {
+  return (uint32_t)x ^ 0x80000000u;
+}
+
+static inline uint64_t _lc_rk_uint(unsigned x) {
+  return x;
+}
+
+static inline uint64_t _lc_rk_long(long x) {
+  return (uint64_t)(unsigned long)x ^ (1ull << (sizeof(long) * CHAR_BIT - 1));
+}
+
+static inline uint64_t _lc_rk_ulong(unsigned long x) {
+  return x;
+}
+
+static inline uint64_t _lc_rk_llong(long long x) {
+  return (uint64_t)x ^ (1ull << 63);
+}
+
+static inline uint64_t _lc_rk_ullong(unsigned long long x) {
+  return x;
+}
+
+static inline uint64_t _lc_rk_float(float x) {
+  uint32_t u;
+  memcpy(&u, &x, sizeof(u));
+  return u & 0x80000000u ? ~u : u | 0x80000000u;
+}
+
+static inline uint64_t _lc_rk_double(double x) {
+  uint64_t u;
+  memcpy(&u, &x, sizeof(u));
+  return u & (1ull << 63) ? ~u : u | (1ull << 63);
+}
+
+#define lc_radix_key(x)                                                        \
+  _Generic((x),                                                                \
+      char: _lc_rk_char,                                                       \
+      signed char: _lc_rk_schar,                                               \
+      unsigned char: _lc_rk_uchar,                                             \
+      short: _lc_rk_short,                                                     \
+      unsigned short: _lc_rk_ushort,                                           \
+      int: _lc_rk_int,                                                         \
+      unsigned: _lc_rk_uint,                                                   \
+      long: _lc_rk_long,                                                       \
+      unsigned long: _lc_rk_ulong,                                             \
+      long long: _lc_rk_llong,                                                 \
+      unsigned long long: _lc_rk_ullong,                                       \
+      float: _lc_rk_float,                                                     \
+      double: _lc_rk_double)(x)
+
+#endif // LC_SORT_H
+
+// The thread helpers are only compiled in once a vector asks for them.
+#if defined(lcore_sort_threads) && !defined(LC_SORT_THREADS_H)
+#define LC_SORT_THREADS_H
+
+#include <pthread.h>
+
+#define LC_SORT_MAX_THREADS 64
+
+typedef struct {
+  void (*fn)(void *ctx, unsigned id);
+  void *ctx;
+  unsigned id;
+} lc_sort_task;
+
+static inline void *_lc_sort_task_main(void *arg) {
+  lc_sort_task *task = (lc_sort_task *)arg;
+  task->fn(task->ctx, task->id);
+  return NULL;
+}
+
+// Runs fn(ctx, id) for every id in [0, n) (n <= LC_SORT_MAX_THREADS) on
+// n - 1 new threads and the calling one, and waits for all of them. Tasks
+// whose thread can not be created run on the caller.
+static inline void lc_sort_parallel(unsigned n, void (*fn)(void *, unsigned),
+                                    void *ctx) {
+  lc_sort_task tasks[LC_SORT_MAX_THREADS];
+  pthread_t tids[LC_SORT_MAX_THREADS];
+  bool spawned[LC_SORT_MAX_THREADS] = {0};
+  assert(n <= LC_SORT_MAX_THREADS);
+  for (unsigned i = 1; i < n; i++) {
+    tasks[i] = (lc_sort_task){fn, ctx, i};
+    spawned[i] =
+        pthread_create(&tids[i], NULL, _lc_sort_task_main, &tasks[i]) == 0;
+  }
+  fn(ctx, 0);
+  for (unsigned i = 1; i < n; i++) {
+    if (spawned[i])
+      pthread_join(tids[i], NULL);
+    else
+      fn(ctx, i);
+  }
+}
+
+#endif // LC_SORT_THREADS_H
@@ -0,0 +1,60 @@
+#if !defined(LC_STATS_H)
+#define LC_STATS_H
+
+#include "_lc_templating.h"
+#include <stdbool.h>
+#include <time.h>
+
+// Counters kept by the hash containers when 'lcore_stats' is defined, read
+// back with their stats() function. Without the macro neither the struct
+// member nor the code updating it is compiled in.
+//
+// Lookups are the contains() and find() calls, batched ones included; their
+// probe length is the number of chain nodes visited (separate chaining) or
+// of control groups loaded (open addressing). A mean probe length well above
+// one or a large max_probe point at a weak hash function or a table that
+// does not resize often enough.
+
+typedef struct {
+  uint64_t lookups;     // contains() / find() calls
+  uint64_t hits;        // lookups that found their key
+  uint64_t misses;      // lookups that did not
+  uint64_t probes;      // total probe length of all lookups
+  uint64_t max_probe;   // longest single lookup
+  uint64_t rehashes;    // resizes started
+  uint64_t rehash_ns;   // time spent resizing and migrating buckets
+  uint64_t alloc_bytes; // bytes allocated for nodes and arrays, ever
+  uint64_t live_bytes;  // bytes held right now, filled in by stats()
+} lc_hash_stats;
+
+static inline void lc_stats_lookup(lc_hash_stats *s, bool hit,
+                                   uint64_t probes) {
+  s->lookups++;
+  s->hits += hit;
+  s->misses += !hit;
+  s->probes += probes;
+  if (probes > s->max_probe)
+    s->max_probe = probes;
+}
+
+// Monotonic when <time.h> declares CLOCK_MONOTONIC (POSIX), so rehash_ns
+// does not jump with the wall clock. Plain C11 only has TIME_UTC.
+static inline uint64_t lc_stats_now_ns(void) {
+  struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  timespec_get(&ts, TIME_UTC);
+#endif // CLOCK_MONOTONIC
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Adds 'len' to bin min(len, bins - 1) of 'hist' and tracks the maximum.
+static inline void lc_stats_bin(size_t *hist, size_t bins, size_t len,
+                                size_t *longest) {
+  hist[len < bins ? len : bins - 1]++;
+  if (len > *longest)
+    *longest = len;
+}
+
+#endif // LC_STATS_H
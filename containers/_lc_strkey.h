@@ -0,0 +1,70 @@
+#if !defined(LC_STRKEY_H)
+#define LC_STRKEY_H
+
+#include "_lc_arena.h"
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Owned string keys of the hash tables instantiated with 'lcore_str_keys'.
+//
+// A key shorter than LC_STRKEY_INLINE bytes (NUL excluded) is copied into the
+// entry itself, a longer one into the table's arena (see _lc_arena.h). The
+// entry also records the key's length and the upper half of its hash, which
+// is compared before any byte of the key: a lookup touches no memory outside
+// the entry unless it meets a long key with a matching tag.
+//
+// An lc_strkey takes LC_STRKEY_INLINE + 8 bytes. The default stores keys of
+// up to 15 bytes inline in 24; 24 covers keys of up to 23 bytes in 32, at the
+// cost of larger entries (empty ones too, with open addressing). It has to
+// be a multiple of 8 of at least 8, and can only be set before the first
+// header including this one.
+
+#ifndef LC_STRKEY_INLINE
+#define LC_STRKEY_INLINE 16
+#endif // LC_STRKEY_INLINE
+
+#if LC_STRKEY_INLINE < 8 || LC_STRKEY_INLINE % 8
+#error "LC_STRKEY_INLINE must be a multiple of 8 of at least 8"
+#endif
+
+typedef struct {
+  uint32_t len; // strlen() of the key
+  uint32_t tag; // hash >> 32
+  union {
+    char buf[LC_STRKEY_INLINE]; // the key when len < LC_STRKEY_INLINE
+    const char *ptr;            // its copy in the arena otherwise
+  };
+} lc_strkey;
+
+// The key as a NUL terminated string. Inline keys move with their entry, the
+// pointer is only valid until the table is modified.
+static inline const char *lc_strkey_str(const lc_strkey *k) {
+  return k->len < LC_STRKEY_INLINE ? k->buf : k->ptr;
+}
+
+// Whether 'k' holds 's', whose hash is 'h'.
+static inline bool lc_strkey_eq(const lc_strkey *k, const char *s,
+                                uint64_t h) {
+  return k->tag == (uint32_t)(h >> 32) && strcmp(lc_strkey_str(k), s) == 0;
+}
+
+// Stores a copy of 's', whose hash is 'h', in 'k'. False when the arena runs
+// out of memory.
+static inline bool lc_strkey_init(lc_strkey *k, const char *s, uint64_t h,
+                                  lc_arena *arena) {
+  size_t len = strlen(s);
+  assert(len <= UINT32_MAX);
+  char *dst = k->buf;
+  if (len >= LC_STRKEY_INLINE) {
+    dst = (char *)lc_arena_alloc(arena, len + 1);
+    if (!dst)
+      return false;
+    k->ptr = dst;
+  }
+  memcpy(dst, s, len + 1);
+  k->len = (uint32_t)len;
+  k->tag = (uint32_t)(h >> 32);
+  return true;
+}
+
+#endif // LC_STRKEY_H
@@ -10,6 +10,12 @@
 #define lc_malloc(T, Size) ((T *)malloc(Size))
 #define lc_calloc(T, TSize, Count) ((T *)calloc(Count, TSize))
 
+#if defined(__GNUC__) || defined(__clang__)
+#define lc_prefetch(addr) __builtin_prefetch(addr)
+#else
+#define lc_prefetch(addr) ((void)(addr))
+#endif
+
 #define _lc_cat(a, b) a##b
 #define _lc_concat(a, b) _lc_cat(a, b)
 #define _lc_join(a, b) _lc_concat(a, _lc_concat(_, b))
@@ -0,0 +1,350 @@
+#include "_lc_simd.h"
+#include "_lc_templating.h"
+
+#ifndef T
+#define T int
+#endif // T
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, btree)
+#endif // lcore_pfx
+
+#ifndef lcore_cmp_fn
+#define _lc_default_cmp
+#define lcore_cmp_fn(a, b) (((a) > (b)) - ((a) < (b)))
+#endif // lcore_cmp_fn
+
+#ifndef lcore_drop_fn
+#define lcore_drop_fn(x)
+#endif // lcore_drop_fn
+
+// Bytes of keys stored in a single node, 256 (four cache lines) by default.
+// The node fanout follows from it: 63 ints or 31 64 bit keys per node, so a
+// lookup in a 10M entries tree touches 4 to 5 nodes instead of the ~24 of a
+// red black tree.
+#ifndef lcore_btree_node_bytes
+#define lcore_btree_node_bytes 256
+#endif // lcore_btree_node_bytes
+
+// With the default comparison and a 32 or 64 bit integer T, the search inside
+// a node is vectorized (see _lc_simd.h). Every other configuration performs a
+// binary search with lcore_cmp_fn.
+
+#define Self lcore_pfx
+#define _Node _lc_join(Self, node)
+
+// Minimum degree of the tree: every node but the root holds between
+// _Degree - 1 and _MaxKeys = 2 * _Degree - 1 keys.
+#define _NodeKeys (lcore_btree_node_bytes / sizeof(T))
+#define _Degree (_NodeKeys < 4 ? 2 : _NodeKeys / 2)
+#define _MaxKeys (2 * _Degree - 1)
+
+// ========== STRUCTS DEFINITIONS ============== //
+
+typedef struct _Node {
+  uint16_t count;           // number of keys in use
+  uint8_t leaf;             // leaves are allocated without children
+  T keys[_MaxKeys];         // sorted keys
+  struct _Node *children[]; // count + 1 children, internal nodes only
+} _Node;
+
+typedef struct Self {
+  _Node *root; // root of the tree
+  size_t size; // number of keys
+} Self;
+
+// ============== PUBLIC API ==================== //
+// These functions are meant to be used to interact with the tree structure
+// you are NOT supposed to modify the struct memebers directly.
+
+static inline void _lc_mfunc(init)(Self *self);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline uint8_t _lc_mfunc(insert)(Self *self, T val);
+static inline uint8_t _lc_mfunc(remove)(Self *self, T val);
+static inline uint8_t _lc_mfunc(contains)(Self *self, T val);
+
+// ============= PRIVATE FUNCTIONS ============== //
+// These functions are not meant to be called directly, they are helpers used
+// inside the public API implementation
+
+static inline _Node *_lc_mfunc_priv(new_node)(uint8_t leaf);
+static inline void _lc_mfunc_priv(free_subtree)(_Node *x);
+static inline size_t _lc_mfunc_priv(rank)(_Node *x, T key);
+static inline size_t _lc_mfunc_priv(rank_cmp)(T const *keys, size_t n, T key);
+static inline void _lc_mfunc_priv(split_child)(_Node *x, size_t i,
+                                               _Node *z);
+static inline void _lc_mfunc_priv(merge_children)(_Node *x, size_t i);
+static inline void _lc_mfunc_priv(fill_child)(_Node *x, size_t i);
+
+// ========== PUBLIC API IMPLEMENTATION ========= //
+
+static inline void _lc_mfunc(init)(Self *self) {
+  memset(self, 0, sizeof(*self));
+}
+
+static inline void _lc_mfunc(destroy)(Self *self) {
+  if (self->root)
+    _lc_mfunc_priv(free_subtree)(self->root);
+  memset(self, 0, sizeof(*self));
+}
+
+// Single top-down pass: every full node met on the way down is split before
+// entering it, so the leaf always has room for the new key.
+static inline uint8_t _lc_mfunc(insert)(Self *self, T val) {
+  if (!self->root) {
+    self->root = _lc_mfunc_priv(new_node)(1);
+    if (!self->root)
+      return 0; // Allocation failed
+  } else if (self->root->count == _MaxKeys) {
+    // Both nodes are allocated before the tree is touched.
+    _Node *root = _lc_mfunc_priv(new_node)(0);
+    _Node *z = _lc_mfunc_priv(new_node)(self->root->leaf);
+    if (!root || !z) {
+      free(root);
+      free(z);
+      return 0; // Allocation failed
+    }
+    root->children[0] = self->root;
+    self->root = root;
+    _lc_mfunc_priv(split_child)(root, 0, z);
+  }
+
+  _Node *x = self->root;
+  for (;;) {
+    size_t i = _lc_mfunc_priv(rank)(x, val);
+    if (i < x->count && lcore_cmp_fn(x->keys[i], val) == 0)
+      return 0; // Value already exists
+    if (x->leaf) {
+      memmove(x->keys + i + 1, x->keys + i, (x->count - i) * sizeof(T));
+      x->keys[i] = val;
+      x->count++;
+      self->size++;
+      return 1;
+    }
+    if (x->children[i]->count == _MaxKeys) {
+      // The splits already done on the way down leave a valid tree.
+      _Node *z = _lc_mfunc_priv(new_node)(x->children[i]->leaf);
+      if (!z)
+        return 0; // Allocation failed
+      _lc_mfunc_priv(split_child)(x, i, z);
+      int c = lcore_cmp_fn(val, x->keys[i]);
+      if (c == 0)
+        return 0; // The median of the split child was the value
+      if (c > 0)
+        i++;
+    }
+    x = x->children[i];
+  }
+}
+
+// Single top-down pass as well: before descending into a child with the
+// minimum number of keys, the child borrows a key from a sibling or is merged
+// with it, so removing from a leaf never underflows it.
+static inline uint8_t _lc_mfunc(remove)(Self *self, T val) {
+  _Node *x = self->root;
+  uint8_t dropped = 0;
+  while (x) {
+    size_t i = _lc_mfunc_priv(rank)(x, val);
+    uint8_t found = i < x->count && lcore_cmp_fn(x->keys[i], val) == 0;
+
+    if (found && x->leaf) {
+      if (!dropped) {
+        lcore_drop_fn(x->keys[i]);
+      }
+      memmove(x->keys + i, x->keys + i + 1, (x->count - i - 1) * sizeof(T));
+      x->count--;
+      self->size--;
+      break;
+    }
+
+    if (found) {
+      _Node *left = x->children[i], *right = x->children[i + 1];
+      if (left->count >= _Degree || right->count >= _Degree) {
+        // Replace the key with its predecessor (or successor) and go on
+        // removing that one from the subtree it comes from.
+        if (!dropped) {
+          lcore_drop_fn(x->keys[i]);
+        }
+        dropped = 1;
+        _Node *y = left->count >= _Degree ? left : right;
+        _Node *leaf = y;
+        while (!leaf->leaf)
+          leaf = leaf->children[y == left ? leaf->count : 0];
+        val = y == left ? leaf->keys[leaf->count - 1] : leaf->keys[0];
+        x->keys[i] = val;
+        x = y;
+        continue;
+      }
+      // Both children are minimal: merge them around the key and remove it
+      // from the merged node.
+      _lc_mfunc_priv(merge_children)(x, i);
+    } else {
+      if (x->leaf)
+        return 0; // Value not found
+      if (x->children[i]->count < _Degree) {
+        _lc_mfunc_priv(fill_child)(x, i);
+        if (i > x->count)
+          i = x->count; // the last child was merged into its left sibling
+      }
+    }
+
+    _Node *next = x->children[i];
+    if (x == self->root && x->count == 0) {
+      // The root lost its last key in a merge, the tree gets shorter.
+      self->root = next;
+      free(x);
+    }
+    x = next;
+  }
+
+  if (!x)
+    return 0;
+  if (self->root->count == 0) {
+    free(self->root);
+    self->root = NULL;
+  }
+  return 1;
+}
+
+static inline uint8_t _lc_mfunc(contains)(Self *self, T val) {
+  _Node *x = self->root;
+  while (x) {
+    size_t i = _lc_mfunc_priv(rank)(x, val);
+    if (i < x->count && lcore_cmp_fn(x->keys[i], val) == 0)
+      return 1;
+    x = x->leaf ? NULL : x->children[i];
+  }
+  return 0;
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline _Node *_lc_mfunc_priv(new_node)(uint8_t leaf) {
+  size_t bytes = sizeof(_Node);
+  if (!leaf)
+    bytes += (_MaxKeys + 1) * sizeof(_Node *);
+  _Node *n = lc_malloc(_Node, bytes);
+  if (!n)
+    return NULL;
+  n->count = 0;
+  n->leaf = leaf;
+  return n;
+}
+
+static inline void _lc_mfunc_priv(free_subtree)(_Node *x) {
+  // The height is logarithmic with a large base, recursion is fine here.
+  if (!x->leaf) {
+    for (size_t i = 0; i <= x->count; i++)
+      _lc_mfunc_priv(free_subtree)(x->children[i]);
+  }
+  for (size_t i = 0; i < x->count; i++)
+    lcore_drop_fn(x->keys[i]);
+  free(x);
+}
+
+// Index of the first key of 'x' that is not smaller than 'key'.
+static inline size_t _lc_mfunc_priv(rank)(_Node *x, T key) {
+#ifdef _lc_default_cmp
+  return lc_rank_dispatch(key, _lc_mfunc_priv(rank_cmp))(x->keys, x->count,
+                                                         key);
+#else
+  return _lc_mfunc_priv(rank_cmp)(x->keys, x->count, key);
+#endif // _lc_default_cmp
+}
+
+static inline size_t _lc_mfunc_priv(rank_cmp)(T const *keys, size_t n,
+                                              T key) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (lcore_cmp_fn(keys[mid], key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Splits the full child 'i' of 'x' around its median key, which moves up
+// into 'x' (never full itself). The upper half goes to 'z', a fresh node of
+// the same kind as the child.
+static inline void _lc_mfunc_priv(split_child)(_Node *x, size_t i,
+                                               _Node *z) {
+  _Node *y = x->children[i];
+  z->count = _Degree - 1;
+  memcpy(z->keys, y->keys + _Degree, (_Degree - 1) * sizeof(T));
+  if (!y->leaf)
+    memcpy(z->children, y->children + _Degree, _Degree * sizeof(_Node *));
+  y->count = _Degree - 1;
+
+  memmove(x->keys + i + 1, x->keys + i, (x->count - i) * sizeof(T));
+  memmove(x->children + i + 2, x->children + i + 1,
+          (x->count - i) * sizeof(_Node *));
+  x->keys[i] = y->keys[_Degree - 1];
+  x->children[i + 1] = z;
+  x->count++;
+}
+
+// Merges children 'i' and 'i + 1' of 'x' (both minimal) together with the
+// key between them into child 'i'.
+static inline void _lc_mfunc_priv(merge_children)(_Node *x, size_t i) {
+  _Node *y = x->children[i], *z = x->children[i + 1];
+  y->keys[y->count] = x->keys[i];
+  memcpy(y->keys + y->count + 1, z->keys, z->count * sizeof(T));
+  if (!y->leaf)
+    memcpy(y->children + y->count + 1, z->children,
+           (z->count + 1) * sizeof(_Node *));
+  y->count += z->count + 1;
+  free(z);
+
+  memmove(x->keys + i, x->keys + i + 1, (x->count - i - 1) * sizeof(T));
+  memmove(x->children + i + 1, x->children + i + 2,
+          (x->count - i - 1) * sizeof(_Node *));
+  x->count--;
+}
+
+// Gives the minimal child 'i' of 'x' an extra key, borrowed through 'x' from
+// a sibling that can spare one or, failing that, by merging it with the
+// right sibling (with the left one for the last child).
+static inline void _lc_mfunc_priv(fill_child)(_Node *x, size_t i) {
+  _Node *c = x->children[i];
+  if (i > 0 && x->children[i - 1]->count >= _Degree) {
+    _Node *l = x->children[i - 1];
+    memmove(c->keys + 1, c->keys, c->count * sizeof(T));
+    c->keys[0] = x->keys[i - 1];
+    if (!c->leaf) {
+      memmove(c->children + 1, c->children, (c->count + 1) * sizeof(_Node *));
+      c->children[0] = l->children[l->count];
+    }
+    x->keys[i - 1] = l->keys[l->count - 1];
+    l->count--;
+    c->count++;
+  } else if (i < x->count && x->children[i + 1]->count >= _Degree) {
+    _Node *r = x->children[i + 1];
+    c->keys[c->count] = x->keys[i];
+    if (!c->leaf) {
+      c->children[c->count + 1] = r->children[0];
+      memmove(r->children, r->children + 1, r->count * sizeof(_Node *));
+    }
+    x->keys[i] = r->keys[0];
+    memmove(r->keys, r->keys + 1, (r->count - 1) * sizeof(T));
+    r->count--;
+    c->count++;
+  } else if (i < x->count) {
+    _lc_mfunc_priv(merge_children)(x, i);
+  } else {
+    _lc_mfunc_priv(merge_children)(x, i - 1);
+  }
+}
+
+#undef T
+#undef lcore_pfx
+#undef lcore_cmp_fn
+#undef lcore_drop_fn
+#undef lcore_btree_node_bytes
+#undef _lc_default_cmp
+#undef Self
+#undef _Node
+#undef _NodeKeys
+#undef _Degree
+#undef _MaxKeys
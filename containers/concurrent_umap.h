@@ -0,0 +1,388 @@
+#include "_lc_group.h"
+#include "_lc_hash.h"
+#include "_lc_templating.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+// Thread-safe hash map, partitioned into 'lcore_shards' open-addressing
+// tables that are locked independently. The shard of a key is picked from
+// hash bits that the in-shard probing does not use, so keys spread evenly
+// and threads working on different shards never touch the same lock or the
+// same cache lines. Each shard has its own reader-writer lock: any number of
+// lookups run in parallel and a writer only stalls the keys of its shard.
+// Resizes are per shard too, a growing shard never blocks the others.
+//
+// Takes the same parameters as unordered_map.h plus 'lcore_shards' (a power
+// of two, default 64):
+//
+// #define K uint64_t
+// #define V uint64_t
+// #define lcore_pfx counters
+// #include "containers/concurrent_umap.h"
+//
+// Values can not be handed out by pointer since another thread may move them
+// as soon as the shard is unlocked: get() copies the value out and update()
+// runs a callback on it while the shard is write-locked. update() and set()
+// behave as in unordered_map.h: a missing key is inserted first.
+
+#ifndef K
+#define K int
+#endif // K
+
+#ifndef V
+#define V int
+#endif // V
+
+#ifndef lcore_hash_fn
+#define lcore_hash_fn(x) lc_hash_int((uint64_t)(x))
+#endif // lcore_hash_fn
+
+#ifndef lcore_eq_fn
+#define lcore_eq_fn(a, b) ((a) == (b))
+#endif // lcore_eq_fn
+
+#ifndef lcore_drop_k
+#define lcore_drop_k(x)
+#endif // lcore_drop_k
+
+#ifndef lcore_drop_v
+#define lcore_drop_v(x)
+#endif // lcore_drop_v
+
+#ifndef lcore_max_loadf
+#define lcore_max_loadf 0.85f
+#endif // lcore_max_loadf
+
+#ifndef lcore_shards
+#define lcore_shards 64
+#endif // lcore_shards
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(_lc_join(K, V), cumap)
+#endif // lcore_pfx
+
+#if (lcore_shards) <= 0 || ((lcore_shards) & ((lcore_shards) - 1)) != 0
+#error "lcore_shards must be a power of two"
+#endif
+
+#if !defined(PTHREAD_RWLOCK_INITIALIZER)
+#error "concurrent_umap.h needs POSIX rwlocks, define _POSIX_C_SOURCE 200809L"
+#endif
+
+#ifndef LC_CACHE_LINE
+#define LC_CACHE_LINE 64
+#endif // LC_CACHE_LINE
+
+#define Self lcore_pfx
+#define _Slot _lc_join(Self, slot)
+#define _Shard _lc_join(Self, shard)
+
+typedef struct _Slot {
+  K key;
+  V value;
+} _Slot;
+
+// Shards are cache line aligned so that locking one never invalidates the
+// line holding its neighbour.
+typedef struct _Shard {
+  _Alignas(LC_CACHE_LINE) pthread_rwlock_t lock;
+  size_t size, capacity;
+  uint8_t *ctrl; // capacity + LC_GROUP_WIDTH control bytes
+  _Slot *slots;  // capacity pairs, valid where ctrl[i] != LC_CTRL_EMPTY
+} _Shard;
+
+typedef struct Self {
+  _Shard *shards; // lcore_shards tables
+} Self;
+
+// clang-format off
+static inline bool _lc_mfunc(init)(Self* self, size_t capacity);
+static inline void _lc_mfunc(destroy)(Self* self);
+static inline bool _lc_mfunc(set)(Self* self, K key, V value);
+static inline bool _lc_mfunc(insert)(Self* self, K key, V value);
+static inline bool _lc_mfunc(remove)(Self* self, K key);
+static inline bool _lc_mfunc(get)(Self* self, K key, V* out);
+static inline bool _lc_mfunc(contains)(Self* self, K key);
+static inline bool _lc_mfunc(update)(Self* self, K key, void (*fn)(V*, void*), void* ctx);
+static inline size_t _lc_mfunc(size)(Self* self);
+// clang-format on
+
+// ============= PRIVATE FUNCTIONS ============== //
+// Everything below works on a single shard whose lock is already held.
+
+static inline _Shard *_lc_mfunc_priv(shard)(Self *self, uint64_t h);
+static inline void _lc_mfunc_priv(rehash)(_Shard *shard, size_t new_capacity);
+static inline bool _lc_mfunc_priv(insert_hashed)(_Shard *shard, K key,
+                                                 V value, uint64_t h);
+static inline size_t _lc_mfunc_priv(find_index)(_Shard *shard, K key,
+                                                uint64_t h);
+static inline size_t _lc_mfunc_priv(empty_index)(_Shard *shard, uint64_t h);
+static inline void _lc_mfunc_priv(erase_at)(_Shard *shard, size_t i);
+
+// ========= PUBLIC API IMPLEMENTATION ========== //
+
+// 'capacity' is a hint for the whole map, it is split among the shards.
+// False, leaving the map empty, when the tables can not be allocated.
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity) {
+  size_t per_shard = LC_GROUP_WIDTH;
+  while (per_shard * lcore_shards < capacity)
+    per_shard <<= 1;
+  self->shards =
+      (_Shard *)aligned_alloc(LC_CACHE_LINE, sizeof(_Shard) * lcore_shards);
+  if (!self->shards)
+    return false;
+  for (size_t s = 0; s < lcore_shards; s++) {
+    _Shard *shard = &self->shards[s];
+    shard->size = 0;
+    shard->capacity = per_shard;
+    shard->ctrl = lc_malloc(uint8_t, per_shard + LC_GROUP_WIDTH);
+    shard->slots = lc_malloc(_Slot, sizeof(_Slot) * per_shard);
+    if (!shard->ctrl || !shard->slots) {
+      free(shard->ctrl);
+      free(shard->slots);
+      while (s--) {
+        free(self->shards[s].ctrl);
+        free(self->shards[s].slots);
+        pthread_rwlock_destroy(&self->shards[s].lock);
+      }
+      free(self->shards);
+      self->shards = NULL;
+      return false;
+    }
+    memset(shard->ctrl, LC_CTRL_EMPTY, per_shard + LC_GROUP_WIDTH);
+    pthread_rwlock_init(&shard->lock, NULL);
+  }
+  return true;
+}
+
+// Must not run concurrently with any other operation on the map.
+static inline void _lc_mfunc(destroy)(Self *self) {
+  if (!self || !self->shards)
+    return;
+  for (size_t s = 0; s < lcore_shards; s++) {
+    _Shard *shard = &self->shards[s];
+    for (size_t i = 0; i < shard->capacity; i++) {
+      if (shard->ctrl[i] & LC_CTRL_EMPTY)
+        continue;
+      lcore_drop_k(shard->slots[i].key);
+      lcore_drop_v(shard->slots[i].value);
+    }
+    free(shard->ctrl);
+    free(shard->slots);
+    pthread_rwlock_destroy(&shard->lock);
+  }
+  free(self->shards);
+  memset(self, 0, sizeof(*self));
+}
+
+// Inserts 'key' or overwrites its value. False when the key was missing and
+// its shard is out of memory, the pair is then not stored.
+static inline bool _lc_mfunc(set)(Self *self, K key, V value) {
+  uint64_t h = lcore_hash_fn(key);
+  _Shard *shard = _lc_mfunc_priv(shard)(self, h);
+  pthread_rwlock_wrlock(&shard->lock);
+  size_t i = _lc_mfunc_priv(find_index)(shard, key, h);
+  bool stored = true;
+  if (i == shard->capacity)
+    stored = _lc_mfunc_priv(insert_hashed)(shard, key, value, h);
+  else
+    shard->slots[i].value = value;
+  pthread_rwlock_unlock(&shard->lock);
+  return stored;
+}
+
+static inline bool _lc_mfunc(insert)(Self *self, K key, V value) {
+  uint64_t h = lcore_hash_fn(key);
+  _Shard *shard = _lc_mfunc_priv(shard)(self, h);
+  pthread_rwlock_wrlock(&shard->lock);
+  bool inserted = false;
+  if (_lc_mfunc_priv(find_index)(shard, key, h) == shard->capacity)
+    inserted = _lc_mfunc_priv(insert_hashed)(shard, key, value, h);
+  pthread_rwlock_unlock(&shard->lock);
+  return inserted;
+}
+
+static inline bool _lc_mfunc(remove)(Self *self, K key) {
+  uint64_t h = lcore_hash_fn(key);
+  _Shard *shard = _lc_mfunc_priv(shard)(self, h);
+  pthread_rwlock_wrlock(&shard->lock);
+  size_t i = _lc_mfunc_priv(find_index)(shard, key, h);
+  bool found = i != shard->capacity;
+  if (found) {
+    lcore_drop_k(shard->slots[i].key);
+    lcore_drop_v(shard->slots[i].value);
+    _lc_mfunc_priv(erase_at)(shard, i);
+    shard->size--;
+  }
+  pthread_rwlock_unlock(&shard->lock);
+  return found;
+}
+
+// Copies the value of 'key' into 'out' (when not NULL).
+static inline bool _lc_mfunc(get)(Self *self, K key, V *out) {
+  uint64_t h = lcore_hash_fn(key);
+  _Shard *shard = _lc_mfunc_priv(shard)(self, h);
+  pthread_rwlock_rdlock(&shard->lock);
+  size_t i = _lc_mfunc_priv(find_index)(shard, key, h);
+  bool found = i != shard->capacity;
+  if (found && out)
+    *out = shard->slots[i].value;
+  pthread_rwlock_unlock(&shard->lock);
+  return found;
+}
+
+static inline bool _lc_mfunc(contains)(Self *self, K key) {
+  return _lc_mfunc(get)(self, key, NULL);
+}
+
+// Calls fn(&value, ctx) on the value of 'key' with its shard write-locked,
+// so read-modify-write sequences are atomic, inserting the key with a
+// zero-filled value first when it is missing. 'fn' must not use the map.
+// Returns false only when the insertion runs out of memory.
+static inline bool _lc_mfunc(update)(Self *self, K key, void (*fn)(V *, void *),
+                                     void *ctx) {
+  uint64_t h = lcore_hash_fn(key);
+  _Shard *shard = _lc_mfunc_priv(shard)(self, h);
+  pthread_rwlock_wrlock(&shard->lock);
+  size_t i = _lc_mfunc_priv(find_index)(shard, key, h);
+  bool found = i != shard->capacity;
+  if (!found) {
+    V zero;
+    memset(&zero, 0, sizeof(V));
+    if (_lc_mfunc_priv(insert_hashed)(shard, key, zero, h)) {
+      i = _lc_mfunc_priv(find_index)(shard, key, h);
+      found = true;
+    }
+  }
+  if (found)
+    fn(&shard->slots[i].value, ctx);
+  pthread_rwlock_unlock(&shard->lock);
+  return found;
+}
+
+// Number of entries. Shards are counted one at a time, so with concurrent
+// writers the result is only a snapshot.
+static inline size_t _lc_mfunc(size)(Self *self) {
+  size_t size = 0;
+  for (size_t s = 0; s < lcore_shards; s++) {
+    _Shard *shard = &self->shards[s];
+    pthread_rwlock_rdlock(&shard->lock);
+    size += shard->size;
+    pthread_rwlock_unlock(&shard->lock);
+  }
+  return size;
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+// Probing uses the low bits of the hash and the control bytes its top 7
+// bits, the shard comes from the middle.
+static inline _Shard *_lc_mfunc_priv(shard)(Self *self, uint64_t h) {
+  return &self->shards[(h >> 32) & (lcore_shards - 1)];
+}
+
+static inline void _lc_mfunc_priv(rehash)(_Shard *shard, size_t new_capacity) {
+  uint8_t *new_ctrl = lc_malloc(uint8_t, new_capacity + LC_GROUP_WIDTH);
+  _Slot *new_slots = lc_malloc(_Slot, sizeof(_Slot) * new_capacity);
+  if (!new_ctrl || !new_slots) {
+    free(new_ctrl);
+    free(new_slots);
+    return;
+  }
+  memset(new_ctrl, LC_CTRL_EMPTY, new_capacity + LC_GROUP_WIDTH);
+  uint8_t *old_ctrl = shard->ctrl;
+  _Slot *old_slots = shard->slots;
+  size_t old_capacity = shard->capacity;
+  shard->ctrl = new_ctrl;
+  shard->slots = new_slots;
+  shard->capacity = new_capacity;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+    uint64_t h = lcore_hash_fn(old_slots[i].key);
+    size_t j = _lc_mfunc_priv(empty_index)(shard, h);
+    lc_ctrl_set(shard->ctrl, shard->capacity, j, old_ctrl[i]);
+    shard->slots[j] = old_slots[i];
+  }
+  free(old_ctrl);
+  free(old_slots);
+}
+
+// Inserts a key known to be absent.
+static inline bool _lc_mfunc_priv(insert_hashed)(_Shard *shard, K key,
+                                                 V value, uint64_t h) {
+  if ((float)(shard->size + 1) / shard->capacity >= lcore_max_loadf)
+    _lc_mfunc_priv(rehash)(shard, shard->capacity << 1);
+  if (shard->size + 1 >= shard->capacity)
+    return false;
+  size_t i = _lc_mfunc_priv(empty_index)(shard, h);
+  lc_ctrl_set(shard->ctrl, shard->capacity, i, lc_hash_h2(h));
+  shard->slots[i].key = key;
+  shard->slots[i].value = value;
+  shard->size++;
+  return true;
+}
+
+// Returns the slot holding 'key', or shard->capacity when it is not present.
+static inline size_t _lc_mfunc_priv(find_index)(_Shard *shard, K key,
+                                                uint64_t h) {
+  size_t mask = shard->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  uint8_t h2 = lc_hash_h2(h);
+  for (;;) {
+    const uint8_t *group = shard->ctrl + pos;
+    lc_group_mask m = lc_group_match(group, h2);
+    while (m) {
+      size_t i = (pos + lc_mask_lowest(m)) & mask;
+      if (lcore_eq_fn(shard->slots[i].key, key))
+        return i;
+      m &= m - 1;
+    }
+    if (lc_group_match_empty(group))
+      return shard->capacity;
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Returns the first free slot of the probe sequence starting at 'h'.
+static inline size_t _lc_mfunc_priv(empty_index)(_Shard *shard, uint64_t h) {
+  size_t mask = shard->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  for (;;) {
+    lc_group_mask m = lc_group_match_empty(shard->ctrl + pos);
+    if (m)
+      return (pos + lc_mask_lowest(m)) & mask;
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Backward-shift deletion, see unordered_set.h.
+static inline void _lc_mfunc_priv(erase_at)(_Shard *shard, size_t i) {
+  size_t mask = shard->capacity - 1;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (shard->ctrl[j] & LC_CTRL_EMPTY)
+      break;
+    size_t home = lc_hash_h1(lcore_hash_fn(shard->slots[j].key)) & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      shard->slots[i] = shard->slots[j];
+      lc_ctrl_set(shard->ctrl, shard->capacity, i, shard->ctrl[j]);
+      i = j;
+    }
+  }
+  lc_ctrl_set(shard->ctrl, shard->capacity, i, LC_CTRL_EMPTY);
+}
+
+#undef K
+#undef V
+#undef lcore_hash_fn
+#undef lcore_eq_fn
+#undef lcore_drop_k
+#undef lcore_drop_v
+#undef lcore_max_loadf
+#undef lcore_shards
+#undef lcore_pfx
+#undef Self
+#undef _Slot
+#undef _Shard
@@ -0,0 +1,232 @@
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Double-ended queue of T, pushes and pops at both ends in O(1).
+//
+// #define T job
+// #define lcore_pfx job_queue
+// #include "containers/deque.h"
+//
+// The elements live in a single ring buffer whose capacity is always a power
+// of two, so wrapping an index around is a mask instead of a division. The
+// buffer doubles when it is full: it is reallocated and the elements that
+// had wrapped around to its start move right after the old end, which
+// copies at most half of them. A deque used as a FIFO (push_back() and
+// pop_front()) stops allocating once it reached its largest size, unlike a
+// linked list that pays one allocation per element.
+//
+// Elements are addressed from the front: at(0) is front(), at(size - 1) is
+// back(). push_back_many() and pop_front_many() move a whole batch with at
+// most two memcpy() each.
+
+#ifndef T
+#define T int
+#endif // T
+
+#ifndef lcore_drop_fn
+#define _lc_trivial_drop
+#define lcore_drop_fn(x)
+#endif // lcore_drop_fn
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, deque)
+#endif // lcore_pfx
+
+#define Self lcore_pfx
+
+typedef struct {
+  size_t head;     // index of the front element in 'elements'
+  size_t size;     // number of elements
+  size_t capacity; // 0 or a power of two
+  T *elements;
+} Self;
+
+// ============== PUBLIC API ==================== //
+// These functions are meant to be used to interact with the deque structure
+// you are NOT supposed to modify the struct memebers directly.
+
+static inline void _lc_mfunc(init)(Self *self, size_t capacity);
+static inline void _lc_mfunc(push_back)(Self *self, T value);
+static inline void _lc_mfunc(push_front)(Self *self, T value);
+static inline T _lc_mfunc(pop_back)(Self *self);
+static inline T _lc_mfunc(pop_front)(Self *self);
+static inline T _lc_mfunc(front)(Self *self);
+static inline T _lc_mfunc(back)(Self *self);
+static inline T _lc_mfunc(at)(Self *self, size_t index);
+static inline T *_lc_mfunc(at_ptr)(Self *self, size_t index);
+static inline void _lc_mfunc(push_back_many)(Self *self, T const *values,
+                                             size_t n);
+static inline size_t _lc_mfunc(pop_front_many)(Self *self, T *out, size_t n);
+static inline void _lc_mfunc(reserve)(Self *self, size_t capacity);
+static inline void _lc_mfunc(clear)(Self *self);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline bool _lc_mfunc(check_health)(Self *self);
+
+// ============== PRIVATE API =================== //
+
+static inline size_t _lc_mfunc_priv(slot)(Self *self, size_t index);
+static inline void _lc_mfunc_priv(grow)(Self *self, size_t min_capacity);
+
+static inline void
+_lc_mfunc(init)(Self *self, size_t capacity) {
+  memset(self, 0, sizeof(*self));
+  if (capacity)
+    _lc_mfunc_priv(grow)(self, capacity);
+}
+
+static inline void
+_lc_mfunc(push_back)(Self *self, T value) {
+  if (self->size == self->capacity)
+    _lc_mfunc_priv(grow)(self, self->size + 1);
+  self->elements[_lc_mfunc_priv(slot)(self, self->size)] = value;
+  self->size++;
+}
+
+static inline void
+_lc_mfunc(push_front)(Self *self, T value) {
+  if (self->size == self->capacity)
+    _lc_mfunc_priv(grow)(self, self->size + 1);
+  self->head = (self->head - 1) & (self->capacity - 1);
+  self->elements[self->head] = value;
+  self->size++;
+}
+
+static inline T
+_lc_mfunc(pop_back)(Self *self) {
+  assert(self->size > 0);
+  self->size--;
+  return self->elements[_lc_mfunc_priv(slot)(self, self->size)];
+}
+
+static inline T
+_lc_mfunc(pop_front)(Self *self) {
+  assert(self->size > 0);
+  T value = self->elements[self->head];
+  self->head = (self->head + 1) & (self->capacity - 1);
+  self->size--;
+  return value;
+}
+
+static inline T
+_lc_mfunc(front)(Self *self) {
+  assert(self->size > 0);
+  return self->elements[self->head];
+}
+
+static inline T
+_lc_mfunc(back)(Self *self) {
+  assert(self->size > 0);
+  return self->elements[_lc_mfunc_priv(slot)(self, self->size - 1)];
+}
+
+static inline T
+_lc_mfunc(at)(Self *self, size_t index) {
+  assert(index < self->size);
+  return self->elements[_lc_mfunc_priv(slot)(self, index)];
+}
+
+// Pointer to the element at 'index', valid until the deque grows.
+static inline T *
+_lc_mfunc(at_ptr)(Self *self, size_t index) {
+  assert(index < self->size);
+  return self->elements + _lc_mfunc_priv(slot)(self, index);
+}
+
+// Appends 'n' values copied from 'values', which must not point into the
+// deque itself.
+static inline void
+_lc_mfunc(push_back_many)(Self *self, T const *values, size_t n) {
+  if (n == 0)
+    return;
+  if (self->size + n > self->capacity)
+    _lc_mfunc_priv(grow)(self, self->size + n);
+  size_t start = _lc_mfunc_priv(slot)(self, self->size);
+  size_t first = self->capacity - start < n ? self->capacity - start : n;
+  memcpy(self->elements + start, values, first * sizeof(T));
+  memcpy(self->elements, values + first, (n - first) * sizeof(T));
+  self->size += n;
+}
+
+// Moves up to 'n' elements from the front into 'out' and returns how many
+// were moved.
+static inline size_t
+_lc_mfunc(pop_front_many)(Self *self, T *out, size_t n) {
+  if (n > self->size)
+    n = self->size;
+  if (n == 0)
+    return 0;
+  size_t first = self->capacity - self->head < n ? self->capacity - self->head
+                                                 : n;
+  memcpy(out, self->elements + self->head, first * sizeof(T));
+  memcpy(out + first, self->elements, (n - first) * sizeof(T));
+  self->head = (self->head + n) & (self->capacity - 1);
+  self->size -= n;
+  return n;
+}
+
+// Makes room for at least 'capacity' elements, never shrinks.
+static inline void
+_lc_mfunc(reserve)(Self *self, size_t capacity) {
+  if (capacity > self->capacity)
+    _lc_mfunc_priv(grow)(self, capacity);
+}
+
+// Drops every element, the buffer is kept.
+static inline void
+_lc_mfunc(clear)(Self *self) {
+#ifndef _lc_trivial_drop
+  for (size_t i = 0; i < self->size; i++)
+    lcore_drop_fn(self->elements[_lc_mfunc_priv(slot)(self, i)]);
+#endif // _lc_trivial_drop
+  self->head = 0;
+  self->size = 0;
+}
+
+static inline void
+_lc_mfunc(destroy)(Self *self) {
+  _lc_mfunc(clear)(self);
+  free(self->elements);
+  memset(self, 0, sizeof(*self));
+}
+
+static inline bool
+_lc_mfunc(check_health)(Self *self) {
+  return self->size <= self->capacity &&
+         (self->capacity & (self->capacity - 1)) == 0 &&
+         (self->capacity == 0 || (self->elements != NULL &&
+                                  self->head < self->capacity));
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+// Position in 'elements' of the element at 'index'.
+static inline size_t
+_lc_mfunc_priv(slot)(Self *self, size_t index) {
+  return (self->head + index) & (self->capacity - 1);
+}
+
+// Doubles the capacity (16 for an empty deque) until it holds at least
+// 'min_capacity' elements.
+static inline void
+_lc_mfunc_priv(grow)(Self *self, size_t min_capacity) {
+  size_t old = self->capacity;
+  size_t capacity = old ? old : 16;
+  while (capacity < min_capacity)
+    capacity <<= 1;
+  T *elements = (T *)realloc(self->elements, capacity * sizeof(T));
+  assert(elements != NULL);
+  // The elements that wrapped around to the start of the old buffer now go
+  // right after its end, where the ring continues in the larger one.
+  size_t wrapped = self->head + self->size > old ? self->head + self->size - old
+                                                 : 0;
+  if (wrapped)
+    memcpy(elements + old, elements, wrapped * sizeof(T));
+  self->elements = elements;
+  self->capacity = capacity;
+}
+
+#undef T
+#undef Self
+#undef lcore_drop_fn
+#undef _lc_trivial_drop
+#undef lcore_pfx
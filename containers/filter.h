@@ -0,0 +1,239 @@
+#include "_lc_hash.h"
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Approximate set membership: contains() never misses a key that was
+// inserted, but may report a key that was not with a small probability, in
+// exchange for a few bits per key and one or two cache lines per lookup.
+// Keys are never stored, only their hashes are looked at.
+//
+// Takes the same parameters as unordered_set.h ('T', 'lcore_hash_fn',
+// 'lcore_batch_window', 'lcore_pfx'):
+//
+// #define T uint64_t
+// #define lcore_pfx seen
+// #include "containers/filter.h"
+//
+// seen s;
+// seen_init(&s, 1000000, 0.01); // expected keys, false positive rate
+//
+// By default the filter is a cache-line blocked Bloom filter (see
+// _lc_bloom.h): every operation touches one 64 byte block and the rate is
+// tunable, but keys can not be removed. Defining 'lcore_cuckoo_filter'
+// switches to a cuckoo filter (see _lc_cuckoo.h) that supports remove() and
+// reads two 8 byte buckets per lookup. Its rate is fixed by its 16 bit
+// fingerprints to about 0.012% and init() ignores 'fpr'; insert() fails once
+// the filter is full, which happens past roughly the capacity it was sized
+// for.
+//
+// unordered_set.h and unordered_map.h can embed a Bloom filter themselves
+// with 'lcore_filter', so negative lookups never reach the table.
+
+#ifndef T
+#define T int
+#endif // T
+
+#ifndef lcore_hash_fn
+#define lcore_hash_fn(x) lc_hash_int((uint64_t)(x))
+#endif // lcore_hash_fn
+
+#ifndef lcore_batch_window
+#define lcore_batch_window 16
+#endif // lcore_batch_window
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, filter)
+#endif // lcore_pfx
+
+#define Self lcore_pfx
+
+#ifdef lcore_cuckoo_filter
+#include "_lc_cuckoo.h"
+#else
+#include "_lc_bloom.h"
+#endif // lcore_cuckoo_filter
+
+typedef struct {
+  size_t size; // keys inserted (minus the ones removed)
+#ifdef lcore_cuckoo_filter
+  lc_cuckoo cuckoo;
+#else
+  lc_bloom bloom;
+#endif // lcore_cuckoo_filter
+} Self;
+
+// ============== PUBLIC API ==================== //
+// These functions are meant to be used to interact with the filter structure
+// you are NOT supposed to modify the struct memebers directly.
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity, double fpr);
+static inline bool _lc_mfunc(insert)(Self *self, T key);
+static inline bool _lc_mfunc(contains)(Self *self, T key);
+static inline void _lc_mfunc(clear)(Self *self);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline size_t _lc_mfunc(bytes)(Self *self);
+static inline bool _lc_mfunc(insert_hashed)(Self *self, uint64_t hash);
+static inline bool _lc_mfunc(contains_hashed)(Self *self, uint64_t hash);
+static inline size_t _lc_mfunc(insert_many)(Self *self, T const *keys,
+                                            size_t n);
+static inline size_t _lc_mfunc(contains_many)(Self *self, T const *keys,
+                                              size_t n, bool *found);
+#ifdef lcore_cuckoo_filter
+static inline bool _lc_mfunc(remove)(Self *self, T key);
+static inline bool _lc_mfunc(remove_hashed)(Self *self, uint64_t hash);
+#endif // lcore_cuckoo_filter
+
+// ============= PRIVATE FUNCTIONS ============== //
+
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h);
+
+// ============ API IMPLEMENTATION ============== //
+
+// Sizes the filter for 'capacity' keys at a false positive rate of 'fpr'
+// (0 < fpr < 1, Bloom filter only). False when the filter can not be
+// allocated.
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity, double fpr) {
+  memset(self, 0, sizeof(*self));
+#ifdef lcore_cuckoo_filter
+  (void)fpr;
+  return lc_cuckoo_init(&self->cuckoo, capacity);
+#else
+  return lc_bloom_init(&self->bloom, capacity, fpr);
+#endif // lcore_cuckoo_filter
+}
+
+// False when the key could not be added (full cuckoo filter).
+static inline bool _lc_mfunc(insert)(Self *self, T key) {
+  return _lc_mfunc(insert_hashed)(self, lcore_hash_fn(key));
+}
+
+static inline bool _lc_mfunc(contains)(Self *self, T key) {
+  return _lc_mfunc(contains_hashed)(self, lcore_hash_fn(key));
+}
+
+static inline void _lc_mfunc(clear)(Self *self) {
+#ifdef lcore_cuckoo_filter
+  lc_cuckoo_clear(&self->cuckoo);
+#else
+  lc_bloom_clear(&self->bloom);
+#endif // lcore_cuckoo_filter
+  self->size = 0;
+}
+
+static inline void _lc_mfunc(destroy)(Self *self) {
+  if (!self)
+    return;
+#ifdef lcore_cuckoo_filter
+  lc_cuckoo_release(&self->cuckoo);
+#else
+  lc_bloom_release(&self->bloom);
+#endif // lcore_cuckoo_filter
+  memset(self, 0, sizeof(*self));
+}
+
+// Memory taken by the filter's bits.
+static inline size_t _lc_mfunc(bytes)(Self *self) {
+#ifdef lcore_cuckoo_filter
+  return lc_cuckoo_bytes(&self->cuckoo);
+#else
+  return lc_bloom_bytes(&self->bloom);
+#endif // lcore_cuckoo_filter
+}
+
+// ============ PRECOMPUTED HASHES ============== //
+// Same as insert() and contains() for callers that already know the hash of
+// the key, which must be lcore_hash_fn(key).
+
+static inline bool _lc_mfunc(insert_hashed)(Self *self, uint64_t hash) {
+#ifdef lcore_cuckoo_filter
+  if (!lc_cuckoo_add(&self->cuckoo, hash))
+    return false;
+#else
+  lc_bloom_add(&self->bloom, hash);
+#endif // lcore_cuckoo_filter
+  self->size++;
+  return true;
+}
+
+static inline bool _lc_mfunc(contains_hashed)(Self *self, uint64_t hash) {
+#ifdef lcore_cuckoo_filter
+  return lc_cuckoo_test(&self->cuckoo, hash);
+#else
+  return lc_bloom_test(&self->bloom, hash);
+#endif // lcore_cuckoo_filter
+}
+
+#ifdef lcore_cuckoo_filter
+// Removes a key that was inserted, false if the filter does not hold it.
+// Removing a key that was never inserted may remove another key sharing
+// its fingerprint, which contains() would then miss.
+static inline bool _lc_mfunc(remove)(Self *self, T key) {
+  return _lc_mfunc(remove_hashed)(self, lcore_hash_fn(key));
+}
+
+static inline bool _lc_mfunc(remove_hashed)(Self *self, uint64_t hash) {
+  if (!lc_cuckoo_remove(&self->cuckoo, hash))
+    return false;
+  self->size--;
+  return true;
+}
+#endif // lcore_cuckoo_filter
+
+// ============ BATCHED OPERATIONS ============== //
+// Keys are processed in windows of 'lcore_batch_window': all the hashes of a
+// window are computed and their cache lines prefetched before any key is
+// resolved, so the misses of the whole window overlap.
+
+static inline size_t _lc_mfunc(insert_many)(Self *self, T const *keys,
+                                            size_t n) {
+  uint64_t hashes[lcore_batch_window];
+  size_t inserted = 0;
+  for (size_t base = 0; base < n; base += lcore_batch_window) {
+    size_t m = n - base < lcore_batch_window ? n - base : lcore_batch_window;
+    for (size_t i = 0; i < m; i++) {
+      hashes[i] = lcore_hash_fn(keys[base + i]);
+      _lc_mfunc_priv(prefetch)(self, hashes[i]);
+    }
+    for (size_t i = 0; i < m; i++)
+      inserted += _lc_mfunc(insert_hashed)(self, hashes[i]);
+  }
+  return inserted;
+}
+
+// Stores in 'found' (when not NULL) whether each key may be in the filter
+// and returns how many may be.
+static inline size_t _lc_mfunc(contains_many)(Self *self, T const *keys,
+                                              size_t n, bool *found) {
+  uint64_t hashes[lcore_batch_window];
+  size_t hits = 0;
+  for (size_t base = 0; base < n; base += lcore_batch_window) {
+    size_t m = n - base < lcore_batch_window ? n - base : lcore_batch_window;
+    for (size_t i = 0; i < m; i++) {
+      hashes[i] = lcore_hash_fn(keys[base + i]);
+      _lc_mfunc_priv(prefetch)(self, hashes[i]);
+    }
+    for (size_t i = 0; i < m; i++) {
+      bool hit = _lc_mfunc(contains_hashed)(self, hashes[i]);
+      if (found)
+        found[base + i] = hit;
+      hits += hit;
+    }
+  }
+  return hits;
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h) {
+#ifdef lcore_cuckoo_filter
+  lc_cuckoo_prefetch(&self->cuckoo, h);
+#else
+  lc_bloom_prefetch(&self->bloom, h);
+#endif // lcore_cuckoo_filter
+}
+
+#undef T
+#undef lcore_hash_fn
+#undef lcore_batch_window
+#undef lcore_pfx
+#undef lcore_cuckoo_filter
+#undef Self
@@ -0,0 +1,423 @@
+#include "_lc_simd.h"
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Immutable ordered map from K to V, built once from sorted keys and then
+// only queried: lookups touch a handful of cache lines and no pointers.
+//
+// #define K uint64_t
+// #define V uint32_t
+// #define lcore_pfx routes
+// #include "containers/flat_map.h"
+//
+// routes r;
+// routes_init(&r);
+// routes_build(&r, keys, values, n); // keys sorted, no duplicates
+// uint32_t *v = routes_find(&r, 42);
+//
+// build() copies its arrays, which typically come from a vector.h instance
+// after sort() (data() and size) or from an in-order walk of a red black
+// tree (first() and iter_next()). The map then owns the copies, destroy()
+// runs 'lcore_drop_k' and 'lcore_drop_v' on them. Keys are ordered by the
+// three-way 'lcore_cmp_fn', as in the trees.
+//
+// The keys are stored in Eytzinger order: the root at index 1, the children
+// of node k at 2k and 2k + 1, i.e. a binary search tree laid out level by
+// level in a single array. A lookup walks down without branches (the next
+// index is computed from the comparison) and prefetches the cache line
+// holding the descendants of the current node several levels ahead, 16 ints
+// or 8 64 bit keys in one line, so the misses of consecutive levels overlap.
+// The values are only read once the key is found. The map takes
+// (n + 1) * (sizeof(K) + sizeof(V)) bytes, versus a node of three pointers
+// per key for the red black tree.
+//
+// Defining 'lcore_flat_simd' keeps the keys sorted instead, split in blocks
+// of one cache line, and builds the Eytzinger tree only over the last key of
+// every block: a lookup walks that much smaller index down to a block, then
+// searches the block with one vectorized pass (see _lc_simd.h) when K is a
+// 32 or 64 bit integer ordered by the default comparison, a branchless
+// linear one otherwise. The index is padded to a complete tree, so every
+// lookup walks the same number of levels and the path taken is the block
+// number. Sorted storage also makes iteration sequential.
+
+#ifndef K
+#define K int
+#endif // K
+
+#ifndef V
+#define V int
+#endif // V
+
+#ifndef lcore_cmp_fn
+#define _lc_default_cmp
+#define lcore_cmp_fn(a, b) (((a) > (b)) - ((a) < (b)))
+#endif // lcore_cmp_fn
+
+#if !defined(lcore_drop_k) && !defined(lcore_drop_v)
+#define _lc_trivial_drop
+#endif
+
+#ifndef lcore_drop_k
+#define lcore_drop_k(x)
+#endif // lcore_drop_k
+
+#ifndef lcore_drop_v
+#define lcore_drop_v(x)
+#endif // lcore_drop_v
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(_lc_join(K, V), fmap)
+#endif // lcore_pfx
+
+#ifndef LC_CACHE_LINE
+#define LC_CACHE_LINE 64
+#endif // LC_CACHE_LINE
+
+#define Self lcore_pfx
+#define _Iter _lc_join(Self, iter)
+
+// Whether 'a' is before 'b'. The default comparison is a single '<', which
+// keeps the compare-and-step of a lookup level to a couple of instructions.
+#ifdef _lc_default_cmp
+#define _lc_less(a, b) ((a) < (b))
+#else
+#define _lc_less(a, b) (lcore_cmp_fn(a, b) < 0)
+#endif // _lc_default_cmp
+
+// Step down from node 'k' holding 'x': right when 'x' is before 'key' (or,
+// for an upper bound, equal to it).
+#define _lc_step(k, x, key, upper)                                             \
+  (2 * (k) + ((upper) ? !_lc_less(key, x) : _lc_less(x, key)))
+
+// Keys per cache line: how far ahead a lookup prefetches, and the size of a
+// block with lcore_flat_simd.
+#define _LineKeys (sizeof(K) < LC_CACHE_LINE ? LC_CACHE_LINE / sizeof(K) : 1)
+
+// ========== STRUCTS DEFINITIONS ============== //
+
+typedef struct Self {
+  size_t size; // number of keys
+#ifdef lcore_flat_simd
+  size_t nblocks;  // blocks of _LineKeys keys, the last one may be shorter
+  unsigned height; // levels of the index, a tree of 2^height - 1 keys
+  K *index;        // last key of each block in Eytzinger order, from 1
+  K *keys;         // sorted, each block on its own cache line
+  V *values;       // same order as 'keys'
+#else
+  K *keys;   // Eytzinger order, from index 1
+  V *values; // same order as 'keys'
+#endif // lcore_flat_simd
+} Self;
+
+// Position in the map, valid until the map is destroyed or rebuilt.
+typedef struct {
+  const Self *map;
+  size_t pos; // index into 'keys', past the end when done
+} _Iter;
+
+// ============== PUBLIC API ==================== //
+// These functions are meant to be used to interact with the map structure
+// you are NOT supposed to modify the struct memebers directly.
+
+static inline void _lc_mfunc(init)(Self *self);
+static inline bool _lc_mfunc(build)(Self *self, K const *keys,
+                                    V const *values, size_t n);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline size_t _lc_mfunc(size)(Self *self);
+static inline size_t _lc_mfunc(bytes)(Self *self);
+static inline V *_lc_mfunc(find)(Self *self, K key);
+static inline bool _lc_mfunc(contains)(Self *self, K key);
+static inline _Iter _lc_mfunc(first)(Self *self);
+static inline _Iter _lc_mfunc(lower_bound)(Self *self, K key);
+static inline _Iter _lc_mfunc(upper_bound)(Self *self, K key);
+static inline bool _lc_mfunc(iter_done)(_Iter it);
+static inline K _lc_mfunc(iter_key)(_Iter it);
+static inline V *_lc_mfunc(iter_value)(_Iter it);
+static inline void _lc_mfunc(iter_next)(_Iter *it);
+
+// ============= PRIVATE FUNCTIONS ============== //
+// These functions are not meant to be called directly, they are helpers used
+// inside the public API implementation
+
+static inline size_t _lc_mfunc_priv(end)(const Self *self);
+static inline size_t _lc_mfunc_priv(search)(const Self *self, K key,
+                                            bool upper);
+#ifdef lcore_flat_simd
+static inline void _lc_mfunc_priv(fill_index)(Self *self, size_t *block,
+                                              size_t k);
+static inline size_t _lc_mfunc_priv(rank_cmp)(K const *keys, size_t n,
+                                              K key);
+#else
+static inline void _lc_mfunc_priv(fill)(Self *self, K const *keys,
+                                        V const *values, size_t *i,
+                                        size_t k);
+#endif // lcore_flat_simd
+
+// ========== PUBLIC API IMPLEMENTATION ========= //
+
+static inline void _lc_mfunc(init)(Self *self) {
+  memset(self, 0, sizeof(*self));
+}
+
+// Replaces the content of the map with the 'n' pairs keys[i] -> values[i].
+// The keys must be sorted by lcore_cmp_fn without duplicates. False, leaving
+// the map empty, when the memory can not be allocated.
+static inline bool _lc_mfunc(build)(Self *self, K const *keys,
+                                    V const *values, size_t n) {
+  _lc_mfunc(destroy)(self);
+  for (size_t i = 1; i < n; i++)
+    assert(lcore_cmp_fn(keys[i - 1], keys[i]) < 0);
+#ifdef lcore_flat_simd
+  size_t nblocks = (n + _LineKeys - 1) / _LineKeys;
+  unsigned height = 0;
+  while (((size_t)1 << height) - 1 < nblocks)
+    height++;
+  size_t kbytes = ((nblocks ? nblocks : 1) * _LineKeys * sizeof(K) +
+                   LC_CACHE_LINE - 1) &
+                  ~(size_t)(LC_CACHE_LINE - 1);
+  size_t ibytes = (((size_t)1 << height) * sizeof(K) + LC_CACHE_LINE - 1) &
+                  ~(size_t)(LC_CACHE_LINE - 1);
+  self->keys = (K *)aligned_alloc(LC_CACHE_LINE, kbytes);
+  self->index = (K *)aligned_alloc(LC_CACHE_LINE, ibytes);
+  self->values = lc_malloc(V, (n ? n : 1) * sizeof(V));
+  if (!self->keys || !self->index || !self->values) {
+    _lc_mfunc(destroy)(self);
+    return false;
+  }
+  if (n) {
+    memcpy(self->keys, keys, n * sizeof(K));
+    memcpy(self->values, values, n * sizeof(V));
+  }
+  self->size = n;
+  self->nblocks = nblocks;
+  self->height = height;
+  size_t block = 0;
+  _lc_mfunc_priv(fill_index)(self, &block, 1);
+#else
+  size_t kbytes = ((n + 1) * sizeof(K) + LC_CACHE_LINE - 1) &
+                  ~(size_t)(LC_CACHE_LINE - 1);
+  self->keys = (K *)aligned_alloc(LC_CACHE_LINE, kbytes);
+  self->values = lc_malloc(V, (n + 1) * sizeof(V));
+  if (!self->keys || !self->values) {
+    _lc_mfunc(destroy)(self);
+    return false;
+  }
+  self->size = n;
+  size_t i = 0;
+  _lc_mfunc_priv(fill)(self, keys, values, &i, 1);
+#endif // lcore_flat_simd
+  return true;
+}
+
+static inline void _lc_mfunc(destroy)(Self *self) {
+#ifndef _lc_trivial_drop
+  for (_Iter it = _lc_mfunc(first)(self); !_lc_mfunc(iter_done)(it);
+       _lc_mfunc(iter_next)(&it)) {
+    lcore_drop_k(self->keys[it.pos]);
+    lcore_drop_v(self->values[it.pos]);
+  }
+#endif // _lc_trivial_drop
+  free(self->keys);
+  free(self->values);
+#ifdef lcore_flat_simd
+  free(self->index);
+#endif // lcore_flat_simd
+  memset(self, 0, sizeof(*self));
+}
+
+static inline size_t _lc_mfunc(size)(Self *self) {
+  return self->size;
+}
+
+// Memory taken by the keys, the values and the index.
+static inline size_t _lc_mfunc(bytes)(Self *self) {
+  if (!self->keys)
+    return 0;
+#ifdef lcore_flat_simd
+  return self->nblocks * _LineKeys * sizeof(K) + self->size * sizeof(V) +
+         ((size_t)1 << self->height) * sizeof(K);
+#else
+  return (self->size + 1) * (sizeof(K) + sizeof(V));
+#endif // lcore_flat_simd
+}
+
+// Value of 'key', NULL when the map does not hold it.
+static inline V *_lc_mfunc(find)(Self *self, K key) {
+  size_t pos = _lc_mfunc_priv(search)(self, key, false);
+  if (pos == _lc_mfunc_priv(end)(self) ||
+      lcore_cmp_fn(self->keys[pos], key) != 0)
+    return NULL;
+  return &self->values[pos];
+}
+
+static inline bool _lc_mfunc(contains)(Self *self, K key) {
+  return _lc_mfunc(find)(self, key) != NULL;
+}
+
+// Smallest key of the map.
+static inline _Iter _lc_mfunc(first)(Self *self) {
+#ifdef lcore_flat_simd
+  return (_Iter){self, 0};
+#else
+  size_t k = self->size ? 1 : 0;
+  while (k && 2 * k <= self->size)
+    k = 2 * k;
+  return (_Iter){self, k};
+#endif // lcore_flat_simd
+}
+
+// Smallest key that is not smaller than 'key'.
+static inline _Iter _lc_mfunc(lower_bound)(Self *self, K key) {
+  return (_Iter){self, _lc_mfunc_priv(search)(self, key, false)};
+}
+
+// Smallest key that is larger than 'key'.
+static inline _Iter _lc_mfunc(upper_bound)(Self *self, K key) {
+  return (_Iter){self, _lc_mfunc_priv(search)(self, key, true)};
+}
+
+static inline bool _lc_mfunc(iter_done)(_Iter it) {
+  return it.pos == _lc_mfunc_priv(end)(it.map);
+}
+
+static inline K _lc_mfunc(iter_key)(_Iter it) {
+  assert(!_lc_mfunc(iter_done)(it));
+  return it.map->keys[it.pos];
+}
+
+static inline V *_lc_mfunc(iter_value)(_Iter it) {
+  assert(!_lc_mfunc(iter_done)(it));
+  return &it.map->values[it.pos];
+}
+
+// Moves to the next larger key.
+static inline void _lc_mfunc(iter_next)(_Iter *it) {
+  assert(!_lc_mfunc(iter_done)(*it));
+#ifdef lcore_flat_simd
+  it->pos++;
+#else
+  // In-order successor: the leftmost node of the right subtree, or else the
+  // first ancestor reached from its left subtree (0 past the largest key).
+  size_t k = it->pos, n = it->map->size;
+  if (2 * k + 1 <= n) {
+    k = 2 * k + 1;
+    while (2 * k <= n)
+      k = 2 * k;
+  } else {
+    k >>= __builtin_ffsll((long long)~k);
+  }
+  it->pos = k;
+#endif // lcore_flat_simd
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+// Position of iterators that are done.
+static inline size_t _lc_mfunc_priv(end)(const Self *self) {
+#ifdef lcore_flat_simd
+  return self->size;
+#else
+  (void)self;
+  return 0;
+#endif // lcore_flat_simd
+}
+
+// Position of the first key larger than 'key' when 'upper' is set, of the
+// first one not smaller than 'key' otherwise. Each step goes right when the
+// node is before 'key' (and left otherwise), so the bits of 'k' below its
+// leading one record the path taken.
+static inline size_t _lc_mfunc_priv(search)(const Self *self, K key,
+                                            bool upper) {
+#ifdef lcore_flat_simd
+  K const *index = self->index;
+  size_t k = 1;
+  for (unsigned level = 0; level < self->height; level++) {
+    lc_prefetch(index + k * _LineKeys);
+    k = _lc_step(k, index[k], key, upper);
+  }
+  // In a complete tree every path has the same length, and the path of a key
+  // read as a number is how many index keys are before it: the block.
+  size_t block = k - ((size_t)1 << self->height);
+  if (block >= self->nblocks)
+    return self->size;
+  size_t base = block * _LineKeys;
+  size_t n = self->size - base < _LineKeys ? self->size - base : _LineKeys;
+  K const *keys = self->keys + base;
+  size_t r;
+#ifdef _lc_default_cmp
+  r = lc_count_dispatch(key, _lc_mfunc_priv(rank_cmp))(keys, n, key);
+#else
+  r = _lc_mfunc_priv(rank_cmp)(keys, n, key);
+#endif // _lc_default_cmp
+  // The block's last key is not before 'key', so 'r' is in the block.
+  if (upper && lcore_cmp_fn(keys[r], key) == 0)
+    r++;
+  return base + r;
+#else
+  K const *keys = self->keys;
+  size_t n = self->size, k = 1;
+  while (k <= n) {
+    lc_prefetch(keys + k * _LineKeys);
+    k = _lc_step(k, keys[k], key, upper);
+  }
+  // Undo the right turns taken since the last left one: that node is the
+  // answer (0, the end, when the walk never went left).
+  return k >> __builtin_ffsll((long long)~k);
+#endif // lcore_flat_simd
+}
+
+#ifdef lcore_flat_simd
+// Stores the index subtree rooted at 'k' in order, '*block' being the next
+// block to record. Padding slots repeat the largest key, so no search ends
+// past the last block unless the key is larger than every other.
+static inline void _lc_mfunc_priv(fill_index)(Self *self, size_t *block,
+                                              size_t k) {
+  if (k >= (size_t)1 << self->height)
+    return;
+  _lc_mfunc_priv(fill_index)(self, block, 2 * k);
+  size_t b = *block < self->nblocks ? *block : self->nblocks - 1;
+  size_t last = (b + 1) * _LineKeys - 1;
+  self->index[k] = self->keys[last < self->size ? last : self->size - 1];
+  (*block)++;
+  _lc_mfunc_priv(fill_index)(self, block, 2 * k + 1);
+}
+
+// Number of 'keys' smaller than 'key', counted without branches: a block is
+// a single cache line, a full pass costs less than mispredicted jumps.
+static inline size_t _lc_mfunc_priv(rank_cmp)(K const *keys, size_t n,
+                                              K key) {
+  size_t r = 0;
+  for (size_t i = 0; i < n; i++)
+    r += _lc_less(keys[i], key);
+  return r;
+}
+#else
+// Copies the pairs into the subtree rooted at 'k' in order, '*i' being the
+// next pair to place.
+static inline void _lc_mfunc_priv(fill)(Self *self, K const *keys,
+                                        V const *values, size_t *i,
+                                        size_t k) {
+  if (k > self->size)
+    return;
+  _lc_mfunc_priv(fill)(self, keys, values, i, 2 * k);
+  self->keys[k] = keys[*i];
+  self->values[k] = values[*i];
+  (*i)++;
+  _lc_mfunc_priv(fill)(self, keys, values, i, 2 * k + 1);
+}
+#endif // lcore_flat_simd
+
+#undef K
+#undef V
+#undef Self
+#undef _Iter
+#undef _LineKeys
+#undef _lc_less
+#undef _lc_step
+#undef lcore_pfx
+#undef lcore_cmp_fn
+#undef _lc_default_cmp
+#undef lcore_drop_k
+#undef lcore_drop_v
+#undef _lc_trivial_drop
+#undef lcore_flat_simd
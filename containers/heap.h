@@ -0,0 +1,540 @@
+#include "_lc_templating.h"
+#include <stdbool.h>
+
+// Priority queue of T, top() being its smallest element according to
+// 'lcore_less_fn' (or a three-way 'lcore_cmp_fn', as used by the trees).
+//
+// #define T uint64_t
+// #define lcore_less_fn(a, b) ((a) < (b))
+// #define lcore_pfx timers
+// #include "containers/heap.h"
+//
+// The heap is d-ary, with 'lcore_arity' children per node (4 by default):
+// the tree is log2(d) times shallower than a binary heap's, so a pop walks
+// that many fewer levels, each comparing d siblings stored next to each
+// other. The elements live in a vector-like array (size, capacity, growth by
+// 'lcore_growth_factor') whose start is offset so that every group of
+// siblings begins on a cache line boundary: with d * sizeof(T) == 64 (8-ary
+// for 8 byte elements) a level costs exactly one cache line.
+//
+// Defining 'lcore_heap_index' keeps the position of every element in an
+// index: push_handle() returns a handle for the new element, which
+// decrease_key(), update(), erase() and get() then find in O(1). A handle
+// stays valid until its element is popped or erased, after which it may be
+// handed out again.
+//
+// Defining 'lcore_radix_heap' switches to a radix heap for monotone integer
+// priorities, as produced by timers and Dijkstra-like searches: the key of
+// an element ('lcore_key_fn', the element itself by default) must never be
+// smaller than the key of the last element popped. Pushes are O(1) appends
+// into one of 65 buckets picked by the highest bit in which the key differs
+// from the last popped one, and every element moves to a lower bucket at most
+// 64 times over its lifetime, without any comparison between elements.
+
+#ifndef T
+#define T int
+#endif // T
+
+#if defined(lcore_cmp_fn) && !defined(lcore_less_fn)
+#define lcore_less_fn(a, b) (lcore_cmp_fn(a, b) < 0)
+#endif // lcore_cmp_fn
+
+#ifndef lcore_less_fn
+#define lcore_less_fn(a, b) ((a) < (b))
+#endif // lcore_less_fn
+
+#ifndef lcore_drop_fn
+#define lcore_drop_fn(x)
+#endif // lcore_drop_fn
+
+#ifndef lcore_arity
+#define lcore_arity 4
+#endif // lcore_arity
+
+#ifndef lcore_growth_factor
+#define lcore_growth_factor 2
+#endif // lcore_growth_factor
+
+#ifndef lcore_key_fn
+#define lcore_key_fn(x) ((uint64_t)(x))
+#endif // lcore_key_fn
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, heap)
+#endif // lcore_pfx
+
+#if (lcore_arity) < 2
+#error "lcore_arity must be at least 2"
+#endif
+#if defined(lcore_radix_heap) && defined(lcore_heap_index)
+#error "lcore_heap_index is not available with lcore_radix_heap"
+#endif
+
+#ifndef LC_CACHE_LINE
+#define LC_CACHE_LINE 64
+#endif // LC_CACHE_LINE
+
+#define Self lcore_pfx
+
+#ifdef lcore_radix_heap
+#define _Bucket _lc_join(Self, bucket)
+#define _LC_RADIX_BUCKETS 65
+
+typedef struct {
+  size_t size, capacity;
+  T *elements;
+} _Bucket;
+
+typedef struct {
+  size_t size;
+  uint64_t last; // key of the last element popped, the lower bound of keys
+  // Bucket 0 holds the keys equal to 'last', bucket b > 0 those whose
+  // highest bit differing from 'last' is bit b - 1.
+  _Bucket buckets[_LC_RADIX_BUCKETS];
+} Self;
+#else
+typedef struct {
+  size_t size, capacity;
+  T *elements; // lcore_arity - 1 slots past a cache line boundary
+#ifdef lcore_heap_index
+  size_t *handles;    // handle of the element at each position
+  size_t *pos;        // position of each handle, next free one when released
+  size_t nhandles;    // handles handed out so far
+  size_t free_handle; // last handle released, SIZE_MAX when none
+#endif // lcore_heap_index
+} Self;
+#endif // lcore_radix_heap
+
+// ============== PUBLIC API ==================== //
+// These functions are meant to be used to interact with the heap structure
+// you are NOT supposed to modify the struct memebers directly.
+
+static inline void _lc_mfunc(init)(Self *self, size_t capacity);
+static inline void _lc_mfunc(push)(Self *self, T value);
+static inline T _lc_mfunc(top)(Self *self);
+static inline T _lc_mfunc(pop)(Self *self);
+static inline void _lc_mfunc(destroy)(Self *self);
+#ifndef lcore_radix_heap
+static inline void _lc_mfunc(reserve)(Self *self, size_t capacity);
+static inline void _lc_mfunc(heapify)(Self *self, T const *values, size_t n);
+#endif // lcore_radix_heap
+#ifdef lcore_heap_index
+static inline size_t _lc_mfunc(push_handle)(Self *self, T value);
+static inline size_t _lc_mfunc(top_handle)(Self *self);
+static inline T _lc_mfunc(get)(Self *self, size_t handle);
+static inline void _lc_mfunc(decrease_key)(Self *self, size_t handle,
+                                           T value);
+static inline void _lc_mfunc(update)(Self *self, size_t handle, T value);
+static inline T _lc_mfunc(erase)(Self *self, size_t handle);
+#endif // lcore_heap_index
+
+// ============== PRIVATE API =================== //
+
+#ifdef lcore_radix_heap
+static inline unsigned _lc_mfunc_priv(bucket_of)(Self *self, uint64_t key);
+static inline void _lc_mfunc_priv(append)(_Bucket *bucket, T value);
+static inline void _lc_mfunc_priv(pull)(Self *self);
+#else
+static inline void _lc_mfunc_priv(sift_up)(Self *self, size_t i, T value,
+                                           size_t handle);
+static inline void _lc_mfunc_priv(sift_down)(Self *self, size_t i, T value,
+                                             size_t handle);
+static inline void _lc_mfunc_priv(move)(Self *self, size_t from, size_t to);
+static inline void _lc_mfunc_priv(place)(Self *self, size_t i, T value,
+                                         size_t handle);
+static inline void _lc_mfunc_priv(set_capacity)(Self *self, size_t capacity);
+#ifdef lcore_heap_index
+static inline size_t _lc_mfunc_priv(take_handle)(Self *self);
+static inline void _lc_mfunc_priv(release_handle)(Self *self, size_t handle);
+#endif // lcore_heap_index
+#endif // lcore_radix_heap
+
+#ifdef lcore_radix_heap
+
+// ========= RADIX HEAP IMPLEMENTATION ========== //
+
+// 'capacity' is only a hint, the buckets grow on demand.
+static inline void
+_lc_mfunc(init)(Self *self, size_t capacity) {
+  (void)capacity;
+  memset(self, 0, sizeof(*self));
+}
+
+static inline void
+_lc_mfunc(push)(Self *self, T value) {
+  uint64_t key = lcore_key_fn(value);
+  assert(key >= self->last);
+  _lc_mfunc_priv(append)(
+      &self->buckets[_lc_mfunc_priv(bucket_of)(self, key)], value);
+  self->size++;
+}
+
+static inline T
+_lc_mfunc(top)(Self *self) {
+  assert(self->size > 0);
+  _lc_mfunc_priv(pull)(self);
+  _Bucket *b = &self->buckets[0];
+  return b->elements[b->size - 1];
+}
+
+static inline T
+_lc_mfunc(pop)(Self *self) {
+  assert(self->size > 0);
+  _lc_mfunc_priv(pull)(self);
+  self->size--;
+  _Bucket *b = &self->buckets[0];
+  return b->elements[--b->size];
+}
+
+static inline void
+_lc_mfunc(destroy)(Self *self) {
+  if (!self)
+    return;
+  for (unsigned i = 0; i < _LC_RADIX_BUCKETS; i++) {
+    _Bucket *b = &self->buckets[i];
+    for (size_t j = 0; j < b->size; j++)
+      lcore_drop_fn(b->elements[j]);
+    free(b->elements);
+  }
+  memset(self, 0, sizeof(*self));
+}
+
+static inline unsigned
+_lc_mfunc_priv(bucket_of)(Self *self, uint64_t key) {
+  uint64_t diff = key ^ self->last;
+  return diff ? 64 - (unsigned)__builtin_clzll(diff) : 0;
+}
+
+static inline void
+_lc_mfunc_priv(append)(_Bucket *bucket, T value) {
+  if (bucket->size == bucket->capacity) {
+    size_t capacity = (size_t)((double)bucket->capacity * lcore_growth_factor);
+    if (capacity <= bucket->capacity)
+      capacity = bucket->capacity ? bucket->capacity + 1 : 16;
+    T *elements = (T *)realloc(bucket->elements, sizeof(T) * capacity);
+    assert(elements);
+    bucket->elements = elements;
+    bucket->capacity = capacity;
+  }
+  bucket->elements[bucket->size++] = value;
+}
+
+// Refills bucket 0 when it is empty: the smallest key of the first non-empty
+// bucket becomes 'last' and that bucket's elements spread over the lower
+// buckets, at least one of them into bucket 0.
+static inline void
+_lc_mfunc_priv(pull)(Self *self) {
+  if (self->buckets[0].size)
+    return;
+  unsigned i = 1;
+  while (self->buckets[i].size == 0)
+    i++;
+  _Bucket *b = &self->buckets[i];
+  uint64_t min = lcore_key_fn(b->elements[0]);
+  for (size_t j = 1; j < b->size; j++) {
+    uint64_t key = lcore_key_fn(b->elements[j]);
+    min = key < min ? key : min;
+  }
+  self->last = min;
+  for (size_t j = 0; j < b->size; j++) {
+    unsigned k = _lc_mfunc_priv(bucket_of)(self, lcore_key_fn(b->elements[j]));
+    _lc_mfunc_priv(append)(&self->buckets[k], b->elements[j]);
+  }
+  b->size = 0;
+}
+
+#else
+
+// ========== D-ARY HEAP IMPLEMENTATION ========= //
+
+static inline void
+_lc_mfunc(init)(Self *self, size_t capacity) {
+  memset(self, 0, sizeof(*self));
+#ifdef lcore_heap_index
+  self->free_handle = SIZE_MAX;
+#endif // lcore_heap_index
+  if (capacity)
+    _lc_mfunc_priv(set_capacity)(self, capacity);
+}
+
+static inline void
+_lc_mfunc(push)(Self *self, T value) {
+#ifdef lcore_heap_index
+  _lc_mfunc(push_handle)(self, value);
+#else
+  if (self->size == self->capacity)
+    _lc_mfunc(reserve)(self, self->size + 1);
+  _lc_mfunc_priv(sift_up)(self, self->size++, value, 0);
+#endif // lcore_heap_index
+}
+
+static inline T
+_lc_mfunc(top)(Self *self) {
+  assert(self->size > 0);
+  return self->elements[0];
+}
+
+static inline T
+_lc_mfunc(pop)(Self *self) {
+  assert(self->size > 0);
+  T top = self->elements[0];
+#ifdef lcore_heap_index
+  _lc_mfunc_priv(release_handle)(self, self->handles[0]);
+  size_t last_handle = self->handles[self->size - 1];
+#else
+  size_t last_handle = 0;
+#endif // lcore_heap_index
+  if (--self->size)
+    _lc_mfunc_priv(sift_down)(self, 0, self->elements[self->size],
+                              last_handle);
+  return top;
+}
+
+static inline void
+_lc_mfunc(destroy)(Self *self) {
+  if (!self)
+    return;
+  for (size_t i = 0; i < self->size; i++)
+    lcore_drop_fn(self->elements[i]);
+  if (self->elements)
+    free(self->elements - (lcore_arity - 1));
+#ifdef lcore_heap_index
+  free(self->handles);
+  free(self->pos);
+#endif // lcore_heap_index
+  memset(self, 0, sizeof(*self));
+}
+
+// Makes room for at least 'capacity' elements, growing by
+// lcore_growth_factor when that is larger. Never shrinks.
+static inline void
+_lc_mfunc(reserve)(Self *self, size_t capacity) {
+  if (capacity <= self->capacity)
+    return;
+  size_t grown = (size_t)((double)self->capacity * lcore_growth_factor);
+  if (self->capacity == 0)
+    grown = 16;
+  _lc_mfunc_priv(set_capacity)(self, grown > capacity ? grown : capacity);
+}
+
+// Adds 'n' values copied from 'values' (e.g. the elements of a vector) and
+// restores the heap order bottom-up, in O(size + n) instead of the
+// O(n log size) of n pushes. With lcore_heap_index the heap must be empty
+// and the values get the handles 0 to n - 1, in order.
+static inline void
+_lc_mfunc(heapify)(Self *self, T const *values, size_t n) {
+  if (n == 0)
+    return;
+  _lc_mfunc(reserve)(self, self->size + n);
+  memcpy(self->elements + self->size, values, n * sizeof(T));
+#ifdef lcore_heap_index
+  assert(self->size == 0);
+  self->nhandles = n;
+  self->free_handle = SIZE_MAX;
+  for (size_t i = 0; i < n; i++)
+    self->handles[i] = self->pos[i] = i;
+#endif // lcore_heap_index
+  self->size += n;
+  if (self->size < 2)
+    return;
+  for (size_t i = (self->size - 2) / lcore_arity + 1; i-- > 0;) {
+#ifdef lcore_heap_index
+    size_t handle = self->handles[i];
+#else
+    size_t handle = 0;
+#endif // lcore_heap_index
+    _lc_mfunc_priv(sift_down)(self, i, self->elements[i], handle);
+  }
+}
+
+#ifdef lcore_heap_index
+// Same as push(), returning the new element's handle.
+static inline size_t
+_lc_mfunc(push_handle)(Self *self, T value) {
+  if (self->size == self->capacity)
+    _lc_mfunc(reserve)(self, self->size + 1);
+  size_t handle = _lc_mfunc_priv(take_handle)(self);
+  _lc_mfunc_priv(sift_up)(self, self->size++, value, handle);
+  return handle;
+}
+
+static inline size_t
+_lc_mfunc(top_handle)(Self *self) {
+  assert(self->size > 0);
+  return self->handles[0];
+}
+
+static inline T
+_lc_mfunc(get)(Self *self, size_t handle) {
+  assert(handle < self->nhandles && self->pos[handle] < self->size);
+  return self->elements[self->pos[handle]];
+}
+
+// Replaces the element of 'handle' with 'value', which must not be greater.
+static inline void
+_lc_mfunc(decrease_key)(Self *self, size_t handle, T value) {
+  size_t i = self->pos[handle];
+  assert(i < self->size && !lcore_less_fn(self->elements[i], value));
+  _lc_mfunc_priv(sift_up)(self, i, value, handle);
+}
+
+// Replaces the element of 'handle' with 'value', in either direction.
+static inline void
+_lc_mfunc(update)(Self *self, size_t handle, T value) {
+  size_t i = self->pos[handle];
+  assert(i < self->size);
+  if (lcore_less_fn(value, self->elements[i]))
+    _lc_mfunc_priv(sift_up)(self, i, value, handle);
+  else
+    _lc_mfunc_priv(sift_down)(self, i, value, handle);
+}
+
+// Removes the element of 'handle' and returns it.
+static inline T
+_lc_mfunc(erase)(Self *self, size_t handle) {
+  size_t i = self->pos[handle];
+  assert(i < self->size);
+  T value = self->elements[i];
+  _lc_mfunc_priv(release_handle)(self, handle);
+  if (i == --self->size)
+    return value;
+  T last = self->elements[self->size];
+  size_t last_handle = self->handles[self->size];
+  if (lcore_less_fn(last, value))
+    _lc_mfunc_priv(sift_up)(self, i, last, last_handle);
+  else
+    _lc_mfunc_priv(sift_down)(self, i, last, last_handle);
+  return value;
+}
+#endif // lcore_heap_index
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+// Moves the parents of the hole at 'i' down until 'value' fits in it.
+static inline void
+_lc_mfunc_priv(sift_up)(Self *self, size_t i, T value, size_t handle) {
+  while (i > 0) {
+    size_t parent = (i - 1) / lcore_arity;
+    if (!lcore_less_fn(value, self->elements[parent]))
+      break;
+    _lc_mfunc_priv(move)(self, parent, i);
+    i = parent;
+  }
+  _lc_mfunc_priv(place)(self, i, value, handle);
+}
+
+// Moves the smallest child of the hole at 'i' up until 'value' fits in it.
+// The smallest sibling is picked without branches (random priorities make
+// those unpredictable), and the d groups of grandchildren, which are
+// contiguous, are prefetched while the current group is compared.
+static inline void
+_lc_mfunc_priv(sift_down)(Self *self, size_t i, T value, size_t handle) {
+  T *e = self->elements;
+  size_t n = self->size;
+  for (;;) {
+    size_t first = i * lcore_arity + 1;
+    if (first >= n)
+      break;
+    size_t below = first * lcore_arity + 1;
+    if (below < n) {
+      const char *g = (const char *)(e + below);
+      for (size_t b = 0; b < lcore_arity * lcore_arity * sizeof(T);
+           b += LC_CACHE_LINE)
+        lc_prefetch(g + b);
+    }
+    size_t best = first;
+    T min = e[first];
+    size_t end = first + lcore_arity <= n ? first + lcore_arity : n;
+    for (size_t c = first + 1; c < end; c++) {
+      bool less = lcore_less_fn(e[c], min);
+      best = less ? c : best;
+      min = less ? e[c] : min;
+    }
+    if (!lcore_less_fn(min, value))
+      break;
+    _lc_mfunc_priv(move)(self, best, i);
+    i = best;
+  }
+  _lc_mfunc_priv(place)(self, i, value, handle);
+}
+
+static inline void
+_lc_mfunc_priv(move)(Self *self, size_t from, size_t to) {
+  self->elements[to] = self->elements[from];
+#ifdef lcore_heap_index
+  self->handles[to] = self->handles[from];
+  self->pos[self->handles[to]] = to;
+#endif // lcore_heap_index
+}
+
+static inline void
+_lc_mfunc_priv(place)(Self *self, size_t i, T value, size_t handle) {
+  self->elements[i] = value;
+#ifdef lcore_heap_index
+  self->handles[i] = handle;
+  self->pos[handle] = i;
+#else
+  (void)handle;
+#endif // lcore_heap_index
+}
+
+// Moves the elements to a buffer of 'capacity' elements. The buffer starts
+// lcore_arity - 1 slots before a cache line boundary: the children of node
+// i start at i * lcore_arity + 1, so every sibling group is aligned.
+static inline void
+_lc_mfunc_priv(set_capacity)(Self *self, size_t capacity) {
+  assert(capacity >= self->size);
+  size_t bytes = (capacity + lcore_arity - 1) * sizeof(T);
+  bytes = (bytes + LC_CACHE_LINE - 1) & ~(size_t)(LC_CACHE_LINE - 1);
+  T *base = (T *)aligned_alloc(LC_CACHE_LINE, bytes);
+  assert(base);
+  T *elements = base + (lcore_arity - 1);
+  if (self->elements) {
+    memcpy(elements, self->elements, self->size * sizeof(T));
+    free(self->elements - (lcore_arity - 1));
+  }
+  self->elements = elements;
+#ifdef lcore_heap_index
+  // At most 'capacity' handles are ever in use, and released ones are
+  // reused before new ones are handed out.
+  size_t *handles = (size_t *)realloc(self->handles, sizeof(size_t) * capacity);
+  size_t *pos = (size_t *)realloc(self->pos, sizeof(size_t) * capacity);
+  assert(handles && pos);
+  self->handles = handles;
+  self->pos = pos;
+#endif // lcore_heap_index
+  self->capacity = capacity;
+}
+
+#ifdef lcore_heap_index
+static inline size_t
+_lc_mfunc_priv(take_handle)(Self *self) {
+  size_t handle = self->free_handle;
+  if (handle == SIZE_MAX)
+    return self->nhandles++;
+  self->free_handle = self->pos[handle];
+  return handle;
+}
+
+static inline void
+_lc_mfunc_priv(release_handle)(Self *self, size_t handle) {
+  self->pos[handle] = self->free_handle;
+  self->free_handle = handle;
+}
+#endif // lcore_heap_index
+
+#endif // lcore_radix_heap
+
+#undef T
+#undef Self
+#undef lcore_less_fn
+#undef lcore_cmp_fn
+#undef lcore_drop_fn
+#undef lcore_arity
+#undef lcore_growth_factor
+#undef lcore_key_fn
+#undef lcore_pfx
+#undef lcore_heap_index
+#undef lcore_radix_heap
+#undef _Bucket
+#undef _LC_RADIX_BUCKETS
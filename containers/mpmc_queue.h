@@ -0,0 +1,239 @@
+#include "_lc_templating.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Bounded lock-free FIFO that any number of threads may push to and pop
+// from at once.
+//
+// #define T job
+// #define lcore_pfx job_queue
+// #include "containers/mpmc_queue.h"
+//
+// job_queue q;
+// job_queue_init(&q, 1024); // capacity, rounded up to a power of two
+//
+// The elements live in a ring buffer of cells allocated once by init(), each
+// holding an element and a sequence number telling which turn of the ring it
+// is ready for: position p may be written when its cell's sequence is p and
+// read when it is p + 1. A producer claims a position by advancing 'tail'
+// with a compare-and-swap, writes the element and publishes it by bumping
+// the sequence; consumers do the same with 'head'. Threads only contend on
+// the index of their own side and never wait for each other: a push into a
+// full queue or a pop from an empty one fails right away (so does a pop
+// whose oldest element is still being written by its producer). 'head' and
+// 'tail' live on separate cache lines, so the struct must be cache line
+// aligned (any automatic or static variable is, a heap allocated one needs
+// aligned_alloc(LC_CACHE_LINE, ...)).
+//
+// push_many() and pop_many() claim a run of consecutive ready cells with a
+// single compare-and-swap, so a batch costs one contended operation instead
+// of one per element. A batch may come out interleaved with the elements of
+// other threads' batches, but keeps its own order.
+
+#ifndef T
+#define T int
+#endif // T
+
+#ifndef lcore_drop_fn
+#define _lc_trivial_drop
+#define lcore_drop_fn(x)
+#endif // lcore_drop_fn
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, mpmc_queue)
+#endif // lcore_pfx
+
+#ifndef LC_CACHE_LINE
+#define LC_CACHE_LINE 64
+#endif // LC_CACHE_LINE
+
+#define Self lcore_pfx
+#define _Cell _lc_join(Self, cell)
+
+typedef struct {
+  atomic_size_t seq; // position the cell is ready for, see above
+  T value;
+} _Cell;
+
+typedef struct {
+  // Read-only after init().
+  _Alignas(LC_CACHE_LINE) _Cell *cells;
+  size_t mask; // capacity - 1
+  _Alignas(LC_CACHE_LINE) atomic_size_t head; // next position to pop
+  _Alignas(LC_CACHE_LINE) atomic_size_t tail; // next position to push
+} Self;
+
+// ============== PUBLIC API ==================== //
+// init() and destroy() must not run concurrently with anything else, every
+// other function may be called from any thread at any time.
+
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline bool _lc_mfunc(try_push)(Self *self, T value);
+static inline bool _lc_mfunc(try_pop)(Self *self, T *out);
+static inline size_t _lc_mfunc(push_many)(Self *self, T const *values,
+                                          size_t n);
+static inline size_t _lc_mfunc(pop_many)(Self *self, T *out, size_t n);
+static inline size_t _lc_mfunc(size)(Self *self);
+static inline size_t _lc_mfunc(capacity)(Self *self);
+
+// ============= PRIVATE FUNCTIONS ============== //
+
+static inline size_t _lc_mfunc_priv(claim)(Self *self, atomic_size_t *index,
+                                           size_t offset, size_t *n);
+
+// ============ API IMPLEMENTATION ============== //
+
+// Allocates room for 'capacity' elements (rounded up to a power of two, at
+// least 2). False when the cells can not be allocated.
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity) {
+  size_t cap = 2;
+  while (cap < capacity)
+    cap <<= 1;
+  memset(self, 0, sizeof(*self));
+  size_t bytes = (cap * sizeof(_Cell) + LC_CACHE_LINE - 1) &
+                 ~(size_t)(LC_CACHE_LINE - 1);
+  self->cells = (_Cell *)aligned_alloc(LC_CACHE_LINE, bytes);
+  if (!self->cells)
+    return false;
+  for (size_t i = 0; i < cap; i++)
+    atomic_init(&self->cells[i].seq, i);
+  self->mask = cap - 1;
+  atomic_init(&self->head, 0);
+  atomic_init(&self->tail, 0);
+  return true;
+}
+
+// Drops the elements still queued.
+static inline void _lc_mfunc(destroy)(Self *self) {
+#ifndef _lc_trivial_drop
+  size_t tail = atomic_load(&self->tail);
+  for (size_t i = atomic_load(&self->head); i != tail; i++)
+    lcore_drop_fn(self->cells[i & self->mask].value);
+#endif // _lc_trivial_drop
+  free(self->cells);
+  memset(self, 0, sizeof(*self));
+}
+
+// False when the queue is full, 'value' is then not queued.
+static inline bool _lc_mfunc(try_push)(Self *self, T value) {
+  size_t one = 1;
+  size_t pos = _lc_mfunc_priv(claim)(self, &self->tail, 0, &one);
+  if (pos == SIZE_MAX)
+    return false;
+  _Cell *cell = &self->cells[pos & self->mask];
+  cell->value = value;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  return true;
+}
+
+// False when the queue is empty.
+static inline bool _lc_mfunc(try_pop)(Self *self, T *out) {
+  size_t one = 1;
+  size_t pos = _lc_mfunc_priv(claim)(self, &self->head, 1, &one);
+  if (pos == SIZE_MAX)
+    return false;
+  _Cell *cell = &self->cells[pos & self->mask];
+  *out = cell->value;
+  atomic_store_explicit(&cell->seq, pos + self->mask + 1,
+                        memory_order_release);
+  return true;
+}
+
+// Queues up to 'n' of the values (fewer when the queue fills up) and
+// returns how many were queued.
+static inline size_t _lc_mfunc(push_many)(Self *self, T const *values,
+                                          size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    size_t want = n - done;
+    size_t pos = _lc_mfunc_priv(claim)(self, &self->tail, 0, &want);
+    if (pos == SIZE_MAX)
+      break;
+    for (size_t i = 0; i < want; i++) {
+      _Cell *cell = &self->cells[(pos + i) & self->mask];
+      cell->value = values[done + i];
+      atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+    }
+    done += want;
+  }
+  return done;
+}
+
+// Moves up to 'n' elements into 'out' and returns how many were moved.
+static inline size_t _lc_mfunc(pop_many)(Self *self, T *out, size_t n) {
+  size_t done = 0;
+  while (done < n) {
+    size_t want = n - done;
+    size_t pos = _lc_mfunc_priv(claim)(self, &self->head, 1, &want);
+    if (pos == SIZE_MAX)
+      break;
+    for (size_t i = 0; i < want; i++) {
+      _Cell *cell = &self->cells[(pos + i) & self->mask];
+      out[done + i] = cell->value;
+      atomic_store_explicit(&cell->seq, pos + i + self->mask + 1,
+                            memory_order_release);
+    }
+    done += want;
+  }
+  return done;
+}
+
+// Number of queued elements, a snapshot when other threads are active.
+static inline size_t _lc_mfunc(size)(Self *self) {
+  size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+  return tail > head ? tail - head : 0;
+}
+
+static inline size_t _lc_mfunc(capacity)(Self *self) {
+  return self->mask + 1;
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+// Claims the run of positions starting at 'index' whose cells are ready, up
+// to '*n' of them (a cell at position p is ready when its sequence is
+// p + offset: 0 for producers, 1 for consumers). Returns the first position
+// and stores in '*n' the length of the run, or SIZE_MAX when the first cell
+// is not ready (full or empty queue). Since no other thread can claim the
+// positions once 'index' moved past them, and a ready cell stays ready until
+// its position is claimed, checking the run before the compare-and-swap is
+// enough.
+static inline size_t _lc_mfunc_priv(claim)(Self *self, atomic_size_t *index,
+                                           size_t offset, size_t *n) {
+  size_t pos = atomic_load_explicit(index, memory_order_relaxed);
+  for (;;) {
+    size_t run = 0;
+    while (run < *n) {
+      _Cell *cell = &self->cells[(pos + run) & self->mask];
+      size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+      if (seq != pos + run + offset)
+        break;
+      run++;
+    }
+    if (run == 0) {
+      // Behind the other side: the queue is full (or empty). Ahead of it:
+      // another thread claimed 'pos' already, retry from the new index.
+      _Cell *cell = &self->cells[pos & self->mask];
+      size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+      if ((ptrdiff_t)(seq - (pos + offset)) < 0)
+        return SIZE_MAX;
+      pos = atomic_load_explicit(index, memory_order_relaxed);
+      continue;
+    }
+    if (atomic_compare_exchange_weak_explicit(index, &pos, pos + run,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      *n = run;
+      return pos;
+    }
+  }
+}
+
+#undef T
+#undef Self
+#undef lcore_drop_fn
+#undef _lc_trivial_drop
+#undef lcore_pfx
+#undef _Cell
@@ -1,4 +1,5 @@
 #include "_lc_templating.h"
+#include <stdbool.h>
 
 #ifndef T
 #define T int
@@ -13,25 +14,151 @@
 #endif // lcore_cmp_fn
 
 #ifndef lcore_drop_fn
+#define _lc_trivial_drop
 #define lcore_drop_fn(x)
 #endif // lcore_drop_fn
 
+// Defining 'lcore_node_pool' right before including this header allocates
+// the tree nodes from a per-tree slab pool (see _lc_pool.h) instead of one
+// malloc per node. When no 'lcore_drop_fn' is given, destroy() then frees the
+// whole tree without visiting its nodes.
+
+#ifdef lcore_node_pool
+#include "_lc_pool.h"
+#endif // lcore_node_pool
+
+// Defining 'lcore_rbtree_compact' stores the nodes in one growable array and
+// links them with 32-bit indices instead of pointers, the color living in the
+// top bit of the parent index: a node takes 12 bytes plus its payload instead
+// of 25, and neighbouring nodes tend to share cache lines. A tree then holds
+// at most 2^31 - 1 keys. The array only grows, freed slots are reused by
+// later insertions and destroy() gives it back. The set operations first move
+// the nodes of the smaller tree into the array of the larger one.
+
+#if defined(lcore_rbtree_compact) && defined(lcore_node_pool)
+#error "lcore_rbtree_compact already keeps every node in one array"
+#endif
+
+// Bulk operations: build() creates a tree from a sorted array in linear time,
+// set_union/set_intersection/set_difference combine two trees with the
+// join-based algorithms of Blelloch et al. ("Just Join for Parallel Ordered
+// Sets"), reusing the nodes of both trees instead of reinserting the keys.
+//
+// Defining 'lcore_rbtree_threads' (e.g. to the number of cores) makes the set
+// operations run the two independent halves of their recursion in separate
+// threads for the topmost levels, link with -pthread in that case.
+
+#ifdef lcore_rbtree_threads
+#include <pthread.h>
+#endif // lcore_rbtree_threads
+
+// Defining 'lcore_order_stats' stores the size of its subtree in every node,
+// kept up to date by every operation, and enables rank() and select() in
+// O(log n).
+
 #define Self lcore_pfx
 #define _Node _lc_join(Self, node)
+#define _Ref _lc_join(Self, ref)
+#define _Iter _lc_join(Self, iter)
+#define _SetOp _lc_join(Self, set_op)
+#define _Task _lc_join(Self, task)
+
+// Every node access goes through these macros, so the same code works on
+// both layouts: a reference to a node ('_Ref') is either a pointer or an
+// index into 'nodes', and _lc_nil (NULL or 0) is false in both cases.
+#ifdef lcore_rbtree_compact
+#define _lc_nil 0
+#define _lc_red_bit 0x80000000u
+#define _lc_at(s, x) (&(s)->nodes[x])
+#define _lc_parent(s, x) (_lc_at(s, x)->parent & ~_lc_red_bit)
+#define _lc_set_parent(s, x, p)                                                \
+  (_lc_at(s, x)->parent =                                                      \
+       (_lc_at(s, x)->parent & _lc_red_bit) | (uint32_t)(p))
+#define _lc_red(s, x) (_lc_at(s, x)->parent >> 31)
+#define _lc_set_red(s, x, c)                                                   \
+  (_lc_at(s, x)->parent =                                                      \
+       (_lc_at(s, x)->parent & ~_lc_red_bit) | ((uint32_t)(c) << 31))
+#else
+#define _lc_nil NULL
+#define _lc_at(s, x) ((void)(s), (x))
+#define _lc_parent(s, x) (_lc_at(s, x)->parent)
+#define _lc_set_parent(s, x, p) (_lc_at(s, x)->parent = (p))
+#define _lc_red(s, x) (_lc_at(s, x)->red)
+#define _lc_set_red(s, x, c) (_lc_at(s, x)->red = (c))
+#endif // lcore_rbtree_compact
+#define _lc_left(s, x) (_lc_at(s, x)->left)
+#define _lc_right(s, x) (_lc_at(s, x)->right)
+#define _lc_data(s, x) (_lc_at(s, x)->data)
+
+#ifdef lcore_order_stats
+#define _lc_count(s, x) ((x) ? _lc_at(s, x)->count : 0)
+#endif // lcore_order_stats
 
 // ========== STRUCTS DEFINITIONS ============== //
 
+#ifdef lcore_rbtree_compact
+typedef uint32_t _Ref;
+
+typedef struct _Node {
+  _Ref left, right; // left and right children, 0 when absent
+  uint32_t parent;  // parent index, the top bit is set when the node is red
+#ifdef lcore_order_stats
+  uint32_t count; // number of nodes in the subtree rooted here
+#endif // lcore_order_stats
+  T data; // node payload
+} _Node;
+
+typedef struct Self {
+  _Ref root;       // root of the tree
+  size_t size;     // number of nodes
+  _Node *nodes;    // node storage, slot 0 is never used
+  size_t capacity; // number of slots in 'nodes'
+  size_t used;     // slots handed out so far, slot 0 included
+  _Ref free_list;  // released slots, linked through 'right'
+} Self;
+#else
+typedef struct _Node *_Ref;
+
 typedef struct _Node {
   struct _Node *left, *right; // left and right children
   struct _Node *parent;       // parent node
   uint8_t red;                // node color (either red (1) or black (0))
+#ifdef lcore_order_stats
+  size_t count;               // number of nodes in the subtree rooted here
+#endif // lcore_order_stats
   T data;                     // node payload
 } _Node;
 
 typedef struct Self {
   _Node *root; // root of the tree
   size_t size; // number of nodes
+#ifdef lcore_node_pool
+  lc_pool pool; // storage for every node of the tree
+#endif // lcore_node_pool
 } Self;
+#endif // lcore_rbtree_compact
+
+// In-order iterator, moved with iter_next/iter_prev using the parent links
+// (amortized O(1) per step, no stack). 'node' is _lc_nil past either end.
+typedef struct _Iter {
+  Self *tree;
+  _Ref node;
+} _Iter;
+
+// Recursive step of a set operation: combines two detached subtrees and
+// pushes the nodes it discards on 'garbage' (linked through 'right').
+typedef _Ref (*_SetOp)(Self *self, _Ref a, _Ref b, _Ref *garbage, int depth);
+
+#ifdef lcore_rbtree_threads
+typedef struct _Task {
+  _SetOp op;
+  Self *self;   // tree owning the nodes
+  _Ref a, b;    // operands
+  _Ref result;  // combined subtree
+  _Ref garbage; // nodes discarded by this task
+  int depth;    // recursion depth of the task
+} _Task;
+#endif // lcore_rbtree_threads
 
 // ============== PUBLIC API ==================== //
 // These functions are meant to be used to interact with the tree structure
@@ -42,57 +169,144 @@ static inline void _lc_mfunc(destroy)(Self *self);
 static inline uint8_t _lc_mfunc(insert)(Self *self, T val);
 static inline uint8_t _lc_mfunc(remove)(Self *self, T val);
 static inline uint8_t _lc_mfunc(contains)(Self *self, T val);
+static inline bool _lc_mfunc(build)(Self *self, T const *values, size_t n);
+static inline void _lc_mfunc(set_union)(Self *self, Self *other);
+static inline void _lc_mfunc(set_intersection)(Self *self, Self *other);
+static inline void _lc_mfunc(set_difference)(Self *self, Self *other);
+static inline _Iter _lc_mfunc(first)(Self *self);
+static inline _Iter _lc_mfunc(last)(Self *self);
+static inline _Iter _lc_mfunc(lower_bound)(Self *self, T key);
+static inline _Iter _lc_mfunc(upper_bound)(Self *self, T key);
+static inline bool _lc_mfunc(iter_done)(_Iter it);
+static inline T _lc_mfunc(iter_get)(_Iter it);
+static inline void _lc_mfunc(iter_next)(_Iter *it);
+static inline void _lc_mfunc(iter_prev)(_Iter *it);
+static inline size_t _lc_mfunc(for_each_range)(Self *self, T lo, T hi,
+                                               bool (*fn)(T, void *),
+                                               void *ctx);
+#ifdef lcore_order_stats
+static inline size_t _lc_mfunc(rank)(Self *self, T key);
+static inline _Iter _lc_mfunc(select)(Self *self, size_t k);
+#endif // lcore_order_stats
 
 // ============= PRIVATE FUNCTIONS ============== //
 // These functions are not meant to be called directly, they are helpers used
 // inside the public API implementation
 
-static inline _Node *_lc_mfunc_priv(max_node)(_Node *x);
-static inline _Node *_lc_mfunc_priv(min_node)(_Node *x);
-static inline _Node *_lc_mfunc_priv(new_node)(T value);
-static inline void _lc_mfunc_priv(transplant)(Self *self, _Node *x,
-                                                 _Node *y);
-static inline void _lc_mfunc_priv(rotate_left)(Self *self, _Node *x);
-static inline void _lc_mfunc_priv(rotate_right)(Self *self, _Node *x);
-static inline void _lc_mfunc_priv(fix_insert)(Self *self, _Node *x);
-static inline void _lc_mfunc_priv(fix_delete)(Self *self, _Node *x,
-                                                 _Node *x_p);
+static inline _Ref _lc_mfunc_priv(max_node)(Self *self, _Ref x);
+static inline _Ref _lc_mfunc_priv(min_node)(Self *self, _Ref x);
+static inline _Ref _lc_mfunc_priv(new_node)(Self *self, T value);
+static inline void _lc_mfunc_priv(free_node)(Self *self, _Ref x);
+#ifdef lcore_rbtree_compact
+static inline bool _lc_mfunc_priv(reserve_nodes)(Self *self, size_t n);
+static inline bool _lc_mfunc_priv(merge_nodes)(Self *self, Self *other,
+                                               _Ref *a, _Ref *b);
+#endif // lcore_rbtree_compact
+static inline void _lc_mfunc_priv(transplant)(Self *self, _Ref x, _Ref y);
+static inline void _lc_mfunc_priv(rotate_left)(Self *self, _Ref x);
+static inline void _lc_mfunc_priv(rotate_right)(Self *self, _Ref x);
+static inline void _lc_mfunc_priv(fix_insert)(Self *self, _Ref x);
+static inline void _lc_mfunc_priv(fix_delete)(Self *self, _Ref x, _Ref x_p);
+static inline _Ref _lc_mfunc_priv(build_range)(Self *self, T const *values,
+                                               size_t n, int depth,
+                                               int red_depth);
+static inline void _lc_mfunc_priv(free_tree)(Self *self, _Ref x);
+static inline _Ref _lc_mfunc_priv(detach)(Self *self, _Ref x);
+static inline int _lc_mfunc_priv(black_height)(Self *self, _Ref x);
+static inline _Ref _lc_mfunc_priv(join)(Self *self, _Ref l, _Ref m, _Ref r);
+static inline _Ref _lc_mfunc_priv(join2)(Self *self, _Ref l, _Ref r);
+static inline void _lc_mfunc_priv(split)(Self *self, _Ref t, T key, _Ref *l,
+                                         _Ref *r, _Ref *dup);
+static inline _Ref _lc_mfunc_priv(split_last)(Self *self, _Ref t, _Ref *last);
+static inline void _lc_mfunc_priv(discard)(Self *self, _Ref t, _Ref *garbage);
+static inline void _lc_mfunc_priv(fork)(Self *self, _SetOp op, _Ref a1,
+                                        _Ref b1, _Ref *r1, _Ref a2, _Ref b2,
+                                        _Ref *r2, _Ref *garbage, int depth);
+static inline _Ref _lc_mfunc_priv(union_rec)(Self *self, _Ref a, _Ref b,
+                                             _Ref *garbage, int depth);
+static inline _Ref _lc_mfunc_priv(intersection_rec)(Self *self, _Ref a,
+                                                    _Ref b, _Ref *garbage,
+                                                    int depth);
+static inline _Ref _lc_mfunc_priv(difference_rec)(Self *self, _Ref a, _Ref b,
+                                                  _Ref *garbage, int depth);
+static inline void _lc_mfunc_priv(set_op)(Self *self, Self *other, _SetOp op);
 
 // ========== PUBLIC API IMPLEMENTATION ========= //
 
 static inline void _lc_mfunc(init)(Self *self) {
   memset(self, 0, sizeof(*self));
+#ifdef lcore_node_pool
+  lc_pool_init(&self->pool, sizeof(_Node));
+#endif // lcore_node_pool
 }
 
 static inline void _lc_mfunc(destroy)(Self *self) {
+#if defined(lcore_rbtree_compact) && defined(_lc_trivial_drop)
+  // Nothing to drop: the node array holds the whole tree.
+  free(self->nodes);
+#elif defined(lcore_node_pool) && defined(_lc_trivial_drop)
+  // Nothing to drop: releasing the slabs frees every node at once.
+  lc_pool_release(&self->pool);
+#else
+  // Post-order walk that detaches each leaf from its parent before freeing
+  // it, so no auxiliary stack is needed.
+  _Ref cur = self->root;
+  while (cur) {
+    if (_lc_left(self, cur)) {
+      cur = _lc_left(self, cur);
+    } else if (_lc_right(self, cur)) {
+      cur = _lc_right(self, cur);
+    } else {
+      _Ref parent = _lc_parent(self, cur);
+      if (parent && _lc_left(self, parent) == cur)
+        _lc_left(self, parent) = _lc_nil;
+      else if (parent)
+        _lc_right(self, parent) = _lc_nil;
+      lcore_drop_fn(_lc_data(self, cur));
+      _lc_mfunc_priv(free_node)(self, cur);
+      cur = parent;
+    }
+  }
+#ifdef lcore_node_pool
+  lc_pool_release(&self->pool);
+#endif // lcore_node_pool
+#ifdef lcore_rbtree_compact
+  free(self->nodes);
+#endif // lcore_rbtree_compact
+#endif // lcore_rbtree_compact && _lc_trivial_drop
+  memset(self, 0, sizeof(*self));
 }
 
 static inline uint8_t _lc_mfunc(insert)(Self *self, T val) {
-  _Node *cur = self->root;
-  _Node *parent = NULL;
+  _Ref cur = self->root;
+  _Ref parent = _lc_nil;
 
   // Traverse to find the correct insertion point
   while (cur) {
     parent = cur;
-    int cmp = lcore_cmp_fn(val, cur->data);
+    int cmp = lcore_cmp_fn(val, _lc_data(self, cur));
     if (cmp == 0)
       return 0; // Value already exists
     else if (cmp < 0)
-      cur = cur->left;
+      cur = _lc_left(self, cur);
     else
-      cur = cur->right;
+      cur = _lc_right(self, cur);
   }
-  _Node *n = _lc_mfunc_priv(new_node)(val);
+  _Ref n = _lc_mfunc_priv(new_node)(self, val);
   if (!n)
     return 0; // Allocation failed
-  n->parent = parent;
+  _lc_set_parent(self, n, parent);
   if (!parent) {
     self->root = n; // Tree was empty
-  } else if (lcore_cmp_fn(val, parent->data) < 0) {
-    parent->left = n;
+  } else if (lcore_cmp_fn(val, _lc_data(self, parent)) < 0) {
+    _lc_left(self, parent) = n;
   } else {
-    parent->right = n;
+    _lc_right(self, parent) = n;
   }
+#ifdef lcore_order_stats
+  for (_Ref p = parent; p; p = _lc_parent(self, p))
+    _lc_at(self, p)->count++;
+#endif // lcore_order_stats
 
   // Fix any red-black tree violations
   _lc_mfunc_priv(fix_insert)(self, n);
@@ -101,59 +315,72 @@ static inline uint8_t _lc_mfunc(insert)(Self *self, T val) {
 }
 
 static inline uint8_t _lc_mfunc(remove)(Self *self, T val) {
-  _Node *z = self->root;
+  _Ref z = self->root;
   while (z) {
-    int c = lcore_cmp_fn(val, z->data);
+    int c = lcore_cmp_fn(val, _lc_data(self, z));
     if (c == 0)
       break;
     else if (c < 0)
-      z = z->left;
+      z = _lc_left(self, z);
     else
-      z = z->right;
+      z = _lc_right(self, z);
   }
 
   if (!z)
     return 0; // Value not found
 
-  _Node *y = z;
-  _Node *x = NULL;
-  _Node *x_parent = NULL;
-  uint8_t y_original_red = y->red;
-
-  if (!z->left) {
-    x = z->right;
-    x_parent = z->parent;
-    _lc_mfunc_priv(transplant)(self, z, z->right);
-  } else if (!z->right) {
-    x = z->left;
-    x_parent = z->parent;
-    _lc_mfunc_priv(transplant)(self, z, z->left);
+  _Ref y = z;
+  _Ref x = _lc_nil;
+  _Ref x_parent = _lc_nil;
+  uint8_t y_original_red = _lc_red(self, y);
+
+#ifdef lcore_order_stats
+  // The node that actually leaves its position is z, or its successor when
+  // z has two children: every ancestor of that position loses one node.
+  _Ref gone = _lc_left(self, z) && _lc_right(self, z)
+                  ? _lc_mfunc_priv(min_node)(self, _lc_right(self, z))
+                  : z;
+  for (_Ref p = _lc_parent(self, gone); p; p = _lc_parent(self, p))
+    _lc_at(self, p)->count--;
+#endif // lcore_order_stats
+
+  if (!_lc_left(self, z)) {
+    x = _lc_right(self, z);
+    x_parent = _lc_parent(self, z);
+    _lc_mfunc_priv(transplant)(self, z, _lc_right(self, z));
+  } else if (!_lc_right(self, z)) {
+    x = _lc_left(self, z);
+    x_parent = _lc_parent(self, z);
+    _lc_mfunc_priv(transplant)(self, z, _lc_left(self, z));
   } else {
-    y = _lc_mfunc_priv(min_node)(z->right);
-    y_original_red = y->red;
-    x = y->right;
+    y = _lc_mfunc_priv(min_node)(self, _lc_right(self, z));
+    y_original_red = _lc_red(self, y);
+    x = _lc_right(self, y);
 
-    if (y->parent == z) {
+    if (_lc_parent(self, y) == z) {
       if (x)
-        x->parent = y;
+        _lc_set_parent(self, x, y);
       x_parent = y;
     } else {
-      _lc_mfunc_priv(transplant)(self, y, y->right);
-      y->right = z->right;
-      if (y->right)
-        y->right->parent = y;
-      x_parent = y->parent;
+      _lc_mfunc_priv(transplant)(self, y, _lc_right(self, y));
+      _lc_right(self, y) = _lc_right(self, z);
+      if (_lc_right(self, y))
+        _lc_set_parent(self, _lc_right(self, y), y);
+      x_parent = _lc_parent(self, y);
     }
 
     _lc_mfunc_priv(transplant)(self, z, y);
-    y->left = z->left;
-    if (y->left)
-      y->left->parent = y;
-    y->red = z->red;
+    _lc_left(self, y) = _lc_left(self, z);
+    if (_lc_left(self, y))
+      _lc_set_parent(self, _lc_left(self, y), y);
+    _lc_set_red(self, y, _lc_red(self, z));
+#ifdef lcore_order_stats
+    _lc_at(self, y)->count = _lc_at(self, z)->count;
+#endif // lcore_order_stats
   }
 
-  lcore_drop_fn(z->data);
-  free(z);
+  lcore_drop_fn(_lc_data(self, z));
+  _lc_mfunc_priv(free_node)(self, z);
   self->size--;
 
   if (y_original_red == 0)
@@ -163,205 +390,498 @@ static inline uint8_t _lc_mfunc(remove)(Self *self, T val) {
 }
 
 static inline uint8_t _lc_mfunc(contains)(Self *self, T val) {
-  _Node *cur = self->root;
+  _Ref cur = self->root;
   while (cur) {
-    int c = lcore_cmp_fn(cur->data, val);
+    int c = lcore_cmp_fn(_lc_data(self, cur), val);
     if (c == 0)
       return 1;
-    cur = c > 0 ? cur->left : cur->right;
+    cur = c > 0 ? _lc_left(self, cur) : _lc_right(self, cur);
   }
   return 0;
 }
 
+// Builds the tree from 'n' values sorted in increasing order and free of
+// duplicates, in O(n) and without any rotation. 'self' must be empty. False,
+// leaving the tree empty and the values owned by the caller, when the nodes
+// can not be allocated.
+static inline bool _lc_mfunc(build)(Self *self, T const *values, size_t n) {
+  assert(self->root == _lc_nil);
+#ifndef NDEBUG
+  for (size_t i = 1; i < n; i++)
+    assert(lcore_cmp_fn(values[i - 1], values[i]) < 0);
+#endif // NDEBUG
+#ifdef lcore_rbtree_compact
+  if (!_lc_mfunc_priv(reserve_nodes)(self, n))
+    return false;
+#endif // lcore_rbtree_compact
+  // Splitting at the middle puts every leaf on the last two levels: the
+  // nodes of the last level are red when it is incomplete, all the others
+  // are black, which gives every path the same number of black nodes.
+  int levels = 0;
+  while (levels < 64 && ((size_t)1 << levels) - 1 < n)
+    levels++;
+  int red_depth = ((size_t)1 << levels) - 1 == n ? -1 : levels - 1;
+  self->root = _lc_mfunc_priv(build_range)(self, values, n, 0, red_depth);
+  if (n && !self->root)
+    return false;
+  self->size = n;
+  return true;
+}
+
+// Adds every key of 'other' to 'self'. The nodes of 'other' are moved, not
+// copied: 'other' is left empty and keys present in both trees are dropped
+// from 'other'.
+static inline void _lc_mfunc(set_union)(Self *self, Self *other) {
+  _lc_mfunc_priv(set_op)(self, other, _lc_mfunc_priv(union_rec));
+}
+
+// Keeps in 'self' only the keys also found in 'other', which is left empty.
+static inline void _lc_mfunc(set_intersection)(Self *self, Self *other) {
+  _lc_mfunc_priv(set_op)(self, other, _lc_mfunc_priv(intersection_rec));
+}
+
+// Removes from 'self' every key found in 'other', which is left empty.
+static inline void _lc_mfunc(set_difference)(Self *self, Self *other) {
+  _lc_mfunc_priv(set_op)(self, other, _lc_mfunc_priv(difference_rec));
+}
+
+static inline _Iter _lc_mfunc(first)(Self *self) {
+  _Iter it = {self, self->root ? _lc_mfunc_priv(min_node)(self, self->root)
+                               : _lc_nil};
+  return it;
+}
+
+static inline _Iter _lc_mfunc(last)(Self *self) {
+  _Iter it = {self, self->root ? _lc_mfunc_priv(max_node)(self, self->root)
+                               : _lc_nil};
+  return it;
+}
+
+// First key that is not smaller than 'key'.
+static inline _Iter _lc_mfunc(lower_bound)(Self *self, T key) {
+  _Iter it = {self, _lc_nil};
+  for (_Ref cur = self->root; cur;) {
+    if (lcore_cmp_fn(_lc_data(self, cur), key) >= 0) {
+      it.node = cur;
+      cur = _lc_left(self, cur);
+    } else {
+      cur = _lc_right(self, cur);
+    }
+  }
+  return it;
+}
+
+// First key that is greater than 'key'.
+static inline _Iter _lc_mfunc(upper_bound)(Self *self, T key) {
+  _Iter it = {self, _lc_nil};
+  for (_Ref cur = self->root; cur;) {
+    if (lcore_cmp_fn(_lc_data(self, cur), key) > 0) {
+      it.node = cur;
+      cur = _lc_left(self, cur);
+    } else {
+      cur = _lc_right(self, cur);
+    }
+  }
+  return it;
+}
+
+static inline bool _lc_mfunc(iter_done)(_Iter it) {
+  return it.node == _lc_nil;
+}
+
+static inline T _lc_mfunc(iter_get)(_Iter it) {
+  assert(it.node != _lc_nil);
+  return _lc_data(it.tree, it.node);
+}
+
+static inline void _lc_mfunc(iter_next)(_Iter *it) {
+  Self *self = it->tree;
+  _Ref x = it->node;
+  if (_lc_right(self, x)) {
+    it->node = _lc_mfunc_priv(min_node)(self, _lc_right(self, x));
+    return;
+  }
+  while (_lc_parent(self, x) && x == _lc_right(self, _lc_parent(self, x)))
+    x = _lc_parent(self, x);
+  it->node = _lc_parent(self, x);
+}
+
+// Moving back from past the end lands on the last key.
+static inline void _lc_mfunc(iter_prev)(_Iter *it) {
+  Self *self = it->tree;
+  _Ref x = it->node;
+  if (!x) {
+    *it = _lc_mfunc(last)(self);
+    return;
+  }
+  if (_lc_left(self, x)) {
+    it->node = _lc_mfunc_priv(max_node)(self, _lc_left(self, x));
+    return;
+  }
+  while (_lc_parent(self, x) && x == _lc_left(self, _lc_parent(self, x)))
+    x = _lc_parent(self, x);
+  it->node = _lc_parent(self, x);
+}
+
+// Calls 'fn' on every key in [lo, hi) in increasing order until it returns
+// false, and returns the number of calls.
+static inline size_t _lc_mfunc(for_each_range)(Self *self, T lo, T hi,
+                                               bool (*fn)(T, void *),
+                                               void *ctx) {
+  size_t calls = 0;
+  _Iter it = _lc_mfunc(lower_bound)(self, lo);
+  while (it.node && lcore_cmp_fn(_lc_data(self, it.node), hi) < 0) {
+    calls++;
+    if (!fn(_lc_data(self, it.node), ctx))
+      break;
+    _lc_mfunc(iter_next)(&it);
+  }
+  return calls;
+}
+
+#ifdef lcore_order_stats
+// Number of keys smaller than 'key'.
+static inline size_t _lc_mfunc(rank)(Self *self, T key) {
+  size_t r = 0;
+  for (_Ref cur = self->root; cur;) {
+    if (lcore_cmp_fn(_lc_data(self, cur), key) < 0) {
+      r += 1 + _lc_count(self, _lc_left(self, cur));
+      cur = _lc_right(self, cur);
+    } else {
+      cur = _lc_left(self, cur);
+    }
+  }
+  return r;
+}
+
+// The k-th smallest key (counting from 0), past the end when k >= size.
+static inline _Iter _lc_mfunc(select)(Self *self, size_t k) {
+  _Iter it = {self, _lc_nil};
+  _Ref cur = self->root;
+  while (cur) {
+    size_t left = _lc_count(self, _lc_left(self, cur));
+    if (k == left) {
+      it.node = cur;
+      break;
+    }
+    if (k < left) {
+      cur = _lc_left(self, cur);
+    } else {
+      k -= left + 1;
+      cur = _lc_right(self, cur);
+    }
+  }
+  return it;
+}
+#endif // lcore_order_stats
+
 // ========= PRIVATE API IMPLEMENTATION ========= //
 
-static inline _Node *_lc_mfunc_priv(max_node)(_Node *x) {
-  _Node *tmp = x;
-  while (tmp->right)
-    tmp = tmp->right;
+static inline _Ref _lc_mfunc_priv(max_node)(Self *self, _Ref x) {
+  _Ref tmp = x;
+  while (_lc_right(self, tmp))
+    tmp = _lc_right(self, tmp);
   return tmp;
 }
 
-static inline _Node *_lc_mfunc_priv(min_node)(_Node *x) {
-  _Node *tmp = x;
-  while (tmp->left)
-    tmp = tmp->left;
+static inline _Ref _lc_mfunc_priv(min_node)(Self *self, _Ref x) {
+  _Ref tmp = x;
+  while (_lc_left(self, tmp))
+    tmp = _lc_left(self, tmp);
   return tmp;
 }
 
-static inline _Node *_lc_mfunc_priv(new_node)(T value) {
+static inline _Ref _lc_mfunc_priv(new_node)(Self *self, T value) {
+#if defined(lcore_rbtree_compact)
+  _Ref n = self->free_list;
+  if (n) {
+    self->free_list = _lc_right(self, n);
+  } else {
+    if (!_lc_mfunc_priv(reserve_nodes)(self, 1))
+      return _lc_nil;
+    n = (_Ref)self->used++;
+  }
+#elif defined(lcore_node_pool)
+  _Node *n = (_Node *)lc_pool_alloc(&self->pool);
+#else
+  (void)self;
   _Node *n = lc_malloc(_Node, sizeof(_Node));
+#endif // lcore_rbtree_compact
   if (!n)
-    return NULL;
-  n->left = n->right = n->parent = NULL;
+    return _lc_nil;
+  _lc_left(self, n) = _lc_right(self, n) = _lc_nil;
+#ifdef lcore_rbtree_compact
+  _lc_at(self, n)->parent = _lc_red_bit;
+#else
+  n->parent = NULL;
   n->red = 1;
-  n->data = value;
+#endif // lcore_rbtree_compact
+#ifdef lcore_order_stats
+  _lc_at(self, n)->count = 1;
+#endif // lcore_order_stats
+  _lc_data(self, n) = value;
   return n;
 }
 
-static inline void _lc_mfunc_priv(transplant)(Self *self, _Node *x,
-                                                 _Node *y) {
-  if (!x->parent)
+static inline void _lc_mfunc_priv(free_node)(Self *self, _Ref x) {
+#if defined(lcore_rbtree_compact)
+  _lc_right(self, x) = self->free_list;
+  self->free_list = x;
+#elif defined(lcore_node_pool)
+  lc_pool_free(&self->pool, x);
+#else
+  (void)self;
+  free(x);
+#endif // lcore_rbtree_compact
+}
+
+#ifdef lcore_rbtree_compact
+// Makes room for 'n' more nodes at the end of the node array. Fails when the
+// indices would no longer fit in 31 bits or the array can not grow.
+static inline bool _lc_mfunc_priv(reserve_nodes)(Self *self, size_t n) {
+  size_t used = self->used ? self->used : 1;
+  if (self->capacity && n <= self->capacity - used)
+    return true;
+  if (n > ((size_t)1 << 31) - used)
+    return false;
+  size_t capacity = self->capacity ? self->capacity : 16;
+  while (capacity < used + n)
+    capacity *= 2;
+  if (capacity > (size_t)1 << 31)
+    capacity = (size_t)1 << 31;
+  _Node *nodes = (_Node *)realloc(self->nodes, sizeof(_Node) * capacity);
+  if (!nodes)
+    return false;
+  self->nodes = nodes;
+  self->capacity = capacity;
+  self->used = used;
+  return true;
+}
+
+// Moves every node of 'other' into the node array of 'self', appending the
+// smaller array to the larger one, and renumbers the roots 'a' (of 'self')
+// and 'b' (of 'other') accordingly. 'other' is left without an array.
+static inline bool _lc_mfunc_priv(merge_nodes)(Self *self, Self *other,
+                                               _Ref *a, _Ref *b) {
+  _Ref *moved = b;
+  if (other->used > self->used) {
+    Self tmp = *self;
+    *self = *other;
+    *other = tmp;
+    moved = a;
+  }
+  size_t n = other->used ? other->used - 1 : 0;
+  if (!_lc_mfunc_priv(reserve_nodes)(self, n)) {
+    if (moved == a) {
+      Self tmp = *self;
+      *self = *other;
+      *other = tmp;
+    }
+    return false;
+  }
+  uint32_t off = (uint32_t)self->used - 1;
+  if (n)
+    memcpy(self->nodes + self->used, other->nodes + 1, sizeof(_Node) * n);
+  for (size_t i = self->used; i < self->used + n; i++) {
+    _Node *x = &self->nodes[i];
+    x->left += x->left ? off : 0;
+    x->right += x->right ? off : 0;
+    x->parent += x->parent & ~_lc_red_bit ? off : 0;
+  }
+  if (other->free_list) {
+    _Ref last = other->free_list + off;
+    while (_lc_right(self, last))
+      last = _lc_right(self, last);
+    _lc_right(self, last) = self->free_list;
+    self->free_list = other->free_list + off;
+  }
+  *moved += *moved ? off : 0;
+  self->used += n;
+  free(other->nodes);
+  other->nodes = NULL;
+  other->capacity = other->used = 0;
+  other->free_list = _lc_nil;
+  return true;
+}
+#endif // lcore_rbtree_compact
+
+static inline void _lc_mfunc_priv(transplant)(Self *self, _Ref x, _Ref y) {
+  _Ref p = _lc_parent(self, x);
+  if (!p)
     self->root = y;
-  else if (x == x->parent->left)
-    x->parent->left = y;
+  else if (x == _lc_left(self, p))
+    _lc_left(self, p) = y;
   else
-    x->parent->right = y;
+    _lc_right(self, p) = y;
 
   if (y)
-    y->parent = x->parent;
+    _lc_set_parent(self, y, p);
 }
 
-static inline void _lc_mfunc_priv(rotate_left)(Self *self, _Node *x) {
-  _Node *r = x->right;
-  x->right = r->left;
-  if (x->right)
-    x->right->parent = x;
-  r->parent = x->parent;
-  if (!x->parent)
+static inline void _lc_mfunc_priv(rotate_left)(Self *self, _Ref x) {
+  _Ref r = _lc_right(self, x);
+  _Ref p = _lc_parent(self, x);
+  _lc_right(self, x) = _lc_left(self, r);
+  if (_lc_right(self, x))
+    _lc_set_parent(self, _lc_right(self, x), x);
+  _lc_set_parent(self, r, p);
+  if (!p)
     self->root = r;
-  else if (x == x->parent->left)
-    x->parent->left = r;
+  else if (x == _lc_left(self, p))
+    _lc_left(self, p) = r;
   else
-    x->parent->right = r;
-  r->left = x;
-  x->parent = r;
-}
-
-static inline void _lc_mfunc_priv(rotate_right)(Self *self, _Node *x) {
-  _Node *l = x->left;
-  x->left = l->right;
-  if (x->left)
-    x->left->parent = x;
-  l->parent = x->parent;
-  if (!x->parent)
+    _lc_right(self, p) = r;
+  _lc_left(self, r) = x;
+  _lc_set_parent(self, x, r);
+#ifdef lcore_order_stats
+  _lc_at(self, r)->count = _lc_at(self, x)->count;
+  _lc_at(self, x)->count = 1 + _lc_count(self, _lc_left(self, x)) +
+                           _lc_count(self, _lc_right(self, x));
+#endif // lcore_order_stats
+}
+
+static inline void _lc_mfunc_priv(rotate_right)(Self *self, _Ref x) {
+  _Ref l = _lc_left(self, x);
+  _Ref p = _lc_parent(self, x);
+  _lc_left(self, x) = _lc_right(self, l);
+  if (_lc_left(self, x))
+    _lc_set_parent(self, _lc_left(self, x), x);
+  _lc_set_parent(self, l, p);
+  if (!p)
     self->root = l;
-  else if (x == x->parent->right)
-    x->parent->right = l;
+  else if (x == _lc_right(self, p))
+    _lc_right(self, p) = l;
   else
-    x->parent->left = l;
-  l->right = x;
-  x->parent = l;
+    _lc_left(self, p) = l;
+  _lc_right(self, l) = x;
+  _lc_set_parent(self, x, l);
+#ifdef lcore_order_stats
+  _lc_at(self, l)->count = _lc_at(self, x)->count;
+  _lc_at(self, x)->count = 1 + _lc_count(self, _lc_left(self, x)) +
+                           _lc_count(self, _lc_right(self, x));
+#endif // lcore_order_stats
 }
 
-static inline void _lc_mfunc_priv(fix_insert)(Self *self, _Node *x) {
-  while (x != self->root && x->parent && x->parent->red) {
-    _Node *parent = x->parent;
-    _Node *grandparent = parent->parent;
+static inline void _lc_mfunc_priv(fix_insert)(Self *self, _Ref x) {
+  while (x != self->root && _lc_parent(self, x) &&
+         _lc_red(self, _lc_parent(self, x))) {
+    _Ref parent = _lc_parent(self, x);
+    _Ref grandparent = _lc_parent(self, parent);
 
     if (!grandparent)
       break; // Needed for safety
 
-    if (parent == grandparent->left) {
-      _Node *uncle = grandparent->right;
+    if (parent == _lc_left(self, grandparent)) {
+      _Ref uncle = _lc_right(self, grandparent);
 
       // Case 1: Uncle is red → recolor
-      if (uncle && uncle->red) {
-        parent->red = 0;
-        uncle->red = 0;
-        grandparent->red = 1;
+      if (uncle && _lc_red(self, uncle)) {
+        _lc_set_red(self, parent, 0);
+        _lc_set_red(self, uncle, 0);
+        _lc_set_red(self, grandparent, 1);
         x = grandparent;
       } else {
         // Case 2: x is right child → left rotate
-        if (x == parent->right) {
+        if (x == _lc_right(self, parent)) {
           x = parent;
           _lc_mfunc_priv(rotate_left)(self, x);
-          parent = x->parent;
-          grandparent = parent->parent;
+          parent = _lc_parent(self, x);
+          grandparent = _lc_parent(self, parent);
         }
 
         // Case 3: x is left child → right rotate
-        parent->red = 0;
-        grandparent->red = 1;
+        _lc_set_red(self, parent, 0);
+        _lc_set_red(self, grandparent, 1);
         _lc_mfunc_priv(rotate_right)(self, grandparent);
       }
     } else {
-      _Node *uncle = grandparent->left;
+      _Ref uncle = _lc_left(self, grandparent);
 
       // Case 1: Uncle is red → recolor
-      if (uncle && uncle->red) {
-        parent->red = 0;
-        uncle->red = 0;
-        grandparent->red = 1;
+      if (uncle && _lc_red(self, uncle)) {
+        _lc_set_red(self, parent, 0);
+        _lc_set_red(self, uncle, 0);
+        _lc_set_red(self, grandparent, 1);
         x = grandparent;
       } else {
         // Case 2: x is left child → right rotate
-        if (x == parent->left) {
+        if (x == _lc_left(self, parent)) {
           x = parent;
           _lc_mfunc_priv(rotate_right)(self, x);
-          parent = x->parent;
-          grandparent = parent->parent;
+          parent = _lc_parent(self, x);
+          grandparent = _lc_parent(self, parent);
         }
 
         // Case 3: x is right child → left rotate
-        parent->red = 0;
-        grandparent->red = 1;
+        _lc_set_red(self, parent, 0);
+        _lc_set_red(self, grandparent, 1);
         _lc_mfunc_priv(rotate_left)(self, grandparent);
       }
     }
   }
-  self->root->red = 0;
+  _lc_set_red(self, self->root, 0);
 }
 
-static inline void _lc_mfunc_priv(fix_delete)(Self *self, _Node *x,
-                                                 _Node *x_p) {
-  while ((x != self->root) && (!x || x->red == 0)) {
-    if (x == (x_p ? x_p->left : NULL)) {
-      _Node *w = x_p->right;
-      if (w && w->red) {
-        w->red = 0;
-        x_p->red = 1;
+static inline void _lc_mfunc_priv(fix_delete)(Self *self, _Ref x, _Ref x_p) {
+  while ((x != self->root) && (!x || _lc_red(self, x) == 0)) {
+    if (x == (x_p ? _lc_left(self, x_p) : _lc_nil)) {
+      _Ref w = _lc_right(self, x_p);
+      if (w && _lc_red(self, w)) {
+        _lc_set_red(self, w, 0);
+        _lc_set_red(self, x_p, 1);
         _lc_mfunc_priv(rotate_left)(self, x_p);
-        w = x_p->right;
+        w = _lc_right(self, x_p);
       }
 
-      if ((!w->left || !w->left->red) && (!w->right || !w->right->red)) {
-        w->red = 1;
+      _Ref wl = _lc_left(self, w), wr = _lc_right(self, w);
+      if ((!wl || !_lc_red(self, wl)) && (!wr || !_lc_red(self, wr))) {
+        _lc_set_red(self, w, 1);
         x = x_p;
-        x_p = x->parent;
+        x_p = _lc_parent(self, x);
       } else {
-        if (!w->right || !w->right->red) {
-          if (w->left)
-            w->left->red = 0;
-          w->red = 1;
+        if (!wr || !_lc_red(self, wr)) {
+          if (wl)
+            _lc_set_red(self, wl, 0);
+          _lc_set_red(self, w, 1);
           _lc_mfunc_priv(rotate_right)(self, w);
-          w = x_p->right;
+          w = _lc_right(self, x_p);
         }
 
-        w->red = x_p->red;
-        x_p->red = 0;
-        if (w->right)
-          w->right->red = 0;
+        _lc_set_red(self, w, _lc_red(self, x_p));
+        _lc_set_red(self, x_p, 0);
+        if (_lc_right(self, w))
+          _lc_set_red(self, _lc_right(self, w), 0);
         _lc_mfunc_priv(rotate_left)(self, x_p);
         x = self->root;
         break;
       }
     } else {
-      _Node *w = x_p->left;
-      if (w && w->red) {
-        w->red = 0;
-        x_p->red = 1;
+      _Ref w = _lc_left(self, x_p);
+      if (w && _lc_red(self, w)) {
+        _lc_set_red(self, w, 0);
+        _lc_set_red(self, x_p, 1);
         _lc_mfunc_priv(rotate_right)(self, x_p);
-        w = x_p->left;
+        w = _lc_left(self, x_p);
       }
 
-      if ((!w->left || !w->left->red) && (!w->right || !w->right->red)) {
-        w->red = 1;
+      _Ref wl = _lc_left(self, w), wr = _lc_right(self, w);
+      if ((!wl || !_lc_red(self, wl)) && (!wr || !_lc_red(self, wr))) {
+        _lc_set_red(self, w, 1);
         x = x_p;
-        x_p = x->parent;
+        x_p = _lc_parent(self, x);
       } else {
-        if (!w->left || !w->left->red) {
-          if (w->right)
-            w->right->red = 0;
-          w->red = 1;
+        if (!wl || !_lc_red(self, wl)) {
+          if (wr)
+            _lc_set_red(self, wr, 0);
+          _lc_set_red(self, w, 1);
           _lc_mfunc_priv(rotate_left)(self, w);
-          w = x_p->left;
+          w = _lc_left(self, x_p);
         }
 
-        w->red = x_p->red;
-        x_p->red = 0;
-        if (w->left)
-          w->left->red = 0;
+        _lc_set_red(self, w, _lc_red(self, x_p));
+        _lc_set_red(self, x_p, 0);
+        if (_lc_left(self, w))
+          _lc_set_red(self, _lc_left(self, w), 0);
         _lc_mfunc_priv(rotate_right)(self, x_p);
         x = self->root;
         break;
@@ -370,5 +890,365 @@ static inline void _lc_mfunc_priv(fix_delete)(Self *self, _Node *x,
   }
 
   if (x)
-    x->red = 0;
+    _lc_set_red(self, x, 0);
+}
+
+// The children are built before being linked: with the compact layout a new
+// node may move the node array. Returns _lc_nil for a non-empty range when a
+// node can not be allocated, the nodes of the range are freed then.
+static inline _Ref _lc_mfunc_priv(build_range)(Self *self, T const *values,
+                                               size_t n, int depth,
+                                               int red_depth) {
+  if (n == 0)
+    return _lc_nil;
+  size_t mid = n / 2;
+  _Ref x = _lc_mfunc_priv(new_node)(self, values[mid]);
+  if (!x)
+    return _lc_nil;
+  _Ref l = _lc_mfunc_priv(build_range)(self, values, mid, depth + 1,
+                                       red_depth);
+  if (mid && !l) {
+    _lc_mfunc_priv(free_node)(self, x);
+    return _lc_nil;
+  }
+  _Ref r = _lc_mfunc_priv(build_range)(self, values + mid + 1, n - mid - 1,
+                                       depth + 1, red_depth);
+  if (n - mid - 1 && !r) {
+    _lc_mfunc_priv(free_tree)(self, l);
+    _lc_mfunc_priv(free_node)(self, x);
+    return _lc_nil;
+  }
+  _lc_set_red(self, x, depth == red_depth);
+  _lc_left(self, x) = l;
+  _lc_right(self, x) = r;
+  if (l)
+    _lc_set_parent(self, l, x);
+  if (r)
+    _lc_set_parent(self, r, x);
+#ifdef lcore_order_stats
+  _lc_at(self, x)->count = n;
+#endif // lcore_order_stats
+  return x;
+}
+
+// Frees the nodes of the subtree 'x' without dropping their values, which
+// still belong to the caller of build().
+static inline void _lc_mfunc_priv(free_tree)(Self *self, _Ref x) {
+  if (!x)
+    return;
+  _lc_mfunc_priv(free_tree)(self, _lc_left(self, x));
+  _lc_mfunc_priv(free_tree)(self, _lc_right(self, x));
+  _lc_mfunc_priv(free_node)(self, x);
+}
+
+static inline _Ref _lc_mfunc_priv(detach)(Self *self, _Ref x) {
+  if (x)
+    _lc_set_parent(self, x, _lc_nil);
+  return x;
+}
+
+// Number of black nodes on the path from 'x' to any leaf.
+static inline int _lc_mfunc_priv(black_height)(Self *self, _Ref x) {
+  int h = 0;
+  for (; x; x = _lc_left(self, x))
+    h += !_lc_red(self, x);
+  return h;
 }
+
+// Joins the detached trees 'l' and 'r' (every key of 'l' smaller than the
+// key of 'm', itself smaller than every key of 'r') under the detached node
+// 'm'. The middle node is hung where the spine of the taller tree reaches
+// the black height of the shorter one, then the usual insertion fixup
+// repairs a possible red violation, in O(difference of the heights).
+static inline _Ref _lc_mfunc_priv(join)(Self *self, _Ref l, _Ref m, _Ref r) {
+  // Both roots are made black first so the red middle node can never end up
+  // above a red child.
+  if (l)
+    _lc_set_red(self, l, 0);
+  if (r)
+    _lc_set_red(self, r, 0);
+  int hl = _lc_mfunc_priv(black_height)(self, l);
+  int hr = _lc_mfunc_priv(black_height)(self, r);
+  _lc_set_parent(self, m, _lc_nil);
+  if (hl == hr) {
+    _lc_left(self, m) = l;
+    _lc_right(self, m) = r;
+    if (l)
+      _lc_set_parent(self, l, m);
+    if (r)
+      _lc_set_parent(self, r, m);
+    _lc_set_red(self, m, 1);
+#ifdef lcore_order_stats
+    _lc_at(self, m)->count = 1 + _lc_count(self, l) + _lc_count(self, r);
+#endif // lcore_order_stats
+    return m;
+  }
+
+  // The fixup runs on a scratch tree sharing the nodes of 'self', so
+  // concurrent joins never write to the same root.
+  Self tmp;
+  memset(&tmp, 0, sizeof(tmp));
+#ifdef lcore_rbtree_compact
+  tmp.nodes = self->nodes;
+#endif // lcore_rbtree_compact
+  uint8_t right = hl > hr;
+  int h = right ? hl : hr, target = right ? hr : hl;
+  _Ref parent = _lc_nil;
+  _Ref c = right ? l : r;
+  while ((c && _lc_red(self, c)) || h > target) {
+    h -= !_lc_red(self, c);
+    parent = c;
+    c = right ? _lc_right(self, c) : _lc_left(self, c);
+  }
+  _lc_set_red(self, m, 1);
+  _lc_set_parent(self, m, parent);
+  if (right) {
+    _lc_left(self, m) = c;
+    _lc_right(self, m) = r;
+    _lc_right(self, parent) = m;
+    tmp.root = l;
+  } else {
+    _lc_left(self, m) = l;
+    _lc_right(self, m) = c;
+    _lc_left(self, parent) = m;
+    tmp.root = r;
+  }
+  if (_lc_left(self, m))
+    _lc_set_parent(self, _lc_left(self, m), m);
+  if (_lc_right(self, m))
+    _lc_set_parent(self, _lc_right(self, m), m);
+#ifdef lcore_order_stats
+  _lc_at(self, m)->count = 1 + _lc_count(self, _lc_left(self, m)) +
+                           _lc_count(self, _lc_right(self, m));
+  for (_Ref p = parent; p; p = _lc_parent(self, p))
+    _lc_at(self, p)->count += 1 + _lc_count(self, right ? r : l);
+#endif // lcore_order_stats
+  _lc_mfunc_priv(fix_insert)(&tmp, m);
+  return tmp.root;
+}
+
+// Joins two detached trees without a middle node, borrowing the largest node
+// of 'l' for that role.
+static inline _Ref _lc_mfunc_priv(join2)(Self *self, _Ref l, _Ref r) {
+  if (!l)
+    return r;
+  _Ref last;
+  l = _lc_mfunc_priv(split_last)(self, l, &last);
+  return _lc_mfunc_priv(join)(self, l, last, r);
+}
+
+// Splits the detached tree 't' into the keys smaller ('l') and greater ('r')
+// than 'key'. The node holding 'key', if any, is detached into 'dup'.
+static inline void _lc_mfunc_priv(split)(Self *self, _Ref t, T key, _Ref *l,
+                                         _Ref *r, _Ref *dup) {
+  if (!t) {
+    *l = *r = _lc_nil;
+    return;
+  }
+  _Ref tl = _lc_mfunc_priv(detach)(self, _lc_left(self, t));
+  _Ref tr = _lc_mfunc_priv(detach)(self, _lc_right(self, t));
+  int c = lcore_cmp_fn(key, _lc_data(self, t));
+  if (c == 0) {
+    *l = tl;
+    *r = tr;
+    *dup = t;
+  } else if (c < 0) {
+    _Ref mid;
+    _lc_mfunc_priv(split)(self, tl, key, l, &mid, dup);
+    *r = _lc_mfunc_priv(join)(self, mid, t, tr);
+  } else {
+    _Ref mid;
+    _lc_mfunc_priv(split)(self, tr, key, &mid, r, dup);
+    *l = _lc_mfunc_priv(join)(self, tl, t, mid);
+  }
+}
+
+// Detaches the largest node of 't' into 'last' and returns the rest.
+static inline _Ref _lc_mfunc_priv(split_last)(Self *self, _Ref t,
+                                              _Ref *last) {
+  _Ref tl = _lc_mfunc_priv(detach)(self, _lc_left(self, t));
+  _Ref tr = _lc_mfunc_priv(detach)(self, _lc_right(self, t));
+  if (!tr) {
+    *last = t;
+    return tl;
+  }
+  tr = _lc_mfunc_priv(split_last)(self, tr, last);
+  return _lc_mfunc_priv(join)(self, tl, t, tr);
+}
+
+static inline void _lc_mfunc_priv(discard)(Self *self, _Ref t,
+                                           _Ref *garbage) {
+  if (!t)
+    return;
+  _lc_mfunc_priv(discard)(self, _lc_left(self, t), garbage);
+  _lc_mfunc_priv(discard)(self, _lc_right(self, t), garbage);
+  _lc_right(self, t) = *garbage;
+  *garbage = t;
+}
+
+#ifdef lcore_rbtree_threads
+static inline void *_lc_mfunc_priv(task_main)(void *arg) {
+  _Task *task = (_Task *)arg;
+  task->result =
+      task->op(task->self, task->a, task->b, &task->garbage, task->depth);
+  return NULL;
+}
+#endif // lcore_rbtree_threads
+
+// Runs the two independent recursive calls of a set operation, the first one
+// in a new thread while the topmost levels have threads to spare and the
+// subtrees are big enough (a black height of 10 means at least 1023 nodes).
+static inline void _lc_mfunc_priv(fork)(Self *self, _SetOp op, _Ref a1,
+                                        _Ref b1, _Ref *r1, _Ref a2, _Ref b2,
+                                        _Ref *r2, _Ref *garbage, int depth) {
+#ifdef lcore_rbtree_threads
+  if ((1 << depth) < lcore_rbtree_threads &&
+      _lc_mfunc_priv(black_height)(self, a1) >= 10) {
+    _Task task = {op, self, a1, b1, _lc_nil, _lc_nil, depth + 1};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _lc_mfunc_priv(task_main), &task) ==
+        0) {
+      *r2 = op(self, a2, b2, garbage, depth + 1);
+      pthread_join(thread, NULL);
+      *r1 = task.result;
+      if (task.garbage) {
+        _Ref tail = task.garbage;
+        while (_lc_right(self, tail))
+          tail = _lc_right(self, tail);
+        _lc_right(self, tail) = *garbage;
+        *garbage = task.garbage;
+      }
+      return;
+    }
+  }
+#endif // lcore_rbtree_threads
+  *r1 = op(self, a1, b1, garbage, depth + 1);
+  *r2 = op(self, a2, b2, garbage, depth + 1);
+}
+
+static inline _Ref _lc_mfunc_priv(union_rec)(Self *self, _Ref a, _Ref b,
+                                             _Ref *garbage, int depth) {
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  _Ref bl, br, dup = _lc_nil;
+  _lc_mfunc_priv(split)(self, b, _lc_data(self, a), &bl, &br, &dup);
+  if (dup) {
+    _lc_right(self, dup) = *garbage;
+    *garbage = dup;
+  }
+  _Ref al = _lc_mfunc_priv(detach)(self, _lc_left(self, a));
+  _Ref ar = _lc_mfunc_priv(detach)(self, _lc_right(self, a));
+  _Ref l, r;
+  _lc_mfunc_priv(fork)(self, _lc_mfunc_priv(union_rec), al, bl, &l, ar, br,
+                       &r, garbage, depth);
+  return _lc_mfunc_priv(join)(self, l, a, r);
+}
+
+static inline _Ref _lc_mfunc_priv(intersection_rec)(Self *self, _Ref a,
+                                                    _Ref b, _Ref *garbage,
+                                                    int depth) {
+  if (!a || !b) {
+    _lc_mfunc_priv(discard)(self, a, garbage);
+    _lc_mfunc_priv(discard)(self, b, garbage);
+    return _lc_nil;
+  }
+  _Ref bl, br, dup = _lc_nil;
+  _lc_mfunc_priv(split)(self, b, _lc_data(self, a), &bl, &br, &dup);
+  _Ref al = _lc_mfunc_priv(detach)(self, _lc_left(self, a));
+  _Ref ar = _lc_mfunc_priv(detach)(self, _lc_right(self, a));
+  _Ref l, r;
+  _lc_mfunc_priv(fork)(self, _lc_mfunc_priv(intersection_rec), al, bl, &l, ar,
+                       br, &r, garbage, depth);
+  if (dup) {
+    _lc_right(self, dup) = *garbage;
+    *garbage = dup;
+    return _lc_mfunc_priv(join)(self, l, a, r);
+  }
+  _lc_right(self, a) = *garbage;
+  *garbage = a;
+  return _lc_mfunc_priv(join2)(self, l, r);
+}
+
+static inline _Ref _lc_mfunc_priv(difference_rec)(Self *self, _Ref a, _Ref b,
+                                                  _Ref *garbage, int depth) {
+  if (!a || !b) {
+    _lc_mfunc_priv(discard)(self, b, garbage);
+    return a;
+  }
+  _Ref al, ar, dup = _lc_nil;
+  _lc_mfunc_priv(split)(self, a, _lc_data(self, b), &al, &ar, &dup);
+  if (dup) {
+    _lc_right(self, dup) = *garbage;
+    *garbage = dup;
+  }
+  _Ref bl = _lc_mfunc_priv(detach)(self, _lc_left(self, b));
+  _Ref br = _lc_mfunc_priv(detach)(self, _lc_right(self, b));
+  _lc_right(self, b) = *garbage;
+  *garbage = b;
+  _Ref l, r;
+  _lc_mfunc_priv(fork)(self, _lc_mfunc_priv(difference_rec), al, bl, &l, ar,
+                       br, &r, garbage, depth);
+  return _lc_mfunc_priv(join2)(self, l, r);
+}
+
+// Shared driver of the set operations: the discarded nodes are only dropped
+// and freed here, once every thread is done, so the recursion never touches
+// the pool or the drop function concurrently. With the compact layout both
+// trees first have to share one node array; if it can not grow, neither
+// tree is changed.
+static inline void _lc_mfunc_priv(set_op)(Self *self, Self *other,
+                                          _SetOp op) {
+  size_t total = self->size + other->size;
+  _Ref a = self->root, b = other->root;
+  _Ref garbage = _lc_nil;
+#ifdef lcore_rbtree_compact
+  if (!_lc_mfunc_priv(merge_nodes)(self, other, &a, &b))
+    return;
+#endif // lcore_rbtree_compact
+  self->root = op(self, _lc_mfunc_priv(detach)(self, a),
+                  _lc_mfunc_priv(detach)(self, b), &garbage, 0);
+  if (self->root)
+    _lc_set_red(self, self->root, 0);
+#ifdef lcore_node_pool
+  lc_pool_adopt(&self->pool, &other->pool);
+#endif // lcore_node_pool
+  while (garbage) {
+    _Ref next = _lc_right(self, garbage);
+    lcore_drop_fn(_lc_data(self, garbage));
+    _lc_mfunc_priv(free_node)(self, garbage);
+    garbage = next;
+    total--;
+  }
+  self->size = total;
+  other->root = _lc_nil;
+  other->size = 0;
+}
+
+#undef T
+#undef lcore_pfx
+#undef lcore_cmp_fn
+#undef lcore_drop_fn
+#undef lcore_node_pool
+#undef lcore_rbtree_threads
+#undef lcore_rbtree_compact
+#undef lcore_order_stats
+#undef _lc_trivial_drop
+#undef Self
+#undef _Node
+#undef _Ref
+#undef _Iter
+#undef _lc_count
+#undef _lc_nil
+#undef _lc_red_bit
+#undef _lc_at
+#undef _lc_parent
+#undef _lc_set_parent
+#undef _lc_red
+#undef _lc_set_red
+#undef _lc_left
+#undef _lc_right
+#undef _lc_data
+#undef _SetOp
+#undef _Task
@@ -0,0 +1,372 @@
+#include "_lc_ebr.h"
+#include "_lc_hash.h"
+#include "_lc_templating.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Lock-free ordered set, safe to use from any number of threads at once.
+//
+// The keys live in a skiplist whose links are updated with compare-and-swap
+// only, so a lookup or range scan never waits for a writer and writers only
+// retry when they race on the very same links. A removal first marks the
+// next pointers of the node (lowest bit set), which makes it logically
+// deleted and stops inserters from linking after it, then unlinks it level
+// by level; threads walking past a marked node help unlinking it.
+//
+// Unlinked nodes are reclaimed through epoch-based reclamation (see
+// _lc_ebr.h): lcore_drop_fn runs once no thread can observe the node, so the
+// keys handed to for_each_range() stay valid during the callback.
+//
+// #define T uint64_t
+// #define lcore_pfx index
+// #include "containers/skiplist.h"
+
+#ifndef T
+#define T int
+#endif // T
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, skiplist)
+#endif // lcore_pfx
+
+#ifndef lcore_cmp_fn
+#define lcore_cmp_fn(a, b) (((a) > (b)) - ((a) < (b)))
+#endif // lcore_cmp_fn
+
+#ifndef lcore_drop_fn
+#define lcore_drop_fn(x)
+#endif // lcore_drop_fn
+
+#define Self lcore_pfx
+#define _Node _lc_join(Self, node)
+
+// Tower heights are drawn with p = 1/4, 16 levels cover 4^16 keys.
+#define _Levels 16
+#define _Ref(link) ((_Node *)((link) & ~(uintptr_t)1))
+#define _Marked(link) ((link) & 1)
+
+// ========== STRUCTS DEFINITIONS ============== //
+
+typedef struct _Node {
+  lc_ebr_link ebr;              // must stay first, see reclaim()
+  T value;                      // key of the node
+  atomic_int links;             // levels linked at, +1 while being inserted
+  int height;                   // number of levels of the tower
+  _Atomic(uintptr_t) next[];    // successor on each level, marked if deleted
+} _Node;
+
+typedef struct Self {
+  _Node *head;       // sentinel tower of _Levels levels
+  atomic_size_t size; // number of keys
+  lc_ebr ebr;        // reclamation domain of the nodes
+} Self;
+
+// ============== PUBLIC API ==================== //
+// init() and destroy() must not run concurrently with anything else, every
+// other function may be called from any thread at any time. The first call
+// of a thread allocates its reclamation record; if that fails the call
+// reports a miss (or a failed insertion).
+
+static inline bool _lc_mfunc(init)(Self *self);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline uint8_t _lc_mfunc(insert)(Self *self, T val);
+static inline uint8_t _lc_mfunc(remove)(Self *self, T val);
+static inline uint8_t _lc_mfunc(contains)(Self *self, T val);
+static inline bool _lc_mfunc(lower_bound)(Self *self, T key, T *out);
+static inline size_t _lc_mfunc(for_each_range)(Self *self, T lo, T hi,
+                                               bool (*fn)(T, void *),
+                                               void *ctx);
+static inline size_t _lc_mfunc(size)(Self *self);
+
+// ============= PRIVATE FUNCTIONS ============== //
+// These functions are not meant to be called directly, they are helpers used
+// inside the public API implementation
+
+static inline _Node *_lc_mfunc_priv(new_node)(T val, int height);
+static inline int _lc_mfunc_priv(random_height)(void);
+static inline void _lc_mfunc_priv(reclaim)(lc_ebr_link *link);
+static inline void _lc_mfunc_priv(unlinked)(Self *self, lc_ebr_thread *t,
+                                            _Node *x);
+static inline bool _lc_mfunc_priv(find)(Self *self, lc_ebr_thread *t, T key,
+                                        _Node **preds, _Node **succs);
+static inline _Node *_lc_mfunc_priv(seek)(Self *self, T key);
+
+// ========== PUBLIC API IMPLEMENTATION ========= //
+
+// False when the head or the reclamation domain can not be set up, the list
+// is then left empty and destroy() does nothing.
+static inline bool _lc_mfunc(init)(Self *self) {
+  self->head = _lc_mfunc_priv(new_node)((T){0}, _Levels);
+  atomic_init(&self->size, 0);
+  if (self->head && lc_ebr_init(&self->ebr))
+    return true;
+  free(self->head);
+  self->head = NULL;
+  return false;
+}
+
+static inline void _lc_mfunc(destroy)(Self *self) {
+  if (!self->head)
+    return;
+  // Every node still linked at the bottom level is owned by the list, the
+  // others were retired and belong to the reclamation domain.
+  _Node *x = _Ref(atomic_load(&self->head->next[0]));
+  while (x) {
+    _Node *next = _Ref(atomic_load(&x->next[0]));
+    _lc_mfunc_priv(reclaim)(&x->ebr);
+    x = next;
+  }
+  free(self->head);
+  lc_ebr_destroy(&self->ebr);
+  memset(self, 0, sizeof(*self));
+}
+
+// The node becomes visible once linked at the bottom level, the upper levels
+// are only shortcuts and are linked afterwards one at a time.
+static inline uint8_t _lc_mfunc(insert)(Self *self, T val) {
+  _Node *preds[_Levels], *succs[_Levels];
+  lc_ebr_thread *t = lc_ebr_enter(&self->ebr);
+  if (!t)
+    return 0; // Allocation failed
+  _Node *x = NULL;
+  for (;;) {
+    if (_lc_mfunc_priv(find)(self, t, val, preds, succs)) {
+      free(x); // never published
+      lc_ebr_exit(t);
+      return 0; // Value already exists
+    }
+    if (!x) {
+      x = _lc_mfunc_priv(new_node)(val, _lc_mfunc_priv(random_height)());
+      if (!x) {
+        lc_ebr_exit(t);
+        return 0; // Allocation failed
+      }
+    }
+    for (int lvl = 0; lvl < x->height; lvl++)
+      atomic_store_explicit(&x->next[lvl], (uintptr_t)succs[lvl],
+                            memory_order_relaxed);
+    atomic_store_explicit(&x->links, 2, memory_order_relaxed);
+    uintptr_t expected = (uintptr_t)succs[0];
+    if (atomic_compare_exchange_strong(&preds[0]->next[0], &expected,
+                                       (uintptr_t)x))
+      break;
+  }
+  atomic_fetch_add(&self->size, 1);
+
+  for (int lvl = 1; lvl < x->height; lvl++) {
+    for (;;) {
+      // A marked link means a remove() got hold of the node, stop growing
+      // the tower.
+      uintptr_t next = atomic_load(&x->next[lvl]);
+      if (_Marked(next))
+        goto done;
+      if (_Ref(next) != succs[lvl] &&
+          !atomic_compare_exchange_strong(&x->next[lvl], &next,
+                                          (uintptr_t)succs[lvl]))
+        goto done;
+      atomic_fetch_add(&x->links, 1);
+      uintptr_t expected = (uintptr_t)succs[lvl];
+      if (atomic_compare_exchange_strong(&preds[lvl]->next[lvl], &expected,
+                                         (uintptr_t)x))
+        break;
+      atomic_fetch_sub(&x->links, 1);
+      _lc_mfunc_priv(find)(self, t, val, preds, succs);
+    }
+  }
+
+done:
+  // A remove() that ran while the tower was growing may have missed the
+  // levels linked after its own cleanup pass.
+  if (_Marked(atomic_load(&x->next[0])))
+    _lc_mfunc_priv(find)(self, t, val, preds, succs);
+  _lc_mfunc_priv(unlinked)(self, t, x);
+  lc_ebr_exit(t);
+  return 1;
+}
+
+// Marks the tower top-down, the thread marking the bottom level owns the
+// removal. The nodes are then unlinked by a find() pass.
+static inline uint8_t _lc_mfunc(remove)(Self *self, T val) {
+  _Node *preds[_Levels], *succs[_Levels];
+  lc_ebr_thread *t = lc_ebr_enter(&self->ebr);
+  if (!t)
+    return 0; // Allocation failed
+  if (!_lc_mfunc_priv(find)(self, t, val, preds, succs)) {
+    lc_ebr_exit(t);
+    return 0; // Value not found
+  }
+  _Node *x = succs[0];
+  for (int lvl = x->height - 1; lvl > 0; lvl--) {
+    uintptr_t next = atomic_load(&x->next[lvl]);
+    while (!_Marked(next) &&
+           !atomic_compare_exchange_weak(&x->next[lvl], &next, next | 1))
+      ;
+  }
+  uintptr_t next = atomic_load(&x->next[0]);
+  for (;;) {
+    if (_Marked(next)) {
+      lc_ebr_exit(t);
+      return 0; // Removed by another thread in the meantime
+    }
+    if (atomic_compare_exchange_strong(&x->next[0], &next, next | 1))
+      break;
+  }
+  atomic_fetch_sub(&self->size, 1);
+  _lc_mfunc_priv(find)(self, t, val, preds, succs);
+  lc_ebr_exit(t);
+  return 1;
+}
+
+static inline uint8_t _lc_mfunc(contains)(Self *self, T val) {
+  lc_ebr_thread *t = lc_ebr_enter(&self->ebr);
+  if (!t)
+    return 0;
+  _Node *x = _lc_mfunc_priv(seek)(self, val);
+  uint8_t found = x && lcore_cmp_fn(x->value, val) == 0;
+  lc_ebr_exit(t);
+  return found;
+}
+
+// Stores the smallest key >= 'key' in 'out', returns false if there is none.
+static inline bool _lc_mfunc(lower_bound)(Self *self, T key, T *out) {
+  lc_ebr_thread *t = lc_ebr_enter(&self->ebr);
+  if (!t)
+    return false;
+  _Node *x = _lc_mfunc_priv(seek)(self, key);
+  if (x)
+    *out = x->value;
+  lc_ebr_exit(t);
+  return x != NULL;
+}
+
+// Calls 'fn' on every key in [lo, hi) in increasing order until it returns
+// false, and returns the number of calls. Keys inserted or removed during
+// the scan may or may not be reported.
+static inline size_t _lc_mfunc(for_each_range)(Self *self, T lo, T hi,
+                                               bool (*fn)(T, void *),
+                                               void *ctx) {
+  size_t calls = 0;
+  lc_ebr_thread *t = lc_ebr_enter(&self->ebr);
+  if (!t)
+    return 0;
+  _Node *x = _lc_mfunc_priv(seek)(self, lo);
+  while (x && lcore_cmp_fn(x->value, hi) < 0) {
+    uintptr_t next = atomic_load_explicit(&x->next[0], memory_order_acquire);
+    if (!_Marked(next)) {
+      calls++;
+      if (!fn(x->value, ctx))
+        break;
+    }
+    x = _Ref(next);
+  }
+  lc_ebr_exit(t);
+  return calls;
+}
+
+static inline size_t _lc_mfunc(size)(Self *self) {
+  return atomic_load_explicit(&self->size, memory_order_relaxed);
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline _Node *_lc_mfunc_priv(new_node)(T val, int height) {
+  _Node *x = lc_malloc(_Node, sizeof(_Node) +
+                                  sizeof(_Atomic(uintptr_t)) * (size_t)height);
+  if (!x)
+    return NULL;
+  x->ebr.next = NULL;
+  x->ebr.free_fn = _lc_mfunc_priv(reclaim);
+  x->value = val;
+  x->height = height;
+  atomic_init(&x->links, 0);
+  for (int lvl = 0; lvl < height; lvl++)
+    atomic_init(&x->next[lvl], (uintptr_t)0);
+  return x;
+}
+
+// Two random bits per level: each level holds a quarter of the one below.
+static inline int _lc_mfunc_priv(random_height)(void) {
+  static _Thread_local uint64_t state;
+  if (!state)
+    state = lc_hash_int((uint64_t)(uintptr_t)&state) | 1;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return 1 + __builtin_ctzll(state | 1ull << (2 * (_Levels - 1))) / 2;
+}
+
+static inline void _lc_mfunc_priv(reclaim)(lc_ebr_link *link) {
+  _Node *x = (_Node *)link;
+  lcore_drop_fn(x->value);
+  free(x);
+}
+
+// Called each time 'x' is unlinked from a level and once when its insertion
+// completes: the last call retires the node.
+static inline void _lc_mfunc_priv(unlinked)(Self *self, lc_ebr_thread *t,
+                                            _Node *x) {
+  if (atomic_fetch_sub(&x->links, 1) == 1)
+    lc_ebr_retire(&self->ebr, t, &x->ebr);
+}
+
+// Fills 'preds' and 'succs' with the neighbours of 'key' on every level,
+// unlinking the marked nodes met on the way. Returns whether succs[0] holds
+// 'key'.
+static inline bool _lc_mfunc_priv(find)(Self *self, lc_ebr_thread *t, T key,
+                                        _Node **preds, _Node **succs) {
+retry:;
+  _Node *pred = self->head;
+  for (int lvl = _Levels - 1; lvl >= 0; lvl--) {
+    _Node *cur = _Ref(atomic_load(&pred->next[lvl]));
+    while (cur) {
+      uintptr_t next = atomic_load(&cur->next[lvl]);
+      if (_Marked(next)) {
+        // Fails if 'pred' got marked or changed, start over from the head.
+        uintptr_t expected = (uintptr_t)cur;
+        if (!atomic_compare_exchange_strong(&pred->next[lvl], &expected,
+                                            next & ~(uintptr_t)1))
+          goto retry;
+        _lc_mfunc_priv(unlinked)(self, t, cur);
+        cur = _Ref(next);
+        continue;
+      }
+      if (lcore_cmp_fn(cur->value, key) >= 0)
+        break;
+      pred = cur;
+      cur = _Ref(next);
+    }
+    preds[lvl] = pred;
+    succs[lvl] = cur;
+  }
+  return succs[0] && lcore_cmp_fn(succs[0]->value, key) == 0;
+}
+
+// Read-only version of find(): returns the first unmarked node >= 'key' of
+// the bottom level, stepping over marked nodes instead of unlinking them.
+static inline _Node *_lc_mfunc_priv(seek)(Self *self, T key) {
+  _Node *pred = self->head, *cur = NULL;
+  for (int lvl = _Levels - 1; lvl >= 0; lvl--) {
+    cur = _Ref(atomic_load_explicit(&pred->next[lvl], memory_order_acquire));
+    while (cur) {
+      uintptr_t next =
+          atomic_load_explicit(&cur->next[lvl], memory_order_acquire);
+      if (!_Marked(next)) {
+        if (lcore_cmp_fn(cur->value, key) >= 0)
+          break;
+        pred = cur;
+      }
+      cur = _Ref(next);
+    }
+  }
+  return cur;
+}
+
+#undef T
+#undef lcore_pfx
+#undef lcore_cmp_fn
+#undef lcore_drop_fn
+#undef Self
+#undef _Node
+#undef _Levels
+#undef _Ref
+#undef _Marked
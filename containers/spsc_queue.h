@@ -0,0 +1,187 @@
+#include "_lc_templating.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Bounded lock-free FIFO between exactly one producer thread and one
+// consumer thread.
+//
+// #define T job
+// #define lcore_pfx job_pipe
+// #include "containers/spsc_queue.h"
+//
+// job_pipe q;
+// job_pipe_init(&q, 1024); // capacity, rounded up to a power of two
+//
+// The elements live in a ring buffer allocated once by init(), so passing
+// an element never allocates. The producer only writes 'tail', the consumer
+// only writes 'head', and each keeps a private copy of the other's index
+// that it refreshes only when the queue looks full (or empty): while the
+// queue is neither, an operation touches no cache line written by the other
+// thread except the slot itself. Both indices and their copies live on
+// separate cache lines, so the struct must be cache line aligned (any
+// automatic or static variable is, a heap allocated one needs
+// aligned_alloc(LC_CACHE_LINE, ...)).
+//
+// push_many() and pop_many() move a whole batch with a single update of the
+// shared index, which is what makes batching worth it between threads.
+
+#ifndef T
+#define T int
+#endif // T
+
+#ifndef lcore_drop_fn
+#define _lc_trivial_drop
+#define lcore_drop_fn(x)
+#endif // lcore_drop_fn
+
+#ifndef lcore_pfx
+#define lcore_pfx _lc_join(T, spsc_queue)
+#endif // lcore_pfx
+
+#ifndef LC_CACHE_LINE
+#define LC_CACHE_LINE 64
+#endif // LC_CACHE_LINE
+
+#define Self lcore_pfx
+
+typedef struct {
+  // Read-only after init().
+  _Alignas(LC_CACHE_LINE) T *elements;
+  size_t mask; // capacity - 1
+  // Consumer side.
+  _Alignas(LC_CACHE_LINE) atomic_size_t head; // elements popped so far
+  size_t tail_cache;                          // last value of 'tail' seen
+  // Producer side.
+  _Alignas(LC_CACHE_LINE) atomic_size_t tail; // elements pushed so far
+  size_t head_cache;                          // last value of 'head' seen
+} Self;
+
+// ============== PUBLIC API ==================== //
+// init() and destroy() must not run concurrently with anything else.
+// try_push() and push_many() may only be called by the producer, try_pop()
+// and pop_many() only by the consumer, size() by either.
+
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity);
+static inline void _lc_mfunc(destroy)(Self *self);
+static inline bool _lc_mfunc(try_push)(Self *self, T value);
+static inline bool _lc_mfunc(try_pop)(Self *self, T *out);
+static inline size_t _lc_mfunc(push_many)(Self *self, T const *values,
+                                          size_t n);
+static inline size_t _lc_mfunc(pop_many)(Self *self, T *out, size_t n);
+static inline size_t _lc_mfunc(size)(Self *self);
+static inline size_t _lc_mfunc(capacity)(Self *self);
+
+// ============ API IMPLEMENTATION ============== //
+
+// Allocates room for 'capacity' elements (rounded up to a power of two, at
+// least 2). False when the buffer can not be allocated.
+static inline bool _lc_mfunc(init)(Self *self, size_t capacity) {
+  size_t cap = 2;
+  while (cap < capacity)
+    cap <<= 1;
+  memset(self, 0, sizeof(*self));
+  self->elements = lc_malloc(T, cap * sizeof(T));
+  if (!self->elements)
+    return false;
+  self->mask = cap - 1;
+  atomic_init(&self->head, 0);
+  atomic_init(&self->tail, 0);
+  return true;
+}
+
+// Drops the elements still queued.
+static inline void _lc_mfunc(destroy)(Self *self) {
+#ifndef _lc_trivial_drop
+  size_t tail = atomic_load(&self->tail);
+  for (size_t i = atomic_load(&self->head); i != tail; i++)
+    lcore_drop_fn(self->elements[i & self->mask]);
+#endif // _lc_trivial_drop
+  free(self->elements);
+  memset(self, 0, sizeof(*self));
+}
+
+// False when the queue is full, 'value' is then not queued.
+static inline bool _lc_mfunc(try_push)(Self *self, T value) {
+  size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+  if (tail - self->head_cache > self->mask) {
+    self->head_cache = atomic_load_explicit(&self->head, memory_order_acquire);
+    if (tail - self->head_cache > self->mask)
+      return false;
+  }
+  self->elements[tail & self->mask] = value;
+  atomic_store_explicit(&self->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+// False when the queue is empty.
+static inline bool _lc_mfunc(try_pop)(Self *self, T *out) {
+  size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+  if (head == self->tail_cache) {
+    self->tail_cache = atomic_load_explicit(&self->tail, memory_order_acquire);
+    if (head == self->tail_cache)
+      return false;
+  }
+  *out = self->elements[head & self->mask];
+  atomic_store_explicit(&self->head, head + 1, memory_order_release);
+  return true;
+}
+
+// Queues as many of the 'n' values as fit and returns how many did, they
+// become visible to the consumer all at once.
+static inline size_t _lc_mfunc(push_many)(Self *self, T const *values,
+                                          size_t n) {
+  size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+  size_t room = self->mask + 1 - (tail - self->head_cache);
+  if (room < n) {
+    self->head_cache = atomic_load_explicit(&self->head, memory_order_acquire);
+    room = self->mask + 1 - (tail - self->head_cache);
+  }
+  if (n > room)
+    n = room;
+  if (n == 0)
+    return 0;
+  size_t start = tail & self->mask;
+  size_t first = self->mask + 1 - start < n ? self->mask + 1 - start : n;
+  memcpy(self->elements + start, values, first * sizeof(T));
+  memcpy(self->elements, values + first, (n - first) * sizeof(T));
+  atomic_store_explicit(&self->tail, tail + n, memory_order_release);
+  return n;
+}
+
+// Moves up to 'n' elements into 'out' and returns how many were moved.
+static inline size_t _lc_mfunc(pop_many)(Self *self, T *out, size_t n) {
+  size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+  size_t avail = self->tail_cache - head;
+  if (avail < n) {
+    self->tail_cache = atomic_load_explicit(&self->tail, memory_order_acquire);
+    avail = self->tail_cache - head;
+  }
+  if (n > avail)
+    n = avail;
+  if (n == 0)
+    return 0;
+  size_t start = head & self->mask;
+  size_t first = self->mask + 1 - start < n ? self->mask + 1 - start : n;
+  memcpy(out, self->elements + start, first * sizeof(T));
+  memcpy(out + first, self->elements, (n - first) * sizeof(T));
+  atomic_store_explicit(&self->head, head + n, memory_order_release);
+  return n;
+}
+
+// Number of queued elements. Exact when called by the producer or the
+// consumer while the other is idle, a snapshot otherwise.
+static inline size_t _lc_mfunc(size)(Self *self) {
+  size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+  size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+  return tail - head;
+}
+
+static inline size_t _lc_mfunc(capacity)(Self *self) {
+  return self->mask + 1;
+}
+
+#undef T
+#undef Self
+#undef lcore_drop_fn
+#undef _lc_trivial_drop
+#undef lcore_pfx
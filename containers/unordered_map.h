@@ -1,4 +1,6 @@
+#include "_lc_hash.h"
 #include "_lc_templating.h"
+#include <stdbool.h>
 
 #ifndef K
 #define K int
@@ -8,14 +10,27 @@
 #define V int
 #endif // V
 
+#ifdef lcore_str_keys
+#ifdef lcore_drop_k
+#error "lcore_str_keys maps own copies of their keys, lcore_drop_k is unused"
+#endif
 #ifndef lcore_hash_fn
-#define lcore_hash_fn(x) x
+#define lcore_hash_fn(x) lc_hash_str(x)
+#endif // lcore_hash_fn
+#endif // lcore_str_keys
+
+#ifndef lcore_hash_fn
+#define lcore_hash_fn(x) lc_hash_int((uint64_t)(x))
 #endif // lcore_hash_fn
 
 #ifndef lcore_eq_fn
 #define lcore_eq_fn(a, b) ((a) == (b))
 #endif // lcore_eq_fn
 
+#if !defined(lcore_drop_k) && !defined(lcore_drop_v)
+#define _lc_trivial_drop
+#endif
+
 #ifndef lcore_drop_k
 #define lcore_drop_k(x)
 #endif // lcore_drop_k
@@ -24,45 +39,724 @@
 #define lcore_drop_v(x)
 #endif // lcore_drop_v
 
+#ifndef lcore_max_loadf
+#define lcore_max_loadf 0.85f
+#endif // lcore_max_loadf
+
+#ifndef lcore_rehash_stride
+#define lcore_rehash_stride 8
+#endif // lcore_rehash_stride
+
+#ifndef lcore_batch_window
+#define lcore_batch_window 16
+#endif // lcore_batch_window
+
+#ifndef lcore_filter_fpr
+#define lcore_filter_fpr 0.01
+#endif // lcore_filter_fpr
+
 #ifndef lcore_pfx
 #define lcore_pfx _lc_join(_lc_join(K, V), umap)
 #endif // lcore_pfx
 
+// By default the map is a separate-chaining table. Defining
+// 'lcore_open_addressing' right before including this header switches the
+// instantiation to a flat open-addressing table: key/value pairs are stored
+// inline and lookups compare a whole group of control bytes per step (see
+// _lc_group.h). Pointers returned by find() are then only valid until the
+// next insertion or removal.
+//
+// #define lcore_open_addressing
+// #include "containers/unordered_map.h"
+//
+// 'lcore_incremental_rehash' spreads resizes of a separate-chaining map over
+// subsequent operations and 'lcore_node_pool' allocates its nodes from a
+// per-table slab pool, see unordered_set.h.
+//
+// 'lcore_stats' compiles in lookup, probe, resize and allocation counters
+// read back with stats() and chain_histogram(), see unordered_set.h.
+//
+// 'lcore_cache_hash' stores the hash of every key next to it so resizes and
+// removals never hash again, and insert_hashed() / find_hashed() take the
+// hash from the caller, see unordered_set.h.
+//
+// 'lcore_str_keys' (K being char * or const char *) stores a copy of every
+// key inline in its entry, or in a per-map arena when it is long, see
+// unordered_set.h. The caller keeps ownership of the keys it passes in.
+//
+// 'lcore_filter' answers most lookups of missing keys from a Bloom filter
+// without probing the map, at a 'lcore_filter_fpr' false positive rate, see
+// unordered_set.h.
+
+#ifdef lcore_stats
+#include "_lc_stats.h"
+#endif // lcore_stats
+
 #define Self lcore_pfx
+
+#if defined(lcore_open_addressing) && defined(lcore_incremental_rehash)
+#error "lcore_incremental_rehash requires the separate chaining layout"
+#endif
+
+#if defined(lcore_filter) && defined(lcore_incremental_rehash)
+#error "lcore_filter can not be combined with lcore_incremental_rehash"
+#endif
+#if defined(lcore_filter) && defined(lcore_persist)
+#error "lcore_filter can not be combined with lcore_persist"
+#endif
+#ifdef lcore_filter
+#include "_lc_bloom.h"
+// Keys the filter is sized for: as many as the table holds before growing.
+#define _lc_filter_keys(capacity) ((size_t)((capacity) * lcore_max_loadf) + 1)
+#endif // lcore_filter
+
+// 'lcore_persist' adds save() and open_mmap() to open-addressing maps, see
+// unordered_set.h. Keys and values must not hold pointers.
+
+#if defined(lcore_persist) && !defined(lcore_open_addressing)
+#error "lcore_persist requires the open addressing layout"
+#endif
+#if defined(lcore_persist) && !defined(_lc_trivial_drop)
+#error "lcore_persist can not be combined with drop functions"
+#endif
+#if defined(lcore_persist) && defined(lcore_cache_hash)
+#error "lcore_persist can not be combined with lcore_cache_hash"
+#endif
+#if defined(lcore_persist) && defined(lcore_str_keys)
+#error "lcore_persist can not be combined with lcore_str_keys"
+#endif
+
+// Stored key type and its operations, see unordered_set.h.
+#ifdef lcore_str_keys
+#include "_lc_strkey.h"
+#define _Key lc_strkey
+#define _lc_key_eq(k, key, h) lc_strkey_eq(&(k), key, h)
+#define _lc_key_hash(k) lcore_hash_fn(lc_strkey_str(&(k)))
+#define _lc_key_set(self, k, key, h)                                           \
+  lc_strkey_init(&(k), key, h, &(self)->arena)
+#else
+#define _Key K
+#define _lc_key_eq(k, key, h) lcore_eq_fn(k, key)
+#define _lc_key_hash(k) lcore_hash_fn(k)
+#define _lc_key_set(self, k, key, h) ((k) = (key), true)
+#endif // lcore_str_keys
+
+#ifdef lcore_open_addressing
+#include "_lc_group.h"
+#ifdef lcore_persist
+#include "_lc_persist.h"
+#endif // lcore_persist
+
+// Hash of the key in slot 'i' and bytes taken by one slot.
+#ifdef lcore_cache_hash
+#define _lc_slot_hash(self, i) ((self)->hashes[i])
+#define _lc_slot_bytes (sizeof(_Slot) + sizeof(uint64_t))
+#else
+#define _lc_slot_hash(self, i) _lc_key_hash((self)->slots[i].key)
+#define _lc_slot_bytes sizeof(_Slot)
+#endif // lcore_cache_hash
+
+// save() writes every slot, so the empty ones are zeroed instead of holding
+// whatever the heap left there.
+#ifdef lcore_persist
+#define _lc_slots_alloc(n) lc_calloc(_Slot, sizeof(_Slot), n)
+#else
+#define _lc_slots_alloc(n) lc_malloc(_Slot, sizeof(_Slot) * (n))
+#endif // lcore_persist
+
+#define _Slot _lc_join(Self, slot)
+
+typedef struct _Slot {
+  _Key key;
+  V value;
+} _Slot;
+
+typedef struct Self {
+  size_t size, capacity;
+  uint8_t *ctrl; // capacity + LC_GROUP_WIDTH control bytes
+  _Slot *slots;  // capacity pairs, valid where ctrl[i] != LC_CTRL_EMPTY
+#ifdef lcore_cache_hash
+  uint64_t *hashes; // hash of the key in each slot
+#endif // lcore_cache_hash
+#ifdef lcore_persist
+  lc_mapping map; // image 'ctrl' and 'slots' point into, if any
+#endif // lcore_persist
+#ifdef lcore_str_keys
+  lc_arena arena; // keys too long to be stored inline
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom filter; // hashes of the keys (and of keys removed since resize)
+#endif // lcore_filter
+#ifdef lcore_stats
+  lc_hash_stats stats;
+#endif // lcore_stats
+} Self;
+#else
+#ifdef lcore_node_pool
+#include "_lc_pool.h"
+#endif // lcore_node_pool
+
 #define _Node _lc_join(Self, node)
 
+// Hash of the key of node 'n', and whether it can hold a key hashing to 'h'.
+#ifdef lcore_cache_hash
+#define _lc_node_hash(n) ((n)->hash)
+#define _lc_hash_match(n, h) ((n)->hash == (h))
+#else
+#define _lc_node_hash(n) _lc_key_hash((n)->key)
+#define _lc_hash_match(n, h) 1
+#endif // lcore_cache_hash
+
 typedef struct _Node {
-  K key;
+  _Key key;
   V value;
+#ifdef lcore_cache_hash
+  uint64_t hash; // lcore_hash_fn(key)
+#endif // lcore_cache_hash
   struct _Node *next;
 } _Node;
 
 typedef struct Self {
   size_t size, capacity;
   _Node **buckets;
+#ifdef lcore_node_pool
+  lc_pool pool; // storage for every node of the table
+#endif // lcore_node_pool
+#ifdef lcore_incremental_rehash
+  _Node **old_buckets; // bucket array being drained, NULL when idle
+  size_t old_capacity; // number of buckets in old_buckets
+  size_t migrated;     // old buckets already moved into 'buckets'
+#endif // lcore_incremental_rehash
+#ifdef lcore_str_keys
+  lc_arena arena; // keys too long to be stored inline
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom filter; // hashes of the keys (and of keys removed since resize)
+#endif // lcore_filter
+#ifdef lcore_stats
+  lc_hash_stats stats;
+#endif // lcore_stats
 } Self;
+#endif // lcore_open_addressing
 
 // clang-format off
 static inline void _lc_mfunc(init)(Self* self, size_t capacity);
 static inline void _lc_mfunc(destroy)(Self* self);
 static inline void _lc_mfunc(rehash)(Self* self, size_t new_capacity);
+static inline bool _lc_mfunc(rehash_step)(Self* self, size_t n);
 static inline void _lc_mfunc(set)(Self* self, K key, V value);
 static inline bool _lc_mfunc(insert)(Self* self, K key, V value);
-static inline bool _lc_mfunc(remove)(Self* self, K key, V value);
+static inline bool _lc_mfunc(remove)(Self* self, K key);
 static inline V*   _lc_mfunc(find)(Self* self, K key);
+static inline size_t _lc_mfunc(insert_many)(Self* self, K const* keys, V const* values, size_t n);
+static inline size_t _lc_mfunc(find_many)(Self* self, K const* keys, size_t n, V** out);
+static inline bool _lc_mfunc(insert_hashed)(Self* self, K key, V value, uint64_t hash);
+static inline V*   _lc_mfunc(find_hashed)(Self* self, K key, uint64_t hash);
+static inline V*   _lc_mfunc(get_or_insert)(Self* self, K key, bool* inserted);
+static inline V*   _lc_mfunc(try_emplace)(Self* self, K key);
+static inline bool _lc_mfunc(update)(Self* self, K key, void (*fn)(V*, void*), void* ctx);
+#ifdef lcore_persist
+static inline bool _lc_mfunc(save)(Self* self, const char* path);
+static inline bool _lc_mfunc(open_mmap)(Self* self, const char* path, lc_persist_mode mode);
+#endif // lcore_persist
+#ifdef lcore_stats
+static inline lc_hash_stats _lc_mfunc(stats)(Self* self);
+static inline size_t _lc_mfunc(chain_histogram)(Self* self, size_t* hist, size_t bins);
+#endif // lcore_stats
 // clang-format on
 
+// ============= PRIVATE FUNCTIONS ============== //
+// Layout specific primitives working on an already computed hash, shared by
+// the single key and the batched APIs.
+
+static inline bool _lc_mfunc_priv(insert_hashed)(Self *self, K key, V value,
+                                                 uint64_t h);
+static inline V *_lc_mfunc_priv(find_hashed)(Self *self, K key, uint64_t h);
+static inline V *_lc_mfunc_priv(entry)(Self *self, K key, uint64_t h,
+                                       bool *inserted);
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h, int stage);
+
+#ifdef lcore_open_addressing
+
+static inline size_t _lc_mfunc_priv(find_index)(Self *self, K key,
+                                                uint64_t h);
+static inline size_t _lc_mfunc_priv(empty_index)(Self *self, uint64_t h);
+static inline size_t _lc_mfunc_priv(probe)(Self *self, K key, uint64_t h,
+                                           bool *found);
+static inline void _lc_mfunc_priv(erase_at)(Self *self, size_t i);
+static inline void _lc_mfunc_priv(release)(Self *self, uint8_t *ctrl,
+                                           _Slot *slots);
+#ifdef lcore_stats
+static inline size_t _lc_mfunc_priv(probe_groups)(Self *self, size_t i,
+                                                  uint64_t h);
+#endif // lcore_stats
+
+// ====== OPEN ADDRESSING IMPLEMENTATION ======== //
+
 static inline void _lc_mfunc(init)(Self *self, size_t capacity) {
-  if (capacity == 0 || (capacity & capacity - 1) != 0)
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    capacity = 64;
+  if (capacity < LC_GROUP_WIDTH)
+    capacity = LC_GROUP_WIDTH;
+  self->capacity = capacity;
+  self->size = 0;
+#ifdef lcore_persist
+  memset(&self->map, 0, sizeof(self->map));
+#endif // lcore_persist
+#ifdef lcore_str_keys
+  lc_arena_init(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_init(&self->filter, _lc_filter_keys(capacity), lcore_filter_fpr);
+#endif // lcore_filter
+#ifdef lcore_stats
+  memset(&self->stats, 0, sizeof(self->stats));
+#endif // lcore_stats
+  self->ctrl = lc_malloc(uint8_t, capacity + LC_GROUP_WIDTH);
+  self->slots = _lc_slots_alloc(capacity);
+#ifdef lcore_cache_hash
+  self->hashes = lc_malloc(uint64_t, sizeof(uint64_t) * capacity);
+#endif // lcore_cache_hash
+  memset(self->ctrl, LC_CTRL_EMPTY, capacity + LC_GROUP_WIDTH);
+#ifdef lcore_stats
+  self->stats.alloc_bytes +=
+      capacity + LC_GROUP_WIDTH + _lc_slot_bytes * capacity;
+#endif // lcore_stats
+}
+
+static inline void _lc_mfunc(destroy)(Self *self) {
+  if (!self)
+    return;
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+    lcore_drop_k(self->slots[i].key);
+    lcore_drop_v(self->slots[i].value);
+  }
+  _lc_mfunc_priv(release)(self, self->ctrl, self->slots);
+#ifdef lcore_cache_hash
+  free(self->hashes);
+#endif // lcore_cache_hash
+#ifdef lcore_str_keys
+  lc_arena_release(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_release(&self->filter);
+#endif // lcore_filter
+  memset(self, 0, sizeof(*self));
+}
+
+static inline void _lc_mfunc(rehash)(Self *self, size_t new_capacity) {
+  if (new_capacity < LC_GROUP_WIDTH || (new_capacity & (new_capacity - 1)) ||
+      new_capacity <= self->size)
+    return;
+  uint8_t *new_ctrl = lc_malloc(uint8_t, new_capacity + LC_GROUP_WIDTH);
+  _Slot *new_slots = _lc_slots_alloc(new_capacity);
+  if (!new_ctrl || !new_slots) {
+    free(new_ctrl);
+    free(new_slots);
+    return;
+  }
+#ifdef lcore_cache_hash
+  uint64_t *new_hashes = lc_malloc(uint64_t, sizeof(uint64_t) * new_capacity);
+  if (!new_hashes) {
+    free(new_ctrl);
+    free(new_slots);
+    return;
+  }
+#endif // lcore_cache_hash
+#ifdef lcore_filter
+  lc_bloom new_filter;
+  if (!lc_bloom_init(&new_filter, _lc_filter_keys(new_capacity),
+                     lcore_filter_fpr)) {
+    free(new_ctrl);
+    free(new_slots);
+#ifdef lcore_cache_hash
+    free(new_hashes);
+#endif // lcore_cache_hash
+    return;
+  }
+#endif // lcore_filter
+#ifdef lcore_stats
+  uint64_t t0 = lc_stats_now_ns();
+#endif // lcore_stats
+  memset(new_ctrl, LC_CTRL_EMPTY, new_capacity + LC_GROUP_WIDTH);
+  uint8_t *old_ctrl = self->ctrl;
+  _Slot *old_slots = self->slots;
+  size_t old_capacity = self->capacity;
+  self->ctrl = new_ctrl;
+  self->slots = new_slots;
+  self->capacity = new_capacity;
+#ifdef lcore_cache_hash
+  uint64_t *old_hashes = self->hashes;
+  self->hashes = new_hashes;
+#endif // lcore_cache_hash
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+#ifdef lcore_cache_hash
+    uint64_t h = old_hashes[i];
+#else
+    uint64_t h = _lc_key_hash(old_slots[i].key);
+#endif // lcore_cache_hash
+    size_t j = _lc_mfunc_priv(empty_index)(self, h);
+#ifdef lcore_filter
+    lc_bloom_add(&new_filter, h);
+#endif // lcore_filter
+    lc_ctrl_set(self->ctrl, self->capacity, j, old_ctrl[i]);
+    self->slots[j] = old_slots[i];
+#ifdef lcore_cache_hash
+    self->hashes[j] = h;
+#endif // lcore_cache_hash
+  }
+  _lc_mfunc_priv(release)(self, old_ctrl, old_slots);
+#ifdef lcore_cache_hash
+  free(old_hashes);
+#endif // lcore_cache_hash
+#ifdef lcore_filter
+  lc_bloom_release(&self->filter);
+  self->filter = new_filter;
+#endif // lcore_filter
+#ifdef lcore_stats
+  self->stats.rehashes++;
+  self->stats.rehash_ns += lc_stats_now_ns() - t0;
+  self->stats.alloc_bytes +=
+      new_capacity + LC_GROUP_WIDTH + _lc_slot_bytes * new_capacity;
+#endif // lcore_stats
+}
+
+static inline bool _lc_mfunc(rehash_step)(Self *self, size_t n) {
+  // Open-addressing tables always resize in one go.
+  (void)self;
+  (void)n;
+  return false;
+}
+
+#ifdef lcore_persist
+static inline bool _lc_mfunc(save)(Self *self, const char *path) {
+  lc_persist_header hdr = {0};
+  hdr.kind = LC_PERSIST_UMAP;
+  hdr.group_width = LC_GROUP_WIDTH;
+  hdr.elem_size = sizeof(_Slot);
+  hdr.size = self->size;
+  hdr.capacity = self->capacity;
+  hdr.length[0] = self->capacity + LC_GROUP_WIDTH;
+  hdr.length[1] = self->capacity * sizeof(_Slot);
+  const void *sections[LC_PERSIST_SECTIONS] = {self->ctrl, self->slots};
+  return lc_persist_save(path, &hdr, sections);
+}
+
+// Initializes 'self' from an image written by save(), false if it can not
+// be read. Insertions and removals on a LC_PERSIST_PRIVATE table stay in
+// memory, a LC_PERSIST_READONLY one only supports lookups.
+static inline bool _lc_mfunc(open_mmap)(Self *self, const char *path,
+                                        lc_persist_mode mode) {
+  lc_mapping map;
+  const lc_persist_header *hdr = lc_persist_open(
+      path, mode, LC_PERSIST_UMAP, sizeof(_Slot), LC_GROUP_WIDTH, &map);
+  if (!hdr)
+    return false;
+  uint64_t capacity = hdr->capacity;
+  if (capacity < LC_GROUP_WIDTH || (capacity & (capacity - 1)) ||
+      capacity > SIZE_MAX / sizeof(_Slot) || hdr->size >= capacity ||
+      hdr->length[0] != capacity + LC_GROUP_WIDTH ||
+      hdr->length[1] != capacity * sizeof(_Slot)) {
+    lc_persist_unmap(&map);
+    return false;
+  }
+  // Everything the image does not hold (stats, rehash state) starts empty.
+  memset(self, 0, sizeof(*self));
+  self->size = (size_t)hdr->size;
+  self->capacity = (size_t)capacity;
+  self->ctrl = (uint8_t *)lc_persist_section(&map, 0);
+  self->slots = (_Slot *)lc_persist_section(&map, 1);
+  self->map = map;
+  return true;
+}
+#endif // lcore_persist
+
+static inline bool _lc_mfunc(insert)(Self *self, K key, V value) {
+  return _lc_mfunc_priv(insert_hashed)(self, key, value, lcore_hash_fn(key));
+}
+
+static inline bool _lc_mfunc(remove)(Self *self, K key) {
+  uint64_t h = lcore_hash_fn(key);
+  size_t i = _lc_mfunc_priv(find_index)(self, key, h);
+  if (i == self->capacity)
+    return false;
+  lcore_drop_k(self->slots[i].key);
+  lcore_drop_v(self->slots[i].value);
+  _lc_mfunc_priv(erase_at)(self, i);
+  self->size--;
+  return true;
+}
+
+static inline V *_lc_mfunc(find)(Self *self, K key) {
+  return _lc_mfunc_priv(find_hashed)(self, key, lcore_hash_fn(key));
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline bool _lc_mfunc_priv(insert_hashed)(Self *self, K key, V value,
+                                                 uint64_t h) {
+  bool inserted;
+  V *val = _lc_mfunc_priv(entry)(self, key, h, &inserted);
+  if (inserted)
+    *val = value;
+  return inserted;
+}
+
+// Returns the value of 'key', claiming a slot for it first when it is
+// missing. A new slot gets the key but no value, which is left to the caller.
+// Returns NULL when the key can not be stored.
+static inline V *_lc_mfunc_priv(entry)(Self *self, K key, uint64_t h,
+                                       bool *inserted) {
+  bool found;
+  size_t i = _lc_mfunc_priv(probe)(self, key, h, &found);
+  *inserted = false;
+  if (found)
+    return &self->slots[i].value;
+  // Hits never resize; after a resize the key is known to be missing. When
+  // the resize fails, the last empty slot is kept: lookups stop on it.
+  if ((float)self->size / self->capacity >= lcore_max_loadf) {
+    _lc_mfunc(rehash)(self, self->capacity << 1);
+    i = _lc_mfunc_priv(empty_index)(self, h);
+  }
+  if (self->size + 1 >= self->capacity)
+    return NULL;
+  if (!_lc_key_set(self, self->slots[i].key, key, h))
+    return NULL;
+  *inserted = true;
+  lc_ctrl_set(self->ctrl, self->capacity, i, lc_hash_h2(h));
+#ifdef lcore_cache_hash
+  self->hashes[i] = h;
+#endif // lcore_cache_hash
+  self->size++;
+#ifdef lcore_filter
+  lc_bloom_add(&self->filter, h);
+#endif // lcore_filter
+  return &self->slots[i].value;
+}
+
+static inline V *_lc_mfunc_priv(find_hashed)(Self *self, K key, uint64_t h) {
+#ifdef lcore_filter
+  if (!lc_bloom_test(&self->filter, h)) {
+#ifdef lcore_stats
+    lc_stats_lookup(&self->stats, false, 0);
+#endif // lcore_stats
+    return NULL;
+  }
+#endif // lcore_filter
+  size_t i = _lc_mfunc_priv(find_index)(self, key, h);
+#ifdef lcore_stats
+  lc_stats_lookup(&self->stats, i != self->capacity,
+                  _lc_mfunc_priv(probe_groups)(self, i, h));
+#endif // lcore_stats
+  return i == self->capacity ? NULL : &self->slots[i].value;
+}
+
+// Stage 0 fetches the first control group, stage 1 the matching pairs.
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h,
+                                            int stage) {
+  size_t pos = lc_hash_h1(h) & (self->capacity - 1);
+  if (stage == 0) {
+    lc_prefetch(self->ctrl + pos);
+#ifdef lcore_filter
+    lc_bloom_prefetch(&self->filter, h);
+#endif // lcore_filter
+  } else {
+#ifdef lcore_filter
+    // Keys the filter rejects will not read the slots.
+    if (!lc_bloom_test(&self->filter, h))
+      return;
+#endif // lcore_filter
+    lc_prefetch(self->slots + pos);
+  }
+}
+
+// Returns the slot holding 'key', or self->capacity when it is not present.
+static inline size_t _lc_mfunc_priv(find_index)(Self *self, K key,
+                                                uint64_t h) {
+  size_t mask = self->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  uint8_t h2 = lc_hash_h2(h);
+  for (;;) {
+    const uint8_t *group = self->ctrl + pos;
+    lc_group_mask m = lc_group_match(group, h2);
+    while (m) {
+      size_t i = (pos + lc_mask_lowest(m)) & mask;
+      if (_lc_key_eq(self->slots[i].key, key, h))
+        return i;
+      m &= m - 1;
+    }
+    if (lc_group_match_empty(group))
+      return self->capacity;
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Returns the first free slot of the probe sequence starting at 'h'.
+static inline size_t _lc_mfunc_priv(empty_index)(Self *self, uint64_t h) {
+  size_t mask = self->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  for (;;) {
+    lc_group_mask m = lc_group_match_empty(self->ctrl + pos);
+    if (m)
+      return (pos + lc_mask_lowest(m)) & mask;
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Single pass find_index() + empty_index(): returns the slot holding 'key',
+// or the one an insertion would take. Without tombstones both searches stop
+// in the first group that has an empty slot.
+static inline size_t _lc_mfunc_priv(probe)(Self *self, K key, uint64_t h,
+                                           bool *found) {
+  size_t mask = self->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  uint8_t h2 = lc_hash_h2(h);
+  for (;;) {
+    const uint8_t *group = self->ctrl + pos;
+    lc_group_mask m = lc_group_match(group, h2);
+    while (m) {
+      size_t i = (pos + lc_mask_lowest(m)) & mask;
+      if (_lc_key_eq(self->slots[i].key, key, h)) {
+        *found = true;
+        return i;
+      }
+      m &= m - 1;
+    }
+    m = lc_group_match_empty(group);
+    if (m) {
+      *found = false;
+      return (pos + lc_mask_lowest(m)) & mask;
+    }
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Backward-shift deletion, see unordered_set.h.
+static inline void _lc_mfunc_priv(erase_at)(Self *self, size_t i) {
+  size_t mask = self->capacity - 1;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (self->ctrl[j] & LC_CTRL_EMPTY)
+      break;
+    size_t home = lc_hash_h1(_lc_slot_hash(self, j)) & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      self->slots[i] = self->slots[j];
+#ifdef lcore_cache_hash
+      self->hashes[i] = self->hashes[j];
+#endif // lcore_cache_hash
+      lc_ctrl_set(self->ctrl, self->capacity, i, self->ctrl[j]);
+      i = j;
+    }
+  }
+  lc_ctrl_set(self->ctrl, self->capacity, i, LC_CTRL_EMPTY);
+}
+
+#ifdef lcore_stats
+static inline lc_hash_stats _lc_mfunc(stats)(Self *self) {
+  lc_hash_stats stats = self->stats;
+  stats.live_bytes =
+      self->capacity + LC_GROUP_WIDTH + _lc_slot_bytes * self->capacity;
+#ifdef lcore_str_keys
+  stats.alloc_bytes += self->arena.bytes;
+  stats.live_bytes += self->arena.bytes;
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  stats.live_bytes += lc_bloom_bytes(&self->filter);
+#endif // lcore_filter
+  return stats;
+}
+
+// Counts the keys by distance from their home slot into 'bins' bins, the
+// last one collecting every longer distance. Returns the longest distance.
+static inline size_t _lc_mfunc(chain_histogram)(Self *self, size_t *hist,
+                                                size_t bins) {
+  size_t mask = self->capacity - 1;
+  size_t longest = 0;
+  memset(hist, 0, sizeof(size_t) * bins);
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+    size_t home = lc_hash_h1(_lc_slot_hash(self, i)) & mask;
+    lc_stats_bin(hist, bins, (i - home) & mask, &longest);
+  }
+  return longest;
+}
+
+// Control groups find_index() loaded to end up at 'i': a hit stops at the
+// group holding its key, a miss at the first group with an empty slot.
+static inline size_t _lc_mfunc_priv(probe_groups)(Self *self, size_t i,
+                                                  uint64_t h) {
+  size_t mask = self->capacity - 1;
+  if (i == self->capacity)
+    i = _lc_mfunc_priv(empty_index)(self, h);
+  return ((i - lc_hash_h1(h)) & mask) / LC_GROUP_WIDTH + 1;
+}
+#endif // lcore_stats
+
+// Frees arrays the table no longer uses, or the image they live in.
+static inline void _lc_mfunc_priv(release)(Self *self, uint8_t *ctrl,
+                                           _Slot *slots) {
+#ifdef lcore_persist
+  if (self->map.addr) {
+    lc_persist_unmap(&self->map);
+    return;
+  }
+#else
+  (void)self;
+#endif // lcore_persist
+  free(ctrl);
+  free(slots);
+}
+
+#undef _lc_slot_hash
+#undef _lc_slot_bytes
+#undef _lc_slots_alloc
+#else
+
+// ===== SEPARATE CHAINING IMPLEMENTATION ======= //
+
+static inline _Node **_lc_mfunc_priv(bucket)(Self *self, uint64_t h);
+static inline _Node *_lc_mfunc_priv(alloc_node)(Self *self);
+static inline void _lc_mfunc_priv(free_node)(Self *self, _Node *node);
+static inline void _lc_mfunc_priv(migrate)(Self *self, _Node *chain);
+
+static inline void _lc_mfunc(init)(Self *self, size_t capacity) {
+  memset(self, 0, sizeof(*self));
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0)
     capacity = 64;
   self->capacity = capacity;
   self->size = 0;
   self->buckets = lc_calloc(_Node *, sizeof(_Node *), self->capacity);
+#ifdef lcore_node_pool
+  lc_pool_init(&self->pool, sizeof(_Node));
+#endif // lcore_node_pool
+#ifdef lcore_str_keys
+  lc_arena_init(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_init(&self->filter, _lc_filter_keys(capacity), lcore_filter_fpr);
+#endif // lcore_filter
+#ifdef lcore_stats
+  self->stats.alloc_bytes += sizeof(_Node *) * self->capacity;
+#endif // lcore_stats
 }
 
 static inline void _lc_mfunc(destroy)(Self *self) {
   if (!self)
     return;
+#if defined(lcore_node_pool) && defined(_lc_trivial_drop)
+  // Nothing to drop: releasing the slabs frees every node at once.
+#ifdef lcore_incremental_rehash
+  free(self->old_buckets);
+#endif // lcore_incremental_rehash
+#else
+  // Finishing a pending migration keeps the cleanup a single pass.
+  _lc_mfunc(rehash_step)(self, SIZE_MAX);
   for (size_t i = 0; i < self->capacity; i++) {
     _Node *cur = self->buckets[i];
     _Node *to_free = NULL;
@@ -71,82 +765,112 @@ static inline void _lc_mfunc(destroy)(Self *self) {
       cur = cur->next;
       lcore_drop_k(to_free->key);
       lcore_drop_v(to_free->value);
-      free(to_free);
+      _lc_mfunc_priv(free_node)(self, to_free);
     }
   }
+#endif // lcore_node_pool && _lc_trivial_drop
   free(self->buckets);
+#ifdef lcore_node_pool
+  lc_pool_release(&self->pool);
+#endif // lcore_node_pool
+#ifdef lcore_str_keys
+  lc_arena_release(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_release(&self->filter);
+#endif // lcore_filter
   memset(self, 0, sizeof(*self));
 }
 
 static inline void _lc_mfunc(rehash)(Self *self, size_t new_capacity) {
-  if (new_capacity == 0)
+  if (new_capacity == 0 || (new_capacity & (new_capacity - 1)) != 0)
     return;
+  // Only one resize can be in flight, finish the previous one first.
+  _lc_mfunc(rehash_step)(self, SIZE_MAX);
   _Node **new_buckets = lc_calloc(_Node *, sizeof(_Node *), new_capacity);
   if (!new_buckets)
     return;
+#ifdef lcore_filter
+  lc_bloom old_filter = self->filter;
+  if (!lc_bloom_init(&self->filter, _lc_filter_keys(new_capacity),
+                     lcore_filter_fpr)) {
+    self->filter = old_filter;
+    free(new_buckets);
+    return;
+  }
+  lc_bloom_release(&old_filter);
+#endif // lcore_filter
+#ifdef lcore_stats
+  uint64_t t0 = lc_stats_now_ns();
+  self->stats.rehashes++;
+  self->stats.alloc_bytes += sizeof(_Node *) * new_capacity;
+#endif // lcore_stats
   _Node **old_buckets = self->buckets;
   size_t old_capacity = self->capacity;
   self->capacity = new_capacity;
-  for (size_t i = 0; i < old_capacity; i++) {
-    _Node *cur = old_buckets[i];
-    while (cur) {
-      _Node *next = cur->next;
-      uint64_t h = lcore_hash_fn(cur->key);
-      size_t b = h & (old_capacity - 1);
-      cur->next = new_buckets[b];
-      new_buckets[b] = cur;
-      cur = next;
-    }
-  }
+  self->buckets = new_buckets;
+#ifdef lcore_incremental_rehash
+  self->old_buckets = old_buckets;
+  self->old_capacity = old_capacity;
+  self->migrated = 0;
+#else
+  for (size_t i = 0; i < old_capacity; i++)
+    _lc_mfunc_priv(migrate)(self, old_buckets[i]);
   free(old_buckets);
+#endif // lcore_incremental_rehash
+#ifdef lcore_stats
+  self->stats.rehash_ns += lc_stats_now_ns() - t0;
+#endif // lcore_stats
 }
 
-static inline void _lc_mfunc(set)(Self *self, K key, V value) {
-  V *val = _lc_mfunc(find)(self, key);
-  if (!val)
-    _lc_mfunc(insert)(self, key, value);
-  else
-    *val = value;
+static inline bool _lc_mfunc(rehash_step)(Self *self, size_t n) {
+#ifdef lcore_incremental_rehash
+  if (!self->old_buckets)
+    return false;
+#ifdef lcore_stats
+  uint64_t t0 = lc_stats_now_ns();
+#endif // lcore_stats
+  size_t left = self->old_capacity - self->migrated;
+  size_t end = self->migrated + (n < left ? n : left);
+  for (; self->migrated < end; self->migrated++)
+    _lc_mfunc_priv(migrate)(self, self->old_buckets[self->migrated]);
+#ifdef lcore_stats
+  self->stats.rehash_ns += lc_stats_now_ns() - t0;
+#endif // lcore_stats
+  if (self->migrated < self->old_capacity)
+    return true;
+  free(self->old_buckets);
+  self->old_buckets = NULL;
+  self->old_capacity = self->migrated = 0;
+  return false;
+#else
+  (void)self;
+  (void)n;
+  return false;
+#endif // lcore_incremental_rehash
 }
 
 static inline bool _lc_mfunc(insert)(Self *self, K key, V value) {
-  uint64_t h = lcore_hash_fn(key);
-  size_t b = h & (self->capacity - 1);
-  _Node *cur = self->buckets[b];
-  _Node *prv = NULL;
-  while (cur) {
-    if (lcore_eq_fn(cur->key, key))
-      return false;
-    prv = cur;
-    cur = cur->next;
-  }
-  _Node *new_node = lc_malloc(_Node, sizeof(_Node));
-  if (!new_node)
-    return false;
-  new_node->next = NULL;
-  new_node->key = key;
-  new_node->value = value;
-  if (prv)
-    prv->next = new_node;
-  else
-    self->buckets[b] = new_node;
-  return true;
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(insert_hashed)(self, key, value, lcore_hash_fn(key));
 }
 
 static inline bool _lc_mfunc(remove)(Self *self, K key) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
   uint64_t h = lcore_hash_fn(key);
-  size_t b = h & (self->capacity - 1);
-  _Node *cur = self->buckets[b];
+  _Node **head = _lc_mfunc_priv(bucket)(self, h);
+  _Node *cur = *head;
   _Node *prv = NULL;
   while (cur) {
-    if (lcore_eq_fn(cur->key, key)) {
+    if (_lc_hash_match(cur, h) && _lc_key_eq(cur->key, key, h)) {
       if (prv)
         prv->next = cur->next;
       else
-        self->buckets[b] = cur->next;
+        *head = cur->next;
       lcore_drop_k(cur->key);
       lcore_drop_v(cur->value);
-      free(cur);
+      _lc_mfunc_priv(free_node)(self, cur);
+      self->size--;
       return true;
     }
     prv = cur;
@@ -156,13 +880,344 @@ static inline bool _lc_mfunc(remove)(Self *self, K key) {
 }
 
 static inline V *_lc_mfunc(find)(Self *self, K key) {
-  uint64_t h = lcore_hash_fn(key);
-  size_t b = h & (self->capacity - 1);
-  _Node *cur = self->buckets[b];
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(find_hashed)(self, key, lcore_hash_fn(key));
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline bool _lc_mfunc_priv(insert_hashed)(Self *self, K key, V value,
+                                                 uint64_t h) {
+  bool inserted;
+  V *val = _lc_mfunc_priv(entry)(self, key, h, &inserted);
+  if (inserted)
+    *val = value;
+  return inserted;
+}
+
+// Returns the value of 'key', appending a node for it first when it is
+// missing. A new node gets the key but no value, which is left to the
+// caller. Returns NULL when the node or the key can not be allocated.
+static inline V *_lc_mfunc_priv(entry)(Self *self, K key, uint64_t h,
+                                       bool *inserted) {
+  *inserted = false;
+  _Node **head = _lc_mfunc_priv(bucket)(self, h);
+  _Node *cur = *head;
+  _Node *prv = NULL;
   while (cur) {
-    if (lcore_eq_fn(cur->key, key))
+    if (_lc_hash_match(cur, h) && _lc_key_eq(cur->key, key, h))
+      return &cur->value;
+    prv = cur;
+    cur = cur->next;
+  }
+  // Hits never resize; after a resize only the new chain's tail is needed.
+  if ((float)self->size / self->capacity >= lcore_max_loadf) {
+    _lc_mfunc(rehash)(self, self->capacity << 1);
+    head = _lc_mfunc_priv(bucket)(self, h);
+    for (prv = NULL, cur = *head; cur; cur = cur->next)
+      prv = cur;
+  }
+  _Node *new_node = _lc_mfunc_priv(alloc_node)(self);
+  if (!new_node)
+    return NULL;
+  if (!_lc_key_set(self, new_node->key, key, h)) {
+    _lc_mfunc_priv(free_node)(self, new_node);
+    return NULL;
+  }
+  new_node->next = NULL;
+#ifdef lcore_cache_hash
+  new_node->hash = h;
+#endif // lcore_cache_hash
+  if (prv)
+    prv->next = new_node;
+  else
+    *head = new_node;
+  self->size++;
+#ifdef lcore_filter
+  lc_bloom_add(&self->filter, h);
+#endif // lcore_filter
+  *inserted = true;
+  return &new_node->value;
+}
+
+static inline V *_lc_mfunc_priv(find_hashed)(Self *self, K key, uint64_t h) {
+#ifdef lcore_filter
+  if (!lc_bloom_test(&self->filter, h)) {
+#ifdef lcore_stats
+    lc_stats_lookup(&self->stats, false, 0);
+#endif // lcore_stats
+    return NULL;
+  }
+#endif // lcore_filter
+  _Node *cur = *_lc_mfunc_priv(bucket)(self, h);
+#ifdef lcore_stats
+  uint64_t probes = 0;
+  while (cur && (probes++, !(_lc_hash_match(cur, h) &&
+                                     _lc_key_eq(cur->key, key, h))))
+    cur = cur->next;
+  lc_stats_lookup(&self->stats, cur != NULL, probes);
+  return cur ? &cur->value : NULL;
+#else
+  while (cur) {
+    if (_lc_hash_match(cur, h) && _lc_key_eq(cur->key, key, h))
       return &cur->value;
     cur = cur->next;
   }
   return NULL;
+#endif // lcore_stats
+}
+
+// Stage 0 fetches the bucket slot, stage 1 the head of its chain.
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h,
+                                            int stage) {
+  _Node **head = _lc_mfunc_priv(bucket)(self, h);
+  if (stage == 0) {
+    lc_prefetch(head);
+#ifdef lcore_filter
+    lc_bloom_prefetch(&self->filter, h);
+#endif // lcore_filter
+  } else {
+#ifdef lcore_filter
+    // Keys the filter rejects will not walk the chain.
+    if (!lc_bloom_test(&self->filter, h))
+      return;
+#endif // lcore_filter
+    lc_prefetch(*head);
+  }
+}
+
+// Returns the chain a key with hash 'h' belongs to, see unordered_set.h.
+static inline _Node **_lc_mfunc_priv(bucket)(Self *self, uint64_t h) {
+#ifdef lcore_incremental_rehash
+  if (self->old_buckets) {
+    size_t b = h & (self->old_capacity - 1);
+    if (b >= self->migrated)
+      return &self->old_buckets[b];
+  }
+#endif // lcore_incremental_rehash
+  return &self->buckets[h & (self->capacity - 1)];
+}
+
+static inline _Node *_lc_mfunc_priv(alloc_node)(Self *self) {
+#ifdef lcore_stats
+  self->stats.alloc_bytes += sizeof(_Node);
+#endif // lcore_stats
+#ifdef lcore_node_pool
+  return (_Node *)lc_pool_alloc(&self->pool);
+#else
+#ifndef lcore_stats
+  (void)self;
+#endif // lcore_stats
+  return lc_malloc(_Node, sizeof(_Node));
+#endif // lcore_node_pool
+}
+
+static inline void _lc_mfunc_priv(free_node)(Self *self, _Node *node) {
+#ifdef lcore_node_pool
+  lc_pool_free(&self->pool, node);
+#else
+  (void)self;
+  free(node);
+#endif // lcore_node_pool
 }
+
+#ifdef lcore_stats
+static inline lc_hash_stats _lc_mfunc(stats)(Self *self) {
+  lc_hash_stats stats = self->stats;
+  stats.live_bytes =
+      sizeof(_Node *) * self->capacity + sizeof(_Node) * self->size;
+#ifdef lcore_incremental_rehash
+  stats.live_bytes += sizeof(_Node *) * self->old_capacity;
+#endif // lcore_incremental_rehash
+#ifdef lcore_str_keys
+  stats.alloc_bytes += self->arena.bytes;
+  stats.live_bytes += self->arena.bytes;
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  stats.live_bytes += lc_bloom_bytes(&self->filter);
+#endif // lcore_filter
+  return stats;
+}
+
+// Counts the buckets by chain length into 'bins' bins, the last one
+// collecting every longer chain. Returns the longest chain.
+static inline size_t _lc_mfunc(chain_histogram)(Self *self, size_t *hist,
+                                                size_t bins) {
+  size_t longest = 0;
+  memset(hist, 0, sizeof(size_t) * bins);
+  for (size_t i = 0; i < self->capacity; i++) {
+    size_t len = 0;
+    for (_Node *cur = self->buckets[i]; cur; cur = cur->next)
+      len++;
+    lc_stats_bin(hist, bins, len, &longest);
+  }
+#ifdef lcore_incremental_rehash
+  for (size_t i = self->migrated; i < self->old_capacity; i++) {
+    size_t len = 0;
+    for (_Node *cur = self->old_buckets[i]; cur; cur = cur->next)
+      len++;
+    lc_stats_bin(hist, bins, len, &longest);
+  }
+#endif // lcore_incremental_rehash
+  return longest;
+}
+#endif // lcore_stats
+
+// Moves every node of 'chain' into the current bucket array.
+static inline void _lc_mfunc_priv(migrate)(Self *self, _Node *chain) {
+  _Node *cur = chain;
+  while (cur) {
+    _Node *next = cur->next;
+    uint64_t h = _lc_node_hash(cur);
+    size_t b = h & (self->capacity - 1);
+#ifdef lcore_filter
+    lc_bloom_add(&self->filter, h);
+#endif // lcore_filter
+    cur->next = self->buckets[b];
+    self->buckets[b] = cur;
+    cur = next;
+  }
+}
+
+#undef _Node
+#undef _lc_node_hash
+#undef _lc_hash_match
+#endif // lcore_open_addressing
+
+// ============ PRECOMPUTED HASHES ============== //
+// Same as insert() and find() for callers that already know the hash of the
+// key, which must be lcore_hash_fn(key).
+
+static inline bool _lc_mfunc(insert_hashed)(Self *self, K key, V value,
+                                            uint64_t hash) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(insert_hashed)(self, key, value, hash);
+}
+
+static inline V *_lc_mfunc(find_hashed)(Self *self, K key, uint64_t hash) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(find_hashed)(self, key, hash);
+}
+
+// ================ ENTRY API =================== //
+// Upserts that hash the key and walk its bucket or probe sequence once,
+// unlike a find() followed by an insert(). When the key is already present
+// the 'key' argument is not stored and stays owned by the caller.
+
+static inline void _lc_mfunc(set)(Self *self, K key, V value) {
+  V *val = _lc_mfunc(get_or_insert)(self, key, NULL);
+  if (val)
+    *val = value;
+}
+
+// Returns the value of 'key', inserting it with a zero-filled value when it
+// is missing; '*inserted' (if not NULL) tells which case happened. Returns
+// NULL only when the insertion runs out of memory. Pointers into an
+// open-addressing map are valid until the next insertion or removal.
+static inline V *_lc_mfunc(get_or_insert)(Self *self, K key, bool *inserted) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  bool is_new;
+  V *val = _lc_mfunc_priv(entry)(self, key, lcore_hash_fn(key), &is_new);
+  if (is_new)
+    memset(val, 0, sizeof(V));
+  if (inserted)
+    *inserted = is_new;
+  return val;
+}
+
+// Inserts 'key' and returns its value left uninitialized, for the caller to
+// build in place. Returns NULL without changing the map when 'key' is
+// already present (or the insertion runs out of memory).
+static inline V *_lc_mfunc(try_emplace)(Self *self, K key) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  bool inserted;
+  V *val = _lc_mfunc_priv(entry)(self, key, lcore_hash_fn(key), &inserted);
+  return inserted ? val : NULL;
+}
+
+// Calls fn(&value, ctx) on the value of 'key', inserting it with a
+// zero-filled value first when it is missing. 'fn' must not use the map.
+// Returns false only when the insertion runs out of memory.
+static inline bool _lc_mfunc(update)(Self *self, K key, void (*fn)(V *, void *),
+                                     void *ctx) {
+  V *val = _lc_mfunc(get_or_insert)(self, key, NULL);
+  if (!val)
+    return false;
+  fn(val, ctx);
+  return true;
+}
+
+// ============ BATCHED OPERATIONS ============== //
+// Same two stage prefetching pipeline as unordered_set.h.
+
+static inline size_t _lc_mfunc(insert_many)(Self *self, K const *keys,
+                                            V const *values, size_t n) {
+  uint64_t hashes[lcore_batch_window];
+  size_t inserted = 0;
+  for (size_t base = 0; base < n; base += lcore_batch_window) {
+    size_t m = n - base < lcore_batch_window ? n - base : lcore_batch_window;
+    _lc_mfunc(rehash_step)(self, lcore_rehash_stride * m);
+    for (size_t i = 0; i < m; i++) {
+      hashes[i] = lcore_hash_fn(keys[base + i]);
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 0);
+    }
+    for (size_t i = 0; i < m; i++)
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 1);
+    for (size_t i = 0; i < m; i++)
+      inserted += _lc_mfunc_priv(insert_hashed)(self, keys[base + i],
+                                                values[base + i], hashes[i]);
+  }
+  return inserted;
+}
+
+// Stores in 'out' the value of each key (NULL when missing) and returns how
+// many keys were found.
+static inline size_t _lc_mfunc(find_many)(Self *self, K const *keys,
+                                          size_t n, V **out) {
+  uint64_t hashes[lcore_batch_window];
+  size_t hits = 0;
+  for (size_t base = 0; base < n; base += lcore_batch_window) {
+    size_t m = n - base < lcore_batch_window ? n - base : lcore_batch_window;
+    _lc_mfunc(rehash_step)(self, lcore_rehash_stride * m);
+    for (size_t i = 0; i < m; i++) {
+      hashes[i] = lcore_hash_fn(keys[base + i]);
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 0);
+    }
+    for (size_t i = 0; i < m; i++)
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 1);
+    for (size_t i = 0; i < m; i++) {
+      out[base + i] =
+          _lc_mfunc_priv(find_hashed)(self, keys[base + i], hashes[i]);
+      hits += out[base + i] != NULL;
+    }
+  }
+  return hits;
+}
+
+#undef K
+#undef V
+#undef lcore_hash_fn
+#undef lcore_eq_fn
+#undef lcore_drop_k
+#undef lcore_drop_v
+#undef lcore_max_loadf
+#undef lcore_rehash_stride
+#undef lcore_batch_window
+#undef lcore_pfx
+#undef lcore_open_addressing
+#undef lcore_incremental_rehash
+#undef lcore_node_pool
+#undef lcore_persist
+#undef lcore_stats
+#undef lcore_cache_hash
+#undef lcore_str_keys
+#undef lcore_filter
+#undef lcore_filter_fpr
+#undef _lc_filter_keys
+#undef _lc_trivial_drop
+#undef _Key
+#undef _lc_key_eq
+#undef _lc_key_hash
+#undef _lc_key_set
+#undef Self
+#undef _Slot
@@ -1,41 +1,246 @@
+#include "_lc_hash.h"
 #include "_lc_templating.h"
+#include <stdbool.h>
 
 #ifndef T
 #define T int
 #endif // T
 
+#ifdef lcore_str_keys
+#ifdef lcore_drop_fn
+#error "lcore_str_keys tables own copies of their keys, lcore_drop_fn is unused"
+#endif
+#ifndef lcore_hash_fn
+#define lcore_hash_fn(x) lc_hash_str(x)
+#endif // lcore_hash_fn
+#endif // lcore_str_keys
+
 #ifndef lcore_eq_fn
 #define lcore_eq_fn(a, b) ((a) == (b))
 #endif // lcore_eq_fn
 
 #ifndef lcore_drop_fn
+#define _lc_trivial_drop
 #define lcore_drop_fn(x)
 #endif // lcore_drop_fn
 
 #ifndef lcore_hash_fn
-#define lcore_hash_fn(x) x
+#define lcore_hash_fn(x) lc_hash_int((uint64_t)(x))
 #endif // lcore_hash_fn
 
 #ifndef lcore_max_loadf
 #define lcore_max_loadf 0.85f
 #endif // lcore_max_loadf
 
+#ifndef lcore_rehash_stride
+#define lcore_rehash_stride 8
+#endif // lcore_rehash_stride
+
+#ifndef lcore_batch_window
+#define lcore_batch_window 16
+#endif // lcore_batch_window
+
+#ifndef lcore_filter_fpr
+#define lcore_filter_fpr 0.01
+#endif // lcore_filter_fpr
+
 #ifndef lcore_pfx
 #define lcore_pfx _lc_join(T, uset)
 #endif // lcore_pfx
 
+// By default the set is a separate-chaining table. Defining
+// 'lcore_open_addressing' right before including this header switches the
+// instantiation to a flat open-addressing table: keys are stored inline and
+// lookups compare a whole group of control bytes per step (see _lc_group.h).
+//
+// #define lcore_open_addressing
+// #include "containers/unordered_set.h"
+//
+// With separate chaining, defining 'lcore_incremental_rehash' spreads resizes
+// over time: the old and new bucket arrays coexist and every insert, contains
+// and remove migrates 'lcore_rehash_stride' old buckets. rehash_step() can be
+// used to drive the migration from idle time, it returns false once done.
+//
+// Defining 'lcore_node_pool' allocates the chains' nodes from a per-table
+// slab pool (see _lc_pool.h) instead of one malloc per node. When no
+// 'lcore_drop_fn' is given, destroy() then frees the whole table without
+// visiting its nodes.
+//
+// Defining 'lcore_stats' makes the table count its lookups, probe lengths,
+// resizes and allocations (see _lc_stats.h). stats() returns the counters
+// and chain_histogram() the distribution of chain lengths, or of the keys'
+// distances from their home slot with open addressing.
+//
+// Defining 'lcore_cache_hash' stores the full hash of every key next to it:
+// resizes and removals never call 'lcore_hash_fn' again and chained lookups
+// only compare keys whose hashes are equal, which pays off when hashing or
+// comparing the keys is expensive (strings). Open-addressing tables keep the
+// hashes in an array of their own, their control bytes already filter most
+// comparisons. insert_hashed() and contains_hashed() take the hash from the
+// caller, it must be the value 'lcore_hash_fn' returns for the key.
+//
+// Defining 'lcore_str_keys' (T being char * or const char *) makes the table
+// store its own copy of every key as an lc_strkey (see _lc_strkey.h): keys of
+// up to LC_STRKEY_INLINE - 1 bytes sit in the entry next to their length and
+// a hash tag, longer ones in a bump arena that only destroy() frees. Lookups
+// then skip the dependent load of a separately allocated string and inserts
+// its malloc, the caller keeps ownership of the strings it passes in.
+// 'lcore_hash_fn' defaults to lc_hash_str() and 'lcore_eq_fn' is not used.
+//
+// Defining 'lcore_filter' puts a blocked Bloom filter (see _lc_bloom.h) in
+// front of the table: a lookup of a missing key reads one cache line of the
+// filter and, except for a 'lcore_filter_fpr' fraction of them (default
+// 0.01, about 12 bits per key), never touches the table. Batched lookups
+// prefetch the filter first and the table only for the keys that pass it.
+// Removed keys keep their bits until the next resize rebuilds the filter, so
+// a set that churns without growing slowly filters less.
+
+#ifdef lcore_stats
+#include "_lc_stats.h"
+#endif // lcore_stats
+
 #define Self lcore_pfx
+
+#if defined(lcore_open_addressing) && defined(lcore_incremental_rehash)
+#error "lcore_incremental_rehash requires the separate chaining layout"
+#endif
+
+#if defined(lcore_filter) && defined(lcore_incremental_rehash)
+#error "lcore_filter can not be combined with lcore_incremental_rehash"
+#endif
+#if defined(lcore_filter) && defined(lcore_persist)
+#error "lcore_filter can not be combined with lcore_persist"
+#endif
+#ifdef lcore_filter
+#include "_lc_bloom.h"
+// Keys the filter is sized for: as many as the table holds before growing.
+#define _lc_filter_keys(capacity) ((size_t)((capacity) * lcore_max_loadf) + 1)
+#endif // lcore_filter
+
+// 'lcore_persist' (POSIX only) adds save(), which writes an open-addressing
+// table to a file, and open_mmap(), which maps such a file and looks keys up
+// in place, without rebuilding the table (see _lc_persist.h). A mapped table
+// moves to owned arrays when it grows. The hash function must be the same
+// for the writer and the reader, and the keys must not hold pointers.
+
+#if defined(lcore_persist) && !defined(lcore_open_addressing)
+#error "lcore_persist requires the open addressing layout"
+#endif
+#if defined(lcore_persist) && !defined(_lc_trivial_drop)
+#error "lcore_persist can not be combined with drop functions"
+#endif
+#if defined(lcore_persist) && defined(lcore_cache_hash)
+#error "lcore_persist can not be combined with lcore_cache_hash"
+#endif
+#if defined(lcore_persist) && defined(lcore_str_keys)
+#error "lcore_persist can not be combined with lcore_str_keys"
+#endif
+
+// Type of the stored keys, how they compare to a key with hash 'h', how
+// they hash and how 'key' is stored into one (false when out of memory).
+#ifdef lcore_str_keys
+#include "_lc_strkey.h"
+#define _Key lc_strkey
+#define _lc_key_eq(k, key, h) lc_strkey_eq(&(k), key, h)
+#define _lc_key_hash(k) lcore_hash_fn(lc_strkey_str(&(k)))
+#define _lc_key_set(self, k, key, h)                                           \
+  lc_strkey_init(&(k), key, h, &(self)->arena)
+#else
+#define _Key T
+#define _lc_key_eq(k, key, h) lcore_eq_fn(k, key)
+#define _lc_key_hash(k) lcore_hash_fn(k)
+#define _lc_key_set(self, k, key, h) ((k) = (key), true)
+#endif // lcore_str_keys
+
+#ifdef lcore_open_addressing
+#include "_lc_group.h"
+#ifdef lcore_persist
+#include "_lc_persist.h"
+#endif // lcore_persist
+
+// Hash of the key in slot 'i' and bytes taken by one slot.
+#ifdef lcore_cache_hash
+#define _lc_slot_hash(self, i) ((self)->hashes[i])
+#define _lc_slot_bytes (sizeof(_Key) + sizeof(uint64_t))
+#else
+#define _lc_slot_hash(self, i) _lc_key_hash((self)->slots[i])
+#define _lc_slot_bytes sizeof(_Key)
+#endif // lcore_cache_hash
+
+// save() writes every slot, so the empty ones are zeroed instead of holding
+// whatever the heap left there.
+#ifdef lcore_persist
+#define _lc_slots_alloc(n) lc_calloc(_Key, sizeof(_Key), n)
+#else
+#define _lc_slots_alloc(n) lc_malloc(_Key, sizeof(_Key) * (n))
+#endif // lcore_persist
+
+typedef struct {
+  size_t size, capacity;
+  uint8_t *ctrl; // capacity + LC_GROUP_WIDTH control bytes
+  _Key *slots;   // capacity keys, valid where ctrl[i] != LC_CTRL_EMPTY
+#ifdef lcore_cache_hash
+  uint64_t *hashes; // hash of the key in each slot
+#endif // lcore_cache_hash
+#ifdef lcore_persist
+  lc_mapping map; // image 'ctrl' and 'slots' point into, if any
+#endif // lcore_persist
+#ifdef lcore_str_keys
+  lc_arena arena; // keys too long to be stored inline
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom filter; // hashes of the keys (and of keys removed since resize)
+#endif // lcore_filter
+#ifdef lcore_stats
+  lc_hash_stats stats;
+#endif // lcore_stats
+} Self;
+#else
+#ifdef lcore_node_pool
+#include "_lc_pool.h"
+#endif // lcore_node_pool
+
 #define _Node _lc_join(Self, node)
 
+// Hash of the key of node 'n', and whether it can hold a key hashing to 'h'.
+#ifdef lcore_cache_hash
+#define _lc_node_hash(n) ((n)->hash)
+#define _lc_hash_match(n, h) ((n)->hash == (h))
+#else
+#define _lc_node_hash(n) _lc_key_hash((n)->data)
+#define _lc_hash_match(n, h) 1
+#endif // lcore_cache_hash
+
 typedef struct _Node {
-  T data;
+  _Key data;
+#ifdef lcore_cache_hash
+  uint64_t hash; // lcore_hash_fn(data)
+#endif // lcore_cache_hash
   struct _Node *next;
 } _Node;
 
 typedef struct {
   size_t size, capacity;
   _Node **buckets;
+#ifdef lcore_node_pool
+  lc_pool pool; // storage for every node of the table
+#endif // lcore_node_pool
+#ifdef lcore_incremental_rehash
+  _Node **old_buckets; // bucket array being drained, NULL when idle
+  size_t old_capacity; // number of buckets in old_buckets
+  size_t migrated;     // old buckets already moved into 'buckets'
+#endif // lcore_incremental_rehash
+#ifdef lcore_str_keys
+  lc_arena arena; // keys too long to be stored inline
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom filter; // hashes of the keys (and of keys removed since resize)
+#endif // lcore_filter
+#ifdef lcore_stats
+  lc_hash_stats stats;
+#endif // lcore_stats
 } Self;
+#endif // lcore_open_addressing
 
 // ============== PUBLIC API ==================== //
 // These functions are meant to be used to interact with the vector structure
@@ -45,67 +250,479 @@ static inline bool _lc_mfunc(insert)(Self *self, T key);
 static inline bool _lc_mfunc(contains)(Self *self, T key);
 static inline bool _lc_mfunc(remove)(Self *self, T key);
 static inline void _lc_mfunc(rehash)(Self *self, size_t new_capacity);
+static inline bool _lc_mfunc(rehash_step)(Self *self, size_t n);
 static inline void _lc_mfunc(destroy)(Self *self);
+static inline size_t _lc_mfunc(insert_many)(Self *self, T const *keys,
+                                            size_t n);
+static inline size_t _lc_mfunc(contains_many)(Self *self, T const *keys,
+                                              size_t n, bool *found);
+static inline bool _lc_mfunc(insert_hashed)(Self *self, T key, uint64_t hash);
+static inline bool _lc_mfunc(contains_hashed)(Self *self, T key,
+                                              uint64_t hash);
+#ifdef lcore_persist
+static inline bool _lc_mfunc(save)(Self *self, const char *path);
+static inline bool _lc_mfunc(open_mmap)(Self *self, const char *path,
+                                        lc_persist_mode mode);
+#endif // lcore_persist
+#ifdef lcore_stats
+static inline lc_hash_stats _lc_mfunc(stats)(Self *self);
+static inline size_t _lc_mfunc(chain_histogram)(Self *self, size_t *hist,
+                                                size_t bins);
+#endif // lcore_stats
+
+// ============= PRIVATE FUNCTIONS ============== //
+// Layout specific primitives working on an already computed hash, shared by
+// the single key and the batched APIs.
+
+static inline bool _lc_mfunc_priv(insert_hashed)(Self *self, T key,
+                                                 uint64_t h);
+static inline bool _lc_mfunc_priv(contains_hashed)(Self *self, T key,
+                                                   uint64_t h);
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h, int stage);
+
+#ifdef lcore_open_addressing
+
+static inline size_t _lc_mfunc_priv(find_index)(Self *self, T key,
+                                                uint64_t h);
+static inline size_t _lc_mfunc_priv(empty_index)(Self *self, uint64_t h);
+static inline void _lc_mfunc_priv(erase_at)(Self *self, size_t i);
+static inline void _lc_mfunc_priv(release)(Self *self, uint8_t *ctrl,
+                                           _Key *slots);
+#ifdef lcore_stats
+static inline size_t _lc_mfunc_priv(probe_groups)(Self *self, size_t i,
+                                                  uint64_t h);
+#endif // lcore_stats
+
+// ====== OPEN ADDRESSING IMPLEMENTATION ======== //
 
 static inline void _lc_mfunc(init)(Self *self, size_t capacity) {
   memset(self, 0, sizeof(*self));
-  if (capacity == 0 || (capacity & capacity - 1))
+  if (capacity == 0 || (capacity & (capacity - 1)))
     capacity = 64;
+  if (capacity < LC_GROUP_WIDTH)
+    capacity = LC_GROUP_WIDTH;
   self->capacity = capacity;
-  self->buckets = lc_calloc(_Node *, sizeof(_Node *), capacity);
+  self->ctrl = lc_malloc(uint8_t, capacity + LC_GROUP_WIDTH);
+  self->slots = _lc_slots_alloc(capacity);
+#ifdef lcore_cache_hash
+  self->hashes = lc_malloc(uint64_t, sizeof(uint64_t) * capacity);
+#endif // lcore_cache_hash
+  memset(self->ctrl, LC_CTRL_EMPTY, capacity + LC_GROUP_WIDTH);
+#ifdef lcore_str_keys
+  lc_arena_init(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_init(&self->filter, _lc_filter_keys(capacity), lcore_filter_fpr);
+#endif // lcore_filter
+#ifdef lcore_stats
+  self->stats.alloc_bytes +=
+      capacity + LC_GROUP_WIDTH + _lc_slot_bytes * capacity;
+#endif // lcore_stats
 }
 
 static inline bool _lc_mfunc(insert)(Self *self, T key) {
-  if ((float)self->size / self->capacity >= lcore_max_loadf)
-    _lc_mfunc(rehash)(self, self->capacity << 1);
+  return _lc_mfunc_priv(insert_hashed)(self, key, lcore_hash_fn(key));
+}
+
+static inline bool _lc_mfunc(contains)(Self *self, T key) {
+  return _lc_mfunc_priv(contains_hashed)(self, key, lcore_hash_fn(key));
+}
+
+static inline bool _lc_mfunc(remove)(Self *self, T key) {
   uint64_t h = lcore_hash_fn(key);
-  size_t b = h & (self->capacity - 1);
-  _Node *cur = self->buckets[b];
-  _Node *prv = NULL;
-  while (cur) {
-    if (lcore_eq_fn(cur->data, key))
-      return false;
-    prv = cur;
-    cur = cur->next;
-  }
-  _Node *new_node = lc_malloc(_Node, sizeof(_Node));
-  if (!new_node)
+  size_t i = _lc_mfunc_priv(find_index)(self, key, h);
+  if (i == self->capacity)
     return false;
-  new_node->next = NULL;
-  new_node->data = key;
-  if (!prv)
-    self->buckets[b] = new_node;
-  else
-    prv->next = new_node;
+  lcore_drop_fn(self->slots[i]);
+  _lc_mfunc_priv(erase_at)(self, i);
+  self->size--;
   return true;
 }
 
-static inline bool _lc_mfunc(contains)(Self *self, T key) {
-  uint64_t h = lcore_hash_fn(key);
-  size_t b = h & (self->capacity - 1);
-  _Node *cur = self->buckets[b];
-  while (cur) {
-    if (lcore_eq_fn(cur->data, key))
-      return true;
-    cur = cur->next;
+static inline void _lc_mfunc(rehash)(Self *self, size_t new_capacity) {
+  if (new_capacity < LC_GROUP_WIDTH || (new_capacity & (new_capacity - 1)) ||
+      new_capacity <= self->size)
+    return;
+  uint8_t *new_ctrl = lc_malloc(uint8_t, new_capacity + LC_GROUP_WIDTH);
+  _Key *new_slots = _lc_slots_alloc(new_capacity);
+  if (!new_ctrl || !new_slots) {
+    free(new_ctrl);
+    free(new_slots);
+    return;
   }
+#ifdef lcore_cache_hash
+  uint64_t *new_hashes = lc_malloc(uint64_t, sizeof(uint64_t) * new_capacity);
+  if (!new_hashes) {
+    free(new_ctrl);
+    free(new_slots);
+    return;
+  }
+#endif // lcore_cache_hash
+#ifdef lcore_filter
+  lc_bloom new_filter;
+  if (!lc_bloom_init(&new_filter, _lc_filter_keys(new_capacity),
+                     lcore_filter_fpr)) {
+    free(new_ctrl);
+    free(new_slots);
+#ifdef lcore_cache_hash
+    free(new_hashes);
+#endif // lcore_cache_hash
+    return;
+  }
+#endif // lcore_filter
+#ifdef lcore_stats
+  uint64_t t0 = lc_stats_now_ns();
+#endif // lcore_stats
+  memset(new_ctrl, LC_CTRL_EMPTY, new_capacity + LC_GROUP_WIDTH);
+  uint8_t *old_ctrl = self->ctrl;
+  _Key *old_slots = self->slots;
+  size_t old_capacity = self->capacity;
+  self->ctrl = new_ctrl;
+  self->slots = new_slots;
+  self->capacity = new_capacity;
+#ifdef lcore_cache_hash
+  uint64_t *old_hashes = self->hashes;
+  self->hashes = new_hashes;
+#endif // lcore_cache_hash
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+#ifdef lcore_cache_hash
+    uint64_t h = old_hashes[i];
+#else
+    uint64_t h = _lc_key_hash(old_slots[i]);
+#endif // lcore_cache_hash
+    size_t j = _lc_mfunc_priv(empty_index)(self, h);
+#ifdef lcore_filter
+    lc_bloom_add(&new_filter, h);
+#endif // lcore_filter
+    lc_ctrl_set(self->ctrl, self->capacity, j, old_ctrl[i]);
+    self->slots[j] = old_slots[i];
+#ifdef lcore_cache_hash
+    self->hashes[j] = h;
+#endif // lcore_cache_hash
+  }
+  _lc_mfunc_priv(release)(self, old_ctrl, old_slots);
+#ifdef lcore_cache_hash
+  free(old_hashes);
+#endif // lcore_cache_hash
+#ifdef lcore_filter
+  lc_bloom_release(&self->filter);
+  self->filter = new_filter;
+#endif // lcore_filter
+#ifdef lcore_stats
+  self->stats.rehashes++;
+  self->stats.rehash_ns += lc_stats_now_ns() - t0;
+  self->stats.alloc_bytes +=
+      new_capacity + LC_GROUP_WIDTH + _lc_slot_bytes * new_capacity;
+#endif // lcore_stats
+}
+
+static inline bool _lc_mfunc(rehash_step)(Self *self, size_t n) {
+  // Open-addressing tables always resize in one go.
+  (void)self;
+  (void)n;
   return false;
 }
 
+#ifdef lcore_persist
+static inline bool _lc_mfunc(save)(Self *self, const char *path) {
+  lc_persist_header hdr = {0};
+  hdr.kind = LC_PERSIST_USET;
+  hdr.group_width = LC_GROUP_WIDTH;
+  hdr.elem_size = sizeof(_Key);
+  hdr.size = self->size;
+  hdr.capacity = self->capacity;
+  hdr.length[0] = self->capacity + LC_GROUP_WIDTH;
+  hdr.length[1] = self->capacity * sizeof(_Key);
+  const void *sections[LC_PERSIST_SECTIONS] = {self->ctrl, self->slots};
+  return lc_persist_save(path, &hdr, sections);
+}
+
+// Initializes 'self' from an image written by save(), false if it can not
+// be read. Insertions and removals on a LC_PERSIST_PRIVATE table stay in
+// memory, a LC_PERSIST_READONLY one only supports lookups.
+static inline bool _lc_mfunc(open_mmap)(Self *self, const char *path,
+                                        lc_persist_mode mode) {
+  lc_mapping map;
+  const lc_persist_header *hdr = lc_persist_open(
+      path, mode, LC_PERSIST_USET, sizeof(_Key), LC_GROUP_WIDTH, &map);
+  if (!hdr)
+    return false;
+  uint64_t capacity = hdr->capacity;
+  if (capacity < LC_GROUP_WIDTH || (capacity & (capacity - 1)) ||
+      capacity > SIZE_MAX / sizeof(_Key) || hdr->size >= capacity ||
+      hdr->length[0] != capacity + LC_GROUP_WIDTH ||
+      hdr->length[1] != capacity * sizeof(_Key)) {
+    lc_persist_unmap(&map);
+    return false;
+  }
+  // Everything the image does not hold (stats, rehash state) starts empty.
+  memset(self, 0, sizeof(*self));
+  self->size = (size_t)hdr->size;
+  self->capacity = (size_t)capacity;
+  self->ctrl = (uint8_t *)lc_persist_section(&map, 0);
+  self->slots = (_Key *)lc_persist_section(&map, 1);
+  self->map = map;
+  return true;
+}
+#endif // lcore_persist
+
+static inline void _lc_mfunc(destroy)(Self *self) {
+  if (!self)
+    return;
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+    lcore_drop_fn(self->slots[i]);
+  }
+  _lc_mfunc_priv(release)(self, self->ctrl, self->slots);
+#ifdef lcore_cache_hash
+  free(self->hashes);
+#endif // lcore_cache_hash
+#ifdef lcore_str_keys
+  lc_arena_release(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_release(&self->filter);
+#endif // lcore_filter
+  memset(self, 0, sizeof(*self));
+}
+
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline bool _lc_mfunc_priv(insert_hashed)(Self *self, T key,
+                                                 uint64_t h) {
+  if (_lc_mfunc_priv(find_index)(self, key, h) != self->capacity)
+    return false;
+  // Hits never resize. When the resize fails, the last empty slot is kept:
+  // lookups stop on it.
+  if ((float)self->size / self->capacity >= lcore_max_loadf)
+    _lc_mfunc(rehash)(self, self->capacity << 1);
+  if (self->size + 1 >= self->capacity)
+    return false;
+  size_t i = _lc_mfunc_priv(empty_index)(self, h);
+  if (!_lc_key_set(self, self->slots[i], key, h))
+    return false;
+  lc_ctrl_set(self->ctrl, self->capacity, i, lc_hash_h2(h));
+#ifdef lcore_cache_hash
+  self->hashes[i] = h;
+#endif // lcore_cache_hash
+  self->size++;
+#ifdef lcore_filter
+  lc_bloom_add(&self->filter, h);
+#endif // lcore_filter
+  return true;
+}
+
+static inline bool _lc_mfunc_priv(contains_hashed)(Self *self, T key,
+                                                   uint64_t h) {
+#ifdef lcore_filter
+  if (!lc_bloom_test(&self->filter, h)) {
+#ifdef lcore_stats
+    lc_stats_lookup(&self->stats, false, 0);
+#endif // lcore_stats
+    return false;
+  }
+#endif // lcore_filter
+  size_t i = _lc_mfunc_priv(find_index)(self, key, h);
+#ifdef lcore_stats
+  lc_stats_lookup(&self->stats, i != self->capacity,
+                  _lc_mfunc_priv(probe_groups)(self, i, h));
+#endif // lcore_stats
+  return i != self->capacity;
+}
+
+// Stage 0 fetches the first control group, stage 1 the matching keys.
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h,
+                                            int stage) {
+  size_t pos = lc_hash_h1(h) & (self->capacity - 1);
+  if (stage == 0) {
+    lc_prefetch(self->ctrl + pos);
+#ifdef lcore_filter
+    lc_bloom_prefetch(&self->filter, h);
+#endif // lcore_filter
+  } else {
+#ifdef lcore_filter
+    // Keys the filter rejects will not read the slots.
+    if (!lc_bloom_test(&self->filter, h))
+      return;
+#endif // lcore_filter
+    lc_prefetch(self->slots + pos);
+  }
+}
+
+// Returns the slot holding 'key', or self->capacity when it is not present.
+static inline size_t _lc_mfunc_priv(find_index)(Self *self, T key,
+                                                uint64_t h) {
+  size_t mask = self->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  uint8_t h2 = lc_hash_h2(h);
+  for (;;) {
+    const uint8_t *group = self->ctrl + pos;
+    lc_group_mask m = lc_group_match(group, h2);
+    while (m) {
+      size_t i = (pos + lc_mask_lowest(m)) & mask;
+      if (_lc_key_eq(self->slots[i], key, h))
+        return i;
+      m &= m - 1;
+    }
+    if (lc_group_match_empty(group))
+      return self->capacity;
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Returns the first free slot of the probe sequence starting at 'h'.
+static inline size_t _lc_mfunc_priv(empty_index)(Self *self, uint64_t h) {
+  size_t mask = self->capacity - 1;
+  size_t pos = lc_hash_h1(h) & mask;
+  for (;;) {
+    lc_group_mask m = lc_group_match_empty(self->ctrl + pos);
+    if (m)
+      return (pos + lc_mask_lowest(m)) & mask;
+    pos = (pos + LC_GROUP_WIDTH) & mask;
+  }
+}
+
+// Backward-shift deletion: the probe sequence is linear, so instead of
+// leaving a tombstone we pull back every following key whose home slot
+// allows it, until the run ends on an empty slot.
+static inline void _lc_mfunc_priv(erase_at)(Self *self, size_t i) {
+  size_t mask = self->capacity - 1;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (self->ctrl[j] & LC_CTRL_EMPTY)
+      break;
+    size_t home = lc_hash_h1(_lc_slot_hash(self, j)) & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      self->slots[i] = self->slots[j];
+#ifdef lcore_cache_hash
+      self->hashes[i] = self->hashes[j];
+#endif // lcore_cache_hash
+      lc_ctrl_set(self->ctrl, self->capacity, i, self->ctrl[j]);
+      i = j;
+    }
+  }
+  lc_ctrl_set(self->ctrl, self->capacity, i, LC_CTRL_EMPTY);
+}
+
+#ifdef lcore_stats
+static inline lc_hash_stats _lc_mfunc(stats)(Self *self) {
+  lc_hash_stats stats = self->stats;
+  stats.live_bytes =
+      self->capacity + LC_GROUP_WIDTH + _lc_slot_bytes * self->capacity;
+#ifdef lcore_str_keys
+  stats.alloc_bytes += self->arena.bytes;
+  stats.live_bytes += self->arena.bytes;
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  stats.live_bytes += lc_bloom_bytes(&self->filter);
+#endif // lcore_filter
+  return stats;
+}
+
+// Counts the keys by distance from their home slot into 'bins' bins, the
+// last one collecting every longer distance. Returns the longest distance.
+static inline size_t _lc_mfunc(chain_histogram)(Self *self, size_t *hist,
+                                                size_t bins) {
+  size_t mask = self->capacity - 1;
+  size_t longest = 0;
+  memset(hist, 0, sizeof(size_t) * bins);
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->ctrl[i] & LC_CTRL_EMPTY)
+      continue;
+    size_t home = lc_hash_h1(_lc_slot_hash(self, i)) & mask;
+    lc_stats_bin(hist, bins, (i - home) & mask, &longest);
+  }
+  return longest;
+}
+
+// Control groups find_index() loaded to end up at 'i': a hit stops at the
+// group holding its key, a miss at the first group with an empty slot.
+static inline size_t _lc_mfunc_priv(probe_groups)(Self *self, size_t i,
+                                                  uint64_t h) {
+  size_t mask = self->capacity - 1;
+  if (i == self->capacity)
+    i = _lc_mfunc_priv(empty_index)(self, h);
+  return ((i - lc_hash_h1(h)) & mask) / LC_GROUP_WIDTH + 1;
+}
+#endif // lcore_stats
+
+// Frees arrays the table no longer uses, or the image they live in.
+static inline void _lc_mfunc_priv(release)(Self *self, uint8_t *ctrl,
+                                           _Key *slots) {
+#ifdef lcore_persist
+  if (self->map.addr) {
+    lc_persist_unmap(&self->map);
+    return;
+  }
+#else
+  (void)self;
+#endif // lcore_persist
+  free(ctrl);
+  free(slots);
+}
+
+#undef _lc_slot_hash
+#undef _lc_slot_bytes
+#undef _lc_slots_alloc
+#else
+
+// ===== SEPARATE CHAINING IMPLEMENTATION ======= //
+
+static inline _Node **_lc_mfunc_priv(bucket)(Self *self, uint64_t h);
+static inline _Node *_lc_mfunc_priv(alloc_node)(Self *self);
+static inline void _lc_mfunc_priv(free_node)(Self *self, _Node *node);
+static inline void _lc_mfunc_priv(migrate)(Self *self, _Node *chain);
+
+static inline void _lc_mfunc(init)(Self *self, size_t capacity) {
+  memset(self, 0, sizeof(*self));
+  if (capacity == 0 || (capacity & (capacity - 1)))
+    capacity = 64;
+  self->capacity = capacity;
+  self->buckets = lc_calloc(_Node *, sizeof(_Node *), capacity);
+#ifdef lcore_node_pool
+  lc_pool_init(&self->pool, sizeof(_Node));
+#endif // lcore_node_pool
+#ifdef lcore_str_keys
+  lc_arena_init(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_init(&self->filter, _lc_filter_keys(capacity), lcore_filter_fpr);
+#endif // lcore_filter
+#ifdef lcore_stats
+  self->stats.alloc_bytes += sizeof(_Node *) * self->capacity;
+#endif // lcore_stats
+}
+
+static inline bool _lc_mfunc(insert)(Self *self, T key) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(insert_hashed)(self, key, lcore_hash_fn(key));
+}
+
+static inline bool _lc_mfunc(contains)(Self *self, T key) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(contains_hashed)(self, key, lcore_hash_fn(key));
+}
+
 static inline bool _lc_mfunc(remove)(Self *self, T key) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
   uint64_t h = lcore_hash_fn(key);
-  size_t b = h & (self->capacity - 1);
-  _Node *cur = self->buckets[b];
+  _Node **head = _lc_mfunc_priv(bucket)(self, h);
+  _Node *cur = *head;
   _Node *prv = NULL;
   while (cur) {
-    if (lcore_eq_fn(cur->data, key)) {
+    if (_lc_hash_match(cur, h) && _lc_key_eq(cur->data, key, h)) {
       if (prv) {
         prv->next = cur->next;
       } else {
-        self->buckets[b] = cur->next;
+        *head = cur->next;
       }
       lcore_drop_fn(cur->data);
-      free(cur);
+      _lc_mfunc_priv(free_node)(self, cur);
+      self->size--;
       return true;
     }
     prv = cur;
@@ -115,34 +732,84 @@ static inline bool _lc_mfunc(remove)(Self *self, T key) {
 }
 
 static inline void _lc_mfunc(rehash)(Self *self, size_t new_capacity) {
-  if (new_capacity == 0)
+  if (new_capacity == 0 || (new_capacity & (new_capacity - 1)))
     return;
+  // Only one resize can be in flight, finish the previous one first.
+  _lc_mfunc(rehash_step)(self, SIZE_MAX);
   _Node **new_buckets = lc_calloc(_Node *, sizeof(_Node *), new_capacity);
   if (!new_buckets)
     return;
+#ifdef lcore_filter
+  lc_bloom old_filter = self->filter;
+  if (!lc_bloom_init(&self->filter, _lc_filter_keys(new_capacity),
+                     lcore_filter_fpr)) {
+    self->filter = old_filter;
+    free(new_buckets);
+    return;
+  }
+  lc_bloom_release(&old_filter);
+#endif // lcore_filter
+#ifdef lcore_stats
+  uint64_t t0 = lc_stats_now_ns();
+  self->stats.rehashes++;
+  self->stats.alloc_bytes += sizeof(_Node *) * new_capacity;
+#endif // lcore_stats
   _Node **old_buckets = self->buckets;
   size_t old_capacity = self->capacity;
-  self->size = 0;
   self->capacity = new_capacity;
   self->buckets = new_buckets;
-  for (size_t i = 0; i < old_capacity; i++) {
-    _Node *cur = old_buckets[i];
-    _Node *nxt = NULL;
-    while (cur) {
-      nxt = cur->next;
-      uint64_t h = lcore_hash_fn(cur->data);
-      size_t b = h & (self->capacity - 1);
-      cur->next = self->buckets[b];
-      self->buckets[b] = cur;
-      cur = nxt;
-    }
-  }
+#ifdef lcore_incremental_rehash
+  self->old_buckets = old_buckets;
+  self->old_capacity = old_capacity;
+  self->migrated = 0;
+#else
+  for (size_t i = 0; i < old_capacity; i++)
+    _lc_mfunc_priv(migrate)(self, old_buckets[i]);
   free(old_buckets);
+#endif // lcore_incremental_rehash
+#ifdef lcore_stats
+  self->stats.rehash_ns += lc_stats_now_ns() - t0;
+#endif // lcore_stats
+}
+
+static inline bool _lc_mfunc(rehash_step)(Self *self, size_t n) {
+#ifdef lcore_incremental_rehash
+  if (!self->old_buckets)
+    return false;
+#ifdef lcore_stats
+  uint64_t t0 = lc_stats_now_ns();
+#endif // lcore_stats
+  size_t left = self->old_capacity - self->migrated;
+  size_t end = self->migrated + (n < left ? n : left);
+  for (; self->migrated < end; self->migrated++)
+    _lc_mfunc_priv(migrate)(self, self->old_buckets[self->migrated]);
+#ifdef lcore_stats
+  self->stats.rehash_ns += lc_stats_now_ns() - t0;
+#endif // lcore_stats
+  if (self->migrated < self->old_capacity)
+    return true;
+  free(self->old_buckets);
+  self->old_buckets = NULL;
+  self->old_capacity = self->migrated = 0;
+  return false;
+#else
+  (void)self;
+  (void)n;
+  return false;
+#endif // lcore_incremental_rehash
 }
 
 static inline void _lc_mfunc(destroy)(Self *self) {
   if (!self)
     return;
+#if defined(lcore_node_pool) && defined(_lc_trivial_drop)
+  // Nothing to drop: releasing the slabs frees every node at once.
+#ifdef lcore_incremental_rehash
+  free(self->old_buckets);
+#endif // lcore_incremental_rehash
+#else
+  // Finishing a pending migration keeps the cleanup a single pass.
+  _lc_mfunc(rehash_step)(self, SIZE_MAX);
   for (size_t i = 0; i < self->capacity; i++) {
     _Node *cur = self->buckets[i];
     _Node *to_free = NULL;
@@ -150,15 +817,300 @@ static inline void _lc_mfunc(destroy)(Self *self) {
       to_free = cur;
       cur = cur->next;
       lcore_drop_fn(to_free->data);
-      free(to_free);
+      _lc_mfunc_priv(free_node)(self, to_free);
     }
   }
+#endif // lcore_node_pool && _lc_trivial_drop
   free(self->buckets);
+#ifdef lcore_node_pool
+  lc_pool_release(&self->pool);
+#endif // lcore_node_pool
+#ifdef lcore_str_keys
+  lc_arena_release(&self->arena);
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  lc_bloom_release(&self->filter);
+#endif // lcore_filter
   memset(self, 0, sizeof(*self));
 }
 
+// ========= PRIVATE API IMPLEMENTATION ========= //
+
+static inline bool _lc_mfunc_priv(insert_hashed)(Self *self, T key,
+                                                 uint64_t h) {
+  _Node **head = _lc_mfunc_priv(bucket)(self, h);
+  _Node *cur = *head;
+  _Node *prv = NULL;
+  while (cur) {
+    if (_lc_hash_match(cur, h) && _lc_key_eq(cur->data, key, h))
+      return false;
+    prv = cur;
+    cur = cur->next;
+  }
+  // Hits never resize; after a resize only the new chain's tail is needed.
+  if ((float)self->size / self->capacity >= lcore_max_loadf) {
+    _lc_mfunc(rehash)(self, self->capacity << 1);
+    head = _lc_mfunc_priv(bucket)(self, h);
+    for (prv = NULL, cur = *head; cur; cur = cur->next)
+      prv = cur;
+  }
+  _Node *new_node = _lc_mfunc_priv(alloc_node)(self);
+  if (!new_node)
+    return false;
+  if (!_lc_key_set(self, new_node->data, key, h)) {
+    _lc_mfunc_priv(free_node)(self, new_node);
+    return false;
+  }
+  new_node->next = NULL;
+#ifdef lcore_cache_hash
+  new_node->hash = h;
+#endif // lcore_cache_hash
+  if (!prv)
+    *head = new_node;
+  else
+    prv->next = new_node;
+  self->size++;
+#ifdef lcore_filter
+  lc_bloom_add(&self->filter, h);
+#endif // lcore_filter
+  return true;
+}
+
+static inline bool _lc_mfunc_priv(contains_hashed)(Self *self, T key,
+                                                   uint64_t h) {
+#ifdef lcore_filter
+  if (!lc_bloom_test(&self->filter, h)) {
+#ifdef lcore_stats
+    lc_stats_lookup(&self->stats, false, 0);
+#endif // lcore_stats
+    return false;
+  }
+#endif // lcore_filter
+  _Node *cur = *_lc_mfunc_priv(bucket)(self, h);
+#ifdef lcore_stats
+  uint64_t probes = 0;
+  while (cur && (probes++, !(_lc_hash_match(cur, h) &&
+                                     _lc_key_eq(cur->data, key, h))))
+    cur = cur->next;
+  lc_stats_lookup(&self->stats, cur != NULL, probes);
+  return cur != NULL;
+#else
+  while (cur) {
+    if (_lc_hash_match(cur, h) && _lc_key_eq(cur->data, key, h))
+      return true;
+    cur = cur->next;
+  }
+  return false;
+#endif // lcore_stats
+}
+
+// Stage 0 fetches the bucket slot, stage 1 the head of its chain.
+static inline void _lc_mfunc_priv(prefetch)(Self *self, uint64_t h,
+                                            int stage) {
+  _Node **head = _lc_mfunc_priv(bucket)(self, h);
+  if (stage == 0) {
+    lc_prefetch(head);
+#ifdef lcore_filter
+    lc_bloom_prefetch(&self->filter, h);
+#endif // lcore_filter
+  } else {
+#ifdef lcore_filter
+    // Keys the filter rejects will not walk the chain.
+    if (!lc_bloom_test(&self->filter, h))
+      return;
+#endif // lcore_filter
+    lc_prefetch(*head);
+  }
+}
+
+// Returns the chain a key with hash 'h' belongs to. While an incremental
+// resize is in flight, buckets of the old array that have not been migrated
+// yet still own their keys.
+static inline _Node **_lc_mfunc_priv(bucket)(Self *self, uint64_t h) {
+#ifdef lcore_incremental_rehash
+  if (self->old_buckets) {
+    size_t b = h & (self->old_capacity - 1);
+    if (b >= self->migrated)
+      return &self->old_buckets[b];
+  }
+#endif // lcore_incremental_rehash
+  return &self->buckets[h & (self->capacity - 1)];
+}
+
+static inline _Node *_lc_mfunc_priv(alloc_node)(Self *self) {
+#ifdef lcore_stats
+  self->stats.alloc_bytes += sizeof(_Node);
+#endif // lcore_stats
+#ifdef lcore_node_pool
+  return (_Node *)lc_pool_alloc(&self->pool);
+#else
+#ifndef lcore_stats
+  (void)self;
+#endif // lcore_stats
+  return lc_malloc(_Node, sizeof(_Node));
+#endif // lcore_node_pool
+}
+
+static inline void _lc_mfunc_priv(free_node)(Self *self, _Node *node) {
+#ifdef lcore_node_pool
+  lc_pool_free(&self->pool, node);
+#else
+  (void)self;
+  free(node);
+#endif // lcore_node_pool
+}
+
+#ifdef lcore_stats
+static inline lc_hash_stats _lc_mfunc(stats)(Self *self) {
+  lc_hash_stats stats = self->stats;
+  stats.live_bytes =
+      sizeof(_Node *) * self->capacity + sizeof(_Node) * self->size;
+#ifdef lcore_incremental_rehash
+  stats.live_bytes += sizeof(_Node *) * self->old_capacity;
+#endif // lcore_incremental_rehash
+#ifdef lcore_str_keys
+  stats.alloc_bytes += self->arena.bytes;
+  stats.live_bytes += self->arena.bytes;
+#endif // lcore_str_keys
+#ifdef lcore_filter
+  stats.live_bytes += lc_bloom_bytes(&self->filter);
+#endif // lcore_filter
+  return stats;
+}
+
+// Counts the buckets by chain length into 'bins' bins, the last one
+// collecting every longer chain. Returns the longest chain.
+static inline size_t _lc_mfunc(chain_histogram)(Self *self, size_t *hist,
+                                                size_t bins) {
+  size_t longest = 0;
+  memset(hist, 0, sizeof(size_t) * bins);
+  for (size_t i = 0; i < self->capacity; i++) {
+    size_t len = 0;
+    for (_Node *cur = self->buckets[i]; cur; cur = cur->next)
+      len++;
+    lc_stats_bin(hist, bins, len, &longest);
+  }
+#ifdef lcore_incremental_rehash
+  for (size_t i = self->migrated; i < self->old_capacity; i++) {
+    size_t len = 0;
+    for (_Node *cur = self->old_buckets[i]; cur; cur = cur->next)
+      len++;
+    lc_stats_bin(hist, bins, len, &longest);
+  }
+#endif // lcore_incremental_rehash
+  return longest;
+}
+#endif // lcore_stats
+
+// Moves every node of 'chain' into the current bucket array.
+static inline void _lc_mfunc_priv(migrate)(Self *self, _Node *chain) {
+  _Node *cur = chain;
+  _Node *nxt = NULL;
+  while (cur) {
+    nxt = cur->next;
+    uint64_t h = _lc_node_hash(cur);
+    size_t b = h & (self->capacity - 1);
+#ifdef lcore_filter
+    lc_bloom_add(&self->filter, h);
+#endif // lcore_filter
+    cur->next = self->buckets[b];
+    self->buckets[b] = cur;
+    cur = nxt;
+  }
+}
+
+#undef _Node
+#undef _lc_node_hash
+#undef _lc_hash_match
+#endif // lcore_open_addressing
+
+// ============ PRECOMPUTED HASHES ============== //
+// Same as insert() and contains() for callers that already know the hash of
+// the key, which must be lcore_hash_fn(key).
+
+static inline bool _lc_mfunc(insert_hashed)(Self *self, T key, uint64_t hash) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(insert_hashed)(self, key, hash);
+}
+
+static inline bool _lc_mfunc(contains_hashed)(Self *self, T key,
+                                              uint64_t hash) {
+  _lc_mfunc(rehash_step)(self, lcore_rehash_stride);
+  return _lc_mfunc_priv(contains_hashed)(self, key, hash);
+}
+
+// ============ BATCHED OPERATIONS ============== //
+// Keys are processed in windows of 'lcore_batch_window': all the hashes of a
+// window are computed first and their buckets prefetched in two stages, so
+// the cache misses of the whole window overlap before any key is resolved.
+
+static inline size_t _lc_mfunc(insert_many)(Self *self, T const *keys,
+                                            size_t n) {
+  uint64_t hashes[lcore_batch_window];
+  size_t inserted = 0;
+  for (size_t base = 0; base < n; base += lcore_batch_window) {
+    size_t m = n - base < lcore_batch_window ? n - base : lcore_batch_window;
+    _lc_mfunc(rehash_step)(self, lcore_rehash_stride * m);
+    for (size_t i = 0; i < m; i++) {
+      hashes[i] = lcore_hash_fn(keys[base + i]);
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 0);
+    }
+    for (size_t i = 0; i < m; i++)
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 1);
+    for (size_t i = 0; i < m; i++)
+      inserted +=
+          _lc_mfunc_priv(insert_hashed)(self, keys[base + i], hashes[i]);
+  }
+  return inserted;
+}
+
+// Stores in 'found' (when not NULL) whether each key is in the set and
+// returns how many are.
+static inline size_t _lc_mfunc(contains_many)(Self *self, T const *keys,
+                                              size_t n, bool *found) {
+  uint64_t hashes[lcore_batch_window];
+  size_t hits = 0;
+  for (size_t base = 0; base < n; base += lcore_batch_window) {
+    size_t m = n - base < lcore_batch_window ? n - base : lcore_batch_window;
+    _lc_mfunc(rehash_step)(self, lcore_rehash_stride * m);
+    for (size_t i = 0; i < m; i++) {
+      hashes[i] = lcore_hash_fn(keys[base + i]);
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 0);
+    }
+    for (size_t i = 0; i < m; i++)
+      _lc_mfunc_priv(prefetch)(self, hashes[i], 1);
+    for (size_t i = 0; i < m; i++) {
+      bool hit =
+          _lc_mfunc_priv(contains_hashed)(self, keys[base + i], hashes[i]);
+      if (found)
+        found[base + i] = hit;
+      hits += hit;
+    }
+  }
+  return hits;
+}
+
 #undef T
+#undef lcore_eq_fn
+#undef lcore_hash_fn
 #undef lcore_max_loadf
 #undef lcore_drop_fn
+#undef lcore_rehash_stride
+#undef lcore_batch_window
+#undef lcore_pfx
+#undef lcore_open_addressing
+#undef lcore_incremental_rehash
+#undef lcore_node_pool
+#undef lcore_persist
+#undef lcore_stats
+#undef lcore_cache_hash
+#undef lcore_str_keys
+#undef lcore_filter
+#undef lcore_filter_fpr
+#undef _lc_filter_keys
+#undef _lc_trivial_drop
+#undef _Key
+#undef _lc_key_eq
+#undef _lc_key_hash
+#undef _lc_key_set
 #undef Self
-#undef _Node
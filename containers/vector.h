@@ -1,14 +1,104 @@
 #include "_lc_templating.h"
 #include <stdbool.h>
 
+#ifdef lcore_mmap_threshold
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#error "lcore_mmap_threshold needs MAP_ANONYMOUS, define _GNU_SOURCE"
+#endif // MAP_ANONYMOUS
+#endif // lcore_mmap_threshold
+
 #ifndef T
 #define T int
 #endif // T
 
 #ifndef lcore_drop_fn
+#define _lc_trivial_drop
 #define lcore_drop_fn(x)
 #endif // lcore_drop_fn
 
+// Small buffer optimization, opt-in:
+//
+// #define lcore_inline_cap 8
+//
+// stores up to 'lcore_inline_cap' elements inside the struct itself, the
+// vector only allocates once it outgrows them. A vector is in inline mode
+// while capacity <= lcore_inline_cap, heap buffers are always larger. Since
+// the inline elements live in the struct, use data() rather than the
+// 'elements' member to reach them.
+
+// Growth factor applied to the capacity when push_back or extend run out of
+// room, 2 by default. Smaller factors (e.g. 1.5) waste less memory at the
+// cost of more frequent reallocations.
+#ifndef lcore_growth_factor
+#define lcore_growth_factor 2
+#endif // lcore_growth_factor
+
+// Large vector mode, opt-in and meant for Linux:
+//
+// #define lcore_mmap_threshold (64 << 20)
+//
+// backs every buffer of at least 'lcore_mmap_threshold' bytes with an
+// anonymous mapping. Those buffers grow and shrink with mremap, which moves
+// page table entries instead of copying the elements, so growing a huge
+// vector neither copies it nor needs the old and the new buffer at the same
+// time. mremap is only declared with _GNU_SOURCE, without it the vector
+// falls back to mmap + memcpy + munmap.
+
+// Sorting, opt-in:
+//
+// #define lcore_less_fn(a, b) ((a) < (b))
+//
+// generates sort(), a pattern-defeating quicksort specialized for T: the
+// comparison is inlined instead of going through qsort's function pointer
+// and elements are moved as T rather than byte by byte. A three-way
+// 'lcore_cmp_fn' (as used by the trees) works too. 'lcore_radix_sort'
+// generates radix_sort(), an LSD radix sort for integer and floating point
+// T that needs a scratch buffer as large as the vector.
+//
+// #define lcore_sort_threads 8
+//
+// lets both of them split vectors of at least 'lcore_sort_parallel_min'
+// elements across up to that many threads.
+
+// Scans: find(), count(), min(), max() and sum() use the kernels of
+// _lc_scan.h when T is an arithmetic type, comparing elements by value (SIMD
+// for 32 and 64 bit integers, float and double). Other types take a scalar
+// loop: find() and count() compare with 'lcore_eq_fn' (byte-wise if it is
+// not defined), min() and max() need 'lcore_less_fn' or 'lcore_cmp_fn' and
+// sum() is not available. Calling them anyway fails to build.
+//
+// #define lcore_eq_fn(a, b) ((a).id == (b).id)
+
+#if defined(lcore_cmp_fn) && !defined(lcore_less_fn)
+#define lcore_less_fn(a, b) (lcore_cmp_fn(a, b) < 0)
+#endif // lcore_cmp_fn
+
+// Persistence, opt-in and POSIX only:
+//
+// #define lcore_persist
+//
+// generates save(), which writes the elements to a file, and open_mmap(),
+// which maps such a file and uses it as the vector's buffer without copying
+// or parsing it (see _lc_persist.h). A mapped vector moves to an owned
+// buffer the first time its capacity changes. T must not hold pointers.
+
+#ifdef lcore_persist
+#include "_lc_persist.h"
+#ifndef _lc_trivial_drop
+#error "lcore_persist needs a T without lcore_drop_fn"
+#endif // _lc_trivial_drop
+#endif // lcore_persist
+
+#include "_lc_scan.h"
+#if defined(lcore_less_fn) || defined(lcore_radix_sort)
+#include "_lc_sort.h"
+#endif // lcore_less_fn || lcore_radix_sort
+
+#ifndef lcore_sort_parallel_min
+#define lcore_sort_parallel_min (1 << 17)
+#endif // lcore_sort_parallel_min
+
 #ifndef lcore_pfx
 #define lcore_pfx _lc_join(T, vec)
 #endif // lcore_pfx
@@ -17,9 +107,37 @@
 
 typedef struct {
   size_t size, capacity;
+#ifdef lcore_inline_cap
+  union {
+    T *elements;
+    T inline_elements[lcore_inline_cap];
+  };
+#else
   T *elements;
+#endif // lcore_inline_cap
+#ifdef lcore_persist
+  lc_mapping map; // image 'elements' points into, if any
+#endif // lcore_persist
 } Self;
 
+#ifdef lcore_sort_threads
+#define _SortJob _lc_join(Self, sort_job)
+#define _SortParts                                                             \
+  (lcore_sort_threads < LC_SORT_MAX_THREADS ? lcore_sort_threads               \
+                                            : LC_SORT_MAX_THREADS)
+
+// Shared state of the tasks of a parallel sort.
+typedef struct {
+  T *src;                // elements being sorted or merged
+  T *dst;                // scratch buffer
+  size_t n;              // number of elements
+  size_t run;            // chunk size of a task, then length of sorted runs
+  unsigned parts;        // number of tasks
+  unsigned shift;        // radix pass: first bit of the digit
+  size_t (*counts)[256]; // radix pass: digit counts, then offsets, per task
+} _SortJob;
+#endif // lcore_sort_threads
+
 // ============== PUBLIC API ==================== //
 // These functions are meant to be used to interact with the vector structure
 // you are NOT supposed to modify the struct memebers directly.
@@ -27,32 +145,141 @@ typedef struct {
 static inline void _lc_mfunc(init)(Self *self, size_t capacity);
 static inline void _lc_mfunc(push_back)(Self *self, T value);
 static inline void _lc_mfunc(resize)(Self *self, size_t new_capacity);
+static inline void _lc_mfunc(reserve)(Self *self, size_t capacity);
+static inline void _lc_mfunc(shrink_to_fit)(Self *self);
+static inline void _lc_mfunc(extend)(Self *self, T const *values, size_t n);
 static inline void _lc_mfunc(insert_at)(Self *self, T value, size_t index);
 static inline void _lc_mfunc(remove_at)(Self *self, size_t index);
 static inline void _lc_mfunc(qsort)(Self *self, int (*cmp)(const T *, const T *));
+#ifdef lcore_less_fn
+static inline void _lc_mfunc(sort)(Self *self);
+#endif // lcore_less_fn
+#ifdef lcore_radix_sort
+static inline bool _lc_mfunc(radix_sort)(Self *self);
+#endif // lcore_radix_sort
+static inline size_t _lc_mfunc(find)(Self *self, T value);
+static inline size_t _lc_mfunc(count)(Self *self, T value);
+static inline bool _lc_mfunc(min)(Self *self, T *out);
+static inline bool _lc_mfunc(max)(Self *self, T *out);
+static inline T _lc_mfunc(sum)(Self *self);
+#ifdef lcore_persist
+static inline bool _lc_mfunc(save)(Self *self, const char *path);
+static inline bool _lc_mfunc(open_mmap)(Self *self, const char *path,
+                                        lc_persist_mode mode);
+#endif // lcore_persist
 static inline void _lc_mfunc(destroy)(Self *self);
 static inline T _lc_mfunc(at)(Self *self, size_t index);
+static inline T *_lc_mfunc(data)(Self *self);
 static inline T _lc_mfunc(pop_back)(Self *self);
 static inline bool _lc_mfunc(check_health)(Self *self);
 
+// ============== PRIVATE API =================== //
+
+static inline bool _lc_mfunc_priv(is_inline)(Self *self);
+static inline size_t _lc_mfunc_priv(find_scalar)(T const *elements, size_t n,
+                                                 T value);
+static inline size_t _lc_mfunc_priv(count_scalar)(T const *elements, size_t n,
+                                                  T value);
+static inline T _lc_mfunc_priv(min_scalar)(T const *elements, size_t n);
+static inline T _lc_mfunc_priv(max_scalar)(T const *elements, size_t n);
+static inline T _lc_mfunc_priv(sum_scalar)(T const *elements, size_t n);
+static inline void _lc_mfunc_priv(grow)(Self *self, size_t min_capacity);
+static inline void _lc_mfunc_priv(set_capacity)(Self *self, size_t capacity);
+static inline T *_lc_mfunc_priv(alloc_buffer)(size_t capacity);
+static inline void _lc_mfunc_priv(free_buffer)(T *buffer, size_t capacity);
+static inline T *_lc_mfunc_priv(realloc_buffer)(T *buffer, size_t capacity,
+                                                size_t new_capacity,
+                                                size_t size);
+#ifdef lcore_sort_threads
+static inline void _lc_mfunc_priv(chunk)(_SortJob *job, unsigned id,
+                                         size_t *lo, size_t *hi);
+#endif // lcore_sort_threads
+#ifdef lcore_less_fn
+static inline void _lc_mfunc_priv(swap)(T *a, T *b);
+static inline void _lc_mfunc_priv(sort3)(T *a, T *b, T *c);
+static inline void _lc_mfunc_priv(insertion_sort)(T *begin, T *end,
+                                                  bool leftmost);
+static inline bool _lc_mfunc_priv(partial_insertion_sort)(T *begin, T *end);
+static inline void _lc_mfunc_priv(sift_down)(T *heap, size_t n, size_t i);
+static inline void _lc_mfunc_priv(heapsort)(T *begin, T *end);
+static inline T *_lc_mfunc_priv(partition_left)(T *begin, T *end);
+static inline T *_lc_mfunc_priv(partition_right)(T *begin, T *end,
+                                                 bool *partitioned);
+static inline void _lc_mfunc_priv(pdqsort)(T *begin, T *end, int bad_allowed,
+                                           bool leftmost);
+static inline void _lc_mfunc_priv(sort_range)(T *begin, T *end);
+#ifdef lcore_sort_threads
+static inline bool _lc_mfunc_priv(parallel_sort)(T *elements, size_t n);
+#endif // lcore_sort_threads
+#endif // lcore_less_fn
+#if defined(lcore_radix_sort) && defined(lcore_sort_threads)
+static inline bool _lc_mfunc_priv(parallel_radix_sort)(T *elements, T *tmp,
+                                                       size_t n);
+#endif // lcore_radix_sort && lcore_sort_threads
+
 static inline void
 _lc_mfunc(init)(Self *self, size_t capacity) {
   memset(self, 0, sizeof(*self));
-  self->elements = lc_calloc(T, sizeof(T), capacity);
+#ifdef lcore_inline_cap
+  if (capacity <= lcore_inline_cap) {
+    self->capacity = lcore_inline_cap;
+    return;
+  }
+#endif // lcore_inline_cap
+#ifdef lcore_mmap_threshold
+  if (capacity * sizeof(T) >= lcore_mmap_threshold)
+    self->elements = _lc_mfunc_priv(alloc_buffer)(capacity);
+  else
+#endif // lcore_mmap_threshold
+    self->elements = lc_calloc(T, sizeof(T), capacity);
   self->capacity = capacity;
 }
 
 static inline void
 _lc_mfunc(push_back)(Self *self, T value) {
   if (self->size == self->capacity)
-    _lc_mfunc(resize)(self, self->capacity * 2);
-  self->elements[self->size++] = value;
+    _lc_mfunc_priv(grow)(self, self->size + 1);
+  _lc_mfunc(data)(self)[self->size++] = value;
 }
 
+// Sets the capacity to 'new_capacity' (never below the current size), 0
+// picks a default one.
 static inline void
 _lc_mfunc(resize)(Self *self, size_t new_capacity) {
-  self->capacity = new_capacity == 0 ? 16 : new_capacity;
-  self->elements = (T *)realloc(self->elements, self->capacity * sizeof(T));
+#ifdef lcore_inline_cap
+  if (new_capacity == 0)
+    new_capacity = lcore_inline_cap;
+#else
+  if (new_capacity == 0)
+    new_capacity = 16;
+#endif // lcore_inline_cap
+  if (new_capacity < self->size)
+    new_capacity = self->size;
+  _lc_mfunc_priv(set_capacity)(self, new_capacity);
+}
+
+// Makes room for at least 'capacity' elements, never shrinks.
+static inline void
+_lc_mfunc(reserve)(Self *self, size_t capacity) {
+  if (capacity > self->capacity)
+    _lc_mfunc_priv(set_capacity)(self, capacity);
+}
+
+// Gives back the unused capacity (an empty vector frees its buffer).
+static inline void
+_lc_mfunc(shrink_to_fit)(Self *self) {
+  if (self->size < self->capacity)
+    _lc_mfunc_priv(set_capacity)(self, self->size);
+}
+
+// Appends 'n' values copied from 'values', which must not point into the
+// vector itself.
+static inline void
+_lc_mfunc(extend)(Self *self, T const *values, size_t n) {
+  if (self->size + n > self->capacity)
+    _lc_mfunc_priv(grow)(self, self->size + n);
+  memcpy(_lc_mfunc(data)(self) + self->size, values, n * sizeof(T));
+  self->size += n;
 }
 
 static inline void
@@ -60,64 +287,922 @@ _lc_mfunc(insert_at)(Self *self, T value, size_t index) {
   if (index >= self->size)
     return;
   if (self->size == self->capacity)
-    _lc_mfunc(resize)(self, self->capacity * 2);
-  void *dst = self->elements + (sizeof(T) * (index + 1));
-  void *src = self->elements + (sizeof(T) * index);
-  memmove(dst, src, self->size - index);
+    _lc_mfunc_priv(grow)(self, self->size + 1);
+  T *elements = _lc_mfunc(data)(self);
+  memmove(elements + index + 1, elements + index,
+          (self->size - index) * sizeof(T));
+  elements[index] = value;
   self->size++;
 }
 
 static inline void
 _lc_mfunc(remove_at)(Self *self, size_t index) {
-  void *dst = self->elements + (sizeof(T) * index);
-  void *src = self->elements + (sizeof(T) * (index + 1));
-  memmove(dst, src, self->size - index - 1);
+  assert(index < self->size);
+  T *elements = _lc_mfunc(data)(self);
+  lcore_drop_fn(elements[index]);
+  memmove(elements + index, elements + index + 1,
+          (self->size - index - 1) * sizeof(T));
   self->size--;
 }
 
 static inline void
 _lc_mfunc(qsort)(Self *self, int (*cmp)(const T *, const T *)) {
-  qsort(self->elements, self->size, sizeof(T),
+  qsort(_lc_mfunc(data)(self), self->size, sizeof(T),
         (int (*)(const void *, const void *))cmp);
 }
 
+#ifdef lcore_less_fn
+// Not stable. Runs in O(n log n) even on adversarial inputs and in O(n) on
+// sorted, reversed or all-equal ones.
+static inline void
+_lc_mfunc(sort)(Self *self) {
+  T *elements = _lc_mfunc(data)(self);
+#ifdef lcore_sort_threads
+  if (self->size >= lcore_sort_parallel_min &&
+      _lc_mfunc_priv(parallel_sort)(elements, self->size))
+    return;
+#endif // lcore_sort_threads
+  _lc_mfunc_priv(sort_range)(elements, elements + self->size);
+}
+#endif // lcore_less_fn
+
+#ifdef lcore_radix_sort
+// Digit of 'x' sorted by the radix pass starting at bit 'shift'.
+#define _Digit(x, shift) ((size_t)(lc_radix_key(x) >> (shift)) & 0xff)
+
+// One counting pass over the whole vector, then one scatter pass per byte of
+// T, skipping the bytes every element has in common. Returns false, leaving
+// the vector untouched, when the scratch buffer can not be allocated.
+static inline bool
+_lc_mfunc(radix_sort)(Self *self) {
+  size_t n = self->size;
+  T *elements = _lc_mfunc(data)(self);
+  if (n < 2)
+    return true;
+  T *tmp = lc_malloc(T, n * sizeof(T));
+  if (!tmp)
+    return false;
+#ifdef lcore_sort_threads
+  if (n >= lcore_sort_parallel_min &&
+      _lc_mfunc_priv(parallel_radix_sort)(elements, tmp, n)) {
+    free(tmp);
+    return true;
+  }
+#endif // lcore_sort_threads
+  size_t counts[sizeof(T)][256];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = lc_radix_key(elements[i]);
+    for (size_t b = 0; b < sizeof(T); b++)
+      counts[b][(key >> (8 * b)) & 0xff]++;
+  }
+  T *src = elements;
+  T *dst = tmp;
+  for (unsigned b = 0; b < sizeof(T); b++) {
+    size_t *offsets = counts[b];
+    unsigned shift = 8 * b;
+    if (offsets[_Digit(src[0], shift)] == n)
+      continue;
+    size_t sum = 0;
+    for (size_t d = 0; d < 256; d++) {
+      size_t count = offsets[d];
+      offsets[d] = sum;
+      sum += count;
+    }
+    for (size_t i = 0; i < n; i++)
+      dst[offsets[_Digit(src[i], shift)]++] = src[i];
+    T *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != elements)
+    memcpy(elements, src, n * sizeof(T));
+  free(tmp);
+  return true;
+}
+#endif // lcore_radix_sort
+
+// Index of the first element equal to 'value', or size() if there is none.
+static inline size_t
+_lc_mfunc(find)(Self *self, T value) {
+  return lc_scan_dispatch(find, value, _lc_mfunc_priv(find_scalar))(
+      _lc_mfunc(data)(self), self->size, value);
+}
+
+static inline size_t
+_lc_mfunc(count)(Self *self, T value) {
+  return lc_scan_dispatch(count, value, _lc_mfunc_priv(count_scalar))(
+      _lc_mfunc(data)(self), self->size, value);
+}
+
+// Stores the smallest element in 'out', false if the vector is empty.
+static inline bool
+_lc_mfunc(min)(Self *self, T *out) {
+  if (self->size == 0)
+    return false;
+  *out = lc_scan_dispatch(min, *out, _lc_mfunc_priv(min_scalar))(
+      _lc_mfunc(data)(self), self->size);
+  return true;
+}
+
+static inline bool
+_lc_mfunc(max)(Self *self, T *out) {
+  if (self->size == 0)
+    return false;
+  *out = lc_scan_dispatch(max, *out, _lc_mfunc_priv(max_scalar))(
+      _lc_mfunc(data)(self), self->size);
+  return true;
+}
+
+// Integer sums wrap around, float sums are rounded per SIMD lane.
+static inline T
+_lc_mfunc(sum)(Self *self) {
+  T zero;
+  memset(&zero, 0, sizeof(T));
+  return lc_scan_dispatch(sum, zero, _lc_mfunc_priv(sum_scalar))(
+      _lc_mfunc(data)(self), self->size);
+}
+
+#ifdef lcore_persist
+static inline bool
+_lc_mfunc(save)(Self *self, const char *path) {
+  lc_persist_header hdr = {0};
+  hdr.kind = LC_PERSIST_VECTOR;
+  hdr.elem_size = sizeof(T);
+  hdr.size = hdr.capacity = self->size;
+  hdr.length[0] = self->size * sizeof(T);
+  const void *sections[LC_PERSIST_SECTIONS] = {_lc_mfunc(data)(self)};
+  return lc_persist_save(path, &hdr, sections);
+}
+
+// Initializes 'self' from an image written by save(), false if it can not
+// be read. Changes to the elements of a LC_PERSIST_PRIVATE vector stay in
+// memory, a LC_PERSIST_READONLY one must not be modified at all.
+static inline bool
+_lc_mfunc(open_mmap)(Self *self, const char *path, lc_persist_mode mode) {
+  lc_mapping map;
+  const lc_persist_header *hdr =
+      lc_persist_open(path, mode, LC_PERSIST_VECTOR, sizeof(T), 0, &map);
+  if (!hdr)
+    return false;
+  if (hdr->length[0] != hdr->size * sizeof(T) ||
+      hdr->size > SIZE_MAX / sizeof(T)) {
+    lc_persist_unmap(&map);
+    return false;
+  }
+  size_t size = (size_t)hdr->size;
+  T *elements = (T *)lc_persist_section(&map, 0);
+  memset(self, 0, sizeof(*self));
+#ifdef lcore_inline_cap
+  if (size <= lcore_inline_cap) {
+    memcpy(self->inline_elements, elements, size * sizeof(T));
+    self->size = size;
+    self->capacity = lcore_inline_cap;
+    lc_persist_unmap(&map);
+    return true;
+  }
+#endif // lcore_inline_cap
+  if (size == 0) {
+    lc_persist_unmap(&map);
+    return true;
+  }
+  self->elements = elements;
+  self->size = self->capacity = size;
+  self->map = map;
+  return true;
+}
+#endif // lcore_persist
+
 static inline void
 _lc_mfunc(destroy)(Self *self) {
-#ifdef lcore_dropfn
+#ifndef _lc_trivial_drop
   // this code is required for heap allocated types.
   // How to use this feature:
   // Right before includind the header file, the user can
-  // define a 'lcore_dropfn' macro that wraps a function that deallocates
+  // define a 'lcore_drop_fn' macro that wraps a function that deallocates
   // the type T used in the vector
   //
-  // #define lcore_dropfn(x) free(x)
+  // #define lcore_drop_fn(x) free(x)
   // #include "libcore/templates/vector.h"
+  T *elements = _lc_mfunc(data)(self);
   for (size_t i = 0; i < self->size; i++) {
-    lcore_dropfn(self->elements[i]);
+    lcore_drop_fn(elements[i]);
   }
-#endif // lcore_dropfn
-  free(self->elements);
+#endif // _lc_trivial_drop
+#ifdef lcore_persist
+  if (self->map.addr) {
+    lc_persist_unmap(&self->map);
+    memset(self, 0, sizeof(*self));
+    return;
+  }
+#endif // lcore_persist
+  if (!_lc_mfunc_priv(is_inline)(self))
+    _lc_mfunc_priv(free_buffer)(self->elements, self->capacity);
   memset(self, 0, sizeof(*self));
 }
 
 static inline T
 _lc_mfunc(at)(Self *self, size_t index) {
   assert(index < self->size);
-  return self->elements[index];
+  return _lc_mfunc(data)(self)[index];
+}
+
+// Pointer to the first element, valid until the next call that changes the
+// capacity (or, with lcore_inline_cap, until the struct is moved).
+static inline T *
+_lc_mfunc(data)(Self *self) {
+#ifdef lcore_inline_cap
+  if (_lc_mfunc_priv(is_inline)(self))
+    return self->inline_elements;
+#endif // lcore_inline_cap
+  return self->elements;
 }
 
 static inline T
 _lc_mfunc(pop_back)(Self *self) {
   assert(self->size > 0);
-  return self->elements[--self->size];
+  return _lc_mfunc(data)(self)[--self->size];
 }
 
 static inline bool
 _lc_mfunc(check_health)(Self *self) {
-  return (self->size <= self->capacity && self->elements != NULL);
+  return (self->size <= self->capacity &&
+          (_lc_mfunc_priv(is_inline)(self) || self->capacity == 0 ||
+           self->elements != NULL));
+}
+
+static inline bool
+_lc_mfunc_priv(is_inline)(Self *self) {
+#ifdef lcore_inline_cap
+  return self->capacity <= lcore_inline_cap;
+#else
+  (void)self;
+  return false;
+#endif // lcore_inline_cap
 }
 
+// Grows the capacity by lcore_growth_factor, or to 'min_capacity' when that
+// is not enough.
+static inline void
+_lc_mfunc_priv(grow)(Self *self, size_t min_capacity) {
+#ifdef lcore_inline_cap
+  if (min_capacity <= lcore_inline_cap) {
+    self->capacity = lcore_inline_cap;
+    return;
+  }
+#endif // lcore_inline_cap
+  size_t capacity = (size_t)((double)self->capacity * lcore_growth_factor);
+  if (self->capacity == 0)
+    capacity = 16;
+  if (capacity <= self->capacity)
+    capacity = self->capacity + 1;
+  if (capacity < min_capacity)
+    capacity = min_capacity;
+  _lc_mfunc_priv(set_capacity)(self, capacity);
+}
+
+// Moves the elements to a buffer of exactly 'capacity' elements, switching
+// between the inline, heap and mapped storage as needed.
+static inline void
+_lc_mfunc_priv(set_capacity)(Self *self, size_t capacity) {
+  assert(capacity >= self->size);
+#ifdef lcore_persist
+  if (self->map.addr) {
+    // The image can not be resized, copy the elements out of it.
+    lc_mapping map = self->map;
+    T *mapped = self->elements;
+    memset(&self->map, 0, sizeof(self->map));
+#ifdef lcore_inline_cap
+    if (capacity <= lcore_inline_cap) {
+      memcpy(self->inline_elements, mapped, self->size * sizeof(T));
+      self->capacity = lcore_inline_cap;
+      lc_persist_unmap(&map);
+      return;
+    }
+#endif // lcore_inline_cap
+    self->elements = _lc_mfunc_priv(alloc_buffer)(capacity);
+    if (self->size)
+      memcpy(self->elements, mapped, self->size * sizeof(T));
+    self->capacity = capacity;
+    lc_persist_unmap(&map);
+    return;
+  }
+#endif // lcore_persist
+#ifdef lcore_inline_cap
+  if (capacity <= lcore_inline_cap) {
+    if (!_lc_mfunc_priv(is_inline)(self)) {
+      T *heap = self->elements;
+      memcpy(self->inline_elements, heap, self->size * sizeof(T));
+      _lc_mfunc_priv(free_buffer)(heap, self->capacity);
+    }
+    self->capacity = lcore_inline_cap;
+    return;
+  }
+  if (_lc_mfunc_priv(is_inline)(self)) {
+    T *heap = _lc_mfunc_priv(alloc_buffer)(capacity);
+    memcpy(heap, self->inline_elements, self->size * sizeof(T));
+    self->elements = heap;
+    self->capacity = capacity;
+    return;
+  }
+#endif // lcore_inline_cap
+  self->elements = _lc_mfunc_priv(realloc_buffer)(
+      self->elements, self->capacity, capacity, self->size);
+  self->capacity = capacity;
+}
+
+// Whether a buffer of 'capacity' elements is an anonymous mapping is a
+// function of its size only, so the capacity alone tells how to free it.
+static inline T *
+_lc_mfunc_priv(alloc_buffer)(size_t capacity) {
+#ifdef lcore_mmap_threshold
+  if (capacity * sizeof(T) >= lcore_mmap_threshold) {
+    void *map = mmap(NULL, capacity * sizeof(T), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return map == MAP_FAILED ? NULL : (T *)map;
+  }
+#endif // lcore_mmap_threshold
+  return capacity == 0 ? NULL : lc_malloc(T, capacity * sizeof(T));
+}
+
+static inline void
+_lc_mfunc_priv(free_buffer)(T *buffer, size_t capacity) {
+#ifdef lcore_mmap_threshold
+  if (capacity * sizeof(T) >= lcore_mmap_threshold) {
+    if (buffer)
+      munmap(buffer, capacity * sizeof(T));
+    return;
+  }
+#else
+  (void)capacity;
+#endif // lcore_mmap_threshold
+  free(buffer);
+}
+
+static inline T *
+_lc_mfunc_priv(realloc_buffer)(T *buffer, size_t capacity, size_t new_capacity,
+                               size_t size) {
+#ifdef lcore_mmap_threshold
+  bool mapped = capacity * sizeof(T) >= lcore_mmap_threshold;
+  bool new_mapped = new_capacity * sizeof(T) >= lcore_mmap_threshold;
+#ifdef MREMAP_MAYMOVE
+  if (mapped && new_mapped && buffer) {
+    void *map = mremap(buffer, capacity * sizeof(T), new_capacity * sizeof(T),
+                       MREMAP_MAYMOVE);
+    return map == MAP_FAILED ? NULL : (T *)map;
+  }
+#endif // MREMAP_MAYMOVE
+  if (mapped || new_mapped) {
+    T *copy = _lc_mfunc_priv(alloc_buffer)(new_capacity);
+    if (copy && size)
+      memcpy(copy, buffer, size * sizeof(T));
+    _lc_mfunc_priv(free_buffer)(buffer, capacity);
+    return copy;
+  }
+#else
+  (void)capacity;
+  (void)size;
+#endif // lcore_mmap_threshold
+  if (new_capacity == 0) {
+    free(buffer);
+    return NULL;
+  }
+  return (T *)realloc(buffer, new_capacity * sizeof(T));
+}
+
+#ifdef lcore_sort_threads
+// Range of the elements handled by task 'id' before any merge.
+static inline void
+_lc_mfunc_priv(chunk)(_SortJob *job, unsigned id, size_t *lo, size_t *hi) {
+  *lo = id * job->run < job->n ? id * job->run : job->n;
+  *hi = job->n - *lo < job->run ? job->n : *lo + job->run;
+}
+#endif // lcore_sort_threads
+
+#ifdef lcore_less_fn
+// The sort is a port of Orson Peters' pattern-defeating quicksort: median of
+// 3 (or pseudo median of 9) pivots, a branchless block partition, insertion
+// sort for small ranges, pattern breaking swaps and a heapsort fallback after
+// too many unbalanced partitions.
+
+#define _SortInsertion 24
+#define _SortNinther 128
+#define _SortBlock 64
+
+static inline void
+_lc_mfunc_priv(swap)(T *a, T *b) {
+  T tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static inline void
+_lc_mfunc_priv(sort3)(T *a, T *b, T *c) {
+  if (lcore_less_fn(*b, *a))
+    _lc_mfunc_priv(swap)(a, b);
+  if (lcore_less_fn(*c, *b))
+    _lc_mfunc_priv(swap)(b, c);
+  if (lcore_less_fn(*b, *a))
+    _lc_mfunc_priv(swap)(a, b);
+}
+
+// Without 'leftmost', the element right before 'begin' must not be greater
+// than any element of the range, which saves the bounds check.
+static inline void
+_lc_mfunc_priv(insertion_sort)(T *begin, T *end, bool leftmost) {
+  if (begin == end)
+    return;
+  for (T *cur = begin + 1; cur != end; cur++) {
+    T *sift = cur;
+    if (!lcore_less_fn(*sift, *(sift - 1)))
+      continue;
+    T tmp = *sift;
+    if (leftmost) {
+      do {
+        *sift = *(sift - 1);
+        sift--;
+      } while (sift != begin && lcore_less_fn(tmp, *(sift - 1)));
+    } else {
+      do {
+        *sift = *(sift - 1);
+        sift--;
+      } while (lcore_less_fn(tmp, *(sift - 1)));
+    }
+    *sift = tmp;
+  }
+}
+
+// Insertion sort that gives up after moving 8 elements, returns whether the
+// range got sorted.
+static inline bool
+_lc_mfunc_priv(partial_insertion_sort)(T *begin, T *end) {
+  if (begin == end)
+    return true;
+  size_t moved = 0;
+  for (T *cur = begin + 1; cur != end; cur++) {
+    T *sift = cur;
+    if (lcore_less_fn(*sift, *(sift - 1))) {
+      T tmp = *sift;
+      do {
+        *sift = *(sift - 1);
+        sift--;
+      } while (sift != begin && lcore_less_fn(tmp, *(sift - 1)));
+      *sift = tmp;
+      moved += (size_t)(cur - sift);
+    }
+    if (moved > 8)
+      return false;
+  }
+  return true;
+}
+
+static inline void
+_lc_mfunc_priv(sift_down)(T *heap, size_t n, size_t i) {
+  T x = heap[i];
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= n)
+      break;
+    if (child + 1 < n && lcore_less_fn(heap[child], heap[child + 1]))
+      child++;
+    if (!lcore_less_fn(x, heap[child]))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = x;
+}
+
+static inline void
+_lc_mfunc_priv(heapsort)(T *begin, T *end) {
+  size_t n = (size_t)(end - begin);
+  for (size_t i = n / 2; i-- > 0;)
+    _lc_mfunc_priv(sift_down)(begin, n, i);
+  for (size_t i = n; i-- > 1;) {
+    _lc_mfunc_priv(swap)(begin, begin + i);
+    _lc_mfunc_priv(sift_down)(begin, i, 0);
+  }
+}
+
+// Puts the elements equal to the pivot *begin to its left, used when the
+// pivot equals the element before the range: nothing left of it needs to be
+// sorted again.
+static inline T *
+_lc_mfunc_priv(partition_left)(T *begin, T *end) {
+  T pivot = *begin;
+  T *first = begin;
+  T *last = end;
+  do {
+    last--;
+  } while (lcore_less_fn(pivot, *last));
+  if (last + 1 == end) {
+    while (first < last) {
+      first++;
+      if (lcore_less_fn(pivot, *first))
+        break;
+    }
+  } else {
+    do {
+      first++;
+    } while (!lcore_less_fn(pivot, *first));
+  }
+  while (first < last) {
+    _lc_mfunc_priv(swap)(first, last);
+    do {
+      last--;
+    } while (lcore_less_fn(pivot, *last));
+    do {
+      first++;
+    } while (!lcore_less_fn(pivot, *first));
+  }
+  *begin = *last;
+  *last = pivot;
+  return last;
+}
+
+// Partitions around the pivot *begin, elements equal to it go to the right.
+// Misplaced elements are found a block at a time with comparisons stored as
+// offsets instead of branches, then swapped in bulk. Sets 'partitioned' when
+// no element had to move.
+static inline T *
+_lc_mfunc_priv(partition_right)(T *begin, T *end, bool *partitioned) {
+  T pivot = *begin;
+  T *first = begin;
+  T *last = end;
+  do {
+    first++;
+  } while (lcore_less_fn(*first, pivot));
+  if (first - 1 == begin) {
+    while (first < last) {
+      last--;
+      if (lcore_less_fn(*last, pivot))
+        break;
+    }
+  } else {
+    do {
+      last--;
+    } while (!lcore_less_fn(*last, pivot));
+  }
+  *partitioned = first >= last;
+  if (!*partitioned) {
+    _lc_mfunc_priv(swap)(first, last);
+    first++;
+  }
+
+  // Each round scans up to a block on both sides and records the offsets
+  // of the elements on the wrong side, then swaps them pairwise. Leftover
+  // offsets of one side carry over to the next round.
+  unsigned char offsets_l[_SortBlock], offsets_r[_SortBlock];
+  T *base_l = first;
+  T *base_r = last;
+  size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+  while (first < last) {
+    size_t unknown = (size_t)(last - first);
+    size_t split_l = num_l ? 0 : num_r ? unknown : unknown / 2;
+    size_t split_r = num_r ? 0 : unknown - split_l;
+    if (split_l > _SortBlock)
+      split_l = _SortBlock;
+    if (split_r > _SortBlock)
+      split_r = _SortBlock;
+    for (size_t i = 0; i < split_l; i++) {
+      offsets_l[num_l] = (unsigned char)i;
+      num_l += !lcore_less_fn(*first, pivot);
+      first++;
+    }
+    for (size_t i = 0; i < split_r; i++) {
+      last--;
+      offsets_r[num_r] = (unsigned char)(i + 1);
+      num_r += lcore_less_fn(*last, pivot);
+    }
+    size_t num = num_l < num_r ? num_l : num_r;
+    for (size_t i = 0; i < num; i++)
+      _lc_mfunc_priv(swap)(base_l + offsets_l[start_l + i],
+                           base_r - offsets_r[start_r + i]);
+    num_l -= num;
+    num_r -= num;
+    start_l += num;
+    start_r += num;
+    if (num_l == 0) {
+      start_l = 0;
+      base_l = first;
+    }
+    if (num_r == 0) {
+      start_r = 0;
+      base_r = last;
+    }
+  }
+
+  // One side may still have misplaced elements, move them next to the
+  // pivot position.
+  if (num_l) {
+    while (num_l--)
+      _lc_mfunc_priv(swap)(base_l + offsets_l[start_l + num_l], --last);
+    first = last;
+  }
+  if (num_r) {
+    while (num_r--) {
+      _lc_mfunc_priv(swap)(base_r - offsets_r[start_r + num_r], first);
+      first++;
+    }
+    last = first;
+  }
+
+  T *pivot_pos = first - 1;
+  *begin = *pivot_pos;
+  *pivot_pos = pivot;
+  return pivot_pos;
+}
+
+static inline void
+_lc_mfunc_priv(pdqsort)(T *begin, T *end, int bad_allowed, bool leftmost) {
+  for (;;) {
+    size_t size = (size_t)(end - begin);
+    if (size < _SortInsertion) {
+      _lc_mfunc_priv(insertion_sort)(begin, end, leftmost);
+      return;
+    }
+
+    size_t s2 = size / 2;
+    if (size > _SortNinther) {
+      _lc_mfunc_priv(sort3)(begin, begin + s2, end - 1);
+      _lc_mfunc_priv(sort3)(begin + 1, begin + (s2 - 1), end - 2);
+      _lc_mfunc_priv(sort3)(begin + 2, begin + (s2 + 1), end - 3);
+      _lc_mfunc_priv(sort3)(begin + (s2 - 1), begin + s2, begin + (s2 + 1));
+      _lc_mfunc_priv(swap)(begin, begin + s2);
+    } else {
+      _lc_mfunc_priv(sort3)(begin + s2, begin, end - 1);
+    }
+
+    // A pivot equal to the element before the range (the pivot of a parent
+    // partition) means the range has many duplicates: put them all on the
+    // left, they are in their final place.
+    if (!leftmost && !lcore_less_fn(*(begin - 1), *begin)) {
+      begin = _lc_mfunc_priv(partition_left)(begin, end) + 1;
+      continue;
+    }
+
+    bool partitioned;
+    T *pivot_pos = _lc_mfunc_priv(partition_right)(begin, end, &partitioned);
+    size_t l_size = (size_t)(pivot_pos - begin);
+    size_t r_size = (size_t)(end - (pivot_pos + 1));
+    if (l_size < size / 8 || r_size < size / 8) {
+      if (--bad_allowed == 0) {
+        _lc_mfunc_priv(heapsort)(begin, end);
+        return;
+      }
+      // Break patterns that fool the pivot selection.
+      if (l_size >= _SortInsertion) {
+        _lc_mfunc_priv(swap)(begin, begin + l_size / 4);
+        _lc_mfunc_priv(swap)(pivot_pos - 1, pivot_pos - l_size / 4);
+        if (l_size > _SortNinther) {
+          _lc_mfunc_priv(swap)(begin + 1, begin + (l_size / 4 + 1));
+          _lc_mfunc_priv(swap)(begin + 2, begin + (l_size / 4 + 2));
+          _lc_mfunc_priv(swap)(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+          _lc_mfunc_priv(swap)(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+        }
+      }
+      if (r_size >= _SortInsertion) {
+        _lc_mfunc_priv(swap)(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+        _lc_mfunc_priv(swap)(end - 1, end - r_size / 4);
+        if (r_size > _SortNinther) {
+          _lc_mfunc_priv(swap)(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+          _lc_mfunc_priv(swap)(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+          _lc_mfunc_priv(swap)(end - 2, end - (1 + r_size / 4));
+          _lc_mfunc_priv(swap)(end - 3, end - (2 + r_size / 4));
+        }
+      }
+    } else if (partitioned &&
+               _lc_mfunc_priv(partial_insertion_sort)(begin, pivot_pos) &&
+               _lc_mfunc_priv(partial_insertion_sort)(pivot_pos + 1, end)) {
+      // The input was (almost) sorted already.
+      return;
+    }
+
+    _lc_mfunc_priv(pdqsort)(begin, pivot_pos, bad_allowed, leftmost);
+    begin = pivot_pos + 1;
+    leftmost = false;
+  }
+}
+
+static inline void
+_lc_mfunc_priv(sort_range)(T *begin, T *end) {
+  int bad_allowed = 0;
+  for (size_t n = (size_t)(end - begin); n > 1; n >>= 1)
+    bad_allowed++;
+  _lc_mfunc_priv(pdqsort)(begin, end, bad_allowed, true);
+}
+
+#ifdef lcore_sort_threads
+static inline void
+_lc_mfunc_priv(sort_task)(void *ctx, unsigned id) {
+  _SortJob *job = (_SortJob *)ctx;
+  size_t lo, hi;
+  _lc_mfunc_priv(chunk)(job, id, &lo, &hi);
+  _lc_mfunc_priv(sort_range)(job->src + lo, job->src + hi);
+}
+
+// Number of elements of 'a' among the first 'k' of the stable merge of 'a'
+// and 'b'.
+static inline size_t
+_lc_mfunc_priv(corank)(T const *a, size_t na, T const *b, size_t nb,
+                       size_t k) {
+  size_t lo = k > nb ? k - nb : 0, hi = k < na ? k : na;
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;
+    if (!lcore_less_fn(b[k - i - 1], a[i]))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+// Every task writes the same share of the output: it locates its slice of
+// each pair of runs with corank() and merges just that part.
+static inline void
+_lc_mfunc_priv(merge_task)(void *ctx, unsigned id) {
+  _SortJob *job = (_SortJob *)ctx;
+  size_t n = job->n, run = job->run;
+  size_t out_lo = n / job->parts * id + (id ? n % job->parts : 0);
+  size_t out_hi = n / job->parts * (id + 1) + n % job->parts;
+  for (size_t base = out_lo / (2 * run) * (2 * run); base < out_hi;
+       base += 2 * run) {
+    T const *a = job->src + base;
+    size_t na = n - base < run ? n - base : run;
+    T const *b = a + na;
+    size_t nb = n - base - na < run ? n - base - na : run;
+    size_t lo = (out_lo > base ? out_lo : base) - base;
+    size_t hi = (out_hi < base + na + nb ? out_hi : base + na + nb) - base;
+    size_t i = _lc_mfunc_priv(corank)(a, na, b, nb, lo), j = lo - i;
+    size_t i_end = _lc_mfunc_priv(corank)(a, na, b, nb, hi), j_end = hi - i_end;
+    T *out = job->dst + base + lo;
+    while (i < i_end && j < j_end)
+      *out++ = lcore_less_fn(b[j], a[i]) ? b[j++] : a[i++];
+    memcpy(out, a + i, (i_end - i) * sizeof(T));
+    out += i_end - i;
+    memcpy(out, b + j, (j_end - j) * sizeof(T));
+  }
+}
+
+// Sorts one chunk per thread, then merges pairs of runs with every thread
+// working on each round. Returns false when the scratch buffer can not be
+// allocated.
+static inline bool
+_lc_mfunc_priv(parallel_sort)(T *elements, size_t n) {
+  T *tmp = lc_malloc(T, n * sizeof(T));
+  if (!tmp)
+    return false;
+  unsigned parts = _SortParts;
+  _SortJob job = {elements, tmp, n, (n + parts - 1) / parts, parts, 0, NULL};
+  lc_sort_parallel(parts, _lc_mfunc_priv(sort_task), &job);
+  for (; job.run < n; job.run *= 2) {
+    lc_sort_parallel(parts, _lc_mfunc_priv(merge_task), &job);
+    T *swap = job.src;
+    job.src = job.dst;
+    job.dst = swap;
+  }
+  if (job.src != elements)
+    memcpy(elements, job.src, n * sizeof(T));
+  free(tmp);
+  return true;
+}
+#endif // lcore_sort_threads
+#endif // lcore_less_fn
+
+#if defined(lcore_radix_sort) && defined(lcore_sort_threads)
+static inline void
+_lc_mfunc_priv(radix_count_task)(void *ctx, unsigned id) {
+  _SortJob *job = (_SortJob *)ctx;
+  size_t *counts = job->counts[id];
+  memset(counts, 0, sizeof(job->counts[id]));
+  size_t lo, hi;
+  _lc_mfunc_priv(chunk)(job, id, &lo, &hi);
+  for (size_t i = lo; i < hi; i++)
+    counts[_Digit(job->src[i], job->shift)]++;
+}
+
+static inline void
+_lc_mfunc_priv(radix_scatter_task)(void *ctx, unsigned id) {
+  _SortJob *job = (_SortJob *)ctx;
+  size_t *offsets = job->counts[id];
+  size_t lo, hi;
+  _lc_mfunc_priv(chunk)(job, id, &lo, &hi);
+  for (size_t i = lo; i < hi; i++)
+    job->dst[offsets[_Digit(job->src[i], job->shift)]++] = job->src[i];
+}
+
+// Each pass counts the digits of every chunk in parallel, turns the counts
+// into per-chunk offsets (chunk order within a digit keeps the sort stable)
+// and scatters the chunks in parallel.
+static inline bool
+_lc_mfunc_priv(parallel_radix_sort)(T *elements, T *tmp, size_t n) {
+  unsigned parts = _SortParts;
+  size_t(*counts)[256] = (size_t(*)[256])malloc(sizeof(*counts) * parts);
+  if (!counts)
+    return false;
+  _SortJob job = {elements, tmp, n, (n + parts - 1) / parts, parts, 0, counts};
+  for (unsigned b = 0; b < sizeof(T); b++) {
+    job.shift = 8 * b;
+    lc_sort_parallel(parts, _lc_mfunc_priv(radix_count_task), &job);
+    size_t first = _Digit(job.src[0], job.shift), same = 0;
+    for (unsigned t = 0; t < parts; t++)
+      same += counts[t][first];
+    if (same == n)
+      continue;
+    size_t sum = 0;
+    for (size_t d = 0; d < 256; d++) {
+      for (unsigned t = 0; t < parts; t++) {
+        size_t count = counts[t][d];
+        counts[t][d] = sum;
+        sum += count;
+      }
+    }
+    lc_sort_parallel(parts, _lc_mfunc_priv(radix_scatter_task), &job);
+    T *swap = job.src;
+    job.src = job.dst;
+    job.dst = swap;
+  }
+  if (job.src != elements)
+    memcpy(elements, job.src, n * sizeof(T));
+  free(counts);
+  return true;
+}
+#endif // lcore_radix_sort && lcore_sort_threads
+
+// ============ SCALAR SCANS ==================== //
+// Taken for the types _lc_scan.h has no kernels for.
+
+#ifdef lcore_eq_fn
+#define _ScanEq(a, b) lcore_eq_fn(a, b)
+#else
+#define _ScanEq(a, b) (memcmp(&(a), &(b), sizeof(T)) == 0)
+#endif // lcore_eq_fn
+
+static inline size_t
+_lc_mfunc_priv(find_scalar)(T const *elements, size_t n, T value) {
+  for (size_t i = 0; i < n; i++)
+    if (_ScanEq(elements[i], value))
+      return i;
+  return n;
+}
+
+static inline size_t
+_lc_mfunc_priv(count_scalar)(T const *elements, size_t n, T value) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++)
+    count += _ScanEq(elements[i], value);
+  return count;
+}
+
+#ifdef lcore_less_fn
+static inline T
+_lc_mfunc_priv(min_scalar)(T const *elements, size_t n) {
+  T best = elements[0];
+  for (size_t i = 1; i < n; i++)
+    if (lcore_less_fn(elements[i], best))
+      best = elements[i];
+  return best;
+}
+
+static inline T
+_lc_mfunc_priv(max_scalar)(T const *elements, size_t n) {
+  T best = elements[0];
+  for (size_t i = 1; i < n; i++)
+    if (lcore_less_fn(best, elements[i]))
+      best = elements[i];
+  return best;
+}
+#else
+// Never defined: calling min() or max() on a T that is neither arithmetic nor
+// ordered by 'lcore_less_fn' fails to build instead of returning a value.
+_LC_SCAN_MISUSE("min() and max() need lcore_less_fn for this T")
+T _lc_mfunc_priv(min_scalar)(T const *elements, size_t n);
+_LC_SCAN_MISUSE("min() and max() need lcore_less_fn for this T")
+T _lc_mfunc_priv(max_scalar)(T const *elements, size_t n);
+#endif // lcore_less_fn
+
+_LC_SCAN_MISUSE("sum() needs an arithmetic T")
+T _lc_mfunc_priv(sum_scalar)(T const *elements, size_t n);
+
 #undef T
 #undef Self
-#undef lcore_dropfn
+#undef lcore_drop_fn
+#undef lcore_inline_cap
+#undef lcore_growth_factor
+#undef lcore_mmap_threshold
+#undef _lc_trivial_drop
 #undef lcore_pfx
+#undef lcore_persist
+#undef lcore_eq_fn
+#undef lcore_less_fn
+#undef lcore_cmp_fn
+#undef lcore_radix_sort
+#undef lcore_sort_threads
+#undef lcore_sort_parallel_min
+#undef _SortJob
+#undef _SortParts
+#undef _SortInsertion
+#undef _SortNinther
+#undef _SortBlock
+#undef _Digit
+#undef _ScanEq